@@ -5,6 +5,12 @@
 #include "makeimage.h"
 #include "tag_db.h"
 
+// what drawTextBox does with text that doesn't fit the box
+#define TEXTBOX_CLIP 0
+#define TEXTBOX_ELLIPSIS 1
+// truetype fonts get smaller until the text fits, vlw fonts get an ellipsis
+#define TEXTBOX_SHRINK 2
+
 struct contentTypes {
     uint16_t id;
     String name;
@@ -19,7 +25,7 @@ void checkVars();
 void drawNew(const uint8_t mac[8], tagRecord *&taginfo);
 bool updateTagImage(String &filename, const uint8_t *dst, uint16_t nextCheckin, tagRecord *&taginfo, imgParam &imageParams);
 void drawString(TFT_eSprite &spr, String content, int16_t posx, int16_t posy, String font, byte align = 0, uint16_t color = TFT_BLACK, uint16_t size = 30, uint16_t bgcolor = TFT_WHITE);
-void drawTextBox(TFT_eSprite &spr, String &content, int16_t &posx, int16_t &posy, int16_t boxwidth, int16_t boxheight, String font, uint16_t color = TFT_BLACK, uint16_t bgcolor = TFT_WHITE, float lineheight = 1, byte align = TL_DATUM);
+void drawTextBox(TFT_eSprite &spr, String &content, int16_t &posx, int16_t &posy, int16_t boxwidth, int16_t boxheight, String font, uint16_t color = TFT_BLACK, uint16_t bgcolor = TFT_WHITE, float lineheight = 1, byte align = TL_DATUM, uint16_t size = 30, uint8_t fit = TEXTBOX_CLIP);
 void initSprite(TFT_eSprite &spr, int w, int h, imgParam &imageParams);
 void drawDate(String &filename, tagRecord *&taginfo, imgParam &imageParams);
 void drawNumber(String &filename, int32_t count, int32_t thresholdred, tagRecord *&taginfo, imgParam &imageParams);
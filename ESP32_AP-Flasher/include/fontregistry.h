@@ -0,0 +1,61 @@
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#pragma once
+
+#include <memory>
+
+// font files kept in memory, a font becomes resident when it fits next to the others
+#ifndef FONT_REGISTRY_BYTES
+#ifdef BOARD_HAS_PSRAM
+#define FONT_REGISTRY_BYTES 1048576
+#else
+#define FONT_REGISTRY_BYTES 0
+#endif
+#endif
+// fonts the registry keeps open, resident or not
+#define FONT_REGISTRY_FONTS 12
+// parsed ttf fonts that keep their file open because they aren't resident
+#define FONT_REGISTRY_OPEN_FILES 2
+// free psram a font has to leave before it is made resident
+#define FONT_REGISTRY_PSRAM_RESERVE 262144
+// a font is compared with its file at most this often
+#define FONT_REGISTRY_RECHECK_MS 10000
+
+class truetypeClass;
+struct fontEntry;
+
+/// @brief A font in use, the registry keeps the font open until its last lease is gone
+class fontLease {
+   public:
+    fontLease() {}
+    fontLease(fontLease &&other);
+    fontLease(const fontLease &) = delete;
+    fontLease &operator=(const fontLease &) = delete;
+    ~fontLease();
+
+    explicit operator bool() const { return entry != nullptr; }
+
+    /// @brief Parsed truetype font, set up for this lease only
+    /// @return nullptr if the font isn't a .ttf or doesn't parse
+    truetypeClass *ttf();
+
+    /// @brief Whole font file
+    /// @return nullptr if the font isn't resident
+    const uint8_t *data() const;
+
+   private:
+    friend fontLease fontOpen(const String &path);
+    std::shared_ptr<fontEntry> entry;
+    truetypeClass *parsed = nullptr;
+};
+
+/// @brief Open a font of contentFS through the registry
+///
+/// The font stays open after the lease is gone, until it is the least recently used one and room is needed
+/// @param path Full path of the font file, including .ttf or .vlw
+/// @return an empty lease if the file doesn't exist
+fontLease fontOpen(const String &path);
+
+/// @brief Add the font registry counters to a json object
+void fontRegistryStatsToJson(JsonObject &obj);
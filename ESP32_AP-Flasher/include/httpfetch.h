@@ -0,0 +1,63 @@
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <HTTPClient.h>
+
+#pragma once
+
+#include <functional>
+
+#ifdef BOARD_HAS_PSRAM
+#define FETCH_CACHE_BYTES 262144
+#define FETCH_MAX_HOSTS 4
+#else
+#define FETCH_CACHE_BYTES 16384
+#define FETCH_MAX_HOSTS 1
+#endif
+
+// minimum time between two requests to the same host, in ms
+#define FETCH_HOST_INTERVAL 250
+// freshness of a response without Cache-Control, in seconds. Covers a batch of tags with the same content
+#define FETCH_DEFAULT_MAX_AGE 60
+
+/// @brief Options of an outgoing request
+struct fetchOptions {
+    // sent as X-ESL-MAC, makes the request per tag: no coalescing and no caching
+    String mac;
+    // sent as If-Modified-Since when not 0
+    time_t ifModifiedSince = 0;
+    uint16_t timeout = 5000;
+    bool http10 = false;
+};
+
+/// @brief Counters of the fetch layer
+struct fetchStats {
+    uint32_t requests;
+    uint32_t cacheHits;
+    uint32_t coalesced;
+    uint32_t notModified;
+    uint32_t network;
+    uint32_t errors;
+};
+
+/// @brief GET a url into a string, through the response cache
+///
+/// Concurrent requests for the same url share one network request, fresh responses come from the cache
+/// and stale ones are revalidated with ETag / Last-Modified
+/// @param url Url
+/// @param body Response body
+/// @param timeout Request timeout in ms
+/// @return http status code, 200 when the body is valid
+int httpFetch(const String &url, String &body, const uint16_t timeout);
+
+/// @brief GET a url and hand the response to a callback, without caching
+///
+/// Uses the keep-alive connection and rate limit of the host
+/// @param url Url
+/// @param options Request options
+/// @param onSuccess Called with the client on status 200, to read the body. Other requests to the host wait for it,
+/// so it should only store the body and leave the drawing until httpFetchStream returns
+/// @return http status code
+int httpFetchStream(const String &url, const fetchOptions &options, std::function<void(HTTPClient &)> onSuccess);
+
+/// @brief Add the fetch counters to a json object
+void fetchStatsToJson(JsonObject &obj);
@@ -11,6 +11,49 @@ extern TFT_eSPI tft;
 #define SHORTLUT_ONLY_BLACK 1
 #define SHORTLUT_ALLOWED 2
 
+// imgParam.dither
+#define DITHER_NONE 0
+#define DITHER_BURKES 1
+#define DITHER_ORDERED 2
+#define DITHER_FLOYD_STEINBERG 3
+#define DITHER_ATKINSON 4
+#define DITHER_SIERRA_LITE 5
+
+// codecs an image can be sent with, the one with the fewest blocks is picked per image
+#define CODEC_RAW 0
+#define CODEC_ZLIB 1
+#define CODEC_G5 2
+#define CODEC_DELTA 3
+#define CODEC_COUNT 4
+// after this many wins in a row for a content mode, only the winning codec is used
+#define CODEC_TRUSTED 8
+// a trusted codec is checked against the others again after this many images
+#define CODEC_RECHECK 16
+
+/// @brief Counters of the codec selection
+struct codecStats {
+    uint32_t trials;
+    uint32_t skipped;
+    uint32_t bytesSaved;
+    uint32_t wins[CODEC_COUNT];
+};
+
+// flag in the colour byte of the image header: the rows of each plane are xored with the row above
+#define ZLIB_ROW_XOR 0x10
+// flag in the colour byte of the image header: a DATATYPE_IMG_DELTA image
+#define ZLIB_DELTA 0x20
+
+// planes of images delta-capable tags got, the bases for their next DATATYPE_IMG_DELTA
+#ifndef DELTA_BASE_BYTES
+#ifdef BOARD_HAS_PSRAM
+#define DELTA_BASE_BYTES 1048576
+#else
+#define DELTA_BASE_BYTES 0
+#endif
+#endif
+// unchanged rows a changed region of a delta bridges before it ends
+#define DELTA_ROW_GAP 8
+
 struct imgParam {
     HwType hwdata;
 
@@ -38,8 +81,37 @@ struct imgParam {
     uint8_t preloadlut;
 
     uint8_t zlib;
+    uint8_t zlibXor;
     uint8_t g5;
+    // the tag takes DATATYPE_IMG_DELTA against the image it has confirmed, baseVer
+    uint8_t delta = 0;
+    uint64_t baseVer = 0;
+    // set when the planes are those of baseVer, nothing was written and the tag needs no update
+    bool unchanged = false;
+
+    // render cache key, 0 if the image can't be shared with other tags
+    uint64_t renderKey = 0;
+    // content mode the image is drawn for, keeps the codec history apart per content type
+    uint8_t contentMode = 0;
 };
 
 void spr2buffer(TFT_eSprite &spr, String &fileout, imgParam &imageParams);
 void jpg2buffer(String filein, String fileout, imgParam &imageParams);
+void jpgSize(const String &filename, uint16_t &w, uint16_t &h);
+void drawJpg(TFT_eSprite &spr, const String &filename);
+
+/// @brief Add the codec selection counters to a json object
+void codecStatsToJson(JsonObject &obj);
+
+/// @brief Add the average quantize and encode time per frame to a json object, by resolution
+///
+/// Quantizing covers spr2color or the jpg decoder, encoding covers the codec trials and writing the file
+void frameStatsToJson(JsonObject &obj);
+
+/// @brief Write the planes of an image a delta-capable tag got to a file, as a raw image
+///
+/// Used for the preview, a DATATYPE_IMG_DELTA file can't be shown without its base
+/// @param dataVer Data version of the image
+/// @param path File to write
+/// @return false if the planes of this image are not kept
+bool deltaBaseToFile(uint64_t dataVer, const String &path);
@@ -1,15 +1,20 @@
 #include <Arduino.h>
 #include <FS.h>
 
+#include <memory>
+
 #include "commstructs.h"
 
 struct PendingItem {
     struct pendingData pendingdata;
     char filename[50];
-    uint8_t* data;
+    std::shared_ptr<uint8_t[]> data;
     uint32_t len;
 };
 
+/// @brief Handle to a queued item, stays valid after the item is dequeued
+typedef std::shared_ptr<PendingItem> PendingItemPtr;
+
 extern void addCRC(void* p, uint8_t len);
 extern bool checkCRC(void* p, uint8_t len);
 
@@ -40,8 +45,13 @@ void enqueueItem(const PendingItem& item);
 bool dequeueItem(const uint8_t* targetMac);
 bool dequeueItem(const uint8_t* targetMac, const uint64_t dataVer);
 uint16_t countQueueItem(const uint8_t* targetMac);
-extern PendingItem* getQueueItem(const uint8_t* targetMac);
-extern PendingItem* getQueueItem(const uint8_t* targetMac, const uint64_t dataVer);
+extern PendingItemPtr getQueueItem(const uint8_t* targetMac);
+extern PendingItemPtr getQueueItem(const uint8_t* targetMac, const uint64_t dataVer);
+/// @brief Payload of a queued item, read from its file if it isn't in memory yet
+///
+/// The queue can swap or drop the payload of an item at any time, use the returned handle instead of queueItem->data
+/// @return nullptr if the file can't be read
+std::shared_ptr<uint8_t[]> loadQueueItemData(const PendingItemPtr& queueItem);
 void checkQueue(const uint8_t* targetMac);
 bool queueDataAvail(struct pendingData* pending, bool local);
 uint8_t* getDataForFile(fs::File& file);
@@ -0,0 +1,59 @@
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#pragma once
+
+// plane size the arenas are sized for when tagDB has no tags yet, 400x300
+#define RENDER_ARENA_MIN_PLANE 15000
+// blocks an arena tracks per side, an allocation beyond that goes to the heap
+#define RENDER_ARENA_BLOCKS 16
+
+/// @brief Side of the arena an allocation comes from
+enum arenaKind {
+    ARENA_OUTPUT,  // planes and encoded images, they live until the image is written
+    ARENA_SCRATCH  // buffers of a single step, freed in reverse order
+};
+
+/// @brief Counters of the render arenas and the sprite fallbacks
+struct arenaStats {
+    uint32_t arenas;
+    uint32_t size;
+    uint32_t highWater;
+    uint32_t fallbacks;
+    uint32_t fallbackBytes;
+    uint32_t sprite8bpp;
+    uint32_t sprite1bpp;
+    uint32_t spriteFailed;
+};
+
+/// @brief Arena size for the largest tag type in tagDB: planes, two zlib streams, xored planes and a compressor
+size_t renderArenaBytes();
+
+/// @brief Give the calling task an arena of size bytes, it keeps it for good
+/// @return false if there is no memory for it, the task then allocates from the heap
+bool initRenderArena(size_t size);
+
+/// @brief Start a new render, everything allocated from the arena of the calling task is released
+void arenaReset();
+
+/// @brief Allocate from the arena of the calling task
+///
+/// Falls back to the heap when the task has no arena or it is full, a fallback of an arena task is counted
+/// @param size Bytes
+/// @param kind Side of the arena
+/// @return nullptr if neither the arena nor the heap has room
+void *arenaAlloc(size_t size, arenaKind kind);
+
+/// @brief Release an allocation of arenaAlloc(), the arena gets the space back once everything above it is released
+void arenaFree(void *ptr);
+
+/// @brief Resize an allocation of arenaAlloc(), in place when it is the last one of the output side
+/// @return the new pointer, nullptr on failure with ptr still valid
+void *arenaRealloc(void *ptr, size_t size);
+
+/// @brief Count a sprite that got less than 16 bits per pixel
+/// @param bpp Colour depth it fell back to, 0 when it couldn't be created at all
+void arenaSpriteFallback(uint8_t bpp);
+
+/// @brief Add the arena counters to a json object
+void arenaStatsToJson(JsonObject &obj);
@@ -0,0 +1,57 @@
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#pragma once
+
+#include "makeimage.h"
+#include "tag_db.h"
+
+#ifndef RENDER_CACHE_BYTES
+#ifdef BOARD_HAS_PSRAM
+#define RENDER_CACHE_BYTES 524288
+#else
+#define RENDER_CACHE_BYTES 32768
+#endif
+#endif
+
+/// @brief Render cache counters
+struct renderCacheStats {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t stores;
+    uint32_t evictions;
+    uint32_t bytes;
+};
+
+/// @brief Key of the image a tag would get, for the content modes that only depend on their config
+///
+/// Made of the content mode, the config without the per tag '#' entries, hwType, rotate, invert, lut and compression
+/// @return 0 if the content of this mode can't be shared between tags
+uint64_t renderCacheKey(const tagRecord *taginfo, const JsonObject &cfgobj, const imgParam &imageParams);
+
+/// @brief Give a tag the cached image for its key
+///
+/// Sets nextupdate to the expiry of the cached image and commits the image through commitDataAvail
+/// @param key Key from renderCacheKey()
+/// @param filename Temp file for the image of the tag
+/// @param taginfo Tag
+/// @return true if the tag got the cached image, false on a miss
+bool renderCacheApply(uint64_t key, String &filename, tagRecord *taginfo);
+
+/// @brief Keep a freshly encoded image, it can be used as soon as renderCacheSeal() sets its expiry
+///
+/// @param key Key from renderCacheKey()
+/// @param filename Encoded image file
+/// @param dataType Data type
+/// @param dataTypeArgument Data type argument
+/// @param nextCheckin Next checkin passed along with the image
+void renderCacheStore(uint64_t key, const String &filename, uint8_t dataType, uint8_t dataTypeArgument, uint16_t nextCheckin);
+
+/// @brief Make a stored image usable until the next update of the tag that drew it
+///
+/// @param key Key from renderCacheKey()
+/// @param expires nextupdate of the tag that drew it
+void renderCacheSeal(uint64_t key, uint32_t expires);
+
+/// @brief Add the cache counters to a json object
+void renderCacheStatsToJson(JsonObject &obj);
@@ -0,0 +1,69 @@
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#pragma once
+
+#include "tag_db.h"
+
+#ifndef RENDER_WORKERS
+#ifdef BOARD_HAS_PSRAM
+#define RENDER_WORKERS 2
+#else
+#define RENDER_WORKERS 1
+#endif
+#endif
+
+// psram needed per worker besides its render arena: a 16 bit sprite of the largest tag, plus room for a decoded jpg
+#define RENDER_WORKER_PSRAM 600000
+#define RENDER_QUEUE_DEPTH 64
+
+enum renderDispatch {
+    RENDER_INLINE,  // no worker for this tag, draw it on the calling task
+    RENDER_QUEUED,  // handed to a worker
+    RENDER_FULL     // queue is full, try again later
+};
+
+/// @brief Render time per content mode, in ms
+struct renderTiming {
+    uint32_t count;
+    uint32_t totalMs;
+    uint32_t maxMs;
+};
+
+/// @brief Start the render workers, their number is limited by the free psram
+void initRenderPool();
+
+/// @brief Hand a due tag to the render workers
+///
+/// The worker draws on a copy of the record, commitRenders() applies the result to the live one
+/// @param taginfo Tag to draw
+/// @return renderDispatch
+renderDispatch queueRender(tagRecord *taginfo);
+
+/// @brief Is the tag queued or being drawn by a worker
+bool renderPending(const uint8_t mac[8]);
+
+/// @brief Is the calling task a render worker
+///
+/// Workers draw on a copy of the tag record, they leave tagDB and the websocket to commitRenders()
+bool onRenderWorker();
+
+/// @brief Pass a finished image to prepareDataAvail, on the owner task when called from a render worker
+///
+/// @param filename Image file, owned by the tag until it is committed
+/// @param dataType Data type
+/// @param dataTypeArgument Data type argument
+/// @param dst Destination mac
+/// @param nextCheckin Next checkin
+/// @param removeAfter File to remove once the image is queued, optional
+/// @return true if handed over or queued, false if prepareDataAvail failed right away
+bool commitDataAvail(String &filename, uint8_t dataType, uint8_t dataTypeArgument, const uint8_t *dst, uint16_t nextCheckin, const String &removeAfter = String());
+
+/// @brief Run the commits of the render workers, call from the owner task only
+void commitRenders();
+
+/// @brief Number of tags waiting for a worker
+uint16_t renderQueueDepth();
+
+/// @brief Add worker count, queue depth and render time per content mode to a json object
+void renderStatsToJson(JsonObject &obj);
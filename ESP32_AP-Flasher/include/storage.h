@@ -1,6 +1,8 @@
 #ifndef _DYN_STORAGE_H_
 #define _DYN_STORAGE_H_
 
+#include <ArduinoJson.h>
+
 #include "FS.h"
 
 #ifdef HAS_SDCARD
@@ -33,7 +35,20 @@ class DynStorage {
     bool isInited;
 };
 
+// upper bounds in ms of the fsMutex hold time buckets, the last bucket takes everything above
+#define FS_HOLD_BUCKETS 6
+#define FS_HOLD_LIMITS {1, 5, 20, 100, 500}
+
 extern SemaphoreHandle_t fsMutex;
+
+/// @brief Take fsMutex. Use instead of xSemaphoreTake, so the hold time ends up in the histogram
+void fsLock();
+
+/// @brief Give fsMutex back and account for the time it was held
+void fsUnlock();
+
+/// @brief Add the fsMutex hold time histogram to a json object
+void fsStatsToJson(JsonObject &obj);
 extern DynStorage Storage;
 extern fs::FS *contentFS;
 extern void copyFile(File in, File out);
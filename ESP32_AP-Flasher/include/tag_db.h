@@ -1,6 +1,8 @@
 #include <Arduino.h>
 #include <ArduinoJson.h>
 
+#include <memory>
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 
@@ -15,7 +17,7 @@
 #define NO_SUBGHZ_CHANNEL  255
 class tagRecord {
    public:
-    tagRecord() : mac{0}, version(0), alias(""), lastseen(0), nextupdate(0), contentMode(0), pendingCount(0), md5{0}, expectedNextCheckin(0), modeConfigJson(""), LQI(0), RSSI(0), temperature(0), batteryMv(0), hwType(0), wakeupReason(0), capabilities(0), lastfullupdate(0), isExternal(false), apIp(IPAddress(0, 0, 0, 0)), pendingIdle(0), rotate(0), lut(0), tagSoftwareVersion(0), currentChannel(0), dataType(0), filename(""), data(nullptr), len(0), invert(0), updateCount(0), updateLast(0) {}
+    tagRecord() : mac{0}, version(0), alias(""), lastseen(0), nextupdate(0), contentMode(0), pendingCount(0), md5{0}, expectedNextCheckin(0), modeConfigJson(""), LQI(0), RSSI(0), temperature(0), batteryMv(0), hwType(0), wakeupReason(0), capabilities(0), lastfullupdate(0), isExternal(false), apIp(IPAddress(0, 0, 0, 0)), pendingIdle(0), rotate(0), lut(0), tagSoftwareVersion(0), currentChannel(0), dataType(0), filename(""), data(nullptr), len(0), invert(0), updateCount(0), updateLast(0), wsHash(0), syncHash(0), lastChanged(0), hotSlot(0), schedSeq(0) {}
 
     uint8_t mac[8];
     uint8_t version;
@@ -51,9 +53,64 @@ class tagRecord {
     uint8_t* data;
     uint32_t len;
 
+    // fingerprint of the record at the last websocket push and udp sync, see hashRecord()
+    uint32_t wsHash;
+    uint32_t syncHash;
+    // time a change was last seen by the websocket push or journalDB(), used by /get_db?since=. Persisted
+    uint32_t lastChanged;
+    // position of the record in tagDB and tagHot
+    uint16_t hotSlot;
+    // sequence number of the current content scheduler entry, older entries are stale
+    uint32_t schedSeq;
+
     static tagRecord* findByMAC(const uint8_t mac[8]);
 };
 
+#define TAGHOT_RSSI 0x01
+#define TAGHOT_EXTERNAL 0x02
+#define TAGHOT_IDLE 0x04
+
+#pragma pack(push, 4)
+/// @brief The fields the periodic scans read, kept in tagHot in the same order as tagDB
+///
+/// getTagCount(), contentRunner() and dbSize() walk this array instead of chasing the
+/// tagRecord pointers. Refreshed by syncHotRecord() wherever a tag changes.
+struct tagHotRecord {
+    uint8_t mac[8];
+    uint32_t lastseen;
+    uint32_t nextupdate;
+    uint32_t expectedNextCheckin;
+    // pending image plus modeConfigJson, for dbSize()
+    uint32_t coldBytes;
+    uint16_t batteryMv;
+    uint16_t pendingCount;
+    uint8_t contentMode;
+    uint8_t wakeupReason;
+    uint8_t flags;
+    uint8_t reserved;
+};
+#pragma pack(pop)
+
+/// @brief Content scheduler counters, lag is the delay between planned and actual render time in seconds
+struct tagSchedStats {
+    uint32_t renders;
+    uint32_t lagTotal;
+    uint32_t lagMax;
+    uint32_t visits;
+    uint32_t stale;
+};
+
+/// @brief Counters of record updates that were written/sent vs. skipped because nothing changed
+struct tagSyncStats {
+    uint32_t persistWritten;
+    uint32_t persistSkipped;
+    uint32_t persistBytes;
+    uint32_t wsSent;
+    uint32_t wsSkipped;
+    uint32_t syncSent;
+    uint32_t syncSkipped;
+};
+
 struct Config {
     uint8_t channel;
     uint8_t subghzchannel;
@@ -94,7 +151,13 @@ struct HwType {
     uint8_t zlib;
     uint8_t g5;
     uint16_t highlightColor;
+    // tag firmware version that undoes ZLIB_ROW_XOR, 0 if none does
+    uint8_t zlibXor;
+    // tag firmware version that takes DATATYPE_IMG_DELTA, 0 if none does
+    uint8_t delta;
     std::vector<Color> colortable;
+    // nearest colour tables of the colortable, see getPaletteLut()
+    std::shared_ptr<uint16_t> paletteLuts[4];
 };
 
 struct varStruct {
@@ -104,23 +167,82 @@ struct varStruct {
 
 extern Config config;
 extern std::vector<tagRecord*> tagDB;
+extern std::unordered_map<uint64_t, tagRecord*> tagIndex;
+extern std::unordered_map<uint64_t, tagRecord*> tagShadowDB;
+extern std::vector<tagHotRecord> tagHot;
 extern std::unordered_map<int, HwType> hwtype;
 extern std::unordered_map<std::string, varStruct> varDB;
-extern String tagDBtoJson(const uint8_t mac[8] = nullptr, uint8_t startPos = 0);
+extern tagSyncStats syncStats;
+extern tagSchedStats schedStats;
+extern String tagDBtoJson(const uint8_t mac[8] = nullptr, uint32_t startPos = 0);
+/// @brief Held while records are added to or removed from tagDB, take it to walk tagDB from another task
+extern std::recursive_mutex tagDBMutex;
+extern void insertRecord(tagRecord* taginfo);
 extern bool deleteRecord(const uint8_t mac[8], bool allVersions = true);
+
+/// @brief Copy the hot fields of a live record into its tagHot slot
+///
+/// Replans the content run of the tag when one of the fields it depends on changed
+/// @param taginfo Record in tagDB, shadow copies are ignored
+extern void syncHotRecord(tagRecord* taginfo);
+
+/// @brief Resync the next few tagHot slots, round robin
+///
+/// Catches fields that were changed without a syncHotRecord() call
+/// @param count Number of slots to refresh
+extern void scrubHotRecords(uint16_t count);
+
+/// @brief Time of the next content run of a tag: its nextupdate, or the start of its checkin window
+///
+/// @return UINT32_MAX if there is nothing to plan
+extern uint32_t plannedRun(const tagRecord* taginfo, time_t now);
+
+/// @brief Plan the next content run of a tag, replacing the one planned before
+///
+/// @param due Time of the run, UINT32_MAX only drops the previous plan
+extern void scheduleRecord(tagRecord* taginfo, uint32_t due);
+
+/// @brief Replan all tags, after a config change
+extern void rescheduleAll();
+
+/// @brief Take the tag with the earliest planned run, if that run is due
+///
+/// @param now Current time
+/// @param planned Planned time of the run that was taken
+/// @return Tag record, or nullptr if nothing is due
+extern tagRecord* popDueRecord(time_t now, uint32_t& planned);
 extern void fillNode(JsonObject& tag, const tagRecord* taginfo);
+extern uint32_t hashRecord(const tagRecord* taginfo);
 extern void saveDB(const String& filename);
 extern bool loadDB(const String& filename);
+extern bool loadDBbinary();
+extern void journalDB();
+extern void compactDB();
 extern void destroyDB();
 extern uint32_t getTagCount();
 extern uint32_t getTagCount(uint32_t& timeoutcount, uint32_t& lowbattcount);
 extern void mac2hex(const uint8_t* mac, char* hexBuffer);
+
+/// @brief Pack a tag mac into the key used by tagIndex and tagShadowDB
+inline uint64_t mac2key(const uint8_t mac[8]) {
+    uint64_t key;
+    memcpy(&key, mac, sizeof(key));
+    return key;
+}
 extern bool hex2mac(const String& hexString, uint8_t* mac);
 extern void clearPending(tagRecord* taginfo);
 extern void initAPconfig();
 extern void saveAPconfig();
 extern HwType getHwType(const uint8_t id);
 
+/// @brief Nearest colour table of the colortable of a hwType, shared by all renders of that type
+///
+/// 65536 entries indexed by RGB565, 0xFFFF until spr2color() fills them in
+/// @param id hwType
+/// @param variant bit 0: black and white swapped (invert), bit 1: only the first two colours
+/// @return the table, or nullptr if the hwType is unknown or there is no memory for it
+extern std::shared_ptr<uint16_t> getPaletteLut(const uint8_t id, const uint8_t variant);
+
 /// @brief Update a variable with the given key and value
 ///
 /// @param key Variable key
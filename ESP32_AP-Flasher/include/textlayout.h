@@ -0,0 +1,37 @@
+#include <Arduino.h>
+
+#pragma once
+
+#include <functional>
+#include <vector>
+
+/// @brief Horizontal metrics of a character, in pixels
+struct glyphMetrics {
+    int16_t advance;  // pen movement to the next character
+    int16_t extent;   // width it takes as the last character of a line
+    int16_t lead;     // width it adds left of the pen as the first character of a line
+};
+
+/// @brief Measures a character, prev is the character before it on the line or 0, for kerning
+typedef std::function<glyphMetrics(uint16_t code, uint16_t prev)> measureFunc;
+
+/// @brief A line of a text box, byte offsets into the text
+struct textLine {
+    uint16_t start;
+    uint16_t end;
+    int16_t width;
+    bool ellipsis;  // "..." goes after it, the text didn't fit
+};
+
+/// @brief Break a text into lines of at most boxwidth pixels, in one pass over the text
+///
+/// Lines break after the last space or '-' that fits, or anywhere in a word without one, and at '\n'.
+/// Spaces at the start of a line are skipped. Each character is measured at most twice
+/// @param text UTF-8 text
+/// @param boxwidth Width of the box
+/// @param maxLines Lines that fit in the box
+/// @param measure Metrics of a character
+/// @param lines Gets the lines
+/// @param ellipsis End the last line with "..." when the text doesn't fit
+/// @return true if all of the text fit
+bool layoutText(const String &text, int16_t boxwidth, uint16_t maxLines, const measureFunc &measure, std::vector<textLine> &lines, bool ellipsis);
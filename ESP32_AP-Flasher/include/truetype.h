@@ -21,6 +21,10 @@ lots of bugfixes and improvements by Nic.
 #include "FS.h"
 #endif /*FS_H*/
 
+#include <ArduinoJson.h>
+
+#include <memory>
+
 #define FLAG_ONCURVE (1 << 0)
 #define FLAG_XSHORT (1 << 1)
 #define FLAG_YSHORT (1 << 2)
@@ -37,7 +41,28 @@ lots of bugfixes and improvements by Nic.
 #define ROTATE_180 2
 #define ROTATE_270 3
 
-#define FILE_BUF_SIZE 256
+// file reads go through a few cached blocks, glyph lookups jump between loca, glyf and hmtx
+#ifndef TTF_BLOCK_SIZE
+#define TTF_BLOCK_SIZE 512
+#endif
+#ifndef TTF_BLOCKS
+#define TTF_BLOCKS 4
+#endif
+
+// rasterised glyphs kept across strings and renders, by font, size and character
+#ifndef TTF_GLYPH_CACHE_BYTES
+#ifdef BOARD_HAS_PSRAM
+#define TTF_GLYPH_CACHE_BYTES 131072
+#else
+#define TTF_GLYPH_CACHE_BYTES 8192
+#endif
+#endif
+// samples per pixel each way for the coverage levels of setTextCoverage(4)
+#define TTF_COVERAGE_SCALE 4
+// fonts whose character to glyph id and hmtx lookups are kept
+#define TTF_FONT_CACHE_FONTS 8
+// characters kept per font
+#define TTF_FONT_CACHE_CODES 1024
 typedef void(TTF_DRAWPIXEL)(int16_t _x, int16_t _y, uint16_t _colorCode);
 
 typedef struct {
@@ -149,10 +174,34 @@ typedef struct {
 } ttHMetric_t;
 
 typedef struct {
-    uint16_t p1;
-    uint16_t p2;
-    uint8_t up;
-} ttWindIntersect_t;
+    int16_t x0;  // top end, the edge covers rows y0 up to but not including y1
+    int16_t y0;
+    int16_t y1;
+    int8_t dir;  // winding direction
+    int32_t dx;
+    int32_t dy;  // always > 0
+    // crossing of the current row, x0 + q + r / dy, stepped per row without a division
+    int32_t q;
+    int32_t r;
+} ttEdge_t;
+
+typedef struct {
+    uint16_t glyphId;
+    uint16_t advanceWidth;  // in font units
+    int16_t leftSideBearing;
+} ttGlyphInfo_t;
+
+typedef struct {
+    int16_t left;  // relative to the pen position
+    int16_t top;
+    uint16_t width;
+    uint16_t height;
+    uint8_t bpp;                    // 1, or 2 for 4 coverage levels
+    std::shared_ptr<uint8_t> bits;  // bpp bits per pixel, rows padded to whole bytes
+} ttGlyphRaster_t;
+
+/// @brief Add the glyph cache counters to a json object
+void glyphCacheStatsToJson(JsonObject &obj);
 
 class truetypeClass {
    public:
@@ -167,10 +216,16 @@ class truetypeClass {
     void setTextBoundary(uint16_t _start_x, uint16_t _end_x, uint16_t _end_y);
     void setTextColor(uint16_t _onLine, uint16_t _inside);
     void setTextRotation(uint16_t _rotation);
+    /// @brief Coverage levels of the glyph edges, 2 draws plain pixels, 4 blends the edges into the framebuffer
+    void setTextCoverage(uint8_t _levels);
+    /// @brief Key of the font in the glyph caches, for a font set with setTtfPointer() that has a better one than its address
+    void setFontKey(uint64_t _key);
 
     uint16_t getStringWidth(const wchar_t _character[]);
     uint16_t getStringWidth(const char _character[]);
     uint16_t getStringWidth(const String _string);
+    /// @brief Pixels a character adds to getStringWidth(), with kerning against the character before it, 0 for none
+    int16_t getCharAdvance(uint16_t _code, uint16_t _prevCode = 0);
 
     void textDraw(int16_t _x, int16_t _y, const wchar_t _character[]);
     void textDraw(int16_t _x, int16_t _y, const char _character[]);
@@ -187,10 +242,15 @@ class truetypeClass {
     bool bFlash = true;                     // does the TTF data come from FLASH?
     uint32_t u32TTFSize, u32TTFOffset = 0;  // current read offset into TTF data
 
-    int iBufferedBytes = 0;            // Number of bytes remaining in u8FileBuf
-    uint8_t u8FileBuf[FILE_BUF_SIZE];  // Buffered reads from the file system
-    uint32_t u32BufPosition;           // Current position in the buffer
-    uint32_t iCurrentBufSize = 0;
+    uint32_t u32ReadOffset = 0;                    // current read offset into the file
+    uint32_t u32FileOffset = 0;                    // offset the file itself is at
+    uint8_t u8Blocks[TTF_BLOCKS][TTF_BLOCK_SIZE];  // cached blocks of the file
+    uint32_t u32BlockOffset[TTF_BLOCKS];           // file offset of each block, a multiple of TTF_BLOCK_SIZE
+    uint16_t u16BlockLength[TTF_BLOCKS] = {0};     // valid bytes of each block, 0 if unused
+    uint32_t u32BlockUsed[TTF_BLOCKS] = {0};       // when each block was last read from
+    uint32_t u32BlockClock = 0;
+    uint8_t u8LastBlock = 0;
+    int8_t fileBlock(uint32_t u32Offset);
 
     TTF_DRAWPIXEL *pfnDrawPixel = NULL;
 
@@ -201,9 +261,15 @@ class truetypeClass {
     const int tablePos = 12;
 
     uint16_t numTables;
-    ttTable_t *table;
+    ttTable_t *table = nullptr;
     ttHeadttTable_t headTable;
 
+    // identifies the font in the glyph caches
+    uint64_t fontKey = 0;
+    uint32_t locaTablePos = 0;
+    uint32_t glyfTablePos = 0;
+    void findGlyphTables();
+
     uint8_t getUInt8t();
     int16_t getInt16t();
     uint16_t getUInt16t();
@@ -233,7 +299,8 @@ class truetypeClass {
     // hmtx. metric information for the horizontal layout each of the glyphs
     uint32_t hmtxTablePos = 0;
     uint8_t readHMetric();
-    ttHMetric_t getHMetric(uint16_t _code);
+    ttHMetric_t getHMetric(const ttGlyphInfo_t &_info);
+    ttGlyphInfo_t glyphInfo(uint16_t _code);
 
     // kerning.
     ttKernHeader_t kernHeader;
@@ -254,11 +321,22 @@ class truetypeClass {
     uint16_t numEndPoints = 0;
 
     // glyf
-    ttGlyph_t glyph;
-    ttWindIntersect_t *pointsToFill = nullptr;
+    ttGlyph_t glyph = {};
+    // contours and points of a compound glyph read so far
+    uint16_t counterContours = 0;
+    uint16_t counterPoints = 0;
+    // edge table and row buffers of the rasteriser, kept for the next glyph
+    ttEdge_t *edges = nullptr;
+    uint16_t *activeEdges = nullptr;
+    uint16_t edgesSize = 0;
+    int16_t *rowDeltas = nullptr;
+    uint8_t *rowSamples = nullptr;
+    uint16_t rowSize = 0;
     void generateOutline(int16_t _x, int16_t _y, uint16_t characterSize);
     void freePointsAll();
-    void fillGlyph(int16_t _x_min, int16_t _y_min, uint16_t characterSize);
+    void fillGlyph(ttGlyphRaster_t &raster, uint8_t _scale);
+    std::shared_ptr<ttGlyphRaster_t> rasterizeGlyph(uint16_t _glyphId);
+    void drawGlyph(int16_t _x, int16_t _y, uint16_t _glyphId);
     uint8_t readGlyph(uint16_t code, uint8_t _justSize = 0);
     void freeGlyph();
 
@@ -269,7 +347,6 @@ class truetypeClass {
     void freeBeginPoints();
     void addEndPoint(uint16_t _ep);
     void freeEndPoints();
-    float isLeft(ttCoordinate_t *_p0, ttCoordinate_t *_p1, ttCoordinate_t *_point);
 
     // write user framebuffer
     uint16_t characterSize = 20;
@@ -285,9 +362,12 @@ class truetypeClass {
     uint8_t stringRotation = 0x00;
     uint16_t colorLine = 0x00;
     uint16_t colorInside = 0x00;
+    uint8_t coverageLevels = 2;
     uint8_t *userFrameBuffer;
     void stringToWchar(String _string, wchar_t _charctor[]);
+    bool mapPixel(int16_t &_x, int16_t &_y);
     void addPixel(int16_t _x, int16_t _y, uint16_t _colorCode);
+    void addCoverage(int16_t _x, int16_t _y, uint8_t _level);
     uint8_t GetU8ByteCount(char _ch);
     bool IsU8LaterByte(char _ch);
 };
@@ -4,6 +4,7 @@
 #include <ArduinoJson.h>
 #include <HTTPClient.h>
 
+#include "httpfetch.h"
 #include "system.h"
 #include "web.h"
 
@@ -71,25 +72,20 @@ static void printLargestFreeBlock() {
 /// @param timeout Request timeout
 /// @return True on success, false on error (httpCode != 200 || deserialization error)
 static bool httpGetJson(String &url, JsonDocument &json, const uint16_t timeout, JsonDocument *filter = nullptr) {
-    HTTPClient http;
     // logLine("http httpGetJson " + url);
-    http.begin(url);
-    http.setTimeout(timeout);
-    http.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
-    const int httpCode = http.GET();
+    String body;
+    const int httpCode = httpFetch(url, body, timeout);
     if (httpCode != 200) {
-        http.end();
         wsErr(String("[httpGetJson] http ") + url + " code " + httpCode);
         return false;
     }
 
     DeserializationError error;
     if (filter) {
-        error = deserializeJson(json, http.getString(), DeserializationOption::Filter(*filter));
+        error = deserializeJson(json, body, DeserializationOption::Filter(*filter));
     } else {
-        error = deserializeJson(json, http.getString());
+        error = deserializeJson(json, body);
     }
-    http.end();
     if (error) {
         Serial.printf("[httpGetJson] JSON: %s\r\n", error.c_str());
         wsErr("[httpGetJson] JSON: " + String(error.c_str()));
@@ -15,6 +15,7 @@ void wsSendAPitem(struct APlist *apitem);
 void wsSerial(const String &text);
 void wsSerial(const String &text, const String &color);
 uint8_t wsClientCount();
+void sendTagDBStream(AsyncWebServerRequest *request);
 
 extern AsyncWebSocket ws;
 extern SemaphoreHandle_t wsMutex;
@@ -215,23 +215,17 @@ uint8_t swapBits(uint8_t num) {
 }
 
 uint32_t compress_image(uint8_t address[8], uint8_t* buffer, uint32_t max_len) {
-    uint32_t t = millis();
-    PendingItem* queueItem = getQueueItem(address, 0);
+    PendingItemPtr queueItem = getQueueItem(address, 0);
     if (queueItem == nullptr) {
         prepareCancelPending(address);
         Serial.printf("blockrequest: couldn't find taginfo %02X%02X%02X%02X%02X%02X%02X%02X\r\n", address[7], address[6], address[5], address[4], address[3], address[2], address[1], address[0]);
         return 0;
     }
-    if (queueItem->data == nullptr) {
-        fs::File file = contentFS->open(queueItem->filename);
-        if (!file) {
-            Serial.print("No current file. " + String(queueItem->filename) + " Canceling request\r\n");
-            prepareCancelPending(address);
-            return 0;
-        }
-        queueItem->data = getDataForFile(file);
-        Serial.println("Reading file " + String(queueItem->filename) + " in  " + String(millis() - t) + "ms");
-        file.close();
+    const std::shared_ptr<uint8_t[]> data = loadQueueItemData(queueItem);
+    if (data == nullptr) {
+        Serial.print("No current file. " + String(queueItem->filename) + " Canceling request\r\n");
+        prepareCancelPending(address);
+        return 0;
     }
 
     uint16_t giciType = (address[7] << 8) | address[6];  // here we "extract" the display info again
@@ -374,14 +368,14 @@ uint32_t compress_image(uint8_t address[8], uint8_t* buffer, uint32_t max_len) {
         }
         if (mirror_width) {
             for (int b = 0; b < byte_per_line; b++) {
-                Mirrorbuffer[b] = ~queueItem->data[curr_input_posi++];
+                Mirrorbuffer[b] = ~data[curr_input_posi++];
             }
             for (int b = byte_per_line - 1; b >= 0; b--) {
                 buffer[len_compressed++] = swapBits(Mirrorbuffer[b]);
             }
         } else {
             for (int b = 0; b < byte_per_line; b++) {
-                buffer[len_compressed++] = ~queueItem->data[curr_input_posi++];
+                buffer[len_compressed++] = ~data[curr_input_posi++];
             }
         }
     }
@@ -401,7 +395,7 @@ uint32_t compress_image(uint8_t address[8], uint8_t* buffer, uint32_t max_len) {
                     if (queueItem->len <= curr_input_posi)
                         Mirrorbuffer[b] = 0x00;  // Do not anything outside of the buffer!
                     else
-                        Mirrorbuffer[b] = queueItem->data[curr_input_posi++];
+                        Mirrorbuffer[b] = data[curr_input_posi++];
                 }
                 for (int b = byte_per_line - 1; b >= 0; b--) {
                     buffer[len_compressed++] = swapBits(Mirrorbuffer[b]);
@@ -411,7 +405,7 @@ uint32_t compress_image(uint8_t address[8], uint8_t* buffer, uint32_t max_len) {
                     if (queueItem->len <= curr_input_posi) {
                         buffer[len_compressed++] = 0x00;  // Do not anything outside of the buffer!
                     } else {
-                        buffer[len_compressed++] = queueItem->data[curr_input_posi++];
+                        buffer[len_compressed++] = data[curr_input_posi++];
                     }
                 }
             }
@@ -428,23 +422,17 @@ uint32_t compress_image(uint8_t address[8], uint8_t* buffer, uint32_t max_len) {
 }
 
 uint32_t get_ATC_BLE_OEPL_image(uint8_t address[8], uint8_t* buffer, uint32_t max_len, uint8_t* dataType, uint8_t* dataTypeArgument, uint16_t* nextCheckIn) {
-    uint32_t t = millis();
-    PendingItem* queueItem = getQueueItem(address, 0);
+    PendingItemPtr queueItem = getQueueItem(address, 0);
     if (queueItem == nullptr) {
         prepareCancelPending(address);
         Serial.printf("blockrequest: couldn't find taginfo %02X%02X%02X%02X%02X%02X%02X%02X\r\n", address[7], address[6], address[5], address[4], address[3], address[2], address[1], address[0]);
         return 0;
     }
-    if (queueItem->data == nullptr) {
-        fs::File file = contentFS->open(queueItem->filename);
-        if (!file) {
-            Serial.print("No current file. " + String(queueItem->filename) + " Canceling request\r\n");
-            prepareCancelPending(address);
-            return 0;
-        }
-        queueItem->data = getDataForFile(file);
-        Serial.println("Reading file " + String(queueItem->filename) + " in  " + String(millis() - t) + "ms");
-        file.close();
+    const std::shared_ptr<uint8_t[]> data = loadQueueItemData(queueItem);
+    if (data == nullptr) {
+        Serial.print("No current file. " + String(queueItem->filename) + " Canceling request\r\n");
+        prepareCancelPending(address);
+        return 0;
     }
     if (queueItem->len > max_len) {
         Serial.print("The upload is too big better cencel it\r\n");
@@ -455,7 +443,7 @@ uint32_t get_ATC_BLE_OEPL_image(uint8_t address[8], uint8_t* buffer, uint32_t ma
     *dataTypeArgument = queueItem->pendingdata.availdatainfo.dataTypeArgument;
     *nextCheckIn = queueItem->pendingdata.availdatainfo.nextCheckIn;
     uint32_t len_compressed = queueItem->len;
-    memcpy(buffer, queueItem->data, queueItem->len);
+    memcpy(buffer, data.get(), queueItem->len);
     Serial.print("Data is prepared Len: " + String(queueItem->len) + "\r\n");
     return queueItem->len;
 }
@@ -24,11 +24,19 @@
 #include <TJpg_Decoder.h>
 #include <time.h>
 
+#include <algorithm>
 #include <map>
+#include <mutex>
+#include <unordered_map>
 
 #include "commstructs.h"
+#include "fontregistry.h"
+#include "httpfetch.h"
 #include "makeimage.h"
 #include "newproto.h"
+#include "renderarena.h"
+#include "rendercache.h"
+#include "renderpool.h"
 #include "storage.h"
 #ifdef CONTENT_QR
 #include "QRCodeGenerator.h"
@@ -37,12 +45,21 @@
 #include "settings.h"
 #include "system.h"
 #include "tag_db.h"
+#include "textlayout.h"
 #include "truetype.h"
 #include "util.h"
 #include "web.h"
 
 // https://csvjson.com/json_beautifier
 
+// truetype text from this size up gets coverage levels on its edges, for the dithering to smooth out
+#define TTF_COVERAGE_MIN_SIZE 32
+// drawTextBox doesn't shrink truetype text below this size
+#define TEXTBOX_MIN_SIZE 8
+
+// coverage levels of the tag the calling render task draws for
+static thread_local uint8_t textCoverage = 2;
+
 bool needRedraw(uint8_t contentMode, uint8_t wakeupReason) {
     // contentmode 26, timestamp
     if ((wakeupReason == WAKEUP_REASON_BUTTON1 || wakeupReason == WAKEUP_REASON_BUTTON2) && contentMode == 26) return true;
@@ -55,11 +72,40 @@ void contentRunner() {
     time_t now;
     time(&now);
 
-    for (tagRecord *taginfo : tagDB) {
+    scrubHotRecords(16);
+
+    const bool sleeping = util::isSleeping(config.sleepTime1, config.sleepTime2);
+    // free space is only checked when there is something to draw, and again after each drawing
+    int8_t spaceOk = -1;
+    auto canDraw = [&]() {
+        if (config.runStatus != RUNSTATUS_RUN || sleeping) return false;
+        if (spaceOk < 0) spaceOk = Storage.freeSpace() > 31000;
+        return spaceOk == 1;
+    };
+
+    // only the tags with a planned run that is due, see plannedRun()
+    uint32_t planned;
+    while (tagRecord *taginfo = popDueRecord(now, planned)) {
+        // a render worker has the tag, commitRenders() plans its next run
+        if (renderPending(taginfo->mac)) continue;
+
         if (taginfo->RSSI &&
             (now >= taginfo->nextupdate || needRedraw(taginfo->contentMode, taginfo->wakeupReason)) &&
-            config.runStatus == RUNSTATUS_RUN &&
-            Storage.freeSpace() > 31000 && !util::isSleeping(config.sleepTime1, config.sleepTime2)) {
+            canDraw()) {
+            const renderDispatch dispatch = queueRender(taginfo);
+            if (dispatch == RENDER_FULL) {
+                // no idle request either, the tag should wait for its image
+                scheduleRecord(taginfo, now + 1);
+                continue;
+            }
+
+            const uint32_t lag = now > planned ? now - planned : 0;
+            schedStats.renders++;
+            schedStats.lagTotal += lag;
+            if (lag > schedStats.lagMax) schedStats.lagMax = lag;
+            spaceOk = -1;
+
+            if (dispatch == RENDER_QUEUED) continue;
             drawNew(taginfo->mac, taginfo);
             taginfo->wakeupReason = 0;
         }
@@ -69,7 +115,7 @@ void contentRunner() {
             if (minutesUntilNextUpdate > config.maxsleep) {
                 minutesUntilNextUpdate = config.maxsleep;
             }
-            if (util::isSleeping(config.sleepTime1, config.sleepTime2)) {
+            if (sleeping) {
                 struct tm timeinfo;
                 getLocalTime(&timeinfo);
                 struct tm nextSleepTimeinfo = timeinfo;
@@ -87,6 +133,9 @@ void contentRunner() {
                 }
             }
         }
+        syncHotRecord(taginfo);
+        // whatever is still due is looked at again next run, not in this loop
+        scheduleRecord(taginfo, std::max(plannedRun(taginfo, now), (uint32_t)now + 1));
 
         vTaskDelay(1 / portTICK_PERIOD_MS);  // add a small delay to allow other threads to run
     }
@@ -122,6 +171,7 @@ void checkVars() {
                 tag->nextupdate = 0;
             }
         }
+        syncHotRecord(tag);
     }
     for (const auto &entry : varDB) {
         if (entry.second.changed) varDB[entry.first].changed = false;
@@ -148,6 +198,16 @@ void drawCounter(const uint8_t mac[8], tagRecord *&taginfo, JsonObject &cfgobj,
     cfgobj["counter"] = counter + 1;
 }
 
+// the planes came out the same as the image the tag confirmed, the way prepareDataAvail skips a full image with its md5
+static void dropUnchangedImage(const String &filename, const uint8_t *dst) {
+    wsLog("new image is the same as current image. not updating tag.");
+    fsLock();
+    contentFS->remove(filename);
+    fsUnlock();
+    // a worker's tag is sent by commitRenders()
+    if (!onRenderWorker()) wsSendTaginfo(dst, SYNC_TAGSTATUS);
+}
+
 void drawNew(const uint8_t mac[8], tagRecord *&taginfo) {
     time_t now;
     time(&now);
@@ -213,15 +273,28 @@ void drawNew(const uint8_t mac[8], tagRecord *&taginfo) {
     imageParams.hasRed = false;
     imageParams.dataType = DATATYPE_IMG_RAW_1BPP;
     imageParams.dither = 2;
+    // panels with more than black and white get large text with blended edges
+    textCoverage = (hwdata.bpp >= 2) ? 4 : 2;
 
     imageParams.invert = taginfo->invert;
     imageParams.symbols = 0;
     imageParams.rotate = taginfo->rotate;
+    imageParams.contentMode = taginfo->contentMode;
     if (hwdata.zlib != 0 && taginfo->tagSoftwareVersion >= hwdata.zlib) {
         imageParams.zlib = 1;
     } else {
         imageParams.zlib = 0;
     }
+    if (imageParams.zlib && hwdata.zlibXor != 0 && taginfo->tagSoftwareVersion >= hwdata.zlibXor) {
+        imageParams.zlibXor = 1;
+    } else {
+        imageParams.zlibXor = 0;
+    }
+    if (DELTA_BASE_BYTES && hwdata.delta != 0 && taginfo->tagSoftwareVersion >= hwdata.delta) {
+        imageParams.delta = 1;
+        // the image the tag confirmed with its last xfer complete
+        memcpy(&imageParams.baseVer, taginfo->md5, sizeof(uint64_t));
+    }
 #ifdef SAVE_SPACE
     imageParams.g5 = 0;
 #else
@@ -251,6 +324,12 @@ void drawNew(const uint8_t mac[8], tagRecord *&taginfo) {
     } else if (interval < 180)
         interval = 60 * 60;
 
+    // tags showing the same content share the image of the first one that drew it
+    if (filename != "direct") imageParams.renderKey = renderCacheKey(taginfo, cfgobj, imageParams);
+    if (imageParams.renderKey && renderCacheApply(imageParams.renderKey, filename, taginfo)) {
+        return;
+    }
+
     switch (taginfo->contentMode) {
         case 0:   // Not configured
         case 22:  // Static image
@@ -275,6 +354,8 @@ void drawNew(const uint8_t mac[8], tagRecord *&taginfo) {
                 imageParams.preload = cfgobj["preload"] && cfgobj["preload"] == "1";
                 imageParams.preloadlut = cfgobj["preload_lut"];
                 imageParams.preloadtype = cfgobj["preload_type"];
+                // a preload image goes into a slot of its own, not over the image the tag shows
+                if (imageParams.preload) imageParams.delta = 0;
 
                 jpg2buffer(configFilename, filename, imageParams);
 
@@ -288,6 +369,9 @@ void drawNew(const uint8_t mac[8], tagRecord *&taginfo) {
                 } else if (imageParams.bpp == 4) {
                     imageParams.dataType = DATATYPE_IMG_RAW_4BPP;
                     Serial.println("datatype: DATATYPE_IMG_RAW_4BPP");
+                } else if (imageParams.delta) {
+                    imageParams.dataType = DATATYPE_IMG_DELTA;
+                    Serial.println("datatype: DATATYPE_IMG_DELTA");
                 } else if (imageParams.zlib) {
                     imageParams.dataType = DATATYPE_IMG_ZLIB;
                     Serial.println("datatype: DATATYPE_IMG_ZLIB");
@@ -311,11 +395,11 @@ void drawNew(const uint8_t mac[8], tagRecord *&taginfo) {
                     arg.lut = imageParams.lut & 0x03;
                 }
 
-                if (prepareDataAvail(filename, imageParams.dataType, *((uint8_t *)&arg), mac, cfgobj["timetolive"].as<int>())) {
-                    if (cfgobj["delete"].as<String>() == "1") {
-                        contentFS->remove("/" + configFilename);
-                    }
-                } else {
+                const String removeAfter = cfgobj["delete"].as<String>() == "1" ? "/" + configFilename : String();
+                if (imageParams.unchanged) {
+                    dropUnchangedImage(filename, mac);
+                    if (removeAfter.length()) contentFS->remove(removeAfter);
+                } else if (!commitDataAvail(filename, imageParams.dataType, *((uint8_t *)&arg), mac, cfgobj["timetolive"].as<int>(), removeAfter)) {
                     wsErr("Error accessing " + filename);
                 }
             } else {
@@ -569,6 +653,7 @@ void drawNew(const uint8_t mac[8], tagRecord *&taginfo) {
         }
     }
 
+    if (imageParams.renderKey) renderCacheSeal(imageParams.renderKey, taginfo->nextupdate);
     taginfo->modeConfigJson = doc.as<String>();
 }
 
@@ -586,6 +671,9 @@ bool updateTagImage(String &filename, const uint8_t *dst, uint16_t nextCheckin,
         } else if (imageParams.bpp == 4) {
             imageParams.dataType = DATATYPE_IMG_RAW_4BPP;
             Serial.println("datatype: DATATYPE_IMG_RAW_4BPP");
+        } else if (imageParams.delta) {
+            imageParams.dataType = DATATYPE_IMG_DELTA;
+            Serial.println("datatype: DATATYPE_IMG_DELTA");
         } else if (imageParams.zlib) {
             imageParams.dataType = DATATYPE_IMG_ZLIB;
             Serial.println("datatype: DATATYPE_IMG_ZLIB");
@@ -596,8 +684,14 @@ bool updateTagImage(String &filename, const uint8_t *dst, uint16_t nextCheckin,
             imageParams.dataType = DATATYPE_IMG_RAW_2BPP;
             Serial.println("datatype: DATATYPE_IMG_RAW_2BPP");
         }
+        if (imageParams.unchanged) {
+            dropUnchangedImage(filename, dst);
+            return true;
+        }
         if (nextCheckin > 0x7fff) nextCheckin = 0;
-        prepareDataAvail(filename, imageParams.dataType, imageParams.lut, dst, nextCheckin);
+        // a delta only fits the tag it was made for
+        if (imageParams.renderKey && imageParams.dataType != DATATYPE_IMG_DELTA) renderCacheStore(imageParams.renderKey, filename, imageParams.dataType, imageParams.lut, nextCheckin);
+        commitDataAvail(filename, imageParams.dataType, imageParams.lut, dst, nextCheckin);
     }
     return true;
 }
@@ -640,6 +734,43 @@ void replaceVariables(String &format) {
     }
 }
 
+// loads a vlw font from the registry when it is resident there, from contentFS otherwise
+static void loadVlwFont(TFT_eSprite &spr, const String &font, const fontLease &lease) {
+    if (lease.data() != nullptr) {
+        spr.loadFont(lease.data());
+    } else {
+        spr.loadFont(font.substring(1), *contentFS);
+    }
+}
+
+// framebuffer, size and colour of a truetype font for drawing into a sprite
+static void prepareTtf(truetypeClass *truetype, TFT_eSprite &spr, uint16_t size, uint16_t color) {
+    void *framebuffer = spr.getPointer();
+    truetype->setFramebuffer(spr.width(), spr.height(), spr.getColorDepth(), static_cast<uint8_t *>(framebuffer));
+
+    truetype->setCharacterSize(size);
+    truetype->setCharacterSpacing(0);
+    truetype->setTextCoverage(size >= TTF_COVERAGE_MIN_SIZE && spr.getColorDepth() >= 8 ? textCoverage : 2);
+    if (spr.getColorDepth() == 8) {
+        truetype->setTextColor(spr.color16to8(color), spr.color16to8(color));
+    } else {
+        truetype->setTextColor(color, color);
+    }
+}
+
+// lines of lineAdvance pixels that fit in a box, the way drawTextBox steps posy
+static uint16_t textBoxLines(int16_t posy, int16_t boxheight, int16_t fontHeight, float lineAdvance, uint16_t length) {
+    uint16_t lines = 0;
+    int16_t y = posy;
+    while (y + fontHeight <= posy + boxheight && lines <= length) {
+        lines++;
+        const int16_t next = y + lineAdvance;
+        if (next <= y) break;
+        y = next;
+    }
+    return lines;
+}
+
 void drawString(TFT_eSprite &spr, String content, int16_t posx, int16_t posy, String font, byte align, uint16_t color, uint16_t size, uint16_t bgcolor) {
     // drawString(spr,"test",100,10,"bahnschrift30",TC_DATUM,TFT_RED);
 
@@ -670,36 +801,27 @@ void drawString(TFT_eSprite &spr, String content, int16_t posx, int16_t posy, St
         case 2: {
             // truetype
             time_t t = millis();
-            truetypeClass truetype = truetypeClass();
-            void *framebuffer = spr.getPointer();
-            truetype.setFramebuffer(spr.width(), spr.height(), spr.getColorDepth(), static_cast<uint8_t *>(framebuffer));
-            File fontFile = contentFS->open(font, "r");
-            if (!truetype.setTtfFile(fontFile)) {
+            fontLease lease = fontOpen(font);
+            truetypeClass *truetype = lease.ttf();
+            if (truetype == nullptr) {
                 Serial.println("read ttf failed");
                 return;
             }
-
-            truetype.setCharacterSize(size);
-            truetype.setCharacterSpacing(0);
+            prepareTtf(truetype, spr, size, color);
             if (align == TC_DATUM) {
-                posx -= truetype.getStringWidth(content) / 2;
+                posx -= truetype->getStringWidth(content) / 2;
             }
             if (align == TR_DATUM) {
-                posx -= truetype.getStringWidth(content);
-            }
-            truetype.setTextBoundary(posx, spr.width(), spr.height());
-            if (spr.getColorDepth() == 8) {
-                truetype.setTextColor(spr.color16to8(color), spr.color16to8(color));
-            } else {
-                truetype.setTextColor(color, color);
+                posx -= truetype->getStringWidth(content);
             }
-            truetype.textDraw(posx, posy, content);
-            truetype.end();
+            truetype->setTextBoundary(posx, spr.width(), spr.height());
+            truetype->textDraw(posx, posy, content);
         } break;
         case 3: {
             // vlw bitmap font
             spr.setTextDatum(align);
-            if (font != "") spr.loadFont(font.substring(1), *contentFS);
+            fontLease lease = font != "" ? fontOpen(font + ".vlw") : fontLease();
+            if (font != "") loadVlwFont(spr, font, lease);
             spr.setTextColor(color, bgcolor);
             spr.setTextWrap(false, false);
             spr.drawString(content, posx, posy);
@@ -708,44 +830,94 @@ void drawString(TFT_eSprite &spr, String content, int16_t posx, int16_t posy, St
     }
 }
 
-void drawTextBox(TFT_eSprite &spr, String &content, int16_t &posx, int16_t &posy, int16_t boxwidth, int16_t boxheight, String font, uint16_t color, uint16_t bgcolor, float lineheight, byte align) {
+void drawTextBox(TFT_eSprite &spr, String &content, int16_t &posx, int16_t &posy, int16_t boxwidth, int16_t boxheight, String font, uint16_t color, uint16_t bgcolor, float lineheight, byte align, uint16_t size, uint8_t fit) {
     replaceVariables(content);
+    std::vector<textLine> lines;
     switch (processFontPath(font)) {
         case 2: {
             // truetype
-            Serial.println("truetype font not implemented for drawTextBox");
+            fontLease lease = fontOpen(font);
+            truetypeClass *truetype = lease.ttf();
+            if (truetype == nullptr) {
+                Serial.println("read ttf failed");
+                return;
+            }
+            const measureFunc measure = [truetype](uint16_t code, uint16_t prev) -> glyphMetrics {
+                const int16_t advance = truetype->getCharAdvance(code, prev);
+                return {advance, advance, 0};
+            };
+            auto layout = [&](uint16_t fontSize) {
+                truetype->setCharacterSize(fontSize);
+                const uint16_t maxLines = textBoxLines(posy, boxheight, fontSize, fontSize * lineheight, content.length());
+                return layoutText(content, boxwidth, maxLines, measure, lines, fit != TEXTBOX_CLIP);
+            };
+
+            if (fit == TEXTBOX_SHRINK && size > TEXTBOX_MIN_SIZE && !layout(size)) {
+                // largest size the whole text fits at, each try is one pass over the text
+                uint16_t low = TEXTBOX_MIN_SIZE, high = size - 1;
+                while (low < high) {
+                    const uint16_t mid = (low + high + 1) / 2;
+                    if (layout(mid)) {
+                        low = mid;
+                    } else {
+                        high = mid - 1;
+                    }
+                }
+                size = low;
+            }
+            layout(size);
+
+            prepareTtf(truetype, spr, size, color);
+            for (const textLine &line : lines) {
+                String text = content.substring(line.start, line.end);
+                if (line.ellipsis) text += "...";
+                int16_t x = posx;
+                if (align == TC_DATUM) x -= line.width / 2;
+                if (align == TR_DATUM) x -= line.width;
+                truetype->setTextBoundary(x, spr.width(), spr.height());
+                truetype->textDraw(x, posy, text);
+                posy += size * lineheight;
+            }
         } break;
         case 3: {
             // vlw bitmap font
             // spr.drawRect(posx, posy, boxwidth, boxheight, TFT_BLACK);
             spr.setTextDatum(align);
-            if (font != "") spr.loadFont(font.substring(1), *contentFS);
+            fontLease lease = font != "" ? fontOpen(font + ".vlw") : fontLease();
+            if (font != "") loadVlwFont(spr, font, lease);
             spr.setTextWrap(false, false);
             spr.setTextColor(color, bgcolor);
 
-            int length = content.length();
-            int startPos = 0;
-            int startPosY = posy;
-
-            while (startPos < length && posy + spr.gFont.yAdvance <= startPosY + boxheight) {
-                int endPos = startPos;
-                bool hasspace = false;
-
-                while (endPos < length && spr.textWidth(content.substring(startPos, endPos + 1).c_str()) <= boxwidth && content.charAt(endPos) != '\n') {
-                    if (content.charAt(endPos) == ' ' || content.charAt(endPos) == '-') hasspace = true;
-                    endPos++;
-                }
-                while (endPos < length && endPos > startPos && hasspace == true && content.charAt(endPos - 1) != ' ' && content.charAt(endPos - 1) != '-' && content.charAt(endPos) != '\n') {
-                    endPos--;
+            // the metrics textWidth() adds up, looked up once per character
+            std::unordered_map<uint16_t, glyphMetrics> metrics;
+            const measureFunc measure = [&spr, &metrics, &font](uint16_t code, uint16_t) -> glyphMetrics {
+                auto it = metrics.find(code);
+                if (it != metrics.end()) return it->second;
+                glyphMetrics glyph;
+                uint16_t gNum = 0;
+                if (font == "") {
+                    const char text[2] = {(char)code, 0};
+                    glyph.advance = glyph.extent = spr.textWidth(text);
+                    glyph.lead = 0;
+                } else if (spr.getUnicodeIndex(code, &gNum)) {
+                    glyph.advance = spr.gxAdvance[gNum];
+                    glyph.extent = spr.gdX[gNum] + spr.gWidth[gNum];
+                    glyph.lead = spr.gdX[gNum] < 0 ? -spr.gdX[gNum] : 0;
+                } else {
+                    glyph.advance = glyph.extent = spr.gFont.spaceWidth + 1;
+                    glyph.lead = 0;
                 }
-                spr.drawString(content.substring(startPos, endPos), posx, posy);
+                metrics[code] = glyph;
+                return glyph;
+            };
+            const uint16_t maxLines = textBoxLines(posy, boxheight, spr.gFont.yAdvance, spr.gFont.yAdvance * lineheight, content.length());
+            layoutText(content, boxwidth, maxLines, measure, lines, fit != TEXTBOX_CLIP);
+
+            for (const textLine &line : lines) {
+                String text = content.substring(line.start, line.end);
+                if (line.ellipsis) text += "...";
+                spr.drawString(text, posx, posy);
                 posy += spr.gFont.yAdvance * lineheight;
-
-                if (content.charAt(endPos) == '\n') endPos++;
-                startPos = endPos;
-                while (startPos < length && content.charAt(startPos) == ' ') {
-                    startPos++;
-                }
             }
             if (font != "") spr.unloadFont();
         }
@@ -760,6 +932,7 @@ void initSprite(TFT_eSprite &spr, int w, int h, imgParam &imageParams) {
         util::printLargestFreeBlock();
         spr.setColorDepth(8);
         spr.createSprite(w, h);
+        if (spr.getPointer() != nullptr) arenaSpriteFallback(8);
     }
     if (spr.getPointer() == nullptr) {
         wsErr("low on memory. Fallback to 1bpp");
@@ -768,9 +941,11 @@ void initSprite(TFT_eSprite &spr, int w, int h, imgParam &imageParams) {
         spr.setBitmapColor(TFT_WHITE, TFT_BLACK);
         imageParams.bufferbpp = 1;
         spr.createSprite(w, h);
+        if (spr.getPointer() != nullptr) arenaSpriteFallback(1);
     }
     if (spr.getPointer() == nullptr) {
         wsErr("Failed to create sprite");
+        arenaSpriteFallback(0);
     }
     spr.setRotation(3);
     spr.fillSprite(TFT_WHITE);
@@ -1054,35 +1229,42 @@ void drawForecast(String &filename, JsonObject &cfgobj, const tagRecord *taginfo
 int getImgURL(String &filename, String URL, time_t fetched, imgParam &imageParams, String MAC) {
     // https://images.klari.net/kat-bw29.jpg
 
-    HTTPClient http;
     logLine("http getImgURL " + URL);
-    http.begin(URL);
-    http.addHeader("If-Modified-Since", formatHttpDate(fetched));
-    http.addHeader("X-ESL-MAC", MAC);
-    http.setTimeout(5000);  // timeout in ms
-    const int httpCode = http.GET();
-    if (httpCode == 200) {
-        xSemaphoreTake(fsMutex, portMAX_DELAY);
-        File f = contentFS->open("/temp/temp.jpg", "w");
+    fetchOptions options;
+    options.mac = MAC;
+    options.ifModifiedSince = fetched;
+    // per tag name, render workers may be downloading at the same time
+    const String jpgFile = "/temp/" + MAC + ".jpg";
+    bool stored = false;
+    const int httpCode = httpFetchStream(URL, options, [&](HTTPClient &http) {
+        fsLock();
+        File f = contentFS->open(jpgFile, "w");
         if (f) {
             http.writeToStream(&f);
             f.close();
-            xSemaphoreGive(fsMutex);
-            jpg2buffer("/temp/temp.jpg", filename, imageParams);
-        } else {
-            xSemaphoreGive(fsMutex);
+            stored = true;
+        }
+        fsUnlock();
+    });
+    if (httpCode == 200) {
+        if (stored) {
+            jpg2buffer(jpgFile, filename, imageParams);
+            fsLock();
+            contentFS->remove(jpgFile);
+            fsUnlock();
         }
     } else {
         if (httpCode != 304) {
             wsErr("http " + URL + " " + String(httpCode));
         }
     }
-    http.end();
     return httpCode;
 }
 
 #ifdef CONTENT_RSS
 rssClass reader;
+// reader does its own http requests and keeps the articles, one feed at a time
+static std::mutex readerMutex;
 #endif
 
 void replaceHTMLentities(String &text) {
@@ -1142,6 +1324,7 @@ bool getRssFeed(String &filename, String URL, String title, tagRecord *&taginfo,
     drawString(spr, title, loc["title"][0], loc["title"][1], loc["title"][2], TL_DATUM, TFT_BLACK, loc["title"][3]);
     int16_t posx = loc["line"][0];
     int16_t posy = loc["line"][1];
+    std::unique_lock<std::mutex> readerLock(readerMutex);
     int n = reader.getArticles(url, rssTitleSize, rssDescSize, loc["items"]);
 
     float lineheight = loc["desc"][3].as<float>();
@@ -1172,6 +1355,7 @@ bool getRssFeed(String &filename, String URL, String title, tagRecord *&taginfo,
         }
     }
     reader.clearItemData();
+    readerLock.unlock();
 
     spr2buffer(spr, filename, imageParams);
     spr.deleteSprite();
@@ -1181,7 +1365,7 @@ bool getRssFeed(String &filename, String URL, String title, tagRecord *&taginfo,
 #endif
 
 char *epoch_to_display(time_t utc) {
-    static char display[6];
+    static thread_local char display[6];
     struct tm local_tm;
     localtime_r(&utc, &local_tm);
     time_t now;
@@ -1219,23 +1403,19 @@ bool getCalFeed(String &filename, JsonObject &cfgobj, tagRecord *&taginfo, imgPa
     char dateString[40];
     strftime(dateString, sizeof(dateString), languageDateFormat[0].c_str(), &timeinfo);
 
-    HTTPClient http;
     // logLine("http getCalFeed " + URL);
-    http.begin(URL);
-    http.setTimeout(10000);
-    http.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
-    int httpCode = http.GET();
+    String response;
+    const int httpCode = httpFetch(URL, response, 10000);
     if (httpCode != 200) {
         wsErr("getCalFeed http error " + String(httpCode));
         return false;
     }
 
     DynamicJsonDocument doc(5000);
-    DeserializationError error = deserializeJson(doc, http.getString());
+    DeserializationError error = deserializeJson(doc, response);
     if (error) {
         wsErr(error.c_str());
     }
-    http.end();
 
     TFT_eSprite spr = TFT_eSprite(&tft);
 
@@ -1590,22 +1770,18 @@ bool getDayAheadFeed(String &filename, JsonObject &cfgobj, tagRecord *&taginfo,
     char dateString[40];
     strftime(dateString, sizeof(dateString), languageDateFormat[0].c_str(), &timeinfo);
 
-    HTTPClient http;
-    http.begin(URL);
-    http.setTimeout(10000);
-    http.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
-    int httpCode = http.GET();
+    String response;
+    const int httpCode = httpFetch(URL, response, 10000);
     if (httpCode != 200) {
         wsErr("getDayAhead http error " + String(httpCode));
         return false;
     }
 
     DynamicJsonDocument doc(5000);
-    DeserializationError error = deserializeJson(doc, http.getString());
+    DeserializationError error = deserializeJson(doc, response);
     if (error) {
         wsErr(error.c_str());
     }
-    http.end();
 
     TFT_eSprite spr = TFT_eSprite(&tft);
 
@@ -1758,15 +1934,12 @@ uint8_t drawBuienradar(String &filename, JsonObject &cfgobj, tagRecord *&taginfo
     wsLog("get buienradar");
 
     getLocation(cfgobj);
-    HTTPClient http;
 
     String lat = cfgobj["#lat"];
     String lon = cfgobj["#lon"];
     // logLine("http drawBuienradar");
-    http.begin("https://gadgets.buienradar.nl/data/raintext/?lat=" + lat + "&lon=" + lon);
-    http.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
-    http.setTimeout(5000);
-    int httpCode = http.GET();
+    String response;
+    const int httpCode = httpFetch("https://gadgets.buienradar.nl/data/raintext/?lat=" + lat + "&lon=" + lon, response, 5000);
 
     if (httpCode == 200) {
         TFT_eSprite spr = TFT_eSprite(&tft);
@@ -1777,8 +1950,6 @@ uint8_t drawBuienradar(String &filename, JsonObject &cfgobj, tagRecord *&taginfo
 
         tft.setTextWrap(false, false);
 
-        String response = http.getString();
-
         drawString(spr, cfgobj["location"], loc["location"][0], loc["location"][1], loc["location"][2]);
 
         const auto &bars = loc["bars"];
@@ -1832,7 +2003,6 @@ uint8_t drawBuienradar(String &filename, JsonObject &cfgobj, tagRecord *&taginfo
     } else {
         wsErr("Buitenradar http " + String(httpCode));
     }
-    http.end();
     return refresh;
 }
 #endif
@@ -1879,6 +2049,12 @@ void drawTimestamp(String &filename, JsonObject &cfgobj, tagRecord *&taginfo, im
         char hexmac[17];
         mac2hex(taginfo->mac, hexmac);
 
+        // spr2buffer clears the codecs it didn't use, each image gets to pick again
+        const uint8_t zlib = imageParams.zlib;
+        const uint8_t g5 = imageParams.g5;
+        const uint8_t delta = imageParams.delta;
+        imageParams.delta = 0;
+
         String filename2 = "/temp/" + String(hexmac) + "-2.raw";
         drawString(spr, cfgobj["button1"].as<String>(), spr.width() / 2, 40, "calibrib30.vlw", TC_DATUM, TFT_BLACK);
         drawString(spr, "Well done!", spr.width() / 2, 90, "calibrib30.vlw", TC_DATUM, TFT_BLACK);
@@ -1895,20 +2071,31 @@ void drawTimestamp(String &filename, JsonObject &cfgobj, tagRecord *&taginfo, im
         arg.specialType = 17;  // button 2
         arg.lut = 0;
 
-        prepareDataAvail(filename2, imageParams.dataType, *((uint8_t *)&arg), taginfo->mac, 5 | 0x8000);
+        commitDataAvail(filename2, imageParams.dataType, *((uint8_t *)&arg), taginfo->mac, 5 | 0x8000);
 
         spr.fillRect(0, 0, spr.width(), spr.height(), TFT_WHITE);
 
         filename2 = "/temp/" + String(hexmac) + "-3.raw";
         drawString(spr, cfgobj["button2"].as<String>(), spr.width() / 2, 40, "calibrib30.vlw", TC_DATUM, TFT_BLACK);
         drawString(spr, "Well done!", spr.width() / 2, 90, "calibrib30.vlw", TC_DATUM, TFT_BLACK);
+        imageParams.zlib = zlib;
+        imageParams.g5 = g5;
         spr2buffer(spr, filename2, imageParams);
 
+        if (imageParams.zlib) {
+            imageParams.dataType = DATATYPE_IMG_ZLIB;
+        } else if (imageParams.g5) {
+            imageParams.dataType = DATATYPE_IMG_G5;
+        }
+
         arg.preloadImage = 1;
         arg.specialType = 16;  // button 1
         arg.lut = 0;
-        prepareDataAvail(filename2, imageParams.dataType, *((uint8_t *)&arg), taginfo->mac, 5 | 0x8000);
+        commitDataAvail(filename2, imageParams.dataType, *((uint8_t *)&arg), taginfo->mac, 5 | 0x8000);
 
+        imageParams.zlib = zlib;
+        imageParams.g5 = g5;
+        imageParams.delta = delta;
         cfgobj["#init"] = "1";
     }
     uint8_t offsety = 0;
@@ -2178,23 +2365,36 @@ bool getJsonTemplateFileExtractVariables(String &filename, String jsonfile, Json
 }
 
 int getJsonTemplateUrl(String &filename, String URL, time_t fetched, String MAC, tagRecord *&taginfo, imgParam &imageParams) {
-    HTTPClient http;
-    http.useHTTP10(true);
     logLine("http getJsonTemplateUrl " + URL);
-    http.begin(URL);
-    http.addHeader("If-Modified-Since", formatHttpDate(fetched));
-    http.addHeader("X-ESL-MAC", MAC);
-    http.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
-    http.setTimeout(5000);
-    const int httpCode = http.GET();
-    if (httpCode == 200) {
-        drawJsonStream(http.getStream(), filename, taginfo, imageParams);
-    } else {
-        if (httpCode != 304) {
-            wsErr("http " + URL + " status " + String(httpCode));
-        }
+    fetchOptions options;
+    options.mac = MAC;
+    options.ifModifiedSince = fetched;
+    options.http10 = true;
+    // the body goes to a file first, other renders can use the connection to the host while this one draws
+    const String jsonFile = "/temp/" + MAC + ".json";
+    bool stored = false;
+    const int httpCode = httpFetchStream(URL, options, [&](HTTPClient &http) {
+        fsLock();
+        File f = contentFS->open(jsonFile, "w");
+        if (f) {
+            http.writeToStream(&f);
+            f.close();
+            stored = true;
+        }
+        fsUnlock();
+    });
+    if (httpCode == 200 && stored) {
+        File file = contentFS->open(jsonFile, "r");
+        if (file) {
+            drawJsonStream(file, filename, taginfo, imageParams);
+            file.close();
+        }
+        fsLock();
+        contentFS->remove(jsonFile);
+        fsUnlock();
+    } else if (httpCode != 200 && httpCode != 304) {
+        wsErr("http " + URL + " status " + String(httpCode));
     }
-    http.end();
     return httpCode;
 }
 
@@ -2250,11 +2450,6 @@ void rotateBuffer(uint8_t rotation, uint8_t &currentOrientation, TFT_eSprite &sp
     }
 }
 
-TFT_eSprite sprDraw = TFT_eSprite(&tft);
-bool spr_draw(int16_t x, int16_t y, uint16_t w, uint16_t h, uint16_t *bitmap) {
-    sprDraw.pushImage(x, y, w, h, bitmap);
-    return 1;
-}
 void drawElement(const JsonObject &element, TFT_eSprite &spr, imgParam &imageParams, uint8_t &currentOrientation) {
     if (element.containsKey("text")) {
         const JsonArray &textArray = element["text"];
@@ -2264,7 +2459,7 @@ void drawElement(const JsonObject &element, TFT_eSprite &spr, imgParam &imagePar
         const uint16_t bgcolor = (bgcolorstr.length() > 0) ? getColor(bgcolorstr) : TFT_WHITE;
         drawString(spr, textArray[2], textArray[0].as<int>(), textArray[1].as<int>(), textArray[3], align, getColor(textArray[4]), size, bgcolor);
     } else if (element.containsKey("textbox")) {
-        // posx, posy, width, height, text, font, color, lineheight, align  
+        // posx, posy, width, height, text, font, color, lineheight, align, size (truetype), fit
         const JsonArray &textArray = element["textbox"];
         float lineheight = textArray[7].as<float>();
         if (lineheight == 0) lineheight = 1;
@@ -2272,7 +2467,9 @@ void drawElement(const JsonObject &element, TFT_eSprite &spr, imgParam &imagePar
         int16_t posy = textArray[1] | 0;
         String text = textArray[4];
         const uint16_t align = textArray[8] | 0;
-        drawTextBox(spr, text, posx, posy, textArray[2], textArray[3], textArray[5], getColor(textArray[6]), TFT_WHITE, lineheight, align);
+        const uint16_t size = textArray[9] | 30;
+        const uint8_t fit = textArray[10] | TEXTBOX_CLIP;
+        drawTextBox(spr, text, posx, posy, textArray[2], textArray[3], textArray[5], getColor(textArray[6]), TFT_WHITE, lineheight, align, size, fit);
     } else if (element.containsKey("box")) {
         const JsonArray &boxArray = element["box"];
         spr.fillRect(boxArray[0].as<int>(), boxArray[1].as<int>(), boxArray[2].as<int>(), boxArray[3].as<int>(), getColor(boxArray[4]));
@@ -2312,26 +2509,24 @@ void drawElement(const JsonObject &element, TFT_eSprite &spr, imgParam &imagePar
     } else if (element.containsKey("image")) {
         const JsonArray &imgArray = element["image"];
 
-        TJpgDec.setSwapBytes(true);
-        TJpgDec.setJpgScale(1);
-        TJpgDec.setCallback(spr_draw);
         uint16_t w = 0, h = 0;
         String filename = imgArray[0];
         if (filename[0] != '/') {
             filename = "/" + filename;
         }
-        TJpgDec.getFsJpgSize(&w, &h, filename, *contentFS);
+        jpgSize(filename, w, h);
         if (w == 0 && h == 0) {
             wsErr("invalid jpg");
             return;
         }
         Serial.println("jpeg conversion " + String(w) + "x" + String(h));
+        TFT_eSprite sprDraw = TFT_eSprite(&tft);
         sprDraw.setColorDepth(16);
         sprDraw.createSprite(w, h);
         if (sprDraw.getPointer() == nullptr) {
             wsErr("Failed to create sprite in contentmanager");
         } else {
-            TJpgDec.drawFsJpg(0, 0, filename, *contentFS);
+            drawJpg(sprDraw, filename);
             sprDraw.pushToSprite(&spr, imgArray[1].as<int>(), imgArray[2].as<int>());
             sprDraw.deleteSprite();
         }
@@ -2363,12 +2558,12 @@ uint16_t getColor(const String &color) {
 }
 
 char *formatHttpDate(const time_t t) {
-    static char buf[40];
-    struct tm *timeinfo;
-    timeinfo = localtime(&t);                 // Get the local time
-    const time_t utcTime = mktime(timeinfo);  // Convert to UTC
-    timeinfo = gmtime(&utcTime);
-    strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", timeinfo);
+    static thread_local char buf[40];
+    struct tm timeinfo;
+    localtime_r(&t, &timeinfo);                // Get the local time
+    const time_t utcTime = mktime(&timeinfo);  // Convert to UTC
+    gmtime_r(&utcTime, &timeinfo);
+    strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &timeinfo);
     return buf;
 }
 
@@ -146,7 +146,7 @@ bool downloadAndWriteBinary(String &filename, const char *url) {
             wsSerial("Couldn't get contentLength");
             break;
         }
-        xSemaphoreTake(fsMutex, portMAX_DELAY);
+        fsLock();
         bHaveFsMutex = true;
         File file = contentFS->open(filename, "wb");
         if(!file) {
@@ -197,7 +197,7 @@ bool downloadAndWriteBinary(String &filename, const char *url) {
     binaryHttp.setReuse(false);
     binaryHttp.end();
     if(bHaveFsMutex) {
-        xSemaphoreGive(fsMutex);
+        fsUnlock();
     }
 
     return Ret;
@@ -0,0 +1,280 @@
+#include "fontregistry.h"
+
+#include <Arduino.h>
+
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "storage.h"
+#include "truetype.h"
+
+struct fontEntry {
+    String path;
+    bool isTtf;
+    size_t size;
+    time_t lastWrite;
+    // glyph cache key, the same one setTtfFile() gives the file
+    uint64_t key;
+    // whole file when resident
+    uint8_t *data = nullptr;
+    // parsed fonts nobody is using
+    std::vector<truetypeClass *> idle;
+    uint16_t refs = 0;
+    uint32_t lastUsed = 0;
+    uint32_t checked = 0;
+    // no longer in the registry, it goes when the last lease does
+    bool retired = false;
+
+    ~fontEntry() {
+        for (truetypeClass *parsed : idle) {
+            parsed->end();
+            delete parsed;
+        }
+        if (data != nullptr) free(data);
+    }
+};
+
+struct fontRegistryStats {
+    uint32_t hits;
+    uint32_t loads;
+    uint32_t reloads;
+    uint32_t parses;
+    uint32_t evictions;
+};
+
+static std::map<String, std::shared_ptr<fontEntry>> fonts;
+static std::mutex registryMutex;
+static fontRegistryStats stats = {0};
+static uint32_t residentBytes = 0;
+static uint32_t openFiles = 0;
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t len) {
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    while (len--) {
+        hash ^= *p++;
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+// registryMutex held
+static void retire(std::map<String, std::shared_ptr<fontEntry>>::iterator it) {
+    fontEntry &entry = *it->second;
+    entry.retired = true;
+    if (entry.data != nullptr) {
+        residentBytes -= entry.size;
+    } else {
+        openFiles -= entry.idle.size();
+    }
+    for (truetypeClass *parsed : entry.idle) {
+        parsed->end();
+        delete parsed;
+    }
+    entry.idle.clear();
+    fonts.erase(it);
+}
+
+// registryMutex held, drops the least recently used font nobody is using
+static bool evictOne(bool residentOnly) {
+    auto victim = fonts.end();
+    for (auto it = fonts.begin(); it != fonts.end(); ++it) {
+        if (it->second->refs || (residentOnly && it->second->data == nullptr)) continue;
+        if (victim == fonts.end() || it->second->lastUsed < victim->second->lastUsed) victim = it;
+    }
+    if (victim == fonts.end()) return false;
+    retire(victim);
+    stats.evictions++;
+    return true;
+}
+
+// size and modification time of a font file, false if it doesn't exist
+static bool statFont(const String &path, size_t &size, time_t &lastWrite) {
+    fsLock();
+    fs::File file = contentFS->open(path, "r");
+    if (!file) {
+        fsUnlock();
+        return false;
+    }
+    size = file.size();
+    lastWrite = file.getLastWrite();
+    file.close();
+    fsUnlock();
+    return true;
+}
+
+static std::shared_ptr<fontEntry> loadFont(const String &path) {
+    fsLock();
+    fs::File file = contentFS->open(path, "r");
+    if (!file) {
+        fsUnlock();
+        return nullptr;
+    }
+    auto entry = std::make_shared<fontEntry>();
+    entry->path = path;
+    entry->isTtf = path.endsWith(".ttf");
+    entry->size = file.size();
+    entry->lastWrite = file.getLastWrite();
+    entry->key = fnv1a(0xCBF29CE484222325ULL, path.c_str(), path.length());
+    entry->key = fnv1a(entry->key, &entry->size, sizeof(entry->size));
+    entry->key = fnv1a(entry->key, &entry->lastWrite, sizeof(entry->lastWrite));
+
+#ifdef BOARD_HAS_PSRAM
+    if (entry->size && entry->size <= FONT_REGISTRY_BYTES / 2 && ESP.getFreePsram() > entry->size + FONT_REGISTRY_PSRAM_RESERVE) {
+        entry->data = (uint8_t *)ps_malloc(entry->size);
+        if (entry->data != nullptr && file.read(entry->data, entry->size) != entry->size) {
+            free(entry->data);
+            entry->data = nullptr;
+        }
+    }
+#endif
+    file.close();
+    fsUnlock();
+    return entry;
+}
+
+fontLease::fontLease(fontLease &&other) : entry(std::move(other.entry)), parsed(other.parsed) {
+    other.parsed = nullptr;
+}
+
+fontLease::~fontLease() {
+    if (entry == nullptr) return;
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        entry->refs--;
+        if (parsed != nullptr && !entry->retired && (entry->data != nullptr || openFiles < FONT_REGISTRY_OPEN_FILES)) {
+            entry->idle.push_back(parsed);
+            if (entry->data == nullptr) openFiles++;
+            parsed = nullptr;
+        }
+    }
+    if (parsed != nullptr) {
+        parsed->end();
+        delete parsed;
+    }
+}
+
+truetypeClass *fontLease::ttf() {
+    if (parsed != nullptr) return parsed;
+    if (entry == nullptr || !entry->isTtf) return nullptr;
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        if (!entry->idle.empty()) {
+            parsed = entry->idle.back();
+            entry->idle.pop_back();
+            if (entry->data == nullptr) openFiles--;
+            return parsed;
+        }
+    }
+
+    truetypeClass *font = new truetypeClass();
+    uint8_t ok;
+    if (entry->data != nullptr) {
+        ok = font->setTtfPointer(entry->data, entry->size, 0, false);
+    } else {
+        ok = font->setTtfFile(contentFS->open(entry->path, "r"));
+    }
+    if (!ok) {
+        delete font;
+        return nullptr;
+    }
+    font->setFontKey(entry->key);
+    parsed = font;
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    stats.parses++;
+    return parsed;
+}
+
+const uint8_t *fontLease::data() const {
+    return entry != nullptr ? entry->data : nullptr;
+}
+
+fontLease fontOpen(const String &path) {
+    fontLease lease;
+    const uint32_t now = millis();
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        auto it = fonts.find(path);
+        if (it != fonts.end() && now - it->second->checked < FONT_REGISTRY_RECHECK_MS) {
+            lease.entry = it->second;
+            lease.entry->refs++;
+            lease.entry->lastUsed = now;
+            stats.hits++;
+            return lease;
+        }
+    }
+
+    // due for a check against its file, only a font that changed is read again
+    size_t size = 0;
+    time_t lastWrite = 0;
+    const bool exists = statFont(path, size, lastWrite);
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        auto it = fonts.find(path);
+        if (it != fonts.end()) {
+            if (exists && it->second->size == size && it->second->lastWrite == lastWrite) {
+                lease.entry = it->second;
+                lease.entry->checked = now;
+                lease.entry->refs++;
+                lease.entry->lastUsed = now;
+                stats.hits++;
+                return lease;
+            }
+            retire(it);
+            stats.reloads++;
+        }
+    }
+    if (!exists) return lease;
+
+    std::shared_ptr<fontEntry> loaded = loadFont(path);
+    if (loaded == nullptr) return lease;
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    auto it = fonts.find(path);
+    if (it != fonts.end()) {
+        // another task loaded it meanwhile
+        if (it->second->size == loaded->size && it->second->lastWrite == loaded->lastWrite) {
+            lease.entry = it->second;
+            lease.entry->refs++;
+            lease.entry->lastUsed = now;
+            stats.hits++;
+            return lease;
+        }
+        retire(it);
+        stats.reloads++;
+    }
+
+    while (fonts.size() >= FONT_REGISTRY_FONTS && evictOne(false)) {
+    }
+    while (loaded->data != nullptr && residentBytes + loaded->size > FONT_REGISTRY_BYTES) {
+        if (evictOne(true)) continue;
+        free(loaded->data);
+        loaded->data = nullptr;
+    }
+    if (loaded->data != nullptr) residentBytes += loaded->size;
+    loaded->checked = now;
+    loaded->lastUsed = now;
+    loaded->refs = 1;
+    fonts[path] = loaded;
+    stats.loads++;
+    lease.entry = loaded;
+    return lease;
+}
+
+void fontRegistryStatsToJson(JsonObject &obj) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    uint32_t resident = 0;
+    for (const auto &font : fonts) {
+        if (font.second->data != nullptr) resident++;
+    }
+    obj["fonts"] = fonts.size();
+    obj["resident"] = resident;
+    obj["residentbytes"] = residentBytes;
+    obj["openfiles"] = openFiles;
+    obj["hits"] = stats.hits;
+    obj["loads"] = stats.loads;
+    obj["reloads"] = stats.reloads;
+    obj["parses"] = stats.parses;
+    obj["evictions"] = stats.evictions;
+}
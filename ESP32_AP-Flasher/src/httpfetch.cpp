@@ -0,0 +1,268 @@
+#include "httpfetch.h"
+
+#include <Arduino.h>
+#include <HTTPClient.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "contentmanager.h"
+
+struct fetchHost {
+    std::mutex lock;
+    HTTPClient http;
+    uint32_t lastRequest = 0;
+    uint32_t lastUsed = 0;
+    bool busy = false;
+};
+
+struct fetchCacheEntry {
+    String body;
+    String etag;
+    String lastModified;
+    uint32_t expires;
+    // millis(), the responses of a batch of tags come within the same second
+    uint32_t lastUsed;
+};
+
+struct fetchFlight {
+    std::mutex lock;
+    std::condition_variable cv;
+    bool done = false;
+    int code = 0;
+    String body;
+};
+
+static std::mutex fetchMutex;
+static std::unordered_map<std::string, std::shared_ptr<fetchHost>> fetchHosts;
+static std::unordered_map<std::string, fetchCacheEntry> fetchCache;
+static std::unordered_map<std::string, std::shared_ptr<fetchFlight>> fetchFlights;
+static uint32_t fetchCacheBytes = 0;
+static fetchStats stats = {0};
+
+static const char *collectedHeaders[] = {"ETag", "Last-Modified", "Cache-Control"};
+
+/// scheme, host and port of a url
+static std::string hostKey(const String &url) {
+    int start = url.indexOf("://");
+    start = start < 0 ? 0 : start + 3;
+    int end = url.indexOf('/', start);
+    if (end < 0) end = url.length();
+    return std::string(url.substring(0, end).c_str());
+}
+
+static std::shared_ptr<fetchHost> acquireHost(const String &url) {
+    const std::string key = hostKey(url);
+    std::shared_ptr<fetchHost> host;
+    {
+        std::lock_guard<std::mutex> lock(fetchMutex);
+        auto it = fetchHosts.find(key);
+        if (it != fetchHosts.end()) {
+            host = it->second;
+        } else {
+            // drop the least recently used idle connection to stay within FETCH_MAX_HOSTS
+            while (fetchHosts.size() >= FETCH_MAX_HOSTS) {
+                auto victim = fetchHosts.end();
+                for (auto h = fetchHosts.begin(); h != fetchHosts.end(); ++h) {
+                    if (h->second->busy) continue;
+                    if (victim == fetchHosts.end() || h->second->lastUsed < victim->second->lastUsed) victim = h;
+                }
+                if (victim == fetchHosts.end()) break;
+                fetchHosts.erase(victim);
+            }
+            host = std::make_shared<fetchHost>();
+            host->http.setReuse(true);
+            host->http.collectHeaders(collectedHeaders, 3);
+            fetchHosts[key] = host;
+        }
+        host->busy = true;
+    }
+    host->lock.lock();
+
+    const uint32_t wait = millis() - host->lastRequest;
+    if (host->lastRequest && wait < FETCH_HOST_INTERVAL) {
+        vTaskDelay((FETCH_HOST_INTERVAL - wait) / portTICK_PERIOD_MS);
+    }
+    return host;
+}
+
+static void releaseHost(const std::shared_ptr<fetchHost> &host) {
+    host->lastRequest = millis();
+    host->lastUsed = host->lastRequest;
+    host->lock.unlock();
+    std::lock_guard<std::mutex> lock(fetchMutex);
+    host->busy = false;
+}
+
+/// max-age of a response, -1 if it may not be cached
+static int32_t maxAge(const String &cacheControl) {
+    if (cacheControl.indexOf("no-store") >= 0 || cacheControl.indexOf("private") >= 0) return -1;
+    if (cacheControl.indexOf("no-cache") >= 0) return 0;
+    const int pos = cacheControl.indexOf("max-age=");
+    if (pos >= 0) return cacheControl.substring(pos + 8).toInt();
+    return FETCH_DEFAULT_MAX_AGE;
+}
+
+// Call with fetchMutex held
+static void storeLocked(const std::string &key, fetchCacheEntry &entry) {
+    auto it = fetchCache.find(key);
+    if (it != fetchCache.end()) {
+        fetchCacheBytes -= it->second.body.length();
+        fetchCache.erase(it);
+    }
+    const uint32_t len = entry.body.length();
+    if (len > FETCH_CACHE_BYTES / 2) return;
+    while (!fetchCache.empty() && fetchCacheBytes + len > FETCH_CACHE_BYTES) {
+        auto oldest = std::min_element(fetchCache.begin(), fetchCache.end(), [](const auto &a, const auto &b) {
+            return a.second.lastUsed < b.second.lastUsed;
+        });
+        fetchCacheBytes -= oldest->second.body.length();
+        fetchCache.erase(oldest);
+    }
+    fetchCacheBytes += len;
+    fetchCache[key] = std::move(entry);
+}
+
+static int fetchRequest(const String &url, const fetchOptions &options, const String &etag, const String &lastModified, std::function<void(HTTPClient &, int)> onResponse) {
+    std::shared_ptr<fetchHost> host = acquireHost(url);
+    HTTPClient &http = host->http;
+    http.useHTTP10(options.http10);
+    http.begin(url);
+    http.setTimeout(options.timeout);
+    http.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
+    if (options.mac.length()) http.addHeader("X-ESL-MAC", options.mac);
+    if (options.ifModifiedSince) {
+        http.addHeader("If-Modified-Since", formatHttpDate(options.ifModifiedSince));
+    } else if (lastModified.length()) {
+        http.addHeader("If-Modified-Since", lastModified);
+    }
+    if (etag.length()) http.addHeader("If-None-Match", etag);
+
+    const int httpCode = http.GET();
+    {
+        std::lock_guard<std::mutex> lock(fetchMutex);
+        stats.network++;
+        if (httpCode < 0) stats.errors++;
+    }
+    if (httpCode > 0) onResponse(http, httpCode);
+    http.end();
+    releaseHost(host);
+    return httpCode;
+}
+
+int httpFetchStream(const String &url, const fetchOptions &options, std::function<void(HTTPClient &)> onSuccess) {
+    {
+        std::lock_guard<std::mutex> lock(fetchMutex);
+        stats.requests++;
+    }
+    const int httpCode = fetchRequest(url, options, String(), String(), [&](HTTPClient &http, int code) {
+        if (code == 200) onSuccess(http);
+    });
+    if (httpCode == 304) {
+        std::lock_guard<std::mutex> lock(fetchMutex);
+        stats.notModified++;
+    }
+    return httpCode;
+}
+
+int httpFetch(const String &url, String &body, const uint16_t timeout) {
+    const std::string key(url.c_str());
+    time_t now;
+    time(&now);
+
+    std::shared_ptr<fetchFlight> flight;
+    String etag, lastModified, staleBody;
+    {
+        std::lock_guard<std::mutex> lock(fetchMutex);
+        stats.requests++;
+        auto cached = fetchCache.find(key);
+        if (cached != fetchCache.end()) {
+            if (now < cached->second.expires) {
+                cached->second.lastUsed = millis();
+                body = cached->second.body;
+                stats.cacheHits++;
+                return 200;
+            }
+            if (cached->second.etag.length() || cached->second.lastModified.length()) {
+                etag = cached->second.etag;
+                lastModified = cached->second.lastModified;
+                staleBody = cached->second.body;
+            }
+        }
+
+        auto running = fetchFlights.find(key);
+        if (running != fetchFlights.end()) {
+            flight = running->second;
+            stats.coalesced++;
+        } else {
+            fetchFlights[key] = std::make_shared<fetchFlight>();
+        }
+    }
+
+    if (flight) {
+        // another task is fetching this url already, wait for its response
+        std::unique_lock<std::mutex> lock(flight->lock);
+        flight->cv.wait(lock, [&] { return flight->done; });
+        body = flight->body;
+        return flight->code;
+    }
+
+    fetchOptions options;
+    options.timeout = timeout;
+    fetchCacheEntry entry;
+    String cacheControl;
+    int httpCode = fetchRequest(url, options, etag, lastModified, [&](HTTPClient &http, int code) {
+        cacheControl = http.header("Cache-Control");
+        entry.etag = http.header("ETag");
+        entry.lastModified = http.header("Last-Modified");
+        if (code == 200) entry.body = http.getString();
+    });
+    const bool notModified = httpCode == 304 && staleBody.length();
+    if (notModified) {
+        entry.body = staleBody;
+        if (entry.etag.isEmpty()) entry.etag = etag;
+        if (entry.lastModified.isEmpty()) entry.lastModified = lastModified;
+        httpCode = 200;
+    }
+    body = entry.body;
+
+    time(&now);
+    {
+        std::lock_guard<std::mutex> lock(fetchMutex);
+        if (notModified) stats.notModified++;
+        if (httpCode == 200) {
+            const int32_t age = maxAge(cacheControl);
+            if (age >= 0) {
+                entry.expires = now + age;
+                entry.lastUsed = millis();
+                storeLocked(key, entry);
+            }
+        }
+        flight = fetchFlights[key];
+        fetchFlights.erase(key);
+    }
+    {
+        std::lock_guard<std::mutex> lock(flight->lock);
+        flight->code = httpCode;
+        flight->body = body;
+        flight->done = true;
+    }
+    flight->cv.notify_all();
+    return httpCode;
+}
+
+void fetchStatsToJson(JsonObject &obj) {
+    std::lock_guard<std::mutex> lock(fetchMutex);
+    obj["requests"] = stats.requests;
+    obj["cachehits"] = stats.cacheHits;
+    obj["coalesced"] = stats.coalesced;
+    obj["notmodified"] = stats.notModified;
+    obj["network"] = stats.network;
+    obj["errors"] = stats.errors;
+    obj["cachebytes"] = fetchCacheBytes;
+    obj["hosts"] = fetchHosts.size();
+}
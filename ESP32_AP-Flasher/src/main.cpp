@@ -5,6 +5,7 @@
 
 #include "contentmanager.h"
 #include "flasher.h"
+#include "renderpool.h"
 #include "serialap.h"
 #include "settings.h"
 #include "storage.h"
@@ -131,13 +132,20 @@ void setup() {
     TagData::loadParsers("/parsers.json");
 #endif
 
-    if (!loadDB("/current/tagDB.json")) {
+    if (loadDBbinary()) {
+        cleanupCurrent();
+    } else if (loadDB("/current/tagDB.json")) {
+        // first start after an upgrade, move over to the binary tagDB
+        compactDB();
+        cleanupCurrent();
+    } else {
         Serial.println("unable to load tagDB, reverting to backup");
         loadDB("/current/tagDB.json.bak");
-    } else {
-        cleanupCurrent();
+        // also when there is no tagDB at all, the journal needs a snapshot to go with
+        compactDB();
     }
     xTaskCreate(APTask, "AP Process", 6000, NULL, 5, NULL);
+    initRenderPool();
     vTaskDelay(10 / portTICK_PERIOD_MS);
 
 #ifdef HAS_BLE_WRITER
@@ -180,11 +188,12 @@ void loop() {
         checkVars();
     }
     if (intervalSaveDB.doRun() && config.runStatus != RUNSTATUS_STOP) {
-        saveDB("/current/tagDB.json");
+        journalDB();
     }
     if (intervalContentRunner.doRun() && (apInfo.state == AP_STATE_ONLINE || apInfo.state == AP_STATE_NORADIO)) {
         contentRunner();
     }
+    commitRenders();
 
 #ifdef HAS_TFT
     extern void yellow_ap_display_loop(void);
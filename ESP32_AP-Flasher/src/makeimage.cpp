@@ -1,12 +1,21 @@
 #include <Arduino.h>
 #include <FS.h>
+#include <MD5Builder.h>
 #include <TFT_eSPI.h>
 #include <TJpg_Decoder.h>
 #include <makeimage.h>
 #include <web.h>
 
+#include <array>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
 #include "leds.h"
 #include "miniz-oepl.h"
+#include "renderarena.h"
 #include "storage.h"
 #include "tag_db.h"
 #include "util.h"
@@ -22,28 +31,53 @@
 #endif
 
 TFT_eSPI tft = TFT_eSPI();
-TFT_eSprite spr = TFT_eSprite(&tft);
 
-bool spr_output(int16_t x, int16_t y, uint16_t w, uint16_t h, uint16_t *bitmap) {
-    spr.pushImage(x, y, w, h, bitmap);
+// tallest MCU TJpgDec delivers
+#define JPG_BAND_ROWS 16
+
+// TJpgDec is a single decoder with a plain callback, the render workers take turns
+static std::mutex jpgMutex;
+static TFT_eSprite *jpgTarget = nullptr;
+
+static bool jpgOutput(int16_t x, int16_t y, uint16_t w, uint16_t h, uint16_t *bitmap) {
+    jpgTarget->pushImage(x, y, w, h, bitmap);
     return 1;
 }
 
-void jpg2buffer(String filein, String fileout, imgParam &imageParams) {
+void jpgSize(const String &filename, uint16_t &w, uint16_t &h) {
+    std::lock_guard<std::mutex> lock(jpgMutex);
+    TJpgDec.setJpgScale(1);
+    TJpgDec.getFsJpgSize(&w, &h, filename, *contentFS);
+}
+
+void drawJpg(TFT_eSprite &spr, const String &filename) {
+    std::lock_guard<std::mutex> lock(jpgMutex);
     TJpgDec.setSwapBytes(true);
     TJpgDec.setJpgScale(1);
-    TJpgDec.setCallback(spr_output);
+    TJpgDec.setCallback(jpgOutput);
+    jpgTarget = &spr;
+    TJpgDec.drawFsJpg(0, 0, filename, *contentFS);
+    jpgTarget = nullptr;
+}
+
+static bool jpgStream2file(const String &filein, String &fileout, uint16_t w, uint16_t h, imgParam &imageParams);
+
+void jpg2buffer(String filein, String fileout, imgParam &imageParams) {
     uint16_t w = 0, h = 0;
     if (filein.c_str()[0] != '/') {
         filein = "/" + filein;
     }
-    TJpgDec.getFsJpgSize(&w, &h, filein, *contentFS);
+    jpgSize(filein, w, h);
     if (w == 0 && h == 0) {
         wsErr("invalid jpg");
         return;
     }
     Serial.println("jpeg conversion " + String(w) + "x" + String(h));
 
+    // straight from the decoder to the tag format when the image doesn't have to turn
+    if (jpgStream2file(filein, fileout, w, h, imageParams)) return;
+
+    TFT_eSprite spr = TFT_eSprite(&tft);
 #ifdef BOARD_HAS_PSRAM
     spr.setColorDepth(16);
 #else
@@ -62,7 +96,7 @@ void jpg2buffer(String filein, String fileout, imgParam &imageParams) {
         wsErr("Failed to create sprite in jpg2buffer");
     } else {
         spr.fillSprite(TFT_WHITE);
-        TJpgDec.drawFsJpg(0, 0, filein, *contentFS);
+        drawJpg(spr, filein);
 
         spr2buffer(spr, fileout, imageParams);
         spr.deleteSprite();
@@ -114,177 +148,499 @@ std::tuple<int, int, float, float> findClosestColors(const Color &pixel, const s
     return { closestIndex, secondClosestIndex, closestDist, secondClosestDist};
 }
 
-void spr2color(TFT_eSprite &spr, imgParam &imageParams, uint8_t *buffer, size_t buffer_size, bool is_red) {
-    uint8_t rotate = imageParams.rotate;
-    long bufw = spr.width(), bufh = spr.height();
+struct ditherTap {
+    int8_t dx;
+    uint8_t dy;
+    uint8_t weight;
+};
 
-    if (imageParams.rotatebuffer % 2) {
-        // turn the image 90 or 270
-        rotate = (rotate + 3) % 4;
-        rotate = (rotate + (imageParams.rotatebuffer - 1)) % 4;
-        bufw = spr.height();
-        bufh = spr.width();
+/// @brief Error diffusion kernel, the weights of the taps are in units of 1 / (1 << shift)
+struct ditherKernel {
+    uint8_t shift;
+    uint8_t rows;
+    uint8_t count;
+    ditherTap taps[7];
+};
+
+static const ditherKernel burkesKernel = {5, 2, 7, {{1, 0, 8}, {2, 0, 4}, {-2, 1, 2}, {-1, 1, 4}, {0, 1, 8}, {1, 1, 4}, {2, 1, 2}}};
+static const ditherKernel floydSteinbergKernel = {4, 2, 4, {{1, 0, 7}, {-1, 1, 3}, {0, 1, 5}, {1, 1, 1}}};
+// spreads 6/8 of the error, keeps more contrast
+static const ditherKernel atkinsonKernel = {3, 3, 6, {{1, 0, 1}, {2, 0, 1}, {-1, 1, 1}, {0, 1, 1}, {1, 1, 1}, {0, 2, 1}}};
+static const ditherKernel sierraLiteKernel = {2, 2, 3, {{1, 0, 2}, {-1, 1, 1}, {0, 1, 1}}};
+
+static const ditherKernel *errorKernel(uint8_t dither) {
+    switch (dither) {
+        case DITHER_BURKES:
+            return &burkesKernel;
+        case DITHER_FLOYD_STEINBERG:
+            return &floydSteinbergKernel;
+        case DITHER_ATKINSON:
+            return &atkinsonKernel;
+        case DITHER_SIERRA_LITE:
+            return &sierraLiteKernel;
+    }
+    return nullptr;
+}
+
+// 0..4, how far a colour is from the closest of its two nearest palette colours, picks the ordered dither pattern
+static uint8_t ditherBand(float weight) {
+    if (weight <= 0.03) return 0;
+    if (weight < 0.30) return 1;
+    if (weight < 0.70) return 2;
+    if (weight < 0.97) return 3;
+    return 4;
+}
+
+/// @brief Palette lut entry of an RGB565 colour
+///
+/// bits 0-3: nearest of the first num_colors colours, bits 4-7 and 8-11: the two closest colours for ordered dithering,
+/// bits 12-14: ditherBand(). 0xFFFF is never a valid entry
+static uint16_t paletteEntry(uint16_t rgb565, const std::vector<Color> &palette, int num_colors) {
+    const Color color(rgb565);
+    uint16_t nearest = 0;
+    uint32_t best_color_distance = colorDistance(color, palette[0], (Error){0, 0, 0});
+    for (int i = 1; i < num_colors; i++) {
+        if (best_color_distance == 0) break;
+        uint32_t distance = colorDistance(color, palette[i], (Error){0, 0, 0});
+        if (distance < best_color_distance) {
+            best_color_distance = distance;
+            nearest = i;
+        }
+    }
+    auto [c1Index, c2Index, distC1, distC2] = findClosestColors(color, palette);
+    const uint8_t band = ditherBand(distC1 / (distC1 + distC2));
+    return nearest | (c1Index & 0x0F) << 4 | (c2Index & 0x0F) << 8 | band << 12;
+}
+
+// RGB565 value readPixel() returns for a pixel of an 8 bit sprite
+static const uint16_t *rgb332to565() {
+    static const std::array<uint16_t, 256> table = [] {
+        std::array<uint16_t, 256> t;
+        const uint8_t blue[] = {0, 11, 21, 31};
+        t[0] = 0;
+        for (uint16_t c = 1; c < 256; c++) {
+            t[c] = (c & 0xE0) << 8 | (c & 0xC0) << 5 | (c & 0x1C) << 6 | (c & 0x1C) << 3 | blue[c & 0x03];
+        }
+        return t;
+    }();
+    return table.data();
+}
+
+/// @brief Read one row of the output image from the sprite
+///
+/// The rotation is a walk over the sprite from (sx, sy) in steps of (dx, dy). 8 and 16 bit sprites are read
+/// straight from their buffer, other depths through readPixel(). Pixels outside the sprite read as 0xFFFF, like readPixel() does
+static void readRow(TFT_eSprite &spr, int32_t sx, int32_t sy, int32_t dx, int32_t dy, uint16_t count, uint16_t *row) {
+    const uint32_t w = spr.width(), h = spr.height();
+    const uint8_t depth = spr.getColorDepth();
+    // the first and the last pixel inside the sprite means they all are
+    const bool inside = count && (uint32_t)sx < w && (uint32_t)sy < h && (uint32_t)(sx + (count - 1) * dx) < w && (uint32_t)(sy + (count - 1) * dy) < h;
+    if (depth == 16 && inside) {
+        const uint16_t *img = static_cast<const uint16_t *>(spr.getPointer()) + sx + sy * w;
+        const int32_t step = dx + dy * (int32_t)w;
+        for (uint16_t x = 0; x < count; x++, img += step) {
+            const uint16_t c = *img;
+            row[x] = (c >> 8) | (c << 8);
+        }
+    } else if (depth == 16) {
+        const uint16_t *img = static_cast<const uint16_t *>(spr.getPointer());
+        for (uint16_t x = 0; x < count; x++, sx += dx, sy += dy) {
+            if ((uint32_t)sx < w && (uint32_t)sy < h) {
+                const uint16_t c = img[sx + sy * w];
+                row[x] = (c >> 8) | (c << 8);
+            } else {
+                row[x] = 0xFFFF;
+            }
+        }
+    } else if (depth == 8) {
+        const uint8_t *img = static_cast<const uint8_t *>(spr.getPointer());
+        const uint16_t *table = rgb332to565();
+        for (uint16_t x = 0; x < count; x++, sx += dx, sy += dy) {
+            row[x] = ((uint32_t)sx < w && (uint32_t)sy < h) ? table[img[sx + sy * w]] : 0xFFFF;
+        }
     } else {
-        // rotate 180
-        rotate = (rotate + (imageParams.rotatebuffer)) % 4;
+        for (uint16_t x = 0; x < count; x++, sx += dx, sy += dy) {
+            row[x] = spr.readPixel(sx, sy);
+        }
     }
+}
+
+/// @brief Turns rows of RGB565 pixels into the pixel format of the tag
+///
+/// Rows come in from top to bottom, in the orientation of the tag buffer. The black and the red plane are filled
+/// in the same pass, for 3 and 4 bpp all pixels go to black.
+class pixelQuantizer {
+   public:
+    /// @param width Pixels per row
+    /// @param black Black plane (or packed pixels for 3/4 bpp), nullptr to skip
+    /// @param red Red plane, nullptr to skip. hasRed is set either way
+    /// @param buffer_size Size of one plane
+    pixelQuantizer(imgParam &imageParams, uint16_t width, uint8_t *black, uint8_t *red, size_t buffer_size);
+    ~pixelQuantizer();
+    pixelQuantizer(const pixelQuantizer &) = delete;
+    pixelQuantizer &operator=(const pixelQuantizer &) = delete;
+
+    void addRow(const uint16_t *row);
+
+   private:
+    void addLutRow(const uint16_t *row);
+
+
+    imgParam &imageParams;
+    const uint16_t bufw;
+    uint8_t *black;
+    uint8_t *red;
+    std::vector<Color> palette;
+    int num_colors;
+    const ditherKernel *kernel;
+    std::shared_ptr<uint16_t> lutHolder;
+    uint16_t *lut = nullptr;
+    // palette index of each pixel of the row, for addLutRow()
+    uint8_t *rowIndexes = nullptr;
+    uint16_t stride;
+    int32_t *errorRows = nullptr;
+    bool paletteColor[16] = {false};
+    size_t bitOffset = 0;
+    uint16_t y = 0;
+};
 
-    memset(buffer, 0, buffer_size);
+pixelQuantizer::pixelQuantizer(imgParam &imageParams, uint16_t width, uint8_t *black, uint8_t *red, size_t buffer_size)
+    : imageParams(imageParams), bufw(width), black(black), red(red) {
+    if (black) memset(black, 0, buffer_size);
+    if (red) memset(red, 0, buffer_size);
 
-    std::vector<Color> palette = imageParams.hwdata.colortable;
+    palette = imageParams.hwdata.colortable;
     if (imageParams.invert == 1) {
         std::swap(palette[0], palette[1]);
     }
-    Color color;
-    int num_colors = palette.size();
+    num_colors = palette.size();
     if (imageParams.bufferbpp == 1) num_colors = 2;
-    Error *error_bufferold = new Error[bufw + 4];
-    Error *error_buffernew = new Error[bufw + 4];
 
-    size_t bitOffset = 0;
+    // without error diffusion the colour of a pixel only depends on its RGB565 value
+    kernel = errorKernel(imageParams.dither);
+    // error diffusion works in integers: the error of a row is r, g, b per pixel in 1/256 units, with two pixels
+    // of margin on both sides. Rows are a ring of kernel->rows, the row of y + n lives at (y + n) % rows
+    stride = (bufw + 4) * 3;
+    if (kernel) {
+        errorRows = (int32_t *)arenaAlloc(kernel->rows * stride * sizeof(int32_t), ARENA_SCRATCH);
+        if (errorRows == nullptr) {
+            Serial.println("Failed to allocate the dither rows, no dithering");
+            kernel = nullptr;
+        }
+    }
+    if (kernel == nullptr) {
+        const uint8_t variant = (imageParams.invert == 1 ? 1 : 0) | (num_colors < (int)palette.size() ? 2 : 0);
+        lutHolder = getPaletteLut(imageParams.hwdata.id, variant);
+        lut = lutHolder.get();
+        if (lut) rowIndexes = (uint8_t *)arenaAlloc(bufw, ARENA_SCRATCH);
+        if (rowIndexes == nullptr) lut = nullptr;
+    }
 
-    memset(error_bufferold, 0, bufw * sizeof(Error));
-    for (uint16_t y = 0; y < bufh; y++) {
-        memset(error_buffernew, 0, bufw * sizeof(Error));
-        for (uint16_t x = 0; x < bufw; x++) {
-            switch (rotate) {
+    if (kernel) {
+        memset(errorRows, 0, kernel->rows * stride * sizeof(int32_t));
+        for (int i = 0; i < num_colors && i < 16; i++) {
+            paletteColor[i] = abs(palette[i].r - palette[i].g) > 20 || abs(palette[i].b - palette[i].g) > 20;
+        }
+    }
+}
+
+pixelQuantizer::~pixelQuantizer() {
+    arenaFree(errorRows);
+    arenaFree(rowIndexes);
+}
+
+// Without error diffusion every pixel is a lut lookup, the row of palette indexes is then packed into the planes a
+// byte at a time
+void pixelQuantizer::addLutRow(const uint16_t *row) {
+    // members copied to locals, the byte stores below could alias them and make the compiler reload them per pixel
+    uint16_t *table = lut;
+    uint8_t *index = rowIndexes;
+    uint8_t *blackPlane = black;
+    uint8_t *redPlane = red;
+    const uint16_t width = bufw;
+    if (imageParams.dither == DITHER_ORDERED) {
+        // the second colour is taken for band b when bit b of the mask of the x parity is set
+        uint8_t secondMask[2];
+        for (uint8_t parity = 0; parity < 2; parity++) {
+            const bool checker = y % 2 && ((y / 2 + parity) % 2);
+            secondMask[parity] = (checker ? 1 << 1 : 0) | ((parity + y) % 2 ? 1 << 2 : 0) | (checker ? 0 : 1 << 3) | 1 << 4;
+        }
+        for (uint16_t x = 0; x < width; x++) {
+            uint16_t entry = table[row[x]];
+            if (entry == 0xFFFF) entry = table[row[x]] = paletteEntry(row[x], palette, num_colors);
+            const uint8_t second = (secondMask[x & 1] >> (entry >> 12)) & 1;
+            index[x] = (entry >> (4 + 4 * second)) & 0x0F;
+        }
+    } else {
+        for (uint16_t x = 0; x < width; x++) {
+            uint16_t entry = table[row[x]];
+            if (entry == 0xFFFF) entry = table[row[x]] = paletteEntry(row[x], palette, num_colors);
+            index[x] = entry & 0x0F;
+        }
+    }
+
+    if (imageParams.bpp == 3 || imageParams.bpp == 4) {
+        // packed pixels run on from the previous row, bits are or'ed in like the planes were cleared
+        const uint8_t bpp = imageParams.bpp;
+        size_t byteIndex = bitOffset / 8;
+        uint32_t bits = 0;
+        uint8_t count = bitOffset % 8;
+        uint16_t x = 0;
+        if (bpp == 4 && count == 0 && blackPlane) {
+            for (; x + 2 <= width; x += 2) blackPlane[byteIndex++] |= index[x] << 4 | index[x + 1];
+        }
+        for (; x < width; x++) {
+            bits = bits << bpp | index[x];
+            count += bpp;
+            if (count >= 8) {
+                count -= 8;
+                if (blackPlane) blackPlane[byteIndex] |= bits >> count;
+                byteIndex++;
+                bits &= (1 << count) - 1;
+            }
+        }
+        if (count && blackPlane) blackPlane[byteIndex] |= bits << (8 - count);
+        bitOffset += width * bpp;
+        y++;
+        return;
+    }
+
+    // index 1 is black, 2 red and 3 both, like the switch of addRow()
+    const uint32_t rowOffset = y * width;
+    size_t byteIndex = rowOffset / 8;
+    uint8_t count = rowOffset % 8;
+    uint8_t blackBits = 0, redBits = 0, anyRed = 0;
+    uint16_t x = 0;
+    if (count == 0 && num_colors <= 4) {
+        // whole bytes, the usual case. The multiply gathers bit 0 of 8 little endian bytes into one byte, first pixel
+        // in the top bit
+        for (; x + 8 <= width; x += 8, byteIndex++) {
+            uint64_t indexes;
+            memcpy(&indexes, index + x, sizeof(indexes));
+            blackBits = ((indexes & 0x0101010101010101ULL) * 0x8040201008040201ULL) >> 56;
+            redBits = (((indexes >> 1) & 0x0101010101010101ULL) * 0x8040201008040201ULL) >> 56;
+            if (blackPlane) blackPlane[byteIndex] |= blackBits;
+            if (redPlane) redPlane[byteIndex] |= redBits;
+            anyRed |= redBits;
+        }
+        blackBits = redBits = 0;
+    }
+    for (; x < width; x++) {
+        const uint8_t i = index[x] < 4 ? index[x] : 0;
+        blackBits = blackBits << 1 | (i & 1);
+        redBits = redBits << 1 | (i >> 1);
+        if (++count == 8) {
+            if (blackPlane) blackPlane[byteIndex] |= blackBits;
+            if (redPlane) redPlane[byteIndex] |= redBits;
+            anyRed |= redBits;
+            byteIndex++;
+            count = 0;
+            blackBits = redBits = 0;
+        }
+    }
+    if (count) {
+        if (blackPlane) blackPlane[byteIndex] |= blackBits << (8 - count);
+        if (redPlane) redPlane[byteIndex] |= redBits << (8 - count);
+        anyRed |= redBits;
+    }
+    if (anyRed) imageParams.hasRed = true;
+    y++;
+}
+
+void pixelQuantizer::addRow(const uint16_t *row) {
+    if (lut && !kernel) {
+        addLutRow(row);
+        return;
+    }
+    const uint32_t rowOffset = y * bufw;
+    int32_t *tapRows[3] = {nullptr};
+    for (uint8_t r = 0; kernel && r < kernel->rows; r++) tapRows[r] = errorRows + ((y + r) % kernel->rows) * stride;
+    int32_t *errorRow = tapRows[0];
+    for (uint16_t x = 0; x < bufw; x++) {
+        const Color color(row[x]);
+
+        uint16_t entry = 0;
+        if (lut) {
+            entry = lut[row[x]];
+            if (entry == 0xFFFF) {
+                entry = paletteEntry(row[x], palette, num_colors);
+                lut[row[x]] = entry;
+            }
+        }
+
+        int best_color_index = 0;
+        if (imageParams.dither == DITHER_ORDERED) {
+            // special ordered dithering
+            int c1Index, c2Index;
+            uint8_t band;
+            if (lut) {
+                c1Index = (entry >> 4) & 0x0F;
+                c2Index = (entry >> 8) & 0x0F;
+                band = entry >> 12;
+            } else {
+                auto [closest, secondClosest, distC1, distC2] = findClosestColors(color, palette);
+                c1Index = closest;
+                c2Index = secondClosest;
+                band = ditherBand(distC1 / (distC1 + distC2));
+            }
+            switch (band) {
                 case 0:
-                    color = Color(spr.readPixel(x, y));
+                    best_color_index = c1Index;
                     break;
                 case 1:
-                    color = Color(spr.readPixel(y, bufw - 1 - x));
+                    best_color_index = ((y % 2 && ((y / 2 + x) % 2)) ? c2Index : c1Index);
                     break;
                 case 2:
-                    color = Color(spr.readPixel(bufw - 1 - x, bufh - 1 - y));
+                    best_color_index = ((x + y) % 2 ? c2Index : c1Index);
                     break;
                 case 3:
-                    color = Color(spr.readPixel(bufh - 1 - y, x));
-                    break;
-            }
-
-            int best_color_index = 0;
-            if (imageParams.dither == 2) {
-                // special ordered dithering
-                auto [c1Index, c2Index, distC1, distC2] = findClosestColors(color, palette);
-                Color c1 = palette[c1Index];
-                Color c2 = palette[c2Index];
-                float weight = distC1 / (distC1 + distC2);
-                if (weight <= 0.03) {
-                    best_color_index = c1Index;
-                } else if (weight < 0.30) {
-                    best_color_index = ((y % 2 && ((y / 2 + x) % 2)) ? c2Index : c1Index);
-                } else if (weight < 0.70) {
-                    best_color_index = ((x + y) % 2 ? c2Index : c1Index);
-                } else if (weight < 0.97) {
                     best_color_index = ((y % 2 && ((y / 2 + x) % 2)) % 2 ? c1Index : c2Index);
-                } else {
+                    break;
+                default:
                     best_color_index = c2Index;
-                }
+                    break;
             }
+        } else if (imageParams.dither == DITHER_NONE && lut) {
+            best_color_index = entry & 0x0F;
+        }
 
-            if (imageParams.dither == 1 || imageParams.dither == 0) {
-                uint32_t best_color_distance = colorDistance(color, palette[0], error_bufferold[x]);
-
-                for (int i = 1; i < num_colors; i++) {
-                    if (best_color_distance == 0) break;
-                    uint32_t distance = colorDistance(color, palette[i], error_bufferold[x]);
-                    if (distance < best_color_distance) {
-                        best_color_distance = distance;
-                        best_color_index = i;
-                    }
+        int32_t *error = kernel ? errorRow + (x + 2) * 3 : nullptr;
+        if (kernel) {
+            // nearest palette colour to the pixel plus its diffused error, a grey pixel never becomes a colour
+            const int32_t r = color.r + ((error[0] + 128) >> 8);
+            const int32_t g = color.g + ((error[1] + 128) >> 8);
+            const int32_t b = color.b + ((error[2] + 128) >> 8);
+            const bool grey = abs(color.r - color.g) < 20 && abs(color.b - color.g) < 20;
+            uint32_t best_color_distance = UINT32_MAX;
+            for (int i = 0; i < num_colors; i++) {
+                if (grey && paletteColor[i & 0x0F]) continue;
+                const int32_t r_diff = r - palette[i].r;
+                const int32_t g_diff = g - palette[i].g;
+                const int32_t b_diff = b - palette[i].b;
+                const uint32_t distance = 300 * r_diff * r_diff + 547 * g_diff * g_diff + 153 * b_diff * b_diff;
+                if (distance < best_color_distance) {
+                    best_color_distance = distance;
+                    best_color_index = i;
+                    if (distance == 0) break;
                 }
             }
-
-            if (imageParams.bpp == 3 || imageParams.bpp == 4) {
-                size_t byteIndex = bitOffset / 8;
-                uint8_t bitIndex = bitOffset % 8;
-
-                if (bitIndex + imageParams.bpp <= 8) {
-                    buffer[byteIndex] |= best_color_index << (8 - bitIndex - imageParams.bpp);
-                } else {
-                    uint8_t highPart = best_color_index >> (bitIndex + imageParams.bpp - 8);
-                    uint8_t lowPart = best_color_index & ((1 << (bitIndex + imageParams.bpp - 8)) - 1);
-                    buffer[byteIndex] |= highPart;
-                    buffer[byteIndex + 1] |= lowPart << (8 - (bitIndex + imageParams.bpp - 8));
-                }
-                bitOffset += imageParams.bpp;
-            } else {
-                uint8_t bitIndex = 7 - (x % 8);
-                uint32_t byteIndex = (y * bufw + x) / 8;
-
-                // this looks a bit ugly, but it's performing better than shorter notations
-                switch (best_color_index) {
-                    case 1:
-                        if (!is_red)
-                            buffer[byteIndex] |= (1 << bitIndex);
-                        break;
-                    case 2:
-                        imageParams.hasRed = true;
-                        if (is_red)
-                            buffer[byteIndex] |= (1 << bitIndex);
-                        break;
-                    case 3:
-                        imageParams.hasRed = true;
-                        buffer[byteIndex] |= (1 << bitIndex);
-                        break;
+        } else if (imageParams.dither == DITHER_NONE && !lut) {
+            uint32_t best_color_distance = colorDistance(color, palette[0], (Error){0, 0, 0});
+
+            for (int i = 1; i < num_colors; i++) {
+                if (best_color_distance == 0) break;
+                uint32_t distance = colorDistance(color, palette[i], (Error){0, 0, 0});
+                if (distance < best_color_distance) {
+                    best_color_distance = distance;
+                    best_color_index = i;
                 }
             }
+        }
 
-            if (imageParams.dither == 1) {
-                // Burkes Dithering
-
-                Error error = {
-                    color.r + error_bufferold[x].r - palette[best_color_index].r,
-                    color.g + error_bufferold[x].g - palette[best_color_index].g,
-                    color.b + error_bufferold[x].b - palette[best_color_index].b};
-
-                float scaling_factor = 255.0f / std::max(std::abs(error.r), std::max(std::abs(error.g), std::abs(error.b)));
-                if (scaling_factor < 1.0f) {
-                    error.r *= scaling_factor;
-                    error.g *= scaling_factor;
-                    error.b *= scaling_factor;
-                }
-
-                error_buffernew[x].r += error.r / 4;
-                error_buffernew[x].g += error.g / 4;
-                error_buffernew[x].b += error.b / 4;
-
-                if (x > 0) {
-                    error_buffernew[x - 1].r += error.r / 8;
-                    error_buffernew[x - 1].g += error.g / 8;
-                    error_buffernew[x - 1].b += error.b / 8;
-                }
-
-                if (x > 1) {
-                    error_buffernew[x - 2].r += error.r / 16;
-                    error_buffernew[x - 2].g += error.g / 16;
-                    error_buffernew[x - 2].b += error.b / 16;
-                }
-
-                error_buffernew[x + 1].r += error.r / 8;
-                error_buffernew[x + 1].g += error.g / 8;
-                error_buffernew[x + 1].b += error.b / 8;
-
-                error_bufferold[x + 1].r += error.r / 4;
-                error_bufferold[x + 1].g += error.g / 4;
-                error_bufferold[x + 1].b += error.b / 4;
+        if (imageParams.bpp == 3 || imageParams.bpp == 4) {
+            size_t byteIndex = bitOffset / 8;
+            uint8_t bitIndex = bitOffset % 8;
+
+            if (black && bitIndex + imageParams.bpp <= 8) {
+                black[byteIndex] |= best_color_index << (8 - bitIndex - imageParams.bpp);
+            } else if (black) {
+                uint8_t highPart = best_color_index >> (bitIndex + imageParams.bpp - 8);
+                uint8_t lowPart = best_color_index & ((1 << (bitIndex + imageParams.bpp - 8)) - 1);
+                black[byteIndex] |= highPart;
+                black[byteIndex + 1] |= lowPart << (8 - (bitIndex + imageParams.bpp - 8));
+            }
+            bitOffset += imageParams.bpp;
+        } else if (best_color_index) {
+            const uint8_t bit = 1 << (7 - (x % 8));
+            const uint32_t byteIndex = (rowOffset + x) / 8;
 
-                error_buffernew[x + 2].r += error.r / 16;
-                error_buffernew[x + 2].g += error.g / 16;
-                error_buffernew[x + 2].b += error.b / 16;
+            // this looks a bit ugly, but it's performing better than shorter notations
+            switch (best_color_index) {
+                case 1:
+                    if (black) black[byteIndex] |= bit;
+                    break;
+                case 2:
+                    imageParams.hasRed = true;
+                    if (red) red[byteIndex] |= bit;
+                    break;
+                case 3:
+                    imageParams.hasRed = true;
+                    if (black) black[byteIndex] |= bit;
+                    if (red) red[byteIndex] |= bit;
+                    break;
+            }
+        }
 
-                error_bufferold[x + 2].r += error.r / 8;
-                error_bufferold[x + 2].g += error.g / 8;
-                error_bufferold[x + 2].b += error.b / 8;
+        if (kernel) {
+            // error in 1/256 units, scaled down to at most 255 on its largest channel
+            const Color &chosen = palette[best_color_index];
+            int32_t e[3] = {(color.r - chosen.r) * 256 + error[0], (color.g - chosen.g) * 256 + error[1], (color.b - chosen.b) * 256 + error[2]};
+            const int32_t largest = std::max(std::abs(e[0]), std::max(std::abs(e[1]), std::abs(e[2])));
+            if (largest > 255 * 256) {
+                for (int c = 0; c < 3; c++) e[c] = (int64_t)e[c] * (255 * 256) / largest;
+            }
+            for (uint8_t t = 0; t < kernel->count; t++) {
+                const ditherTap &tap = kernel->taps[t];
+                int32_t *target = tapRows[tap.dy] + (x + 2 + tap.dx) * 3;
+                target[0] += (e[0] * tap.weight) >> kernel->shift;
+                target[1] += (e[1] * tap.weight) >> kernel->shift;
+                target[2] += (e[2] * tap.weight) >> kernel->shift;
             }
         }
-        memcpy(error_bufferold, error_buffernew, bufw * sizeof(Error));
     }
+    // this row comes back as y + rows
+    if (kernel) memset(errorRow, 0, stride * sizeof(int32_t));
+    y++;
+}
 
-    delete[] error_buffernew;
-    delete[] error_bufferold;
+/// @brief Convert a sprite to the pixel format of the tag
+///
+/// @param black Black plane (or packed pixels for 3/4 bpp), nullptr to skip
+/// @param red Red plane, nullptr to skip. hasRed is set either way
+/// @param buffer_size Size of one plane
+void spr2color(TFT_eSprite &spr, imgParam &imageParams, uint8_t *black, uint8_t *red, size_t buffer_size) {
+    uint8_t rotate = imageParams.rotate;
+    long bufw = spr.width(), bufh = spr.height();
 
-    return;
+    if (imageParams.rotatebuffer % 2) {
+        // turn the image 90 or 270
+        rotate = (rotate + 3) % 4;
+        rotate = (rotate + (imageParams.rotatebuffer - 1)) % 4;
+        bufw = spr.height();
+        bufh = spr.width();
+    } else {
+        // rotate 180
+        rotate = (rotate + (imageParams.rotatebuffer)) % 4;
+    }
+
+    // the output row y is a line through the sprite starting at (sx0 + y * sxy, sy0 + y * syy), walking (dx, dy) per pixel
+    int32_t sx0, sy0, sxy, syy, dx, dy;
+    switch (rotate) {
+        case 1:
+            sx0 = 0, sy0 = bufw - 1, sxy = 1, syy = 0, dx = 0, dy = -1;
+            break;
+        case 2:
+            sx0 = bufw - 1, sy0 = bufh - 1, sxy = 0, syy = -1, dx = -1, dy = 0;
+            break;
+        case 3:
+            sx0 = bufh - 1, sy0 = 0, sxy = -1, syy = 0, dx = 0, dy = 1;
+            break;
+        default:
+            sx0 = 0, sy0 = 0, sxy = 0, syy = 1, dx = 1, dy = 0;
+            break;
+    }
+
+    pixelQuantizer quantizer(imageParams, bufw, black, red, buffer_size);
+    uint16_t *row = (uint16_t *)arenaAlloc(bufw * sizeof(uint16_t), ARENA_SCRATCH);
+    if (row == nullptr) {
+        Serial.println("Failed to allocate a sprite row");
+        return;
+    }
+    for (uint16_t y = 0; y < bufh; y++) {
+        readRow(spr, sx0 + y * sxy, sy0 + y * syy, dx, dy, bufw, row);
+        quantizer.addRow(row);
+    }
+    arenaFree(row);
 }
 
 size_t prepareHeader(uint8_t headerbuf[], uint16_t bufw, uint16_t bufh, imgParam imageParams, size_t buffer_size) {
@@ -313,19 +669,15 @@ bool initializeCompressor(Miniz::tdefl_compressor *comp, int flags) {
     return Miniz::tdefl_initOEPL(comp, NULL, NULL, flags) == Miniz::TDEFL_STATUS_OKAY;
 }
 
-size_t compressAndWrite(Miniz::tdefl_compressor *comp, const void *inbuf, size_t inbytes, void *zlibbuf, size_t outsize, size_t totalbytes, File &f_out, Miniz::tdefl_flush flush) {
+size_t compressChunk(Miniz::tdefl_compressor *comp, const void *inbuf, size_t inbytes, void *zlibbuf, size_t outsize, Miniz::tdefl_flush flush) {
     size_t inbytes_compressed = inbytes;
     size_t outbytes_compressed = outsize;
 
-    uint32_t t = millis();
     Miniz::tdefl_compressOEPL(comp, inbuf, &inbytes_compressed, zlibbuf, &outbytes_compressed, flush);
-    Serial.printf("zlib: compressed %d into %d bytes in %d ms\r\n", inbytes_compressed, outbytes_compressed, millis() - t);
-
-    f_out.write((const uint8_t *)zlibbuf, outbytes_compressed);
     return outbytes_compressed;
 }
 
-void rewriteHeader(File &f_out) {
+void rewriteHeader(uint8_t *zlibstream) {
     // https://www.rfc-editor.org/rfc/rfc1950
     const uint8_t cmf = 0x48;  // 4096
     // const uint8_t cmf = 0x58; // 8192
@@ -333,16 +685,15 @@ void rewriteHeader(File &f_out) {
     uint16_t header = cmf << 8 | (flevel << 6);
     header += 31 - (header % 31);
     flg = header & 0xFF;
-    f_out.seek(4);
-    f_out.write(cmf);
-    f_out.write(flg);
+    zlibstream[0] = cmf;
+    zlibstream[1] = flg;
 }
 
 #ifndef SAVE_SPACE
 uint8_t *g5Compress(uint16_t width, uint16_t height, uint8_t *buffer, uint16_t buffersize, uint16_t &outBufferSize) {
     G5ENCIMAGE g5enc;
     int rc;
-    uint8_t *outbuffer = (uint8_t *)ps_malloc(buffersize+16384);
+    uint8_t *outbuffer = (uint8_t *)arenaAlloc(buffersize + 16384, ARENA_SCRATCH);
     if (outbuffer == NULL) {
         Serial.println("Failed to allocate the output buffer for the G5 encoder");
         return nullptr;
@@ -358,13 +709,688 @@ uint8_t *g5Compress(uint16_t width, uint16_t height, uint8_t *buffer, uint16_t b
         outBufferSize = g5_encode_getOutSize(&g5enc);
     } else {
         printf("Encode failed! rc=%d\n", rc);
-        free(outbuffer);
+        arenaFree(outbuffer);
         return nullptr;
     }
     return outbuffer;
 }
 #endif
 
+/// @brief Allocate the planes spr2color() fills for an image of bufw x bufh
+///
+/// For 2bpp the red plane sits right behind the black one when there is room for it, red is nullptr otherwise
+/// @return false if there is no memory for the image
+static bool allocPlanes(imgParam &imageParams, long bufw, long bufh, uint8_t *&buffer, uint8_t *&red, size_t &buffer_size) {
+    buffer = nullptr;
+    red = nullptr;
+    if (imageParams.bpp == 3 || imageParams.bpp == 4) {
+        buffer_size = (bufw * bufh) / 8 * imageParams.bpp;
+        buffer = (uint8_t *)arenaAlloc(buffer_size, ARENA_OUTPUT);
+    } else {
+        buffer_size = (bufw * bufh) / 8;
+        // one byte more, the G5 encoder reads a byte past the end of the last line
+        if (imageParams.bpp == 2) buffer = (uint8_t *)arenaAlloc(2 * buffer_size + 1, ARENA_OUTPUT);
+        red = buffer ? buffer + buffer_size : nullptr;
+        if (!buffer) buffer = (uint8_t *)arenaAlloc(buffer_size + 1, ARENA_OUTPUT);
+#ifndef BOARD_HAS_PSRAM
+        imageParams.zlib = 0;
+        imageParams.g5 = 0;
+#endif
+    }
+    if (!buffer) {
+        Serial.println("Failed to allocate buffer");
+        util::printLargestFreeBlock();
+        return false;
+    }
+    return true;
+}
+
+static const char *codecNames[CODEC_COUNT] = {"raw", "zlib", "g5", "delta"};
+
+// which codec made the smallest images of a content mode lately
+struct codecHistory {
+    uint8_t winner;
+    uint8_t streak;
+    uint8_t untested;
+};
+
+static std::mutex codecMutex;
+static codecHistory codecHistories[256] = {0};
+static codecStats encodeStats = {0};
+
+// deflate settings zlibEncode() tries, the smallest stream is sent. The tag inflates with a 4 KB window
+struct zlibProfile {
+    const char *name;
+    int flags;
+    bool rowXor;
+};
+
+static const zlibProfile zlibProfiles[] = {
+    // 1500 = unofficial level 10, lazy matching
+    {"lazy", 1500, false},
+    // distance 1 matches only, wins on text and dithered photos
+    {"rle", 16 | Miniz::TDEFL_RLE_MATCHES, false},
+    // rows xored with the row above, wins on grids, tables and qr codes
+    {"xor", 64, true},
+    {"xor rle", 16 | Miniz::TDEFL_RLE_MATCHES, true},
+};
+
+// dst gets every row of a plane xored with the row above it, identical rows turn into zeros
+static void xorRows(uint8_t *dst, const uint8_t *src, size_t planeSize, size_t rowBytes) {
+    memcpy(dst, src, rowBytes);
+    for (size_t i = rowBytes; i < planeSize; i++) dst[i] = src[i] ^ src[i - rowBytes];
+}
+
+// One deflate run over the header and the planes, returns the size of the stream in out.
+// With red nullptr the black plane is reused for the red pass
+static size_t zlibDeflate(Miniz::tdefl_compressor *comp, int flags, const uint8_t *headerbuf, uint8_t *black, uint8_t *red, size_t buffer_size, uint8_t *out, size_t capacity, const std::function<void(uint8_t *)> &redPass) {
+    if (!initializeCompressor(comp, Miniz::TDEFL_WRITE_ZLIB_HEADER | flags)) return 0;
+    const bool twoPlanes = (headerbuf[5] & ~ZLIB_ROW_XOR) == 2;
+    size_t size = compressChunk(comp, headerbuf, 6, out, capacity, Miniz::TDEFL_NO_FLUSH);
+    size += compressChunk(comp, black, buffer_size, out + size, capacity - size, twoPlanes ? Miniz::TDEFL_SYNC_FLUSH : Miniz::TDEFL_FINISH);
+    if (twoPlanes) {
+        if (!red) {
+            red = black;
+            redPass(red);
+        }
+        size += compressChunk(comp, red, buffer_size, out + size, capacity - size, Miniz::TDEFL_FINISH);
+    }
+    rewriteHeader(out);
+    return size;
+}
+
+/// zlib stream of the planes behind the 4 byte length the tag expects, nullptr on failure.
+/// Each of zlibProfiles is tried and the smallest stream is kept. With red nullptr the black plane is reused
+/// for the red pass, so there is only one go with the first profile
+static uint8_t *zlibEncode(imgParam &imageParams, long bufw, long bufh, uint8_t *buffer, uint8_t *red, size_t buffer_size, const std::function<void(uint8_t *)> &redPass, size_t &outSize) {
+    uint8_t headerbuf[6];
+    uint32_t totalbytes = prepareHeader(headerbuf, bufw, bufh, imageParams, buffer_size);
+    const bool twoPlanes = headerbuf[5] == 2;
+    const size_t capacity = totalbytes * 1.3;
+    Miniz::tdefl_compressor *comp = (Miniz::tdefl_compressor *)arenaAlloc(sizeof(Miniz::tdefl_compressor), ARENA_SCRATCH);
+    uint8_t *out = (uint8_t *)arenaAlloc(sizeof(uint32_t) + capacity, ARENA_OUTPUT);
+    if (comp == NULL || out == NULL) {
+        Serial.println("Failed to initialize compressor or allocate memory for zlib");
+        arenaFree(out);
+        arenaFree(comp);
+        return nullptr;
+    }
+
+    uint32_t t = millis();
+    uint8_t best = 0;
+    outSize = 0;
+    if (twoPlanes && !red) {
+        outSize = zlibDeflate(comp, zlibProfiles[0].flags, headerbuf, buffer, nullptr, buffer_size, out + sizeof(uint32_t), capacity, redPass);
+    } else {
+        const size_t planes = twoPlanes ? 2 : 1;
+        uint8_t *first = out;
+        uint8_t *trial = (uint8_t *)arenaAlloc(sizeof(uint32_t) + capacity, ARENA_OUTPUT);
+        uint8_t *xored = nullptr;
+        for (uint8_t i = 0; i < sizeof(zlibProfiles) / sizeof(zlibProfiles[0]); i++) {
+            const zlibProfile &profile = zlibProfiles[i];
+            uint8_t *target = outSize ? trial : out;
+            if (target == nullptr) break;
+            uint8_t header[6];
+            memcpy(header, headerbuf, sizeof(header));
+            uint8_t *black = buffer;
+            uint8_t *planeRed = red;
+            if (profile.rowXor) {
+                if (!imageParams.zlibXor) continue;
+                if (xored == nullptr) {
+                    const size_t rowBytes = (imageParams.rotatebuffer % 2 ? bufh : bufw) / 8;
+                    xored = (uint8_t *)arenaAlloc(planes * buffer_size, ARENA_SCRATCH);
+                    if (xored == nullptr) break;
+                    xorRows(xored, buffer, buffer_size, rowBytes);
+                    if (twoPlanes) xorRows(xored + buffer_size, red, buffer_size, rowBytes);
+                }
+                black = xored;
+                planeRed = xored + buffer_size;
+                header[5] |= ZLIB_ROW_XOR;
+            }
+            const size_t size = zlibDeflate(comp, profile.flags, header, black, planeRed, buffer_size, target + sizeof(uint32_t), capacity, redPass);
+            if (size && (outSize == 0 || size < outSize)) {
+                outSize = size;
+                best = i;
+                if (target == trial) std::swap(out, trial);
+            }
+        }
+        if (out != first) {
+            // keep the stream in the first buffer, so the trial buffer above it goes back to the arena
+            memcpy(first + sizeof(uint32_t), out + sizeof(uint32_t), outSize);
+            std::swap(out, trial);
+        }
+        arenaFree(xored);
+        arenaFree(trial);
+    }
+    arenaFree(comp);
+    if (outSize == 0) {
+        Serial.println("Failed to compress zlib");
+        arenaFree(out);
+        return nullptr;
+    }
+
+    memcpy(out, &totalbytes, sizeof(uint32_t));
+    outSize += sizeof(uint32_t);
+    uint8_t *shrunk = (uint8_t *)arenaRealloc(out, outSize);
+    if (shrunk) out = shrunk;
+    Serial.printf("zlib: compressed %d into %d bytes with %s in %d ms\r\n", totalbytes, outSize, zlibProfiles[best].name, millis() - t);
+    return out;
+}
+
+// planes of an image a delta-capable tag got, by data version
+struct deltaBase {
+    std::shared_ptr<uint8_t> planes;
+    uint32_t size;
+    uint32_t lastUsed;
+};
+
+static std::mutex deltaMutex;
+static std::unordered_map<uint64_t, deltaBase> deltaBases;
+static uint32_t deltaBaseBytes = 0;
+
+static std::shared_ptr<uint8_t> findDeltaBase(uint64_t dataVer, size_t size) {
+    std::lock_guard<std::mutex> lock(deltaMutex);
+    auto it = deltaBases.find(dataVer);
+    if (it == deltaBases.end() || it->second.size != size) return nullptr;
+    it->second.lastUsed = millis();
+    return it->second.planes;
+}
+
+// keeps a copy of the planes, the oldest bases make room for it
+static void keepDeltaBase(uint64_t dataVer, const uint8_t *black, const uint8_t *red, size_t buffer_size) {
+    const uint32_t size = red ? 2 * buffer_size : buffer_size;
+    if (size > DELTA_BASE_BYTES / 4) return;
+    uint8_t *planes = (uint8_t *)ps_malloc(size);
+    if (planes == nullptr) return;
+    memcpy(planes, black, buffer_size);
+    if (red) memcpy(planes + buffer_size, red, buffer_size);
+
+    std::lock_guard<std::mutex> lock(deltaMutex);
+    auto it = deltaBases.find(dataVer);
+    if (it != deltaBases.end()) {
+        deltaBaseBytes -= it->second.size;
+        deltaBases.erase(it);
+    }
+    while (!deltaBases.empty() && deltaBaseBytes + size > DELTA_BASE_BYTES) {
+        auto oldest = std::min_element(deltaBases.begin(), deltaBases.end(), [](const auto &a, const auto &b) {
+            return a.second.lastUsed < b.second.lastUsed;
+        });
+        deltaBaseBytes -= oldest->second.size;
+        deltaBases.erase(oldest);
+    }
+    deltaBases[dataVer] = {std::shared_ptr<uint8_t>(planes, free), size, millis()};
+    deltaBaseBytes += size;
+}
+
+bool deltaBaseToFile(uint64_t dataVer, const String &path) {
+    deltaBase base;
+    {
+        std::lock_guard<std::mutex> lock(deltaMutex);
+        auto it = deltaBases.find(dataVer);
+        if (it == deltaBases.end()) return false;
+        base = it->second;
+    }
+    fs::File file = contentFS->open(path, "w");
+    if (!file) return false;
+    const size_t written = file.write(base.planes.get(), base.size);
+    file.close();
+    return written == base.size;
+}
+
+// writes the header of a changed region and the xor of its bytes in each plane, returns the end of it
+static uint8_t *deltaRegion(uint8_t *out, const uint8_t *planes, const uint8_t *base, size_t buffer_size, uint8_t planeCount, size_t rowBytes, uint16_t firstRow, uint16_t rows, uint16_t firstByte, uint16_t bytes) {
+    const uint16_t region[4] = {firstRow, rows, firstByte, bytes};
+    memcpy(out, region, sizeof(region));
+    out += sizeof(region);
+    for (uint8_t plane = 0; plane < planeCount; plane++) {
+        for (uint16_t y = firstRow; y < firstRow + rows; y++) {
+            const size_t offset = plane * buffer_size + y * rowBytes + firstByte;
+            for (uint16_t x = 0; x < bytes; x++) *out++ = planes[offset + x] ^ base[offset + x];
+        }
+    }
+    return out;
+}
+
+/// zlib stream of the changes against base, behind the 4 byte length the tag expects. nullptr on failure.
+/// Changed rows closer than DELTA_ROW_GAP are one region, as wide as the widest change in it
+static uint8_t *deltaEncode(imgParam &imageParams, long bufw, long bufh, const uint8_t *planes, const uint8_t *base, size_t buffer_size, uint8_t planeCount, size_t &outSize) {
+    uint8_t headerbuf[14];
+    prepareHeader(headerbuf, bufw, bufh, imageParams, buffer_size);
+    headerbuf[0] = sizeof(headerbuf);
+    headerbuf[5] |= ZLIB_DELTA;
+    memcpy(headerbuf + 6, &imageParams.baseVer, sizeof(uint64_t));
+
+    const size_t rowBytes = (imageParams.rotatebuffer % 2 ? bufh : bufw) / 8;
+    const uint16_t rowCount = buffer_size / rowBytes;
+    // worst case every row is a region of its own, plus all planes
+    uint8_t *payload = (uint8_t *)arenaAlloc(sizeof(headerbuf) + rowCount * 4 * sizeof(uint16_t) + planeCount * buffer_size, ARENA_SCRATCH);
+    if (payload == nullptr) return nullptr;
+    memcpy(payload, headerbuf, sizeof(headerbuf));
+    uint8_t *end = payload + sizeof(headerbuf);
+
+    int32_t firstRow = -1;
+    uint16_t lastRow = 0, low = 0, high = 0;
+    for (uint16_t y = 0; y < rowCount; y++) {
+        int32_t rowLow = -1, rowHigh = -1;
+        for (uint8_t plane = 0; plane < planeCount; plane++) {
+            const size_t offset = plane * buffer_size + y * rowBytes;
+            for (size_t x = 0; x < rowBytes; x++) {
+                if (planes[offset + x] == base[offset + x]) continue;
+                if (rowLow < 0 || (int32_t)x < rowLow) rowLow = x;
+                break;
+            }
+            for (size_t x = rowBytes; x-- > 0;) {
+                if (planes[offset + x] == base[offset + x]) continue;
+                if ((int32_t)x > rowHigh) rowHigh = x;
+                break;
+            }
+        }
+        if (rowLow < 0) {
+            if (firstRow >= 0 && y - lastRow > DELTA_ROW_GAP) {
+                end = deltaRegion(end, planes, base, buffer_size, planeCount, rowBytes, firstRow, lastRow - firstRow + 1, low, high - low + 1);
+                firstRow = -1;
+            }
+            continue;
+        }
+        if (firstRow < 0) {
+            firstRow = y;
+            low = rowLow;
+            high = rowHigh;
+        } else {
+            low = std::min<uint16_t>(low, rowLow);
+            high = std::max<uint16_t>(high, rowHigh);
+        }
+        lastRow = y;
+    }
+    if (firstRow >= 0) end = deltaRegion(end, planes, base, buffer_size, planeCount, rowBytes, firstRow, lastRow - firstRow + 1, low, high - low + 1);
+
+    const uint32_t payloadSize = end - payload;
+    const size_t capacity = payloadSize * 1.3 + 64;
+    Miniz::tdefl_compressor *comp = (Miniz::tdefl_compressor *)arenaAlloc(sizeof(Miniz::tdefl_compressor), ARENA_SCRATCH);
+    uint8_t *out = (uint8_t *)arenaAlloc(sizeof(uint32_t) + capacity, ARENA_OUTPUT);
+    if (comp == NULL || out == NULL || !initializeCompressor(comp, Miniz::TDEFL_WRITE_ZLIB_HEADER | 1500)) {
+        Serial.println("Failed to initialize compressor or allocate memory for the delta");
+        arenaFree(out);
+        arenaFree(comp);
+        arenaFree(payload);
+        return nullptr;
+    }
+    memcpy(out, &payloadSize, sizeof(uint32_t));
+    outSize = sizeof(uint32_t) + compressChunk(comp, payload, payloadSize, out + sizeof(uint32_t), capacity, Miniz::TDEFL_FINISH);
+    rewriteHeader(out + sizeof(uint32_t));
+    arenaFree(comp);
+    arenaFree(payload);
+    uint8_t *shrunk = (uint8_t *)arenaRealloc(out, outSize);
+    return shrunk ? shrunk : out;
+}
+
+#ifndef SAVE_SPACE
+/// Header and G5 data of the planes, nullptr on failure or when it is larger than raw.
+/// For two planes buffer holds black and red back to back
+static uint8_t *g5Encode(imgParam &imageParams, long bufw, long bufh, uint8_t *buffer, size_t buffer_size, size_t &outSize) {
+    uint8_t headerbuf[6];
+    prepareHeader(headerbuf, bufw, bufh, imageParams, buffer_size);
+
+    uint16_t height = imageParams.height;  // spr.height();
+    uint16_t width = imageParams.width;
+    if (imageParams.hasRed && imageParams.bpp > 1) {
+        buffer_size *= 2;
+        // double the height, to do two layers sequentially
+        if (imageParams.rotatebuffer % 2) {
+            width *= 2;
+        } else {
+            height *= 2;
+        }
+    }
+    uint16_t outbufferSize = 0;
+    uint8_t *outBuffer;
+    if (imageParams.rotatebuffer % 2) {
+        outBuffer = g5Compress(height, width, buffer, buffer_size, outbufferSize);
+    } else {
+        outBuffer = g5Compress(width, height, buffer, buffer_size, outbufferSize);
+    }
+    if (outBuffer == NULL) {
+        Serial.println("Failed to compress G5");
+        return nullptr;
+    }
+    printf("Compressed %d to %d bytes\n", buffer_size, outbufferSize);
+    if (outbufferSize > buffer_size) {
+        printf("That wasn't very useful, falling back to raw\n");
+        arenaFree(outBuffer);
+        return nullptr;
+    }
+    uint8_t *out = (uint8_t *)arenaAlloc(sizeof(headerbuf) + outbufferSize, ARENA_OUTPUT);
+    if (out != NULL) {
+        memcpy(out, headerbuf, sizeof(headerbuf));
+        memcpy(out + sizeof(headerbuf), outBuffer, outbufferSize);
+        outSize = sizeof(headerbuf) + outbufferSize;
+    }
+    arenaFree(outBuffer);
+    return out;
+}
+#endif
+
+// number of blocks a tag has to fetch for an image of this size
+static uint32_t imageBlocks(size_t size) {
+    return (size + BLOCK_DATA_SIZE - 1) / BLOCK_DATA_SIZE;
+}
+
+// the codec the data type rule in contentmanager goes for: zlib over g5 over raw
+static uint8_t preferredCodec(const imgParam &imageParams) {
+    if (imageParams.zlib) return CODEC_ZLIB;
+#ifndef SAVE_SPACE
+    if (imageParams.g5) return CODEC_G5;
+#endif
+    return CODEC_RAW;
+}
+
+/// @brief Codecs to try on an image, as bits of 1 << CODEC_x
+///
+/// The codec that always wins for a content mode is used on its own, except for every CODEC_RECHECK'th image
+static uint8_t codecCandidates(const imgParam &imageParams, uint8_t preferred, bool trial, bool hasBase) {
+    if (!trial) return 1 << preferred;
+    uint8_t allowed = 1 << CODEC_RAW;
+    if (imageParams.zlib) allowed |= 1 << CODEC_ZLIB;
+#ifndef SAVE_SPACE
+    if (imageParams.g5) allowed |= 1 << CODEC_G5;
+#endif
+    if (hasBase) allowed |= 1 << CODEC_DELTA;
+
+    std::lock_guard<std::mutex> lock(codecMutex);
+    codecHistory &history = codecHistories[imageParams.contentMode];
+    if (history.streak >= CODEC_TRUSTED && (allowed & (1 << history.winner)) && ++history.untested < CODEC_RECHECK) {
+        encodeStats.skipped++;
+        return 1 << history.winner;
+    }
+    history.untested = 0;
+    return allowed;
+}
+
+static void codecResult(const imgParam &imageParams, uint8_t candidates, uint8_t winner) {
+    std::lock_guard<std::mutex> lock(codecMutex);
+    encodeStats.wins[winner]++;
+    if (candidates == (1 << winner)) return;
+    codecHistory &history = codecHistories[imageParams.contentMode];
+    if (history.winner == winner) {
+        if (history.streak < 255) history.streak++;
+    } else {
+        history.winner = winner;
+        history.streak = 1;
+    }
+}
+
+/// @brief Write converted planes to a file, raw or compressed as the tag wants it. Frees buffer
+///
+/// When all planes are in memory every codec the tag supports is tried, and the one with the fewest blocks is written.
+/// zlib, g5 and delta in imageParams are cleared for the codecs that weren't used
+/// @param redPass Fills the red plane it gets, for when red is nullptr and the image turned out to have red
+static void planes2file(fs::File &f_out, const String &fileout, imgParam &imageParams, long bufw, long bufh, uint8_t *buffer, uint8_t *red, size_t buffer_size, const std::function<void(uint8_t *)> &redPass) {
+    if (imageParams.bpp == 3 || imageParams.bpp == 4) {
+        f_out.write(buffer, buffer_size);
+        arenaFree(buffer);
+        return;
+    }
+
+    const bool twoPlanes = imageParams.hasRed && imageParams.bpp > 1;
+    const size_t rawSize = twoPlanes ? 2 * buffer_size : buffer_size;
+    const bool trial = red || !twoPlanes;
+    // a delta is against the image the tag confirmed, and needs its planes
+    const bool deltaTag = imageParams.delta && trial && (!twoPlanes || red == buffer + buffer_size);
+    std::shared_ptr<uint8_t> base;
+    if (deltaTag && imageParams.baseVer) base = findDeltaBase(imageParams.baseVer, rawSize);
+    if (base != nullptr && memcmp(buffer, base.get(), rawSize) == 0) {
+        // an empty delta would still wake the tag, and its md5 never matches the one the tag has
+        imageParams.unchanged = true;
+        arenaFree(buffer);
+        return;
+    }
+    const uint8_t preferred = preferredCodec(imageParams);
+    const uint8_t candidates = codecCandidates(imageParams, preferred, trial, base != nullptr);
+
+#ifndef SAVE_SPACE
+    if ((candidates & (1 << CODEC_G5)) && twoPlanes && !red) {
+        // G5 encodes both planes in one go, and reads a byte past the end of the red one
+        uint8_t *newbuffer = (uint8_t *)arenaRealloc(buffer, 2 * buffer_size + 1);
+        if (newbuffer == NULL) {
+            Serial.println("Failed to allocate larger buffer for 2bpp G5");
+            arenaFree(buffer);
+            return;
+        }
+        buffer = newbuffer;
+        red = buffer + buffer_size;
+        redPass(red);
+    }
+#endif
+
+    uint32_t t = millis();
+    uint8_t *encoded[CODEC_COUNT] = {nullptr};
+    size_t sizes[CODEC_COUNT] = {rawSize, 0, 0, 0};
+    if (candidates & (1 << CODEC_ZLIB)) {
+        encoded[CODEC_ZLIB] = zlibEncode(imageParams, bufw, bufh, buffer, red, buffer_size, redPass, sizes[CODEC_ZLIB]);
+    }
+#ifndef SAVE_SPACE
+    if (candidates & (1 << CODEC_G5)) {
+        encoded[CODEC_G5] = g5Encode(imageParams, bufw, bufh, buffer, buffer_size, sizes[CODEC_G5]);
+    }
+#endif
+    if (candidates & (1 << CODEC_DELTA)) {
+        encoded[CODEC_DELTA] = deltaEncode(imageParams, bufw, bufh, buffer, base.get(), buffer_size, twoPlanes ? 2 : 1, sizes[CODEC_DELTA]);
+    }
+
+    // fewest blocks wins, then fewest bytes. Raw is the fallback when compression fails
+    uint8_t winner = CODEC_RAW;
+    for (uint8_t codec = CODEC_ZLIB; codec < CODEC_COUNT; codec++) {
+        if (encoded[codec] == nullptr) continue;
+        if (winner == CODEC_RAW && !(candidates & (1 << CODEC_RAW))) {
+            winner = codec;
+        } else if (imageBlocks(sizes[codec]) < imageBlocks(sizes[winner]) ||
+                   (imageBlocks(sizes[codec]) == imageBlocks(sizes[winner]) && sizes[codec] < sizes[winner])) {
+            winner = codec;
+        }
+    }
+    codecResult(imageParams, candidates, winner);
+
+    MD5Builder md5;
+    md5.begin();
+    if (winner == CODEC_RAW) {
+        f_out.write(buffer, buffer_size);
+        md5.add(buffer, buffer_size);
+        if (twoPlanes) {
+            if (!red) {
+                red = buffer;
+                redPass(red);
+            }
+            f_out.write(red, buffer_size);
+            md5.add(red, buffer_size);
+        }
+        imageParams.dataType = twoPlanes ? DATATYPE_IMG_RAW_2BPP : DATATYPE_IMG_RAW_1BPP;
+    } else {
+        f_out.write(encoded[winner], sizes[winner]);
+        md5.add(encoded[winner], sizes[winner]);
+    }
+    if (winner != CODEC_ZLIB) imageParams.zlib = 0;
+    if (winner != CODEC_G5) imageParams.g5 = 0;
+    if (winner != CODEC_DELTA) imageParams.delta = 0;
+
+    if (deltaTag) {
+        // the data version the tag will confirm is the md5 of this file, as in prepareDataAvail
+        md5.calculate();
+        uint8_t md5bytes[16];
+        md5.getBytes(md5bytes);
+        uint64_t dataVer;
+        memcpy(&dataVer, md5bytes, sizeof(uint64_t));
+        keepDeltaBase(dataVer, buffer, twoPlanes ? red : nullptr, buffer_size);
+    }
+
+    if (__builtin_popcount(candidates) > 1) {
+        // compared to what the tag would have got without trying the others
+        const size_t preferredSize = encoded[preferred] ? sizes[preferred] : rawSize;
+        const int32_t saved = (int32_t)preferredSize - (int32_t)sizes[winner];
+        {
+            std::lock_guard<std::mutex> lock(codecMutex);
+            encodeStats.trials++;
+            if (saved > 0) encodeStats.bytesSaved += saved;
+        }
+        Serial.printf("codec %s: %s %u bytes (%u blocks), zlib %u, g5 %u, delta %u, raw %u, saved %d bytes over %s in %u ms\n",
+                      fileout.c_str(), codecNames[winner], sizes[winner], imageBlocks(sizes[winner]), sizes[CODEC_ZLIB], sizes[CODEC_G5],
+                      sizes[CODEC_DELTA], rawSize, saved, codecNames[preferred], millis() - t);
+    }
+
+    for (uint8_t codec = 0; codec < CODEC_COUNT; codec++) {
+        arenaFree(encoded[codec]);
+    }
+    arenaFree(buffer);
+}
+
+void codecStatsToJson(JsonObject &obj) {
+    std::lock_guard<std::mutex> lock(codecMutex);
+    obj["trials"] = encodeStats.trials;
+    obj["skipped"] = encodeStats.skipped;
+    obj["bytessaved"] = encodeStats.bytesSaved;
+    JsonObject wins = obj.createNestedObject("wins");
+    for (uint8_t codec = 0; codec < CODEC_COUNT; codec++) wins[codecNames[codec]] = encodeStats.wins[codec];
+    std::lock_guard<std::mutex> baseLock(deltaMutex);
+    obj["deltabases"] = deltaBases.size();
+    obj["deltabytes"] = deltaBaseBytes;
+}
+
+// quantize and encode time of the frames drawn so far, by resolution
+struct frameTiming {
+    uint32_t frames;
+    uint64_t pixelUs;
+    uint64_t encodeUs;
+    uint32_t maxUs;
+};
+
+static std::mutex frameMutex;
+static std::map<uint32_t, frameTiming> frameTimings;
+
+static void recordFrame(long w, long h, uint32_t pixelUs, uint32_t encodeUs) {
+    std::lock_guard<std::mutex> lock(frameMutex);
+    frameTiming &timing = frameTimings[(uint32_t)w << 16 | (uint16_t)h];
+    timing.frames++;
+    timing.pixelUs += pixelUs;
+    timing.encodeUs += encodeUs;
+    if (pixelUs + encodeUs > timing.maxUs) timing.maxUs = pixelUs + encodeUs;
+}
+
+void frameStatsToJson(JsonObject &obj) {
+    std::lock_guard<std::mutex> lock(frameMutex);
+    for (const auto &kv : frameTimings) {
+        JsonObject res = obj.createNestedObject(String(kv.first >> 16) + "x" + String(kv.first & 0xFFFF));
+        const frameTiming &timing = kv.second;
+        res["frames"] = timing.frames;
+        res["pixelms"] = timing.pixelUs / timing.frames / 1000.0;
+        res["encodems"] = timing.encodeUs / timing.frames / 1000.0;
+        res["maxms"] = timing.maxUs / 1000.0;
+    }
+}
+
+// Images are encoded into a temp file next to fileout without holding fsMutex, nothing else opens it.
+// Only swapping it in place is serialized, so readers of fileout never see a half written image
+static fs::File openEncodeFile(const String &fileout) {
+    return contentFS->open(fileout + ".tmp", "w");
+}
+
+static void commitEncodeFile(fs::File &f_out, const String &fileout) {
+    if (!f_out) {
+        wsErr("failed to open " + fileout + ".tmp");
+        return;
+    }
+    f_out.close();
+    fsLock();
+    contentFS->remove(fileout);
+    if (!contentFS->rename(fileout + ".tmp", fileout)) wsErr("failed to rename " + fileout + ".tmp");
+    fsUnlock();
+}
+
+// one band of MCU rows of a jpg on its way to the quantizer
+struct jpgBand {
+    pixelQuantizer *quantizer;
+    uint16_t *pixels;
+    uint16_t width;
+    uint16_t height;
+    int16_t top;
+    uint8_t rows;
+};
+
+static jpgBand *bandTarget = nullptr;
+
+static void flushBand(jpgBand &band) {
+    for (uint8_t r = 0; r < band.rows && band.top + r < band.height; r++) {
+        band.quantizer->addRow(band.pixels + r * band.width);
+    }
+    // pixels the jpg doesn't cover are white, as on the sprite
+    for (uint32_t i = 0; i < (uint32_t)band.width * JPG_BAND_ROWS; i++) band.pixels[i] = 0xFFFF;
+    band.rows = 0;
+}
+
+// TJpgDec delivers its MCUs left to right, top to bottom. A new top means the band above is complete
+static bool jpgBandOutput(int16_t x, int16_t y, uint16_t w, uint16_t h, uint16_t *bitmap) {
+    jpgBand &band = *bandTarget;
+    if (y != band.top) {
+        flushBand(band);
+        band.top = y;
+    }
+    if (x < 0 || x >= band.width || h > JPG_BAND_ROWS) return 1;
+    const uint16_t count = std::min<uint16_t>(w, band.width - x);
+    for (uint16_t r = 0; r < h; r++) {
+        memcpy(band.pixels + r * band.width + x, bitmap + r * w, count * sizeof(uint16_t));
+    }
+    if (h > band.rows) band.rows = h;
+    return 1;
+}
+
+static bool jpgStream2file(const String &filein, String &fileout, uint16_t w, uint16_t h, imgParam &imageParams) {
+    long t = millis();
+    const uint32_t start = micros();
+    if (imageParams.bpp < 1 || imageParams.bpp > 4) return false;
+    // a turned buffer needs the columns of the jpg as rows
+    if (imageParams.rotatebuffer % 2 || (imageParams.rotate + imageParams.rotatebuffer) % 4) return false;
+#ifdef HAS_TFT
+    if (fileout == "direct") return false;
+#endif
+
+    uint8_t *buffer, *red;
+    size_t buffer_size;
+    if (!allocPlanes(imageParams, w, h, buffer, red, buffer_size)) return false;
+    if (imageParams.bpp == 2 && red == nullptr) {
+        // there is no second look at the jpg for the red plane
+        arenaFree(buffer);
+        return false;
+    }
+    uint16_t *pixels = (uint16_t *)arenaAlloc(w * JPG_BAND_ROWS * sizeof(uint16_t), ARENA_SCRATCH);
+    if (pixels == nullptr) {
+        arenaFree(buffer);
+        return false;
+    }
+
+    {
+        pixelQuantizer quantizer(imageParams, w, buffer, red, buffer_size);
+        jpgBand band = {&quantizer, pixels, w, h, 0, 0};
+        for (uint32_t i = 0; i < (uint32_t)w * JPG_BAND_ROWS; i++) pixels[i] = 0xFFFF;
+
+        std::lock_guard<std::mutex> lock(jpgMutex);
+        TJpgDec.setSwapBytes(false);
+        TJpgDec.setJpgScale(1);
+        TJpgDec.setCallback(jpgBandOutput);
+        bandTarget = &band;
+        TJpgDec.drawFsJpg(0, 0, filein, *contentFS);
+        flushBand(band);
+        bandTarget = nullptr;
+    }
+    arenaFree(pixels);
+
+    const uint32_t encodeStart = micros();
+    fs::File f_out = openEncodeFile(fileout);
+    planes2file(f_out, fileout, imageParams, w, h, buffer, red, buffer_size, nullptr);
+    commitEncodeFile(f_out, fileout);
+    // decoding the jpg counts as pixel time, it is interleaved with the quantizer
+    recordFrame(w, h, encodeStart - start, micros() - encodeStart);
+    Serial.println("finished streaming jpg " + String(millis() - t) + "ms");
+    return true;
+}
+
 void spr2buffer(TFT_eSprite &spr, String &fileout, imgParam &imageParams) {
     long t = millis();
 
@@ -404,150 +1430,32 @@ void spr2buffer(TFT_eSprite &spr, String &fileout, imgParam &imageParams) {
     }
 #endif
 
-    xSemaphoreTake(fsMutex, portMAX_DELAY);
-    fs::File f_out = contentFS->open(fileout, "w");
+    fs::File f_out = openEncodeFile(fileout);
 
     switch (imageParams.bpp) {
         case 1:
-        case 2: {
-            long bufw = spr.width(), bufh = spr.height();
-            size_t buffer_size = (bufw * bufh) / 8;
-#ifdef BOARD_HAS_PSRAM
-            uint8_t *buffer = (uint8_t *)ps_malloc(buffer_size);
-#else
-            uint8_t *buffer = (uint8_t *)malloc(buffer_size);
-            imageParams.zlib = 0;
-            imageParams.g5 = 0;
-#endif
-            if (!buffer) {
-                Serial.println("Failed to allocate buffer");
-                util::printLargestFreeBlock();
-                f_out.close();
-                xSemaphoreGive(fsMutex);
-                return;
-            }
-            spr2color(spr, imageParams, buffer, buffer_size, false);
-
-            if (imageParams.zlib) {
-                Miniz::tdefl_compressor *comp;
-                comp = (Miniz::tdefl_compressor *)malloc(sizeof(Miniz::tdefl_compressor));
-
-                uint8_t headerbuf[6];
-                size_t totalbytes = prepareHeader(headerbuf, bufw, bufh, imageParams, buffer_size);
-                char *zlibbuf = (char *)malloc(totalbytes * 1.3);
-
-                f_out.write(reinterpret_cast<uint8_t *>(&totalbytes), sizeof(uint32_t));
-
-                // 768 = compression level 9, 1500 = unofficial level 10
-                if (comp == NULL || zlibbuf == NULL || totalbytes == 0 || !initializeCompressor(comp, Miniz::TDEFL_WRITE_ZLIB_HEADER | 1500)) {
-                    Serial.println("Failed to initialize compressor or allocate memory for zlib");
-                    if (zlibbuf != NULL) free(zlibbuf);
-                    if (comp != NULL) free(comp);
-                    break;
-                }
-
-                size_t bufferstart = compressAndWrite(comp, headerbuf, sizeof(headerbuf), zlibbuf, buffer_size, totalbytes, f_out, Miniz::TDEFL_NO_FLUSH);
-                compressAndWrite(comp, buffer, buffer_size, zlibbuf + bufferstart, buffer_size, buffer_size, f_out, (headerbuf[5] == 2 ? Miniz::TDEFL_SYNC_FLUSH : Miniz::TDEFL_FINISH));
-
-                if (headerbuf[5] == 2) {
-                    spr2color(spr, imageParams, buffer, buffer_size, true);
-                    compressAndWrite(comp, buffer, buffer_size, zlibbuf, buffer_size, buffer_size, f_out, Miniz::TDEFL_FINISH);
-                }
-
-                free(zlibbuf);
-                free(comp);
-
-                rewriteHeader(f_out);
-#ifndef SAVE_SPACE
-            } else if (imageParams.g5) {
-                // handling for G5-compressed image data
-
-                uint8_t headerbuf[6];
-                prepareHeader(headerbuf, bufw, bufh, imageParams, buffer_size);
-                f_out.write(headerbuf, sizeof(headerbuf));
-
-                uint16_t height = imageParams.height;  // spr.height();
-                uint16_t width = imageParams.width;
-                spr.width();
-                if (imageParams.hasRed && imageParams.bpp > 1) {
-                    uint8_t *newbuffer = (uint8_t *)ps_realloc(buffer, 2 * buffer_size);
-                    if (newbuffer == NULL) {
-                        Serial.println("Failed to allocate larger buffer for 2bpp G5");
-                        free(buffer);
-                        f_out.close();
-                        xSemaphoreGive(fsMutex);
-                        return;
-                    }
-                    buffer = newbuffer;
-                    spr2color(spr, imageParams, buffer + buffer_size, buffer_size, true);
-                    buffer_size *= 2;
-                    // double the height, to do two layers sequentially
-                    if (imageParams.rotatebuffer % 2) {
-                        width *= 2;
-                    } else {
-                        height *= 2;
-                    }
-                }
-                uint16_t outbufferSize = 0;
-                uint8_t *outBuffer;
-                bool compressionSuccessful = true;
-                if (imageParams.rotatebuffer % 2) {
-                    outBuffer = g5Compress(height, width, buffer, buffer_size, outbufferSize);
-                } else {
-                    outBuffer = g5Compress(width, height, buffer, buffer_size, outbufferSize);
-                }
-                if (outBuffer == NULL) {
-                    Serial.println("Failed to compress G5");
-                    compressionSuccessful = false;
-                } else {
-                    printf("Compressed %d to %d bytes\n", buffer_size, outbufferSize);
-                    if (outbufferSize > buffer_size) {
-                        printf("That wasn't very useful, falling back to raw\n");
-                        compressionSuccessful = false;
-                    } else {
-                        f_out.write(outBuffer, outbufferSize);
-                    }
-                    free(outBuffer);
-                }
-                if (!compressionSuccessful) {
-                    // if we failed to compress the image, or the resulting image was larger than a raw file, fallback
-                    imageParams.g5 = false;
-                    if (imageParams.hasRed && imageParams.bpp > 1) {
-                        imageParams.dataType = DATATYPE_IMG_RAW_2BPP;
-                    } else {
-                        imageParams.dataType = DATATYPE_IMG_RAW_1BPP;
-                    }
-                    f_out.seek(0);
-                    f_out.write(buffer, buffer_size);
-                }
-#endif
-            } else {
-                f_out.write(buffer, buffer_size);
-                if (imageParams.hasRed && imageParams.bpp > 1) {
-                    spr2color(spr, imageParams, buffer, buffer_size, true);
-                    f_out.write(buffer, buffer_size);
-                }
-            }
-
-            free(buffer);
-        } break;
-
+        case 2:
         case 3:
         case 4: {
             long bufw = spr.width(), bufh = spr.height();
-            size_t buffer_size = (bufw * bufh) / 8 * imageParams.bpp;
-            uint8_t *buffer = (uint8_t *)ps_malloc(buffer_size);
-            if (!buffer) {
-                Serial.println("Failed to allocate buffer");
-                util::printLargestFreeBlock();
+            uint8_t *buffer, *red;
+            size_t buffer_size;
+            if (!allocPlanes(imageParams, bufw, bufh, buffer, red, buffer_size)) {
                 f_out.close();
-                xSemaphoreGive(fsMutex);
+                contentFS->remove(fileout + ".tmp");
                 return;
             }
-            spr2color(spr, imageParams, buffer, buffer_size, false);
-            f_out.write(buffer, buffer_size);
-
-            free(buffer);
+            const uint32_t pixelStart = micros();
+            spr2color(spr, imageParams, buffer, red, buffer_size);
+            const uint32_t encodeStart = micros();
+            // a red pass during encoding counts as pixel time
+            uint32_t redUs = 0;
+            planes2file(f_out, fileout, imageParams, bufw, bufh, buffer, red, buffer_size, [&](uint8_t *plane) {
+                const uint32_t redStart = micros();
+                spr2color(spr, imageParams, nullptr, plane, buffer_size);
+                redUs += micros() - redStart;
+            });
+            recordFrame(bufw, bufh, encodeStart - pixelStart + redUs, micros() - encodeStart - redUs);
         } break;
 
         case 16: {
@@ -556,7 +1464,6 @@ void spr2buffer(TFT_eSprite &spr, String &fileout, imgParam &imageParams) {
         } break;
     }
 
-    f_out.close();
-    xSemaphoreGive(fsMutex);
+    commitEncodeFile(f_out, fileout);
     Serial.println("finished writing buffer " + String(millis() - t) + "ms");
 }
@@ -8,9 +8,12 @@
 
 #include <algorithm>
 #include <cstring>
+#include <deque>
 #include <mutex>
+#include <unordered_map>
 #include <vector>
 
+#include "makeimage.h"
 #include "serialap.h"
 #include "settings.h"
 #include "storage.h"
@@ -23,7 +26,11 @@
 
 extern uint16_t sendBlock(const void* data, const uint16_t len);
 extern UDPcomm udpsync;
-std::vector<PendingItem> pendingQueue;
+// pending items per tag, in order of arrival
+std::unordered_map<uint64_t, std::deque<PendingItemPtr>> pendingQueue;
+size_t pendingQueueSize = 0;
+// data buffers shared between queue items of mirrored tags
+std::unordered_map<const uint8_t*, std::weak_ptr<uint8_t[]>> pendingPayloads;
 std::mutex queueMutex;
 
 void addCRC(void* p, uint8_t len) {
@@ -60,6 +67,7 @@ void prepareCancelPending(const uint8_t dst[8]) {
     memcpy(pending.targetMac, dst, 8);
     sendCancelPending(&pending);
 
+    std::lock_guard<std::recursive_mutex> dbLock(tagDBMutex);
     tagRecord* taginfo = tagRecord::findByMAC(dst);
     if (taginfo == nullptr) {
         if (config.lock) return;
@@ -88,6 +96,7 @@ void prepareIdleReq(const uint8_t* dst, uint16_t nextCheckin) {
 
 void prepareDataAvail(const uint8_t* dst) {
     // resend
+    std::lock_guard<std::recursive_mutex> dbLock(tagDBMutex);
     tagRecord* taginfo = tagRecord::findByMAC(dst);
     if (taginfo == nullptr) {
         if (config.lock) return;
@@ -115,6 +124,8 @@ void prepareDataAvail(const uint8_t* dst) {
 }
 
 void prepareDataAvail(uint8_t* data, uint16_t len, uint8_t dataType, const uint8_t* dst) {
+    // taginfo->data changes hands until it is in the queue, processXferComplete() frees it meanwhile
+    std::lock_guard<std::recursive_mutex> dbLock(tagDBMutex);
     tagRecord* taginfo = tagRecord::findByMAC(dst);
     if (taginfo == nullptr) {
         if (config.lock) return;
@@ -173,6 +184,7 @@ bool prepareDataAvail(String& filename, uint8_t dataType, uint8_t dataTypeArgume
     }
 #endif
 
+    std::lock_guard<std::recursive_mutex> dbLock(tagDBMutex);
     tagRecord* taginfo = tagRecord::findByMAC(dst);
     if (taginfo == nullptr) {
         if (config.lock) return true;
@@ -289,11 +301,11 @@ void prepareExternalDataAvail(struct pendingData* pending, IPAddress remoteIP) {
                 http.begin(imageUrl);
                 int httpCode = http.GET();
                 if (httpCode == 200) {
-                    xSemaphoreTake(fsMutex, portMAX_DELAY);
+                    fsLock();
                     File file = contentFS->open(filename, "w");
                     http.writeToStream(&file);
                     file.close();
-                    xSemaphoreGive(fsMutex);
+                    fsUnlock();
                 } else if (httpCode == 404) {
                     snprintf(imageUrl, sizeof(imageUrl), "http://%s/current/%s.raw", remoteIP.toString().c_str(), hexmac);
                     // imageUrl = "http://" + remoteIP.toString() + "/current/" + String(hexmac) + ".raw";
@@ -301,11 +313,11 @@ void prepareExternalDataAvail(struct pendingData* pending, IPAddress remoteIP) {
                     http.begin(imageUrl);
                     httpCode = http.GET();
                     if (httpCode == 200) {
-                        xSemaphoreTake(fsMutex, portMAX_DELAY);
+                        fsLock();
                         File file = contentFS->open(filename, "w");
                         http.writeToStream(&file);
                         file.close();
-                        xSemaphoreGive(fsMutex);
+                        fsUnlock();
                     }
                 } else {
                     logLine("prepareExternalDataAvail " + String(imageUrl) + " error " + String(httpCode));
@@ -331,6 +343,7 @@ void prepareExternalDataAvail(struct pendingData* pending, IPAddress remoteIP) {
                 }
 
                 file.close();
+                std::lock_guard<std::recursive_mutex> dbLock(tagDBMutex);
                 clearPending(taginfo);
                 taginfo->filename = filename;
                 taginfo->len = filesize;
@@ -353,11 +366,14 @@ void prepareExternalDataAvail(struct pendingData* pending, IPAddress remoteIP) {
                 int httpCode = http.GET();
                 if (httpCode == 200) {
                     size_t len = http.getSize();
-                    if (len > 0) {
-                        clearPending(taginfo);
-                        taginfo->data = new uint8_t[len];
+                    uint8_t* data = len > 0 ? (uint8_t*)malloc(len) : nullptr;
+                    if (data != nullptr) {
+                        // malloc, the queue frees it with free()
                         WiFiClient* stream = http.getStreamPtr();
-                        stream->readBytes(taginfo->data, len);
+                        stream->readBytes(data, len);
+                        std::lock_guard<std::recursive_mutex> dbLock(tagDBMutex);
+                        clearPending(taginfo);
+                        taginfo->data = data;
                         taginfo->dataType = pending->availdatainfo.dataType;
                         taginfo->pendingCount++;
                         taginfo->len = len;
@@ -370,15 +386,17 @@ void prepareExternalDataAvail(struct pendingData* pending, IPAddress remoteIP) {
                 return;
             }
         }
-        checkMirror(taginfo, pending);
-        queueDataAvail(pending, !taginfo->isExternal);
+        {
+            std::lock_guard<std::recursive_mutex> dbLock(tagDBMutex);
+            checkMirror(taginfo, pending);
+            queueDataAvail(pending, !taginfo->isExternal);
+        }
 
         wsSendTaginfo(pending->targetMac, SYNC_NOSYNC);
     }
 }
 
 void processBlockRequest(struct espBlockRequest* br) {
-    uint32_t t = millis();
     if (config.runStatus == RUNSTATUS_STOP) {
         return;
     }
@@ -387,22 +405,17 @@ void processBlockRequest(struct espBlockRequest* br) {
         return;
     }
 
-    PendingItem* queueItem = getQueueItem(br->src, br->ver);
+    PendingItemPtr queueItem = getQueueItem(br->src, br->ver);
     if (queueItem == nullptr) {
         prepareCancelPending(br->src);
         Serial.printf("blockrequest: couldn't find taginfo %02X%02X%02X%02X%02X%02X%02X%02X\r\n", br->src[7], br->src[6], br->src[5], br->src[4], br->src[3], br->src[2], br->src[1], br->src[0]);
         return;
     }
-    if (queueItem->data == nullptr) {
-        fs::File file = contentFS->open(queueItem->filename);
-        if (!file) {
-            Serial.print("No current file. " + String(queueItem->filename) + " Canceling request\r\n");
-            prepareCancelPending(br->src);
-            return;
-        }
-        queueItem->data = getDataForFile(file);
-        Serial.println("Reading file " + String(queueItem->filename) + " in  " + String(millis() - t) + "ms");
-        file.close();
+    const std::shared_ptr<uint8_t[]> data = loadQueueItemData(queueItem);
+    if (data == nullptr) {
+        Serial.print("No current file. " + String(queueItem->filename) + " Canceling request\r\n");
+        prepareCancelPending(br->src);
+        return;
     }
 
     // check if we're not exceeding max blocks (to prevent sendBlock from exceeding its boundary)
@@ -413,7 +426,7 @@ void processBlockRequest(struct espBlockRequest* br) {
     }
     uint32_t len = queueItem->len - (BLOCK_DATA_SIZE * br->blockId);
     if (len > BLOCK_DATA_SIZE) len = BLOCK_DATA_SIZE;
-    uint16_t checksum = sendBlock(queueItem->data + (br->blockId * BLOCK_DATA_SIZE), len);
+    uint16_t checksum = sendBlock(data.get() + (br->blockId * BLOCK_DATA_SIZE), len);
     char buffer[150];
     sprintf(buffer, "%02X%02X%02X%02X%02X%02X%02X%02X block request %s block %d, len %d checksum %u\0", br->src[7], br->src[6], br->src[5], br->src[4], br->src[3], br->src[2], br->src[1], br->src[0], queueItem->filename, br->blockId, len, checksum);
     wsLog((String)buffer);
@@ -441,14 +454,21 @@ void processXferComplete(struct espXferComplete* xfc, bool local) {
     sprintf(dst_path, "/current/%02X%02X%02X%02X%02X%02X%02X%02X.raw\0", xfc->src[7], xfc->src[6], xfc->src[5], xfc->src[4], xfc->src[3], xfc->src[2], xfc->src[1], xfc->src[0]);
 
     uint8_t md5bytes[16];
-    PendingItem* queueItem = getQueueItem(xfc->src);
+    // a mirrored buffer is in the queue of one tag and still in taginfo->data of the other until both are queued,
+    // the dequeue mustn't free it in between
+    std::unique_lock<std::recursive_mutex> dbLock(tagDBMutex);
+    PendingItemPtr queueItem = getQueueItem(xfc->src);
     if (queueItem != nullptr) {
         if (contentFS->exists(dst_path) && contentFS->exists(queueItem->filename)) {
             contentFS->remove(dst_path);
         }
         if (contentFS->exists(queueItem->filename)) {
             uint8_t dataType = queueItem->pendingdata.availdatainfo.dataType;
-            if (config.preview && dataType != DATATYPE_FW_UPDATE && dataType != DATATYPE_NOUPDATE) {
+            if (config.preview && dataType == DATATYPE_IMG_DELTA) {
+                // the preview shows whole images, write the one the delta was made from
+                if (!deltaBaseToFile(queueItem->pendingdata.availdatainfo.dataVer, String(dst_path))) contentFS->remove(dst_path);
+                contentFS->remove(queueItem->filename);
+            } else if (config.preview && dataType != DATATYPE_FW_UPDATE && dataType != DATATYPE_NOUPDATE) {
                 contentFS->rename(queueItem->filename, String(dst_path));
                 }
             else {
@@ -479,6 +499,7 @@ void processXferComplete(struct espXferComplete* xfc, bool local) {
             taginfo->nextupdate = now;
         }
     }
+    dbLock.unlock();
 
     // more in the queue?
     if (local) checkQueue(xfc->src);
@@ -503,12 +524,16 @@ void processXferTimeout(struct espXferComplete* xfc, bool local) {
 
     time_t now;
     time(&now);
-    tagRecord* taginfo = tagRecord::findByMAC(xfc->src);
-    if (taginfo != nullptr) {
-        taginfo->pendingIdle = 60;
-        clearPending(taginfo);
-        while (dequeueItem(xfc->src)) {
-        };
+    {
+        std::lock_guard<std::recursive_mutex> dbLock(tagDBMutex);
+        tagRecord* taginfo = tagRecord::findByMAC(xfc->src);
+        if (taginfo != nullptr) {
+            taginfo->pendingIdle = 60;
+            clearPending(taginfo);
+            while (dequeueItem(xfc->src)) {
+            };
+            taginfo->pendingCount = 0;
+        }
     }
 
     checkQueue(xfc->src);
@@ -541,7 +566,7 @@ void processDataReq(struct espAvailDataReq* eadr, bool local, IPAddress remoteIP
         taginfo = new tagRecord;
         memcpy(taginfo->mac, eadr->src, sizeof(taginfo->mac));
         taginfo->pendingCount = 0;
-        tagDB.push_back(taginfo);
+        insertRecord(taginfo);
     }
     time_t now;
     time(&now);
@@ -789,7 +814,7 @@ void updateTaginfoitem(struct TagInfo* taginfoitem, IPAddress remoteIP) {
         taginfo = new tagRecord;
         memcpy(taginfo->mac, taginfoitem->mac, sizeof(taginfo->mac));
         taginfo->pendingCount = 0;
-        tagDB.push_back(taginfo);
+        insertRecord(taginfo);
     }
     tagRecord initialTagInfo = *taginfo;
 
@@ -870,16 +895,16 @@ bool checkMirror(struct tagRecord* taginfo, struct pendingData* pending) {
                 } else {
                     char dst_path[64];
                     sprintf(dst_path, "/current/%02X%02X%02X%02X%02X%02X%02X%02X_%lu.pending", taginfo2->mac[7], taginfo2->mac[6], taginfo2->mac[5], taginfo2->mac[4], taginfo2->mac[3], taginfo2->mac[2], taginfo2->mac[1], taginfo2->mac[0], millis() % 1000000);
-                    xSemaphoreTake(fsMutex, portMAX_DELAY);
+                    fsLock();
                     File file = contentFS->open(dst_path, "w");
                     if (file) {
                         file.write(taginfo2->data, taginfo2->len);
                         file.close();
-                        xSemaphoreGive(fsMutex);
+                        fsUnlock();
                         queueDataAvail(&pending2, false);
                         udpsync.netSendDataAvail(&pending2);
                     } else {
-                        xSemaphoreGive(fsMutex);
+                        fsUnlock();
                     }
                 }
 
@@ -890,9 +915,41 @@ bool checkMirror(struct tagRecord* taginfo, struct pendingData* pending) {
     return false;
 }
 
-void enqueueItem(struct PendingItem& item) {
+// Hands out a shared handle for a buffer that is moved into the queue. Mirrored tags
+// queue the same buffer, it is freed when the last queue item using it is gone.
+// Call with queueMutex held.
+static std::shared_ptr<uint8_t[]> adoptPayload(uint8_t* data) {
+    if (data == nullptr) {
+        return nullptr;
+    }
+    auto it = pendingPayloads.find(data);
+    if (it != pendingPayloads.end()) {
+        std::shared_ptr<uint8_t[]> payload = it->second.lock();
+        if (payload) {
+            return payload;
+        }
+    }
+    for (auto ref = pendingPayloads.begin(); ref != pendingPayloads.end();) {
+        if (ref->second.expired()) {
+            ref = pendingPayloads.erase(ref);
+        } else {
+            ++ref;
+        }
+    }
+    std::shared_ptr<uint8_t[]> payload(data, [](uint8_t* p) { free(p); });
+    pendingPayloads[data] = payload;
+    return payload;
+}
+
+// Call with queueMutex held
+static void enqueueLocked(const PendingItemPtr& item) {
+    pendingQueue[mac2key(item->pendingdata.targetMac)].push_back(item);
+    pendingQueueSize++;
+}
+
+void enqueueItem(const PendingItem& item) {
     std::lock_guard<std::mutex> lock(queueMutex);
-    pendingQueue.push_back(item);
+    enqueueLocked(std::make_shared<PendingItem>(item));
 }
 
 bool dequeueItem(const uint8_t* targetMac) {
@@ -901,120 +958,164 @@ bool dequeueItem(const uint8_t* targetMac) {
 
 bool dequeueItem(const uint8_t* targetMac, const uint64_t dataVer) {
     std::lock_guard<std::mutex> lock(queueMutex);
-    auto it = std::find_if(pendingQueue.begin(), pendingQueue.end(),
-                           [targetMac, dataVer](const PendingItem& item) {
-                               bool macMatches = memcmp(item.pendingdata.targetMac, targetMac, sizeof(item.pendingdata.targetMac)) == 0;
-                               bool dataVerMatches = (dataVer == 0) || (dataVer == item.pendingdata.availdatainfo.dataVer);
-                               return macMatches && dataVerMatches;
+    auto queue = pendingQueue.find(mac2key(targetMac));
+    if (queue == pendingQueue.end()) {
+        return false;
+    }
+    std::deque<PendingItemPtr>& items = queue->second;
+    auto it = std::find_if(items.begin(), items.end(),
+                           [dataVer](const PendingItemPtr& item) {
+                               return (dataVer == 0) || (dataVer == item->pendingdata.availdatainfo.dataVer);
                            });
-    if (it != pendingQueue.end()) {
-        if (it->data != nullptr) {
-            int datacount = 0;
-            for (const PendingItem& item : pendingQueue) {
-                if (item.data == it->data) {
-                    datacount++;
-                }
-            }
-            if (datacount == 1) {
-                free(it->data);
-            }
-            it->data = nullptr;
-        }
-        pendingQueue.erase(it);
-        return true;
+    if (it == items.end()) {
+        return false;
     }
-    return false;
+    // the buffer itself is released when the last handle to it goes away
+    items.erase(it);
+    pendingQueueSize--;
+    if (items.empty()) {
+        pendingQueue.erase(queue);
+    }
+    return true;
 }
 
 uint16_t countQueueItem(const uint8_t* targetMac) {
-    std::unique_lock<std::mutex> lock(queueMutex);
-    int count = std::count_if(pendingQueue.begin(), pendingQueue.end(),
-                              [targetMac](const PendingItem& item) {
-                                  return memcmp(item.pendingdata.targetMac, targetMac, sizeof(item.pendingdata.targetMac)) == 0;
-                              });
-    return count;
+    std::lock_guard<std::mutex> lock(queueMutex);
+    auto queue = pendingQueue.find(mac2key(targetMac));
+    if (queue == pendingQueue.end()) {
+        return 0;
+    }
+    return queue->second.size();
 }
 
-PendingItem* getQueueItem(const uint8_t* targetMac) {
+PendingItemPtr getQueueItem(const uint8_t* targetMac) {
     return getQueueItem(targetMac, 0);
 }
 
-PendingItem* getQueueItem(const uint8_t* targetMac, const uint64_t dataVer) {
-    auto it = std::find_if(pendingQueue.begin(), pendingQueue.end(),
-                           [targetMac, dataVer](const PendingItem& item) {
-                               bool macMatches = memcmp(item.pendingdata.targetMac, targetMac, sizeof(item.pendingdata.targetMac)) == 0;
-                               bool dataVerMatches = (dataVer == 0) || (dataVer == item.pendingdata.availdatainfo.dataVer);
-                               return macMatches && dataVerMatches;
-                           });
-    if (it != pendingQueue.end()) {
-        return &(*it);
-    } else {
+PendingItemPtr getQueueItem(const uint8_t* targetMac, const uint64_t dataVer) {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    auto queue = pendingQueue.find(mac2key(targetMac));
+    if (queue == pendingQueue.end()) {
         return nullptr;
     }
+    for (const PendingItemPtr& item : queue->second) {
+        if (dataVer == 0 || dataVer == item->pendingdata.availdatainfo.dataVer) {
+            return item;
+        }
+    }
+    return nullptr;
+}
+
+std::shared_ptr<uint8_t[]> loadQueueItemData(const PendingItemPtr& queueItem) {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (queueItem->data != nullptr) return queueItem->data;
+    }
+    const uint32_t t = millis();
+    fs::File file = contentFS->open(queueItem->filename);
+    if (!file) {
+        return nullptr;
+    }
+    uint8_t* data = getDataForFile(file);
+    file.close();
+    if (data == nullptr) {
+        return nullptr;
+    }
+    Serial.println("Reading file " + String(queueItem->filename) + " in " + String(millis() - t) + "ms");
+    std::lock_guard<std::mutex> lock(queueMutex);
+    if (queueItem->data == nullptr) {
+        queueItem->data = adoptPayload(data);
+    } else {
+        // loaded by someone else in the meantime
+        free(data);
+    }
+    return queueItem->data;
 }
 
 void checkQueue(const uint8_t* targetMac) {
-    uint16_t queueCount;
-    queueCount = countQueueItem(targetMac);
-    if (queueCount > 0) {
-        Serial.printf("queue: total %d elements\r\n", pendingQueue.size());
-        PendingItem* queueItem = getQueueItem(targetMac);
-        if (queueItem == nullptr) {
+    struct pendingData pending;
+    size_t total;
+    {
+        // the item is shared, it is changed and copied under the lock and sent from the copy
+        std::lock_guard<std::mutex> lock(queueMutex);
+        auto queue = pendingQueue.find(mac2key(targetMac));
+        if (queue == pendingQueue.end()) {
             return;
         }
-        if (queueCount > 1) queueItem->pendingdata.availdatainfo.nextCheckIn = 5 | 0x8000;
-        sendDataAvail(&queueItem->pendingdata);
+        const PendingItemPtr& queueItem = queue->second.front();
+        if (queue->second.size() > 1) queueItem->pendingdata.availdatainfo.nextCheckIn = 5 | 0x8000;
+        pending = queueItem->pendingdata;
+        total = pendingQueueSize;
     }
+    Serial.printf("queue: total %u elements\r\n", total);
+    sendDataAvail(&pending);
 }
 
 bool queueDataAvail(struct pendingData* pending, bool local) {
-    PendingItem newPending;
-    newPending.pendingdata.availdatainfo = pending->availdatainfo;
-    newPending.pendingdata.attemptsLeft = pending->attemptsLeft;
-    std::copy(pending->targetMac, pending->targetMac + sizeof(pending->targetMac), newPending.pendingdata.targetMac);
+    PendingItemPtr newPending = std::make_shared<PendingItem>();
+    newPending->pendingdata.availdatainfo = pending->availdatainfo;
+    newPending->pendingdata.attemptsLeft = pending->attemptsLeft;
+    std::copy(pending->targetMac, pending->targetMac + sizeof(pending->targetMac), newPending->pendingdata.targetMac);
 
+    std::lock_guard<std::recursive_mutex> dbLock(tagDBMutex);
     tagRecord* taginfo = tagRecord::findByMAC(pending->targetMac);
 
     if (taginfo == nullptr) {
         return false;
     }
 
-    std::strcpy(newPending.filename, taginfo->filename.c_str());
-    if (taginfo->data != nullptr) {
-        // move data pointer
-        newPending.data = taginfo->data;
-        taginfo->data = nullptr;
-    } else {
-        newPending.data = nullptr;
-        
-        if (pendingQueue.size() < 5) {   // maximized to 5 to save some memory
+    std::strcpy(newPending->filename, taginfo->filename.c_str());
+    newPending->len = taginfo->len;
+
+    // move data pointer
+    uint8_t* data = taginfo->data;
+    taginfo->data = nullptr;
+    if (data == nullptr) {
+        bool preload;
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            preload = pendingQueueSize < 5;  // maximized to 5 to save some memory
+        }
+        if (preload) {
             // optional: read data early, don't wait for block request.
-            fs::File file = contentFS->open(newPending.filename);
+            fs::File file = contentFS->open(newPending->filename);
             if (file) {
-                newPending.data = getDataForFile(file);
-                Serial.println("Reading file " + String(newPending.filename));
+                data = getDataForFile(file);
+                Serial.println("Reading file " + String(newPending->filename));
                 file.close();
             } else {
-                Serial.println("Warning: not found: " + String(newPending.filename));
+                Serial.println("Warning: not found: " + String(newPending->filename));
             }
         }
     }
-    newPending.len = taginfo->len;
 
-    uint8_t dataType = pending->availdatainfo.dataType;
-    if (dataType != DATATYPE_FW_UPDATE && dataType != DATATYPE_NOUPDATE && pending->availdatainfo.dataTypeArgument & 0xF8 == 0x00) {
-        // in case of an image (no preload), remove already queued images
-        pendingQueue.erase(std::remove_if(pendingQueue.begin(), pendingQueue.end(),
-                                          [pending](const PendingItem& item) {
-                                              bool macMatches = memcmp(item.pendingdata.targetMac, pending->targetMac, sizeof(item.pendingdata.targetMac)) == 0;
-                                              bool dataTypeArgumentMatches = (pending->availdatainfo.dataType == item.pendingdata.availdatainfo.dataType) && ((item.pendingdata.availdatainfo.dataTypeArgument & 0xF8) == 0x00);
-                                              return macMatches && dataTypeArgumentMatches;
-                                          }),
-                           pendingQueue.end());
+    uint16_t queueCount;
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        newPending->data = adoptPayload(data);
+
+        uint8_t dataType = pending->availdatainfo.dataType;
+        if (dataType != DATATYPE_FW_UPDATE && dataType != DATATYPE_NOUPDATE && pending->availdatainfo.dataTypeArgument & 0xF8 == 0x00) {
+            // in case of an image (no preload), remove already queued images
+            auto queue = pendingQueue.find(mac2key(pending->targetMac));
+            if (queue != pendingQueue.end()) {
+                std::deque<PendingItemPtr>& items = queue->second;
+                const size_t before = items.size();
+                items.erase(std::remove_if(items.begin(), items.end(),
+                                           [pending](const PendingItemPtr& item) {
+                                               return (pending->availdatainfo.dataType == item->pendingdata.availdatainfo.dataType) && ((item->pendingdata.availdatainfo.dataTypeArgument & 0xF8) == 0x00);
+                                           }),
+                            items.end());
+                pendingQueueSize -= before - items.size();
+            }
+        }
+
+        enqueueLocked(newPending);
+        queueCount = pendingQueue[mac2key(pending->targetMac)].size();
     }
 
-    enqueueItem(newPending);
-    taginfo->pendingCount = countQueueItem(pending->targetMac);
+    taginfo->pendingCount = queueCount;
+    syncHotRecord(taginfo);
     if (taginfo->pendingCount == 1) {
         Serial.printf("queue item added, first in line\r\n");
         // if (local) sendDataAvail(pending);
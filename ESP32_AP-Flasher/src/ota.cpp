@@ -8,11 +8,17 @@
 #include <Update.h>
 
 #include "flasher.h"
+#include "fontregistry.h"
+#include "httpfetch.h"
 #include "espflasher.h"
 #include "leds.h"
+#include "renderarena.h"
+#include "rendercache.h"
+#include "renderpool.h"
 #include "serialap.h"
 #include "storage.h"
 #include "tag_db.h"
+#include "truetype.h"
 #include "util.h"
 #include "web.h"
 
@@ -36,7 +42,7 @@
 
 
 void handleSysinfoRequest(AsyncWebServerRequest* request) {
-    StaticJsonDocument<250> doc;
+    DynamicJsonDocument doc(7168);
     doc["alias"] = config.alias;
     doc["env"] = STR(BUILD_ENV_NAME);
     doc["buildtime"] = STR(BUILD_TIME);
@@ -64,6 +70,33 @@ void handleSysinfoRequest(AsyncWebServerRequest* request) {
 #else
     doc["hasFlasher"] = 0;
 #endif
+
+    JsonObject dbsync = doc.createNestedObject("dbsync");
+    dbsync["persistwritten"] = syncStats.persistWritten;
+    dbsync["persistskipped"] = syncStats.persistSkipped;
+    dbsync["persistbytes"] = syncStats.persistBytes;
+    dbsync["wssent"] = syncStats.wsSent;
+    dbsync["wsskipped"] = syncStats.wsSkipped;
+    dbsync["syncsent"] = syncStats.syncSent;
+    dbsync["syncskipped"] = syncStats.syncSkipped;
+    JsonObject render = doc.createNestedObject("render");
+    renderStatsToJson(render);
+    JsonObject rendercache = doc.createNestedObject("rendercache");
+    renderCacheStatsToJson(rendercache);
+    JsonObject fetch = doc.createNestedObject("fetch");
+    fetchStatsToJson(fetch);
+    JsonObject codec = doc.createNestedObject("codec");
+    codecStatsToJson(codec);
+    JsonObject frames = doc.createNestedObject("frames");
+    frameStatsToJson(frames);
+    JsonObject arena = doc.createNestedObject("arena");
+    arenaStatsToJson(arena);
+    JsonObject glyphs = doc.createNestedObject("glyphs");
+    glyphCacheStatsToJson(glyphs);
+    JsonObject fontregistry = doc.createNestedObject("fonts");
+    fontRegistryStatsToJson(fontregistry);
+    JsonObject filesystem = doc.createNestedObject("fs");
+    fsStatsToJson(filesystem);
     const size_t bufferSize = measureJson(doc) + 1;
     AsyncResponseStream* response = request->beginResponseStream("application/json", bufferSize);
     serializeJson(doc, *response);
@@ -142,7 +175,7 @@ void handleLittleFSUpload(AsyncWebServerRequest* request, String filename, size_
                 memcpy(&uploadInfo->buffer[uploadInfo->bufferSize], data, len);
                 uploadInfo->bufferSize += len;
             } else {
-                xSemaphoreTake(fsMutex, portMAX_DELAY);
+                fsLock();
                 File file = contentFS->open(uploadfilename, "a");
                 if (file) {
                     file.write(uploadInfo->buffer, uploadInfo->bufferSize);
@@ -153,7 +186,7 @@ void handleLittleFSUpload(AsyncWebServerRequest* request, String filename, size_
                     final = true;
                     error = true;
                 }
-                xSemaphoreGive(fsMutex);
+                fsUnlock();
 
                 memcpy(uploadInfo->buffer, data, len);
                 uploadInfo->bufferSize = len;
@@ -161,7 +194,7 @@ void handleLittleFSUpload(AsyncWebServerRequest* request, String filename, size_
         }
         if (final) {
             if (uploadInfo->bufferSize > 0) {
-                xSemaphoreTake(fsMutex, portMAX_DELAY);
+                fsLock();
                 File file = contentFS->open(uploadfilename, "a");
                 if (file) {
                     file.write(uploadInfo->buffer, uploadInfo->bufferSize);
@@ -170,7 +203,7 @@ void handleLittleFSUpload(AsyncWebServerRequest* request, String filename, size_
                     logLine("Failed to open file for appending: " + uploadfilename);
                     error = true;
                 }
-                xSemaphoreGive(fsMutex);
+                fsUnlock();
                 request->_tempObject = nullptr;
                 delete uploadInfo;
             }
@@ -226,6 +259,8 @@ void updateFirmware(const char* url, const char* expectedMd5, const size_t size)
 
     config.runStatus = RUNSTATUS_STOP;
     vTaskDelay(3000 / portTICK_PERIOD_MS);
+    journalDB();
+    // keep a json copy for a rollback to firmware without the binary tagDB
     saveDB("/current/tagDB.json");
     // destroyDB();
 
@@ -0,0 +1,183 @@
+#include "renderarena.h"
+
+#include <Arduino.h>
+
+#include <algorithm>
+#include <mutex>
+#include <set>
+
+#include "miniz-oepl.h"
+#include "tag_db.h"
+
+struct arenaBlock {
+    uint32_t offset;
+    uint32_t size;
+    bool freed;
+};
+
+// output blocks grow up from the start, scratch blocks down from the end
+struct renderArena {
+    uint8_t *base;
+    uint32_t size;
+    arenaBlock blocks[2][RENDER_ARENA_BLOCKS];
+    uint8_t count[2];
+    uint32_t used[2];
+    uint32_t highWater;
+};
+
+static thread_local renderArena *taskArena = nullptr;
+static std::mutex arenaMutex;
+static arenaStats stats = {0};
+
+static void *heapAlloc(size_t size) {
+#ifdef BOARD_HAS_PSRAM
+    return ps_malloc(size);
+#else
+    return malloc(size);
+#endif
+}
+
+static bool inArena(const renderArena *arena, const void *ptr) {
+    return arena && ptr >= arena->base && ptr < arena->base + arena->size;
+}
+
+static arenaBlock *findBlock(renderArena *arena, const void *ptr, arenaKind &kind) {
+    const uint32_t offset = (const uint8_t *)ptr - arena->base;
+    for (uint8_t side = 0; side < 2; side++) {
+        for (uint8_t i = arena->count[side]; i-- > 0;) {
+            if (arena->blocks[side][i].offset != offset) continue;
+            kind = (arenaKind)side;
+            return &arena->blocks[side][i];
+        }
+    }
+    return nullptr;
+}
+
+static void noteUsage(renderArena *arena) {
+    const uint32_t used = arena->used[ARENA_OUTPUT] + arena->used[ARENA_SCRATCH];
+    if (used <= arena->highWater) return;
+    arena->highWater = used;
+    std::lock_guard<std::mutex> lock(arenaMutex);
+    if (used > stats.highWater) stats.highWater = used;
+}
+
+size_t renderArenaBytes() {
+    uint32_t plane = RENDER_ARENA_MIN_PLANE;
+    std::set<uint8_t> seen;
+    for (tagRecord *tag : tagDB) {
+        if (!seen.insert(tag->hwType).second) continue;
+        const HwType hwdata = getHwType(tag->hwType);
+        plane = std::max<uint32_t>(plane, (uint32_t)hwdata.width * hwdata.height / 8);
+    }
+    // zlibEncode keeps its best stream and a trial of 1.3 times the image
+    const uint32_t zlibCapacity = (2 * plane + 6) * 1.3 + sizeof(uint32_t);
+    return 4 * plane + 2 * zlibCapacity + sizeof(Miniz::tdefl_compressor) + 16384;
+}
+
+bool initRenderArena(size_t size) {
+    uint8_t *base = (uint8_t *)heapAlloc(size);
+    if (base == nullptr) return false;
+    taskArena = new renderArena();
+    taskArena->base = base;
+    taskArena->size = size;
+
+    std::lock_guard<std::mutex> lock(arenaMutex);
+    stats.arenas++;
+    stats.size += size;
+    return true;
+}
+
+void arenaReset() {
+    renderArena *arena = taskArena;
+    if (arena == nullptr) return;
+    arena->count[ARENA_OUTPUT] = arena->count[ARENA_SCRATCH] = 0;
+    arena->used[ARENA_OUTPUT] = arena->used[ARENA_SCRATCH] = 0;
+}
+
+void *arenaAlloc(size_t size, arenaKind kind) {
+    renderArena *arena = taskArena;
+    if (arena) {
+        const uint32_t aligned = (size + 7) & ~7;
+        if (arena->count[kind] < RENDER_ARENA_BLOCKS && arena->used[ARENA_OUTPUT] + arena->used[ARENA_SCRATCH] + aligned <= arena->size) {
+            arenaBlock &block = arena->blocks[kind][arena->count[kind]++];
+            block.offset = kind == ARENA_OUTPUT ? arena->used[kind] : arena->size - arena->used[kind] - aligned;
+            block.size = aligned;
+            block.freed = false;
+            arena->used[kind] += aligned;
+            noteUsage(arena);
+            return arena->base + block.offset;
+        }
+        std::lock_guard<std::mutex> lock(arenaMutex);
+        stats.fallbacks++;
+        stats.fallbackBytes += size;
+    }
+    return heapAlloc(size);
+}
+
+void arenaFree(void *ptr) {
+    if (ptr == nullptr) return;
+    renderArena *arena = taskArena;
+    if (!inArena(arena, ptr)) {
+        free(ptr);
+        return;
+    }
+    arenaKind kind;
+    arenaBlock *block = findBlock(arena, ptr, kind);
+    if (block == nullptr) return;
+    block->freed = true;
+    while (arena->count[kind] && arena->blocks[kind][arena->count[kind] - 1].freed) {
+        arena->used[kind] -= arena->blocks[kind][--arena->count[kind]].size;
+    }
+}
+
+void *arenaRealloc(void *ptr, size_t size) {
+    if (ptr == nullptr) return arenaAlloc(size, ARENA_OUTPUT);
+    renderArena *arena = taskArena;
+    if (!inArena(arena, ptr)) {
+#ifdef BOARD_HAS_PSRAM
+        return ps_realloc(ptr, size);
+#else
+        return realloc(ptr, size);
+#endif
+    }
+    arenaKind kind;
+    arenaBlock *block = findBlock(arena, ptr, kind);
+    if (block == nullptr) return nullptr;
+
+    const uint32_t aligned = (size + 7) & ~7;
+    const bool last = block == &arena->blocks[kind][arena->count[kind] - 1];
+    if (kind == ARENA_OUTPUT && last && block->offset + aligned + arena->used[ARENA_SCRATCH] <= arena->size) {
+        block->size = aligned;
+        arena->used[kind] = block->offset + aligned;
+        noteUsage(arena);
+        return ptr;
+    }
+    void *moved = arenaAlloc(size, kind);
+    if (moved == nullptr) return nullptr;
+    memcpy(moved, ptr, std::min<size_t>(size, block->size));
+    arenaFree(ptr);
+    return moved;
+}
+
+void arenaSpriteFallback(uint8_t bpp) {
+    std::lock_guard<std::mutex> lock(arenaMutex);
+    if (bpp == 8) {
+        stats.sprite8bpp++;
+    } else if (bpp == 1) {
+        stats.sprite1bpp++;
+    } else {
+        stats.spriteFailed++;
+    }
+}
+
+void arenaStatsToJson(JsonObject &obj) {
+    std::lock_guard<std::mutex> lock(arenaMutex);
+    obj["arenas"] = stats.arenas;
+    obj["size"] = stats.size;
+    obj["highwater"] = stats.highWater;
+    obj["fallbacks"] = stats.fallbacks;
+    obj["fallbackbytes"] = stats.fallbackBytes;
+    obj["sprite8bpp"] = stats.sprite8bpp;
+    obj["sprite1bpp"] = stats.sprite1bpp;
+    obj["spritefailed"] = stats.spriteFailed;
+}
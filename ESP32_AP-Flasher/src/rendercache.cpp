@@ -0,0 +1,232 @@
+#include "rendercache.h"
+
+#include <Arduino.h>
+#include <MD5Builder.h>
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "newproto.h"
+#include "renderpool.h"
+#include "storage.h"
+#include "web.h"
+
+// a cached image is never used for longer than this, whatever the content interval is
+#define RENDER_CACHE_MAX_TTL (24 * 3600)
+
+struct renderCacheEntry {
+    std::shared_ptr<uint8_t> data;
+    uint32_t len;
+    uint8_t md5[16];
+    uint8_t dataType;
+    uint8_t dataTypeArgument;
+    uint16_t nextCheckin;
+    // 0 until renderCacheSeal()
+    uint32_t expires;
+    uint32_t lastUsed;
+};
+
+static std::unordered_map<uint64_t, renderCacheEntry> renderCache;
+static std::mutex renderCacheMutex;
+static renderCacheStats cacheStats = {0};
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t len) {
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    while (len--) {
+        hash ^= *p++;
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+static bool isShareable(uint8_t contentMode) {
+    switch (contentMode) {
+        case 1:   // Today
+        case 4:   // Weather
+        case 8:   // Forecast
+        case 9:   // RSSFeed
+        case 10:  // QRcode
+        case 11:  // Calendar
+        case 16:  // buienradar
+        case 27:  // Day Ahead
+            return true;
+    }
+    return false;
+}
+
+uint64_t renderCacheKey(const tagRecord *taginfo, const JsonObject &cfgobj, const imgParam &imageParams) {
+    if (!isShareable(taginfo->contentMode)) return 0;
+
+    // '#' entries are per tag state, and the order of the other entries doesn't matter
+    std::vector<String> entries;
+    for (JsonPairConst kv : JsonObjectConst(cfgobj)) {
+        if (kv.key().c_str()[0] == '#') continue;
+        String entry = kv.key().c_str();
+        entry += '=';
+        serializeJson(kv.value(), entry);
+        entries.push_back(entry);
+    }
+    std::sort(entries.begin(), entries.end(), [](const String &a, const String &b) { return strcmp(a.c_str(), b.c_str()) < 0; });
+
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    const uint8_t fields[] = {taginfo->contentMode, taginfo->hwType, imageParams.rotate, imageParams.invert,
+                              imageParams.lut, imageParams.zlib, imageParams.zlibXor, imageParams.g5, config.language};
+    hash = fnv1a(hash, fields, sizeof(fields));
+    for (const String &entry : entries) {
+        hash = fnv1a(hash, entry.c_str(), entry.length() + 1);
+    }
+    return hash ? hash : 1;
+}
+
+// Call with renderCacheMutex held
+static void evictFor(uint32_t len, uint32_t now) {
+    for (auto it = renderCache.begin(); it != renderCache.end();) {
+        if (it->second.expires && it->second.expires <= now) {
+            cacheStats.bytes -= it->second.len;
+            cacheStats.evictions++;
+            it = renderCache.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    while (!renderCache.empty() && cacheStats.bytes + len > RENDER_CACHE_BYTES) {
+        auto oldest = std::min_element(renderCache.begin(), renderCache.end(), [](const auto &a, const auto &b) {
+            return a.second.lastUsed < b.second.lastUsed;
+        });
+        cacheStats.bytes -= oldest->second.len;
+        cacheStats.evictions++;
+        renderCache.erase(oldest);
+    }
+}
+
+bool renderCacheApply(uint64_t key, String &filename, tagRecord *taginfo) {
+    time_t now;
+    time(&now);
+
+    renderCacheEntry entry;
+    {
+        std::lock_guard<std::mutex> lock(renderCacheMutex);
+        auto it = renderCache.find(key);
+        if (it == renderCache.end() || it->second.expires == 0) {
+            cacheStats.misses++;
+            return false;
+        }
+        if (it->second.expires <= now) {
+            cacheStats.bytes -= it->second.len;
+            cacheStats.evictions++;
+            renderCache.erase(it);
+            cacheStats.misses++;
+            return false;
+        }
+        it->second.lastUsed = now;
+        entry = it->second;
+        cacheStats.hits++;
+    }
+
+    taginfo->nextupdate = entry.expires;
+    if (memcmp(entry.md5, taginfo->md5, 8) == 0) {
+        // prepareDataAvail would find the same image as well, a worker's tag is sent by commitRenders()
+        if (!onRenderWorker()) wsSendTaginfo(taginfo->mac, SYNC_TAGSTATUS);
+        return true;
+    }
+
+    fsLock();
+    fs::File file = contentFS->open(filename, "w");
+    const size_t written = file ? file.write(entry.data.get(), entry.len) : 0;
+    if (file) file.close();
+    fsUnlock();
+    if (written != entry.len) {
+        wsErr("render cache: failed to write " + filename);
+        return false;
+    }
+
+    uint16_t nextCheckin = entry.nextCheckin;
+    if ((nextCheckin & 0x8000) == 0 && nextCheckin > (entry.expires - now) / 60) nextCheckin = (entry.expires - now) / 60;
+    commitDataAvail(filename, entry.dataType, entry.dataTypeArgument, taginfo->mac, nextCheckin);
+    return true;
+}
+
+void renderCacheStore(uint64_t key, const String &filename, uint8_t dataType, uint8_t dataTypeArgument, uint16_t nextCheckin) {
+    fsLock();
+    fs::File file = contentFS->open(filename, "r");
+    const uint32_t len = file ? file.size() : 0;
+    if (len == 0 || len > RENDER_CACHE_BYTES / 2) {
+        if (file) file.close();
+        fsUnlock();
+        return;
+    }
+#ifdef BOARD_HAS_PSRAM
+    uint8_t *data = (uint8_t *)ps_malloc(len);
+#else
+    uint8_t *data = (uint8_t *)malloc(len);
+#endif
+    if (data == nullptr) {
+        file.close();
+        fsUnlock();
+        return;
+    }
+    const size_t read = file.read(data, len);
+    file.close();
+    fsUnlock();
+    if (read != len) {
+        free(data);
+        return;
+    }
+
+    renderCacheEntry entry;
+    entry.data = std::shared_ptr<uint8_t>(data, free);
+    entry.len = len;
+    MD5Builder md5;
+    md5.begin();
+    md5.add(data, len);
+    md5.calculate();
+    md5.getBytes(entry.md5);
+    entry.dataType = dataType;
+    entry.dataTypeArgument = dataTypeArgument;
+    entry.nextCheckin = nextCheckin;
+    entry.expires = 0;
+
+    time_t now;
+    time(&now);
+    entry.lastUsed = now;
+
+    std::lock_guard<std::mutex> lock(renderCacheMutex);
+    auto it = renderCache.find(key);
+    if (it != renderCache.end()) {
+        cacheStats.bytes -= it->second.len;
+        renderCache.erase(it);
+    }
+    evictFor(len, now);
+    renderCache[key] = entry;
+    cacheStats.bytes += len;
+    cacheStats.stores++;
+}
+
+void renderCacheSeal(uint64_t key, uint32_t expires) {
+    time_t now;
+    time(&now);
+    if (expires > now + RENDER_CACHE_MAX_TTL) expires = now + RENDER_CACHE_MAX_TTL;
+
+    std::lock_guard<std::mutex> lock(renderCacheMutex);
+    auto it = renderCache.find(key);
+    if (it == renderCache.end() || it->second.expires != 0) return;
+    if (expires <= now) {
+        cacheStats.bytes -= it->second.len;
+        renderCache.erase(it);
+        return;
+    }
+    it->second.expires = expires;
+}
+
+void renderCacheStatsToJson(JsonObject &obj) {
+    std::lock_guard<std::mutex> lock(renderCacheMutex);
+    obj["entries"] = renderCache.size();
+    obj["bytes"] = cacheStats.bytes;
+    obj["hits"] = cacheStats.hits;
+    obj["misses"] = cacheStats.misses;
+    obj["stores"] = cacheStats.stores;
+    obj["evictions"] = cacheStats.evictions;
+}
@@ -0,0 +1,242 @@
+#include "renderpool.h"
+
+#include <Arduino.h>
+#include <WiFi.h>
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "commstructs.h"
+#include "contentmanager.h"
+#include "newproto.h"
+#include "renderarena.h"
+#include "storage.h"
+#include "tag_db.h"
+#include "web.h"
+
+// a worker draws on a copy of the record, the live one can be changed or deleted meanwhile
+struct renderJob {
+    tagRecord record;
+    // fields of the live record when the job was queued, to tell if the result is still wanted
+    uint8_t contentMode;
+    uint8_t wakeupReason;
+    String modeConfigJson;
+};
+
+struct renderCommit {
+    uint8_t mac[8];
+    // empty when the worker is done with the tag
+    String filename;
+    uint8_t dataType;
+    uint8_t dataTypeArgument;
+    uint16_t nextCheckin;
+    String removeAfter;
+    // the drawn copy, with the worker done
+    std::unique_ptr<renderJob> job;
+};
+
+static QueueHandle_t renderQueue = nullptr;
+static TaskHandle_t renderWorkers[RENDER_WORKERS] = {nullptr};
+static uint8_t renderWorkerCount = 0;
+static size_t renderArenaSize = 0;
+
+static std::mutex renderMutex;
+static std::unordered_map<uint64_t, std::unique_ptr<renderJob>> renderInFlight;
+static std::deque<renderCommit> renderCommits;
+static std::unordered_map<uint8_t, renderTiming> renderTimings;
+
+bool onRenderWorker() {
+    const TaskHandle_t current = xTaskGetCurrentTaskHandle();
+    for (uint8_t c = 0; c < renderWorkerCount; c++) {
+        if (renderWorkers[c] == current) return true;
+    }
+    return false;
+}
+
+static void renderTask(void *parameter) {
+    if (renderArenaSize && !initRenderArena(renderArenaSize)) Serial.println("No psram for a render arena, allocating per render");
+    uint64_t key;
+    while (true) {
+        if (xQueueReceive(renderQueue, &key, portMAX_DELAY) != pdTRUE) continue;
+
+        std::unique_ptr<renderJob> job;
+        {
+            std::lock_guard<std::mutex> lock(renderMutex);
+            auto it = renderInFlight.find(key);
+            if (it == renderInFlight.end() || !it->second) continue;
+            job = std::move(it->second);
+        }
+
+        tagRecord *taginfo = &job->record;
+        const uint32_t t = millis();
+        arenaReset();
+        drawNew(taginfo->mac, taginfo);
+        const uint32_t duration = millis() - t;
+
+        // hand the tag back to the owner, commitRenders() applies what drawNew changed
+        renderCommit done;
+        memcpy(done.mac, &key, sizeof(done.mac));
+        done.job = std::move(job);
+        std::lock_guard<std::mutex> lock(renderMutex);
+        renderTiming &timing = renderTimings[done.job->contentMode];
+        timing.count++;
+        timing.totalMs += duration;
+        if (duration > timing.maxMs) timing.maxMs = duration;
+        renderCommits.push_back(std::move(done));
+    }
+}
+
+void initRenderPool() {
+    uint8_t workers = RENDER_WORKERS;
+#ifdef BOARD_HAS_PSRAM
+    renderArenaSize = renderArenaBytes();
+    const uint32_t budget = ESP.getFreePsram() / (RENDER_WORKER_PSRAM + renderArenaSize);
+    if (budget < workers) workers = budget;
+#endif
+    if (workers == 0) {
+        Serial.println("Not enough psram for render workers, drawing on the main task");
+        return;
+    }
+
+    renderQueue = xQueueCreate(RENDER_QUEUE_DEPTH, sizeof(uint64_t));
+    for (uint8_t c = 0; c < workers; c++) {
+        if (xTaskCreate(renderTask, "renderworker", 10000, NULL, 2, &renderWorkers[c]) != pdPASS) break;
+        renderWorkerCount++;
+    }
+    Serial.printf("Started %d render workers\r\n", renderWorkerCount);
+}
+
+// content that isn't an image is sent to the tag right away, that stays on the owner task
+static bool drawsImage(const tagRecord *taginfo) {
+    if (taginfo->hwType == SOLUM_SEG_UK) return false;
+    // the tag defaults can switch a new tag to any content mode
+    if (taginfo->contentMode == 0 && (taginfo->wakeupReason == WAKEUP_REASON_FIRSTBOOT || taginfo->wakeupReason == WAKEUP_REASON_WDT_RESET)) return false;
+    switch (taginfo->contentMode) {
+        case 5:   // Firmware
+        case 12:  // RemoteAP
+        case 13:  // SegStatic
+        case 14:  // NFC URL
+        case 17:  // tag command
+        case 18:  // tag config
+        case 20:  // display a copy
+        case 28:  // set mac
+            return false;
+    }
+    return true;
+}
+
+renderDispatch queueRender(tagRecord *taginfo) {
+    if (renderWorkerCount == 0 || !drawsImage(taginfo)) return RENDER_INLINE;
+#ifdef HAS_TFT
+    // the ap draws its own tag straight to the display
+    uint8_t wifimac[8];
+    WiFi.macAddress(wifimac);
+    memset(&wifimac[6], 0, 2);
+    if (memcmp(taginfo->mac, wifimac, 8) == 0) return RENDER_INLINE;
+#endif
+
+    const uint64_t key = mac2key(taginfo->mac);
+    std::lock_guard<std::mutex> lock(renderMutex);
+    if (renderInFlight.count(key)) return RENDER_QUEUED;
+    if (xQueueSend(renderQueue, &key, 0) != pdTRUE) return RENDER_FULL;
+
+    std::unique_ptr<renderJob> job(new renderJob());
+    job->record = *taginfo;
+    // the pending buffer stays with the live record
+    job->record.data = nullptr;
+    job->record.len = 0;
+    job->contentMode = taginfo->contentMode;
+    job->wakeupReason = taginfo->wakeupReason;
+    job->modeConfigJson = taginfo->modeConfigJson;
+    renderInFlight[key] = std::move(job);
+    return RENDER_QUEUED;
+}
+
+bool renderPending(const uint8_t mac[8]) {
+    std::lock_guard<std::mutex> lock(renderMutex);
+    return renderInFlight.count(mac2key(mac)) != 0;
+}
+
+bool commitDataAvail(String &filename, uint8_t dataType, uint8_t dataTypeArgument, const uint8_t *dst, uint16_t nextCheckin, const String &removeAfter) {
+    if (!onRenderWorker()) {
+        if (!prepareDataAvail(filename, dataType, dataTypeArgument, dst, nextCheckin)) return false;
+        if (removeAfter.length()) contentFS->remove(removeAfter);
+        return true;
+    }
+
+    renderCommit commit;
+    memcpy(commit.mac, dst, sizeof(commit.mac));
+    commit.filename = filename;
+    commit.dataType = dataType;
+    commit.dataTypeArgument = dataTypeArgument;
+    commit.nextCheckin = nextCheckin;
+    commit.removeAfter = removeAfter;
+    std::lock_guard<std::mutex> lock(renderMutex);
+    renderCommits.push_back(std::move(commit));
+    return true;
+}
+
+void commitRenders() {
+    while (true) {
+        renderCommit commit;
+        {
+            std::lock_guard<std::mutex> lock(renderMutex);
+            if (renderCommits.empty()) break;
+            commit = std::move(renderCommits.front());
+            renderCommits.pop_front();
+        }
+
+        if (commit.filename.length()) {
+            if (prepareDataAvail(commit.filename, commit.dataType, commit.dataTypeArgument, commit.mac, commit.nextCheckin)) {
+                if (commit.removeAfter.length()) contentFS->remove(commit.removeAfter);
+            } else {
+                wsErr("Error accessing " + commit.filename);
+            }
+            continue;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(renderMutex);
+            renderInFlight.erase(mac2key(commit.mac));
+        }
+        // the tag can be gone by now, then there is nothing to apply
+        std::lock_guard<std::recursive_mutex> dbLock(tagDBMutex);
+        tagRecord *taginfo = tagRecord::findByMAC(commit.mac);
+        if (taginfo != nullptr && commit.job) {
+            const renderJob &job = *commit.job;
+            // unless the content was reconfigured while the worker drew it
+            if (taginfo->contentMode == job.contentMode && taginfo->modeConfigJson == job.modeConfigJson) {
+                taginfo->nextupdate = job.record.nextupdate;
+                taginfo->contentMode = job.record.contentMode;
+                taginfo->modeConfigJson = job.record.modeConfigJson;
+                taginfo->lastfullupdate = job.record.lastfullupdate;
+            }
+            // a button press that came in meanwhile asks for another drawing
+            if (taginfo->wakeupReason == job.wakeupReason) taginfo->wakeupReason = 0;
+            wsSendTaginfo(taginfo->mac, SYNC_TAGSTATUS);
+            time_t now;
+            time(&now);
+            scheduleRecord(taginfo, plannedRun(taginfo, now));
+        }
+    }
+}
+
+uint16_t renderQueueDepth() {
+    return renderQueue ? uxQueueMessagesWaiting(renderQueue) : 0;
+}
+
+void renderStatsToJson(JsonObject &obj) {
+    obj["workers"] = renderWorkerCount;
+    obj["queue"] = renderQueueDepth();
+    std::lock_guard<std::mutex> lock(renderMutex);
+    obj["inflight"] = renderInFlight.size();
+    JsonObject modes = obj.createNestedObject("modes");
+    for (const auto &entry : renderTimings) {
+        JsonArray timing = modes.createNestedArray(String(entry.first));
+        timing.add(entry.second.count);
+        timing.add(entry.second.count ? entry.second.totalMs / entry.second.count : 0);
+        timing.add(entry.second.maxMs);
+    }
+}
@@ -12,6 +12,50 @@ DynStorage::DynStorage() : isInited(0) {}
 
 SemaphoreHandle_t fsMutex;
 
+// only touched while fsMutex is held, or read as a snapshot for the stats
+static uint32_t fsLockedAt = 0;
+static uint32_t fsHoldCounts[FS_HOLD_BUCKETS] = {0};
+static uint32_t fsHoldMax = 0;
+static uint64_t fsHoldTotal = 0;
+
+void fsLock() {
+    xSemaphoreTake(fsMutex, portMAX_DELAY);
+    fsLockedAt = micros();
+}
+
+void fsUnlock() {
+    static const uint32_t limits[] = FS_HOLD_LIMITS;
+    const uint32_t held = micros() - fsLockedAt;
+    uint8_t bucket = 0;
+    while (bucket < FS_HOLD_BUCKETS - 1 && held >= limits[bucket] * 1000) bucket++;
+    fsHoldCounts[bucket]++;
+    fsHoldTotal += held;
+    if (held > fsHoldMax) fsHoldMax = held;
+    xSemaphoreGive(fsMutex);
+}
+
+void fsStatsToJson(JsonObject &obj) {
+    static const uint32_t limits[] = FS_HOLD_LIMITS;
+    fsLock();
+    uint32_t counts[FS_HOLD_BUCKETS];
+    memcpy(counts, fsHoldCounts, sizeof(counts));
+    const uint32_t holdMax = fsHoldMax;
+    const uint64_t holdTotal = fsHoldTotal;
+    fsUnlock();
+
+    uint32_t locks = 0;
+    JsonArray histogram = obj.createNestedArray("holdms");
+    for (uint8_t i = 0; i < FS_HOLD_BUCKETS; i++) {
+        JsonObject bucket = histogram.createNestedObject();
+        if (i < FS_HOLD_BUCKETS - 1) bucket["lt"] = limits[i];
+        bucket["count"] = counts[i];
+        locks += counts[i];
+    }
+    obj["locks"] = locks;
+    obj["maxus"] = holdMax;
+    obj["avgus"] = locks ? (uint32_t)(holdTotal / locks) : 0;
+}
+
 static void initLittleFS() {
     LittleFS.begin();
     contentFS = &LittleFS;
@@ -88,15 +132,15 @@ void copyBetweenFS(FS& sourceFS, const char* source_path, FS& targetFS) {
 
                 copyBetweenFS(sourceFS, file.path(), targetFS);
             } else {
-                xSemaphoreTake(fsMutex, portMAX_DELAY);
+                fsLock();
                 File target = contentFS->open(file.path(), "w");
                 if (target) {
                     copyFile(file, target);
                     target.close();
                     file.close();
-                    xSemaphoreGive(fsMutex);
+                    fsUnlock();
                 } else {
-                    xSemaphoreGive(fsMutex);
+                    fsUnlock();
                     Serial.print("Couldn't create high target file");
                     Serial.println(file.path());
                     return;
@@ -105,14 +149,14 @@ void copyBetweenFS(FS& sourceFS, const char* source_path, FS& targetFS) {
             file = root.openNextFile();
         }
     } else {
-        xSemaphoreTake(fsMutex, portMAX_DELAY);
+        fsLock();
         File target = contentFS->open(root.path(), "w");
         if (target) {
             copyFile(root, target);
             target.close();
-            xSemaphoreGive(fsMutex);
+            fsUnlock();
         } else {
-            xSemaphoreGive(fsMutex);
+            fsUnlock();
             Serial.print("Couldn't create target file ");
             Serial.println(root.path());
             return;
@@ -49,7 +49,7 @@ void logLine(const String& text) {
     const char* format = (now < (time_t)1672531200) ? "           %H:%M:%S " : "%Y-%m-%d %H:%M:%S ";
     strftime(timeStr, sizeof(timeStr), format, localtime(&now));
 
-    xSemaphoreTake(fsMutex, portMAX_DELAY);
+    fsLock();
     File logFile = contentFS->open("/log.txt", "a");
     if (logFile) {
         if (logFile.size() >= 10 * 1024) {
@@ -58,7 +58,7 @@ void logLine(const String& text) {
             contentFS->rename("/log.txt", "/logold.txt");
             logFile = contentFS->open("/log.txt", "a");
             if (!logFile) {
-                xSemaphoreGive(fsMutex);
+                fsUnlock();
                 return;
             }
         }
@@ -67,7 +67,7 @@ void logLine(const String& text) {
         logFile.println(text);
         logFile.close();
     }
-    xSemaphoreGive(fsMutex);
+    fsUnlock();
 }
 
 void logStartUp() {
@@ -4,45 +4,218 @@
 #include <ArduinoJson.h>
 #include <FS.h>
 
+#include <algorithm>
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 
 #include "language.h"
+#include "miniz-oepl.h"
 #include "storage.h"
+#include "system.h"
 #include "util.h"
 
 #define STR_IMPL(x) #x
 #define STR(x) STR_IMPL(x)
 
 std::vector<tagRecord*> tagDB;
+std::unordered_map<uint64_t, tagRecord*> tagIndex;
+std::unordered_map<uint64_t, tagRecord*> tagShadowDB;
+std::vector<tagHotRecord> tagHot;
 std::unordered_map<std::string, varStruct> varDB;
+tagSyncStats syncStats = {0};
+tagSchedStats schedStats = {0};
 std::unordered_map<int, HwType> hwdata = {};
+// render workers look up hwTypes at the same time
+static std::mutex hwdataMutex;
+std::recursive_mutex tagDBMutex;
 
 Config config;
 
 tagRecord* tagRecord::findByMAC(const uint8_t mac[8]) {
-    for (tagRecord* tag : tagDB) {
-        if (memcmp(tag->mac, mac, 8) == 0 && tag->version == 0) {
-            return tag;
+    auto it = tagIndex.find(mac2key(mac));
+    if (it != tagIndex.end()) {
+        return it->second;
+    }
+    return nullptr;
+}
+
+static void fillHotRecord(tagHotRecord& hot, const tagRecord* taginfo) {
+    memcpy(hot.mac, taginfo->mac, sizeof(hot.mac));
+    hot.lastseen = taginfo->lastseen;
+    hot.nextupdate = taginfo->nextupdate;
+    hot.expectedNextCheckin = taginfo->expectedNextCheckin;
+    hot.coldBytes = taginfo->modeConfigJson.length() + (taginfo->data ? taginfo->len : 0);
+    hot.batteryMv = taginfo->batteryMv;
+    hot.pendingCount = taginfo->pendingCount;
+    hot.contentMode = taginfo->contentMode;
+    hot.wakeupReason = taginfo->wakeupReason;
+    hot.flags = (taginfo->RSSI ? TAGHOT_RSSI : 0) |
+                (taginfo->isExternal ? TAGHOT_EXTERNAL : 0) |
+                (taginfo->pendingIdle ? TAGHOT_IDLE : 0);
+    hot.reserved = 0;
+}
+
+struct schedEntry {
+    uint32_t due;
+    uint32_t seq;
+    uint64_t key;
+};
+
+// min-heap on due, entries are never removed in place: a tag that is replanned gets a new
+// sequence number and its older entries are dropped when they reach the top
+static std::vector<schedEntry> schedHeap;
+static uint32_t schedSeqCounter = 0;
+static std::mutex schedMutex;
+
+static bool schedLater(const schedEntry& a, const schedEntry& b) {
+    return a.due > b.due;
+}
+
+uint32_t plannedRun(const tagRecord* taginfo, time_t now) {
+    uint32_t due = UINT32_MAX;
+    if (taginfo->RSSI) {
+        due = taginfo->nextupdate;
+    }
+    // contentRunner sends the idle request while expectedNextCheckin is in (now - 10, now + 30)
+    if (taginfo->pendingIdle == 0 && taginfo->pendingCount == 0 && taginfo->expectedNextCheckin > now - 10) {
+        due = std::min(due, taginfo->expectedNextCheckin - 29);
+    }
+    return due;
+}
+
+// Call with schedMutex held
+static void scheduleLocked(tagRecord* taginfo, uint32_t due) {
+    taginfo->schedSeq = ++schedSeqCounter;
+    if (due == UINT32_MAX) return;
+    schedHeap.push_back({due, taginfo->schedSeq, mac2key(taginfo->mac)});
+    std::push_heap(schedHeap.begin(), schedHeap.end(), schedLater);
+}
+
+// Call with schedMutex held
+static void rescheduleAllLocked() {
+    time_t now;
+    time(&now);
+    schedHeap.clear();
+    for (tagRecord* taginfo : tagDB) {
+        scheduleLocked(taginfo, plannedRun(taginfo, now));
+    }
+}
+
+void scheduleRecord(tagRecord* taginfo, uint32_t due) {
+    std::lock_guard<std::mutex> lock(schedMutex);
+    scheduleLocked(taginfo, due);
+}
+
+void rescheduleAll() {
+    std::lock_guard<std::mutex> lock(schedMutex);
+    rescheduleAllLocked();
+}
+
+tagRecord* popDueRecord(time_t now, uint32_t& planned) {
+    std::lock_guard<std::mutex> lock(schedMutex);
+    while (!schedHeap.empty() && schedHeap.front().due <= now) {
+        std::pop_heap(schedHeap.begin(), schedHeap.end(), schedLater);
+        const schedEntry entry = schedHeap.back();
+        schedHeap.pop_back();
+
+        auto it = tagIndex.find(entry.key);
+        if (it == tagIndex.end() || it->second->schedSeq != entry.seq) {
+            schedStats.stale++;
+            continue;
         }
+        planned = entry.due;
+        schedStats.visits++;
+        return it->second;
+    }
+    // drop the stale entries if they pile up
+    if (schedHeap.size() > 4 * tagDB.size() + 64) {
+        rescheduleAllLocked();
     }
     return nullptr;
 }
 
+void syncHotRecord(tagRecord* taginfo) {
+    const uint16_t slot = taginfo->hotSlot;
+    if (slot < tagDB.size() && tagDB[slot] == taginfo) {
+        tagHotRecord& hot = tagHot[slot];
+        const tagHotRecord before = hot;
+        fillHotRecord(hot, taginfo);
+        if (hot.nextupdate != before.nextupdate || hot.expectedNextCheckin != before.expectedNextCheckin ||
+            hot.pendingCount != before.pendingCount || hot.flags != before.flags || hot.wakeupReason != before.wakeupReason) {
+            time_t now;
+            time(&now);
+            // a button press can ask for a redraw, let contentRunner have a look right away
+            const bool button = hot.wakeupReason != before.wakeupReason &&
+                                (hot.wakeupReason == WAKEUP_REASON_BUTTON1 || hot.wakeupReason == WAKEUP_REASON_BUTTON2);
+            scheduleRecord(taginfo, button ? now : plannedRun(taginfo, now));
+        }
+    }
+}
+
+void scrubHotRecords(uint16_t count) {
+    static uint16_t cursor = 0;
+    const size_t size = tagDB.size();
+    if (size == 0) return;
+    if (count > size) count = size;
+    while (count--) {
+        if (cursor >= size) cursor = 0;
+        syncHotRecord(tagDB[cursor]);
+        cursor++;
+    }
+}
+
+void insertRecord(tagRecord* taginfo) {
+    std::lock_guard<std::recursive_mutex> lock(tagDBMutex);
+    time_t now;
+    time(&now);
+    taginfo->hotSlot = tagDB.size();
+    tagDB.push_back(taginfo);
+    tagHot.emplace_back();
+    fillHotRecord(tagHot.back(), taginfo);
+    tagIndex[mac2key(taginfo->mac)] = taginfo;
+    scheduleRecord(taginfo, plannedRun(taginfo, now));
+}
+
+static void freeRecord(tagRecord* tag) {
+    if (tag->data != nullptr) {
+        free(tag->data);
+    }
+    tag->data = nullptr;
+    delete tag;
+}
+
 bool deleteRecord(const uint8_t mac[8], bool allVersions) {
-    for (uint32_t c = 0; c < tagDB.size(); c++) {
-        tagRecord* tag = tagDB.at(c);
-        if (memcmp(tag->mac, mac, 8) == 0 && (allVersions || tag->version == 0)) {
-            if (tag->data != nullptr) {
-                free(tag->data);
+    std::lock_guard<std::recursive_mutex> lock(tagDBMutex);
+    const uint64_t key = mac2key(mac);
+    bool deleted = false;
+
+    if (allVersions) {
+        auto shadow = tagShadowDB.find(key);
+        if (shadow != tagShadowDB.end()) {
+            freeRecord(shadow->second);
+            tagShadowDB.erase(shadow);
+            deleted = true;
+        }
+    }
+
+    auto it = tagIndex.find(key);
+    if (it != tagIndex.end()) {
+        tagRecord* tag = it->second;
+        tagIndex.erase(it);
+        auto pos = std::find(tagDB.begin(), tagDB.end(), tag);
+        if (pos != tagDB.end()) {
+            const size_t slot = pos - tagDB.begin();
+            tagDB.erase(pos);
+            tagHot.erase(tagHot.begin() + slot);
+            for (size_t c = slot; c < tagDB.size(); ++c) {
+                tagDB[c]->hotSlot = c;
             }
-            tag->data = nullptr;
-            delete tagDB[c];
-            tagDB.erase(tagDB.begin() + c);
-            return true;
         }
+        freeRecord(tag);
+        deleted = true;
     }
-    return false;
+    return deleted;
 }
 
 void mac2hex(const uint8_t* mac, char* hexBuffer) {
@@ -66,20 +239,25 @@ bool hex2mac(const String& hexString, uint8_t* mac) {
     }
 }
 
-String tagDBtoJson(const uint8_t mac[8], uint8_t startPos) {
+String tagDBtoJson(const uint8_t mac[8], uint32_t startPos) {
     DynamicJsonDocument doc(5000);
     JsonArray tags = doc.createNestedArray("tags");
 
+    if (mac) {
+        const tagRecord* taginfo = tagRecord::findByMAC(mac);
+        if (taginfo != nullptr) {
+            JsonObject tag = tags.createNestedObject();
+            fillNode(tag, taginfo);
+        }
+        return doc.as<String>();
+    }
+
     for (uint32_t c = startPos; c < tagDB.size(); ++c) {
         const tagRecord* taginfo = tagDB.at(c);
 
-        const bool select = !mac || memcmp(taginfo->mac, mac, 8) == 0;
-        if (select && taginfo->version == 0) {
+        if (taginfo->version == 0) {
             JsonObject tag = tags.createNestedObject();
             fillNode(tag, taginfo);
-            if (mac) {
-                break;
-            }
         }
 
         if (doc.capacity() - doc.memoryUsage() < doc.memoryUsage() / (c + 1) + 500) {
@@ -130,7 +308,7 @@ void saveDB(const String& filename) {
 
     const long t = millis();
 
-    xSemaphoreTake(fsMutex, portMAX_DELAY);
+    fsLock();
 
     fs::File existingFile = contentFS->open(filename, "r");
     if (existingFile) {
@@ -146,7 +324,7 @@ void saveDB(const String& filename) {
     fs::File file = contentFS->open(filename, "w");
     if (!file) {
         Serial.println("saveDB: Failed to open file for writing");
-        xSemaphoreGive(fsMutex);
+        fsUnlock();
         return;
     }
 
@@ -167,7 +345,7 @@ void saveDB(const String& filename) {
     file.write(']');
 
     file.close();
-    xSemaphoreGive(fsMutex);
+    fsUnlock();
     Serial.println("DB saved " + String(millis() - t) + "ms");
 }
 
@@ -198,7 +376,7 @@ bool loadDB(const String& filename) {
                     if (taginfo == nullptr) {
                         taginfo = new tagRecord;
                         memcpy(taginfo->mac, mac, sizeof(taginfo->mac));
-                        tagDB.push_back(taginfo);
+                        insertRecord(taginfo);
                     }
                     String md5 = tag["hash"].as<String>();
                     if (md5.length() >= 32) {
@@ -232,6 +410,7 @@ bool loadDB(const String& filename) {
                     taginfo->updateLast = tag["updatelast"] | 0;
                     taginfo->currentChannel = tag["ch"] | 0;
                     taginfo->tagSoftwareVersion = tag["ver"] | 0;
+                    syncHotRecord(taginfo);
                 }
             } else {
                 Serial.print(F("deserializeJson() failed: "));
@@ -252,17 +431,457 @@ bool loadDB(const String& filename) {
     return true;
 }
 
+// Binary tagDB: a snapshot file plus an append-only journal of changed records.
+// Both files start with a header, followed by entries:
+//   uint16_t payload length, uint8_t op, payload, uint32_t crc32 over op + payload
+// A PUT payload is a tagRecordBin followed by the alias and modeConfigJson strings,
+// each prefixed with a uint16_t length, and the uint32_t lastChanged. A DELETE payload is the mac only.
+// Newer firmware may append fields to the payload, older readers ignore them.
+
+#define TAGDB_BIN_FILE "/current/tagDB.bin"
+#define TAGDB_JOURNAL_FILE "/current/tagDB.jnl"
+#define TAGDB_MAGIC 0x4244454F  // "OEDB"
+#define TAGDB_FORMAT_VERSION 1
+#define TAGDB_OP_PUT 1
+#define TAGDB_OP_DELETE 2
+#define TAGDB_WRITE_CHUNK 2048
+#define TAGDB_MIN_COMPACT_SIZE 16384
+
+struct tagDBHeader {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t reserved[3];
+} __packed;
+
+struct tagRecordBin {
+    uint8_t mac[8];
+    uint8_t md5[16];
+    uint32_t lastseen;
+    uint32_t nextupdate;
+    uint32_t expectedNextCheckin;
+    uint8_t contentMode;
+    uint8_t LQI;
+    int8_t RSSI;
+    int8_t temperature;
+    uint16_t batteryMv;
+    uint8_t hwType;
+    uint8_t wakeupReason;
+    uint8_t capabilities;
+    uint8_t isExternal;
+    uint32_t apIp;
+    uint8_t rotate;
+    uint8_t lut;
+    uint8_t invert;
+    uint32_t updateCount;
+    uint32_t updateLast;
+    uint8_t currentChannel;
+    uint16_t tagSoftwareVersion;
+} __packed;
+
+// crc of the last persisted payload of each tag
+static std::unordered_map<uint64_t, uint32_t> persistedCrc;
+static size_t journalSize = 0;
+static size_t snapshotSize = 0;
+// one writer of the snapshot and journal at a time, taken before tagDBMutex
+static std::mutex dbWriteMutex;
+
+/// @brief Buffers entries and writes them out in chunks, so fsMutex is only held per chunk
+class DBWriter {
+   public:
+    DBWriter(const char* filename, const char* mode) {
+        fsLock();
+        file = contentFS->open(filename, mode);
+        fsUnlock();
+    }
+
+    ~DBWriter() {
+        close();
+    }
+
+    operator bool() const {
+        return (bool)file;
+    }
+
+    void writeHeader() {
+        tagDBHeader header = {TAGDB_MAGIC, TAGDB_FORMAT_VERSION, {0}};
+        write(reinterpret_cast<const uint8_t*>(&header), sizeof(header));
+    }
+
+    void writeEntry(uint8_t op, const uint8_t* payload, uint16_t len) {
+        uint32_t crc = mz_crc32(MZ_CRC32_INIT, &op, 1);
+        crc = mz_crc32(crc, payload, len);
+        write(reinterpret_cast<const uint8_t*>(&len), sizeof(len));
+        write(&op, 1);
+        write(payload, len);
+        write(reinterpret_cast<const uint8_t*>(&crc), sizeof(crc));
+    }
+
+    void close() {
+        if (file) {
+            flush();
+            fsLock();
+            file.close();
+            fsUnlock();
+        }
+    }
+
+    size_t written = 0;
+
+   private:
+    void write(const uint8_t* data, size_t len) {
+        while (len > 0) {
+            const size_t n = std::min(len, sizeof(buffer) - used);
+            memcpy(buffer + used, data, n);
+            used += n;
+            data += n;
+            len -= n;
+            if (used == sizeof(buffer)) flush();
+        }
+    }
+
+    void flush() {
+        if (used == 0) return;
+        fsLock();
+        file.write(buffer, used);
+        fsUnlock();
+        written += used;
+        used = 0;
+    }
+
+    fs::File file;
+    uint8_t buffer[TAGDB_WRITE_CHUNK];
+    size_t used = 0;
+};
+
+static void fillRecordBin(const tagRecord* taginfo, tagRecordBin& bin) {
+    memcpy(bin.mac, taginfo->mac, sizeof(bin.mac));
+    memcpy(bin.md5, taginfo->md5, sizeof(bin.md5));
+    bin.lastseen = taginfo->lastseen;
+    bin.nextupdate = taginfo->nextupdate;
+    bin.expectedNextCheckin = taginfo->expectedNextCheckin;
+    bin.contentMode = taginfo->contentMode;
+    bin.LQI = taginfo->LQI;
+    bin.RSSI = taginfo->RSSI;
+    bin.temperature = taginfo->temperature;
+    bin.batteryMv = taginfo->batteryMv;
+    bin.hwType = taginfo->hwType;
+    bin.wakeupReason = taginfo->wakeupReason;
+    bin.capabilities = taginfo->capabilities;
+    bin.isExternal = taginfo->isExternal;
+    bin.apIp = (uint32_t)taginfo->apIp;
+    bin.rotate = taginfo->rotate;
+    bin.lut = taginfo->lut;
+    bin.invert = taginfo->invert;
+    bin.updateCount = taginfo->updateCount;
+    bin.updateLast = taginfo->updateLast;
+    bin.currentChannel = taginfo->currentChannel;
+    bin.tagSoftwareVersion = taginfo->tagSoftwareVersion;
+}
+
+static void serializeRecord(const tagRecord* taginfo, std::vector<uint8_t>& out) {
+    tagRecordBin bin;
+    fillRecordBin(taginfo, bin);
+
+    out.clear();
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(&bin);
+    out.insert(out.end(), p, p + sizeof(bin));
+    for (const String* str : {&taginfo->alias, &taginfo->modeConfigJson}) {
+        const uint16_t len = std::min(str->length(), (unsigned int)UINT16_MAX);
+        out.push_back(len & 0xFF);
+        out.push_back(len >> 8);
+        out.insert(out.end(), str->c_str(), str->c_str() + len);
+    }
+    const uint8_t* changed = reinterpret_cast<const uint8_t*>(&taginfo->lastChanged);
+    out.insert(out.end(), changed, changed + sizeof(taginfo->lastChanged));
+}
+
+uint32_t hashRecord(const tagRecord* taginfo) {
+    tagRecordBin bin;
+    fillRecordBin(taginfo, bin);
+    uint32_t hash = mz_crc32(MZ_CRC32_INIT, reinterpret_cast<const uint8_t*>(&bin), sizeof(bin));
+    hash = mz_crc32(hash, reinterpret_cast<const uint8_t*>(taginfo->alias.c_str()), taginfo->alias.length());
+    hash = mz_crc32(hash, reinterpret_cast<const uint8_t*>(taginfo->modeConfigJson.c_str()), taginfo->modeConfigJson.length());
+    hash = mz_crc32(hash, reinterpret_cast<const uint8_t*>(&taginfo->pendingCount), sizeof(taginfo->pendingCount));
+    return hash;
+}
+
+static bool deserializeRecord(const uint8_t* payload, uint16_t len, tagRecord* taginfo) {
+    if (len < sizeof(tagRecordBin)) return false;
+    tagRecordBin bin;
+    memcpy(&bin, payload, sizeof(bin));
+    memcpy(taginfo->md5, bin.md5, sizeof(bin.md5));
+    taginfo->lastseen = bin.lastseen;
+    taginfo->nextupdate = bin.nextupdate;
+    taginfo->expectedNextCheckin = bin.expectedNextCheckin;
+    taginfo->contentMode = bin.contentMode;
+    taginfo->LQI = bin.LQI;
+    taginfo->RSSI = bin.RSSI;
+    taginfo->temperature = bin.temperature;
+    taginfo->batteryMv = bin.batteryMv;
+    taginfo->hwType = bin.hwType;
+    taginfo->wakeupReason = bin.wakeupReason;
+    taginfo->capabilities = bin.capabilities;
+    taginfo->isExternal = bin.isExternal;
+    taginfo->apIp = IPAddress(bin.apIp);
+    taginfo->rotate = bin.rotate;
+    taginfo->lut = bin.lut;
+    taginfo->invert = bin.invert;
+    taginfo->updateCount = bin.updateCount;
+    taginfo->updateLast = bin.updateLast;
+    taginfo->currentChannel = bin.currentChannel;
+    taginfo->tagSoftwareVersion = bin.tagSoftwareVersion;
+
+    size_t pos = sizeof(tagRecordBin);
+    for (String* str : {&taginfo->alias, &taginfo->modeConfigJson}) {
+        if (pos + 2 > len) return false;
+        const uint16_t strLen = payload[pos] | (payload[pos + 1] << 8);
+        pos += 2;
+        if (pos + strLen > len) return false;
+        *str = String(reinterpret_cast<const char*>(payload + pos), strLen);
+        pos += strLen;
+    }
+    // not in files written before it was added
+    if (pos + sizeof(taginfo->lastChanged) <= len) memcpy(&taginfo->lastChanged, payload + pos, sizeof(taginfo->lastChanged));
+    return true;
+}
+
+// Replays all entries of a snapshot or journal file. Returns false if the file has no valid header,
+// a torn entry at the end (power loss while appending) ends the replay and sets torn.
+static bool replayDBFile(const char* filename, size_t& fileSize, bool& torn) {
+    fs::File file = contentFS->open(filename, "r");
+    if (!file) return false;
+    fileSize = file.size();
+
+    tagDBHeader header;
+    if (file.read(reinterpret_cast<uint8_t*>(&header), sizeof(header)) != sizeof(header) || header.magic != TAGDB_MAGIC) {
+        Serial.printf("%s: invalid header\r\n", filename);
+        file.close();
+        return false;
+    }
+    if (header.version > TAGDB_FORMAT_VERSION) {
+        Serial.printf("%s: unknown format version %d\r\n", filename, header.version);
+        file.close();
+        return false;
+    }
+
+    std::vector<uint8_t> payload;
+    uint32_t entries = 0;
+    while (file.available()) {
+        uint16_t len;
+        uint8_t op;
+        uint32_t crc;
+        torn = true;
+        if (file.read(reinterpret_cast<uint8_t*>(&len), sizeof(len)) != sizeof(len)) break;
+        if (file.read(&op, 1) != 1) break;
+        payload.resize(len);
+        if (file.read(payload.data(), len) != len) break;
+        if (file.read(reinterpret_cast<uint8_t*>(&crc), sizeof(crc)) != sizeof(crc)) break;
+        uint32_t check = mz_crc32(MZ_CRC32_INIT, &op, 1);
+        check = mz_crc32(check, payload.data(), len);
+        if (check != crc || len < 8) {
+            Serial.printf("%s: corrupt entry after %d entries\r\n", filename, entries);
+            break;
+        }
+        torn = false;
+
+        const uint8_t* mac = payload.data();
+        if (op == TAGDB_OP_PUT) {
+            tagRecord* taginfo = tagRecord::findByMAC(mac);
+            if (taginfo == nullptr) {
+                taginfo = new tagRecord;
+                memcpy(taginfo->mac, mac, sizeof(taginfo->mac));
+                insertRecord(taginfo);
+            }
+            if (deserializeRecord(payload.data(), len, taginfo)) {
+                persistedCrc[mac2key(mac)] = crc;
+            }
+            syncHotRecord(taginfo);
+        } else if (op == TAGDB_OP_DELETE) {
+            deleteRecord(mac);
+            persistedCrc.erase(mac2key(mac));
+        }
+        entries++;
+    }
+    file.close();
+    return true;
+}
+
+static void compactDBLocked();
+
+bool loadDBbinary() {
+    Serial.println("reading DB from " TAGDB_BIN_FILE);
+    const long t = millis();
+    std::lock_guard<std::mutex> writeLock(dbWriteMutex);
+    std::lock_guard<std::recursive_mutex> lock(tagDBMutex);
+
+    bool snapshotTorn = false;
+    bool journalTorn = false;
+    if (!replayDBFile(TAGDB_BIN_FILE, snapshotSize, snapshotTorn)) {
+        snapshotSize = 0;
+        // a damaged snapshot falls back to the json backups, a missing one is normal until the first compaction
+        if (contentFS->exists(TAGDB_BIN_FILE)) return false;
+    }
+    if (!replayDBFile(TAGDB_JOURNAL_FILE, journalSize, journalTorn)) {
+        journalSize = 0;
+        if (snapshotSize == 0) return false;
+    }
+
+    time_t now;
+    time(&now);
+    for (tagRecord* taginfo : tagDB) {
+        taginfo->pendingCount = 0;
+        if (taginfo->expectedNextCheckin < now) {
+            taginfo->expectedNextCheckin = now + 1800;
+        }
+        syncHotRecord(taginfo);
+    }
+    // the next journalDB() would append behind the torn entry, where no replay reaches
+    if (snapshotTorn || journalTorn) compactDBLocked();
+
+    Serial.println("loadDBbinary took " + String(millis() - t) + "ms, " + String(tagDB.size()) + " tags");
+    return true;
+}
+
+// dbWriteMutex and tagDBMutex held
+static void compactDBLocked() {
+    const long t = millis();
+    const String tmpFilename = TAGDB_BIN_FILE ".tmp";
+
+    std::unordered_map<uint64_t, uint32_t> crcs;
+    {
+        DBWriter writer(tmpFilename.c_str(), "w");
+        if (!writer) {
+            Serial.println("compactDB: Failed to open file for writing");
+            return;
+        }
+        writer.writeHeader();
+        std::vector<uint8_t> payload;
+        for (size_t c = 0; c < tagDB.size(); c++) {
+            const tagRecord* taginfo = tagDB.at(c);
+            serializeRecord(taginfo, payload);
+            writer.writeEntry(TAGDB_OP_PUT, payload.data(), payload.size());
+            uint8_t op = TAGDB_OP_PUT;
+            crcs[mac2key(taginfo->mac)] = mz_crc32(mz_crc32(MZ_CRC32_INIT, &op, 1), payload.data(), payload.size());
+        }
+        writer.close();
+        snapshotSize = writer.written;
+        syncStats.persistBytes += writer.written;
+    }
+
+    fsLock();
+    if (!contentFS->rename(tmpFilename.c_str(), TAGDB_BIN_FILE)) {
+        // not every filesystem replaces an existing file on rename
+        contentFS->remove(TAGDB_BIN_FILE);
+        contentFS->rename(tmpFilename.c_str(), TAGDB_BIN_FILE);
+    }
+    contentFS->remove(TAGDB_JOURNAL_FILE);
+    fsUnlock();
+
+    persistedCrc.swap(crcs);
+    journalSize = 0;
+    Serial.println("DB compacted " + String(millis() - t) + "ms, " + String(snapshotSize) + " bytes");
+}
+
+void compactDB() {
+    std::lock_guard<std::mutex> writeLock(dbWriteMutex);
+    std::lock_guard<std::recursive_mutex> lock(tagDBMutex);
+    compactDBLocked();
+}
+
+void journalDB() {
+    std::lock_guard<std::mutex> writeLock(dbWriteMutex);
+    std::lock_guard<std::recursive_mutex> lock(tagDBMutex);
+    const long t = millis();
+    std::vector<uint8_t> payload;
+    DBWriter* writer = nullptr;
+    uint32_t count = 0;
+
+    auto append = [&](uint8_t op, const uint8_t* data, uint16_t len) -> bool {
+        if (writer == nullptr) {
+            const bool isNew = journalSize == 0;
+            writer = new DBWriter(TAGDB_JOURNAL_FILE, isNew ? "w" : "a");
+            if (isNew && *writer) writer->writeHeader();
+        }
+        if (!*writer) return false;
+        writer->writeEntry(op, data, len);
+        count++;
+        return true;
+    };
+
+    time_t now;
+    time(&now);
+    for (size_t c = 0; c < tagDB.size(); c++) {
+        tagRecord* taginfo = tagDB.at(c);
+        serializeRecord(taginfo, payload);
+        uint8_t op = TAGDB_OP_PUT;
+        uint32_t crc = mz_crc32(mz_crc32(MZ_CRC32_INIT, &op, 1), payload.data(), payload.size());
+        const uint64_t key = mac2key(taginfo->mac);
+        auto it = persistedCrc.find(key);
+        if (it != persistedCrc.end() && it->second == crc) {
+            syncStats.persistSkipped++;
+            continue;
+        }
+        // also changes that never went out on the websocket are found by /get_db?since=
+        if (taginfo->lastChanged != (uint32_t)now) {
+            taginfo->lastChanged = now;
+            serializeRecord(taginfo, payload);
+            crc = mz_crc32(mz_crc32(MZ_CRC32_INIT, &op, 1), payload.data(), payload.size());
+        }
+        if (!append(op, payload.data(), payload.size())) break;
+        persistedCrc[key] = crc;
+        syncStats.persistWritten++;
+    }
+
+    for (auto it = persistedCrc.begin(); it != persistedCrc.end();) {
+        if (tagIndex.find(it->first) == tagIndex.end()) {
+            uint8_t mac[8];
+            memcpy(mac, &it->first, sizeof(mac));
+            if (!append(TAGDB_OP_DELETE, mac, sizeof(mac))) break;
+            it = persistedCrc.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    if (writer != nullptr) {
+        const bool ok = *writer;
+        writer->close();
+        journalSize += writer->written;
+        syncStats.persistBytes += writer->written;
+        delete writer;
+        if (!ok) {
+            Serial.println("journalDB: Failed to open journal, writing full DB");
+            compactDBLocked();
+            return;
+        }
+        Serial.println("DB journaled " + String(count) + " records " + String(millis() - t) + "ms");
+    }
+
+    if (journalSize > std::max((size_t)TAGDB_MIN_COMPACT_SIZE, snapshotSize)) {
+        compactDBLocked();
+    }
+}
+
 void destroyDB() {
     Serial.println("destroying DB");
     util::printHeap();
+    std::lock_guard<std::mutex> writeLock(dbWriteMutex);
+    std::lock_guard<std::recursive_mutex> lock(tagDBMutex);
     for (tagRecord*& tag : tagDB) {
-        if (tag->data != nullptr) {
-            free(tag->data);
-        }
-        tag->data = nullptr;
-        delete tag;
+        freeRecord(tag);
     }
     tagDB.clear();
+    tagHot.clear();
+    {
+        std::lock_guard<std::mutex> lock(schedMutex);
+        schedHeap.clear();
+    }
+    tagIndex.clear();
+    persistedCrc.clear();
+    for (auto& shadow : tagShadowDB) {
+        freeRecord(shadow.second);
+    }
+    tagShadowDB.clear();
     util::printHeap();
 }
 
@@ -275,17 +894,17 @@ uint32_t getTagCount(uint32_t& timeoutcount, uint32_t& lowbattcount) {
     uint32_t tagcount = 0;
     time_t now;
     time(&now);
-    for (const tagRecord* taginfo : tagDB) {
-        if (!taginfo->isExternal) tagcount++;
-        const int32_t timeout = now - taginfo->lastseen;
-        if (taginfo->expectedNextCheckin < 3600) {
+    for (const tagHotRecord& hot : tagHot) {
+        if (!(hot.flags & TAGHOT_EXTERNAL)) tagcount++;
+        const int32_t timeout = now - hot.lastseen;
+        if (hot.expectedNextCheckin < 3600) {
             // not initialised, timeout if not seen last 10 minutes
             if (timeout > 600) timeoutcount++;
-        } else if (now - taginfo->expectedNextCheckin > 600) {
+        } else if (now - hot.expectedNextCheckin > 600) {
             // expected checkin is behind, timeout if not seen last 10 minutes
             if (timeout > 600) timeoutcount++;
         }
-        if (taginfo->batteryMv < 2400 && taginfo->batteryMv != 0 && taginfo->batteryMv != 1337) lowbattcount++;
+        if (hot.batteryMv < 2400 && hot.batteryMv != 0 && hot.batteryMv != 1337) lowbattcount++;
     }
     return tagcount;
 }
@@ -350,7 +969,7 @@ void initAPconfig() {
 }
 
 void saveAPconfig() {
-    xSemaphoreTake(fsMutex, portMAX_DELAY);
+    fsLock();
     fs::File configFile = contentFS->open("/current/apconfig.json", "w");
     DynamicJsonDocument APconfig(500);
     APconfig["channel"] = config.channel;
@@ -374,10 +993,14 @@ void saveAPconfig() {
     APconfig["discovery"] = config.discovery;
     serializeJsonPretty(APconfig, configFile);
     configFile.close();
-    xSemaphoreGive(fsMutex);
+    fsUnlock();
+
+    // sleep times and runstate change what contentRunner does with a due tag
+    rescheduleAll();
 }
 
 HwType getHwType(const uint8_t id) {
+    std::lock_guard<std::mutex> lock(hwdataMutex);
     auto it = hwdata.find(id);
     if (it != hwdata.end()) {
         return it->second;
@@ -388,7 +1011,7 @@ HwType getHwType(const uint8_t id) {
         File jsonFile = contentFS->open(filename, "r");
 
         if (jsonFile) {
-            StaticJsonDocument<150> filter;
+            StaticJsonDocument<224> filter;
             filter["width"] = true;
             filter["height"] = true;
             filter["rotatebuffer"] = true;
@@ -396,6 +1019,8 @@ HwType getHwType(const uint8_t id) {
             filter["shortlut"] = true;
             filter["zlib_compression"] = true;
             filter["g5_compression"] = true;
+            filter["zlib_rowxor"] = true;
+            filter["delta_compression"] = true;
             filter["highlight_color"] = true;
             filter["colortable"] = true;
             StaticJsonDocument<1000> doc;
@@ -422,6 +1047,16 @@ HwType getHwType(const uint8_t id) {
                 } else {
                     hwType.g5 = 0;
                 }
+                if (doc.containsKey("zlib_rowxor")) {
+                    hwType.zlibXor = strtol(doc["zlib_rowxor"], nullptr, 16);
+                } else {
+                    hwType.zlibXor = 0;
+                }
+                if (doc.containsKey("delta_compression")) {
+                    hwType.delta = strtol(doc["delta_compression"], nullptr, 16);
+                } else {
+                    hwType.delta = 0;
+                }
                 hwType.highlightColor = doc.containsKey("highlight_color") ? doc["highlight_color"].as<uint16_t>() : 2;
                 JsonObject colorTable = doc["colortable"];
                 for (auto kv : colorTable) {
@@ -439,6 +1074,25 @@ HwType getHwType(const uint8_t id) {
     }
 }
 
+std::shared_ptr<uint16_t> getPaletteLut(const uint8_t id, const uint8_t variant) {
+    std::lock_guard<std::mutex> lock(hwdataMutex);
+    auto it = hwdata.find(id);
+    if (it == hwdata.end() || variant >= 4) return nullptr;
+    std::shared_ptr<uint16_t>& lut = it->second.paletteLuts[variant];
+    if (!lut) {
+#ifdef BOARD_HAS_PSRAM
+        uint16_t* table = (uint16_t*)ps_malloc(65536 * sizeof(uint16_t));
+#else
+        // 128kB is more than the heap can spare
+        uint16_t* table = nullptr;
+#endif
+        if (table == nullptr) return nullptr;
+        memset(table, 0xFF, 65536 * sizeof(uint16_t));
+        lut = std::shared_ptr<uint16_t>(table, free);
+    }
+    return lut;
+}
+
 bool setVarDB(const std::string& key, const String& value, const bool notify) {
     auto it = varDB.find(key);
     if (it == varDB.end()) {
@@ -473,13 +1127,7 @@ void cleanupCurrent() {
         String filename = file.name();
         uint8_t mac[8];
         if (hex2mac(getBaseName(filename), mac)) {
-            bool found = false;
-            for (tagRecord* record : tagDB) {
-                if (memcmp(record->mac, mac, 8) == 0) {
-                    found = true;
-                    break;
-                }
-            }
+            const bool found = tagRecord::findByMAC(mac) != nullptr;
             if (!found || filename.endsWith(".pending")) {
                 filename = file.path();
                 file.close();
@@ -504,16 +1152,53 @@ void cleanupCurrent() {
 }
 
 void pushTagInfo(tagRecord* taginfo) {
+    std::lock_guard<std::recursive_mutex> lock(tagDBMutex);
     tagRecord* taginfo2 = new tagRecord(*taginfo);
     taginfo2->version = 1;
-    tagDB.push_back(taginfo2);
+    // the pending buffer belongs to the live record, don't let the copy free it
+    taginfo2->data = nullptr;
+
+    const uint64_t key = mac2key(taginfo->mac);
+    auto it = tagShadowDB.find(key);
+    if (it != tagShadowDB.end()) {
+        freeRecord(it->second);
+        it->second = taginfo2;
+    } else {
+        tagShadowDB[key] = taginfo2;
+    }
 }
 
 void popTagInfo(const uint8_t mac[8]) {
-    for (tagRecord* tag : tagDB) {
-        if (memcmp(tag->mac, mac, 8) == 0 && tag->version == 1) {
-            deleteRecord(mac, false);
-            tag->version = 0;
+    std::lock_guard<std::recursive_mutex> lock(tagDBMutex);
+    const uint64_t key = mac2key(mac);
+    auto shadow = tagShadowDB.find(key);
+    if (shadow == tagShadowDB.end()) {
+        return;
+    }
+    tagRecord* tag = shadow->second;
+    tagShadowDB.erase(shadow);
+    tag->version = 0;
+    tag->wsHash = 0;
+    tag->syncHash = 0;
+
+    // put the restored record in the slot of the live one, so the order of tagDB is preserved
+    auto it = tagIndex.find(key);
+    if (it != tagIndex.end()) {
+        tagRecord* live = it->second;
+        auto pos = std::find(tagDB.begin(), tagDB.end(), live);
+        it->second = tag;
+        if (pos != tagDB.end()) {
+            *pos = tag;
+            tag->hotSlot = pos - tagDB.begin();
+            syncHotRecord(tag);
+            time_t now;
+            time(&now);
+            scheduleRecord(tag, plannedRun(tag, now));
+        } else {
+            insertRecord(tag);
         }
+        freeRecord(live);
+    } else {
+        insertRecord(tag);
     }
 }
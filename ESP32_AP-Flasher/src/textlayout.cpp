@@ -0,0 +1,94 @@
+#include "textlayout.h"
+
+#include <Arduino.h>
+
+// code point starting at pos, pos moves past it. Bytes that aren't valid UTF-8 stand for themselves
+static uint16_t nextChar(const String &text, uint16_t &pos) {
+    const uint8_t c = text[pos++];
+    if (c < 0x80) return c;
+    uint8_t extra = ((c & 0xE0) == 0xC0) ? 1 : ((c & 0xF0) == 0xE0) ? 2 : ((c & 0xF8) == 0xF0) ? 3 : 0;
+    if (extra == 0) return c;
+    uint32_t code = c & (0x3F >> extra);
+    while (extra-- && pos < text.length() && (text[pos] & 0xC0) == 0x80) {
+        code = code << 6 | (text[pos++] & 0x3F);
+    }
+    return code > 0xFFFF ? 0xFFFD : code;
+}
+
+// shortens the last line until "..." fits behind it
+static void addEllipsis(const String &text, int16_t boxwidth, const measureFunc &measure, textLine &line) {
+    const glyphMetrics dot = measure('.', 0);
+    const int32_t dots = 2 * dot.advance + dot.extent;
+
+    int32_t penX = 0;
+    uint16_t pos = line.start;
+    uint16_t prev = 0;
+    uint16_t end = line.start;
+    int32_t width = dots;
+    while (pos < line.end) {
+        uint16_t next = pos;
+        const uint16_t code = nextChar(text, next);
+        const glyphMetrics m = measure(code, prev);
+        const int32_t pen = penX + (pos == line.start ? m.lead : 0) + m.advance;
+        if (pen + dots > boxwidth) break;
+        penX = pen;
+        pos = next;
+        prev = code;
+        if (code != ' ') {
+            end = pos;
+            width = penX + dots;
+        }
+    }
+    line.end = end;
+    line.width = width;
+    line.ellipsis = true;
+}
+
+bool layoutText(const String &text, int16_t boxwidth, uint16_t maxLines, const measureFunc &measure, std::vector<textLine> &lines, bool ellipsis) {
+    lines.clear();
+    const uint16_t length = text.length();
+    uint16_t start = 0;
+
+    while (start < length && lines.size() < maxLines) {
+        // width of the line so far, and where the pen is for the next character
+        int32_t width = 0;
+        int32_t penX = 0;
+        uint16_t pos = start;
+        uint16_t prev = 0;
+        uint16_t lastBreak = 0;
+        int32_t breakWidth = 0;
+
+        while (pos < length) {
+            uint16_t next = pos;
+            const uint16_t code = nextChar(text, next);
+            if (code == '\n') break;
+            const glyphMetrics m = measure(code, prev);
+            const int32_t lead = (pos == start) ? m.lead : 0;
+            // a character wider than the box still gets a line of its own
+            if (penX + lead + m.extent > boxwidth && pos != start) break;
+            width = penX + lead + m.extent;
+            penX += lead + m.advance;
+            pos = next;
+            prev = code;
+            if (code == ' ' || code == '-') {
+                lastBreak = pos;
+                breakWidth = width;
+            }
+        }
+
+        // the box ended inside a word, it goes to the next line
+        if (pos < length && text[pos] != '\n' && lastBreak != 0 && lastBreak != pos) {
+            pos = lastBreak;
+            width = breakWidth;
+        }
+        lines.push_back({start, pos, (int16_t)width, false});
+
+        if (pos < length && text[pos] == '\n') pos++;
+        while (pos < length && text[pos] == ' ') pos++;
+        start = pos;
+    }
+
+    const bool complete = start >= length;
+    if (!complete && ellipsis && !lines.empty()) addEllipsis(text, boxwidth, measure, lines.back());
+    return complete;
+}
@@ -1,8 +1,93 @@
 #include "truetype.h"
 
+#include <algorithm>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
 //Kerning is optional. Many fonts don't have kerning tables anyway.
 //#define ENABLEKERNING
 
+// character lookups of a font, they don't depend on the size
+struct fontGlyphs {
+    std::unordered_map<uint16_t, ttGlyphInfo_t> codes;
+    uint32_t lastUsed;
+};
+
+struct glyphCacheEntry {
+    std::shared_ptr<ttGlyphRaster_t> raster;
+    uint32_t bytes;
+    std::list<uint64_t>::iterator lru;
+};
+
+static std::mutex ttCacheMutex;
+static std::unordered_map<uint64_t, fontGlyphs> fontCache;
+// most recently drawn first
+static std::list<uint64_t> glyphLru;
+static std::unordered_map<uint64_t, glyphCacheEntry> glyphCache;
+static uint32_t glyphCacheBytes = 0;
+static uint32_t glyphHits = 0, glyphMisses = 0, glyphEvictions = 0;
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t len) {
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    while (len--) {
+        hash ^= *p++;
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+// the font key is hashed too, as the seed two keys a few bits apart would give the same key for neighbouring glyphs
+static uint64_t glyphKey(uint64_t fontKey, uint16_t size, uint16_t code, uint8_t levels) {
+    const uint32_t glyph = (uint32_t)size << 16 | code;
+    const uint64_t hash = fnv1a(0xCBF29CE484222325ULL, &fontKey, sizeof(fontKey));
+    return fnv1a(fnv1a(hash, &glyph, sizeof(glyph)), &levels, sizeof(levels));
+}
+
+static inline int32_t floorDiv(int32_t num, int32_t den) {
+    const int32_t q = num / den;
+    return (num % den != 0 && (num < 0) != (den < 0)) ? q - 1 : q;
+}
+
+static std::shared_ptr<ttGlyphRaster_t> findRaster(uint64_t key) {
+    std::lock_guard<std::mutex> lock(ttCacheMutex);
+    auto it = glyphCache.find(key);
+    if (it == glyphCache.end()) {
+        glyphMisses++;
+        return nullptr;
+    }
+    glyphHits++;
+    glyphLru.splice(glyphLru.begin(), glyphLru, it->second.lru);
+    return it->second.raster;
+}
+
+static void storeRaster(uint64_t key, const std::shared_ptr<ttGlyphRaster_t> &raster) {
+    const uint32_t bytes = sizeof(ttGlyphRaster_t) + sizeof(glyphCacheEntry) + (raster->width * raster->bpp + 7) / 8 * raster->height;
+    if (bytes > TTF_GLYPH_CACHE_BYTES / 4) return;
+    std::lock_guard<std::mutex> lock(ttCacheMutex);
+    if (glyphCache.count(key)) return;
+    while (!glyphLru.empty() && glyphCacheBytes + bytes > TTF_GLYPH_CACHE_BYTES) {
+        auto victim = glyphCache.find(glyphLru.back());
+        glyphCacheBytes -= victim->second.bytes;
+        glyphCache.erase(victim);
+        glyphLru.pop_back();
+        glyphEvictions++;
+    }
+    glyphLru.push_front(key);
+    glyphCache[key] = {raster, bytes, glyphLru.begin()};
+    glyphCacheBytes += bytes;
+}
+
+void glyphCacheStatsToJson(JsonObject &obj) {
+    std::lock_guard<std::mutex> lock(ttCacheMutex);
+    obj["entries"] = glyphCache.size();
+    obj["bytes"] = glyphCacheBytes;
+    obj["hits"] = glyphHits;
+    obj["misses"] = glyphMisses;
+    obj["evictions"] = glyphEvictions;
+    obj["fonts"] = fontCache.size();
+}
+
 truetypeClass::truetypeClass() {}
 
 void truetypeClass::end() {
@@ -10,6 +95,15 @@ void truetypeClass::end() {
     freePointsAll();
     freeGlyph();
     if (table != nullptr) free(table);
+    free(edges);
+    free(activeEdges);
+    free(rowDeltas);
+    free(rowSamples);
+    edges = nullptr;
+    activeEdges = nullptr;
+    rowDeltas = nullptr;
+    rowSamples = nullptr;
+    edgesSize = rowSize = 0;
 }
 
 uint8_t truetypeClass::setTtfFile(File _file, uint8_t _checkCheckSum) {
@@ -18,6 +112,14 @@ uint8_t truetypeClass::setTtfFile(File _file, uint8_t _checkCheckSum) {
     }
 
     file = _file;
+    u32ReadOffset = 0;
+    u32FileOffset = file.position();
+    for (uint8_t i = 0; i < TTF_BLOCKS; i++) u16BlockLength[i] = 0;
+    const size_t fileSize = file.size();
+    const time_t lastWrite = file.getLastWrite();
+    fontKey = fnv1a(0xCBF29CE484222325ULL, file.path(), strlen(file.path()));
+    fontKey = fnv1a(fontKey, &fileSize, sizeof(fileSize));
+    fontKey = fnv1a(fontKey, &lastWrite, sizeof(lastWrite));
     if (readTableDirectory(_checkCheckSum) == 0) {
         file.close();
         return 0;
@@ -32,15 +134,19 @@ uint8_t truetypeClass::setTtfFile(File _file, uint8_t _checkCheckSum) {
         file.close();
         return 0;
     }
-    iBufferedBytes = 0;
 #ifdef ENABLEKERNING
     readKern();
 #endif
     readHeadTable();
     readHhea();
+    findGlyphTables();
     return 1;
 }
 
+void truetypeClass::setFontKey(uint64_t _key) {
+    fontKey = _key;
+}
+
 void truetypeClass::setTtfDrawPixel(TTF_DRAWPIXEL *p) {
     pfnDrawPixel = p;
 }
@@ -49,6 +155,9 @@ uint8_t truetypeClass::setTtfPointer(uint8_t *p, uint32_t u32Size, uint8_t _chec
     pTTF = p;
     u32TTFSize = u32Size;
     bFlash = bF;
+    const uintptr_t address = (uintptr_t)p;
+    fontKey = fnv1a(0xCBF29CE484222325ULL, &address, sizeof(address));
+    fontKey = fnv1a(fontKey, &u32Size, sizeof(u32Size));
 
     if (readTableDirectory(_checkCheckSum) == 0) {
         file.close();
@@ -69,34 +178,65 @@ uint8_t truetypeClass::setTtfPointer(uint8_t *p, uint32_t u32Size, uint8_t _chec
     readKern();
 #endif
     readHeadTable();
+    readHhea();
+    findGlyphTables();
     return 1;
 
 } 
 
+/* block of the file holding u32Offset, read into the least recently used block when it isn't cached */
+int8_t truetypeClass::fileBlock(uint32_t u32Offset) {
+    const uint32_t u32Start = u32Offset - u32Offset % TTF_BLOCK_SIZE;
+    if (u16BlockLength[u8LastBlock] && u32BlockOffset[u8LastBlock] == u32Start) return u8LastBlock;
+
+    uint8_t victim = 0;
+    for (uint8_t i = 0; i < TTF_BLOCKS; i++) {
+        if (u16BlockLength[i] && u32BlockOffset[i] == u32Start) {
+            u32BlockUsed[i] = ++u32BlockClock;
+            u8LastBlock = i;
+            return i;
+        }
+        if (u32BlockUsed[i] < u32BlockUsed[victim]) victim = i;
+    }
+
+    if (u32FileOffset != u32Start && !file.seek(u32Start)) {
+        u32FileOffset = UINT32_MAX;
+        return -1;
+    }
+    const int iRead = file.read(u8Blocks[victim], TTF_BLOCK_SIZE);
+    u32FileOffset = u32Start + (iRead > 0 ? iRead : 0);
+    if (iRead <= 0) {
+        u16BlockLength[victim] = 0;
+        return -1;
+    }
+    u32BlockOffset[victim] = u32Start;
+    u16BlockLength[victim] = iRead;
+    u32BlockUsed[victim] = ++u32BlockClock;
+    u8LastBlock = victim;
+    return victim;
+}
+
 int truetypeClass::ttfRead(uint8_t *d, int iLen) {
     if (!pTTF) {
-        //return file.read(d, iLen);
         int totalBytesRead = 0;
 
         while (iLen > 0) {
-            if (iBufferedBytes == 0) {
-                iBufferedBytes = file.read(u8FileBuf, FILE_BUF_SIZE);
-                iCurrentBufSize = iBufferedBytes;
-                if (iBufferedBytes <= 0) break;
-                u32BufPosition = 0;
-            }
+            const int8_t block = fileBlock(u32ReadOffset);
+            if (block < 0) break;
+            const uint32_t u32InBlock = u32ReadOffset - u32BlockOffset[block];
+            if (u32InBlock >= u16BlockLength[block]) break;  // end of file
 
-            int bytesToCopy = min(iLen, iBufferedBytes);
-            memcpy(d, u8FileBuf + u32BufPosition, bytesToCopy);
+            int bytesToCopy = min(iLen, (int)(u16BlockLength[block] - u32InBlock));
+            memcpy(d, u8Blocks[block] + u32InBlock, bytesToCopy);
 
             d += bytesToCopy;
             iLen -= bytesToCopy;
-            iBufferedBytes -= bytesToCopy;
-            u32BufPosition += bytesToCopy;
+            u32ReadOffset += bytesToCopy;
             totalBytesRead += bytesToCopy;
         }
         return totalBytesRead;
     } else {
+        // fonts in memory are read in place
 
         if (u32TTFOffset + iLen > u32TTFSize) {
             iLen = u32TTFSize - u32TTFOffset;
@@ -115,18 +255,8 @@ int truetypeClass::ttfRead(uint8_t *d, int iLen) {
 
 void truetypeClass::ttfSeek(uint32_t u32Offset) {
     if (!pTTF) {
-        /*
-        TODO/FIXME: for some reason this doesn't work.
-        If a seek position is within the current loaded buffer, it should just change the buffer position
-
-        if (u32Offset >= file.position() - iCurrentBufSize && u32Offset < file.position()) {
-            u32BufPosition = u32Offset - (file.position() - iCurrentBufSize);
-            iBufferedBytes = file.position() - u32Offset;
-        } else {
-        */
-            file.seek(u32Offset);
-            iBufferedBytes = 0;
-        // }
+        // the file is only seeked when a block that isn't cached gets read
+        u32ReadOffset = u32Offset;
     } else {
         if (u32Offset > u32TTFSize) {
             u32Offset = u32TTFSize;
@@ -137,7 +267,7 @@ void truetypeClass::ttfSeek(uint32_t u32Offset) {
 
 uint32_t truetypeClass::ttfPosition(void) {
     if (!pTTF) {
-        return file.position() - iBufferedBytes;
+        return u32ReadOffset;
     } else {
         return u32TTFOffset;
     }
@@ -209,6 +339,10 @@ void truetypeClass::setTextRotation(uint16_t _rotation) {
     stringRotation = _rotation;
 }
 
+void truetypeClass::setTextCoverage(uint8_t _levels) {
+    coverageLevels = (_levels == 4) ? 4 : 2;
+}
+
 /* ----------------private---------------- */
 /* calculate checksum */
 uint32_t truetypeClass::calculateCheckSum(uint32_t offset, uint32_t length) {
@@ -462,42 +596,68 @@ uint8_t truetypeClass::readHMetric() {
     return 1;
 }
 
-ttHMetric_t truetypeClass::getHMetric(uint16_t _code) {
+ttHMetric_t truetypeClass::getHMetric(const ttGlyphInfo_t &_info) {
     ttHMetric_t result;
-    result.advanceWidth = 0;
+    result.advanceWidth = (_info.advanceWidth * characterSize) / headTable.unitsPerEm;
+    result.leftSideBearing = (_info.leftSideBearing * characterSize) / headTable.unitsPerEm;
+    return result;
+}
 
-    ttfSeek(hmtxTablePos + (_code * 4));
-    result.advanceWidth = getUInt16t();
-    result.leftSideBearing = getInt16t();
+/* glyph id and hmtx entry of a character, from the font cache when it was looked up before */
+ttGlyphInfo_t truetypeClass::glyphInfo(uint16_t _code) {
+    {
+        std::lock_guard<std::mutex> lock(ttCacheMutex);
+        auto font = fontCache.find(fontKey);
+        if (font != fontCache.end()) {
+            font->second.lastUsed = millis();
+            auto it = font->second.codes.find(_code);
+            if (it != font->second.codes.end()) return it->second;
+        }
+    }
 
-    result.advanceWidth = (result.advanceWidth * characterSize) / headTable.unitsPerEm;
-    result.leftSideBearing = (result.leftSideBearing * characterSize) / headTable.unitsPerEm;
-    return result;
+    ttGlyphInfo_t info;
+    info.glyphId = codeToGlyphId(_code);
+    ttfSeek(hmtxTablePos + (info.glyphId * 4));
+    info.advanceWidth = getUInt16t();
+    info.leftSideBearing = getInt16t();
+
+    std::lock_guard<std::mutex> lock(ttCacheMutex);
+    if (!fontCache.count(fontKey) && fontCache.size() >= TTF_FONT_CACHE_FONTS) {
+        fontCache.erase(std::min_element(fontCache.begin(), fontCache.end(), [](const auto &a, const auto &b) {
+            return a.second.lastUsed < b.second.lastUsed;
+        }));
+    }
+    fontGlyphs &font = fontCache[fontKey];
+    font.lastUsed = millis();
+    if (font.codes.size() < TTF_FONT_CACHE_CODES) font.codes[_code] = info;
+    return info;
+}
+
+/* positions of loca and glyf, looked up once per font */
+void truetypeClass::findGlyphTables() {
+    locaTablePos = 0;
+    glyfTablePos = 0;
+    for (int i = 0; i < numTables; i++) {
+        if (strcmp(table[i].name, "loca") == 0) locaTablePos = table[i].offset;
+        if (strcmp(table[i].name, "glyf") == 0) glyfTablePos = table[i].offset;
+    }
 }
 
 /* get glyph offset */
 uint32_t truetypeClass::getGlyphOffset(uint16_t index) {
     uint32_t offset = 0;
 
-    for (int i = 0; i < numTables; i++) {
-        if (strcmp(table[i].name, "loca") == 0) {
-            if (headTable.indexToLocFormat == 1) {
-                ttfSeek(table[i].offset + index * 4);
-                offset = getUInt32t();
-            } else {
-                ttfSeek(table[i].offset + index * 2);
-                offset = getUInt16t() * 2;
-            }
-            break;
-        }
-    }
-
-    for (int i = 0; i < numTables; i++) {
-        if (strcmp(table[i].name, "glyf") == 0) {
-            return (offset + table[i].offset);
+    if (locaTablePos) {
+        if (headTable.indexToLocFormat == 1) {
+            ttfSeek(locaTablePos + index * 4);
+            offset = getUInt32t();
+        } else {
+            ttfSeek(locaTablePos + index * 2);
+            offset = getUInt16t() * 2;
         }
     }
 
+    if (glyfTablePos) return offset + glyfTablePos;
     return 0;
 }
 
@@ -545,8 +705,6 @@ void truetypeClass::readCoords(char _xy, uint16_t _startPoint) {
 uint8_t truetypeClass::readSimpleGlyph(uint8_t _addGlyph) {
     uint8_t repeatCount;
     uint8_t flag;
-    static uint16_t counterContours;
-    static uint16_t counterPoints;
 
     if (glyph.numberOfContours <= 0) {
         return 0;
@@ -787,11 +945,12 @@ void truetypeClass::generateOutline(int16_t _x, int16_t _y, uint16_t characterSi
 
 void truetypeClass::addLine(float _x0, float _y0, float _x1, float _y1) {
 
+    // outlines are generated at the origin, flooring keeps them on the pixels of the old absolute truncation
     if (numPoints == 0) {
-        addPoint(_x0, _y0);
+        addPoint(floorf(_x0), floorf(_y0));
         addBeginPoint(0);
     }
-    addPoint(_x1, _y1);
+    addPoint(floorf(_x1), floorf(_y1));
 
     /*
         int16_t dx = abs(x1 - x0);
@@ -818,86 +977,185 @@ void truetypeClass::addLine(float _x0, float _y0, float _x1, float _y1) {
     */
 }
 
-void truetypeClass::fillGlyph(int16_t _x_min, int16_t _y_min, uint16_t characterSize) {
-    for (int16_t y = round((float)(ascender - glyph.yMax) * (float)characterSize / (float)headTable.unitsPerEm + _y_min);
-         y < round((float)(ascender - glyph.yMin) * (float)characterSize / (float)headTable.unitsPerEm + _y_min);
-         y++) {
-        ttCoordinate_t point1, point2;
-        ttCoordinate_t point;
-        point.y = (float)y;
-
-        uint16_t intersectPointsNum = 0;
-        uint16_t bpCounter = 0;
-        uint16_t epCounter = 0;
-        uint16_t p2Num = 0;
-
-        for (uint16_t i = 0; i < numPoints; i++) {
-            point1 = points[i];
-            // Wrap?
-            if (i == endPoints[epCounter]) {
-                p2Num = beginPoints[bpCounter];
-                epCounter++;
-                bpCounter++;
-            } else {
-                p2Num = i + 1;
-            }
-            point2 = points[p2Num];
-
-            if (point1.y <= (float)y) {
-                if (point2.y > (float)y) {
-                    // Have a valid up intersect
-                    intersectPointsNum++;
-                    pointsToFill = (ttWindIntersect_t *)realloc(pointsToFill, sizeof(ttWindIntersect_t) * intersectPointsNum);
-                    pointsToFill[intersectPointsNum - 1].p1 = i;
-                    pointsToFill[intersectPointsNum - 1].p2 = p2Num;
-                    pointsToFill[intersectPointsNum - 1].up = 1;
-                }
-            } else {
-                // start y > point.y (no test needed)
-                if (point2.y <= (float)y) {
-                    // Have a valid down intersect
-                    intersectPointsNum++;
-                    pointsToFill = (ttWindIntersect_t *)realloc(pointsToFill, sizeof(ttWindIntersect_t) * intersectPointsNum);
-                    pointsToFill[intersectPointsNum - 1].p1 = i;
-                    pointsToFill[intersectPointsNum - 1].p2 = p2Num;
-                    pointsToFill[intersectPointsNum - 1].up = 0;
-                }
+/*
+  Active edge list scanline fill of the outline in points, at _scale samples per pixel each way.
+  Edges and samples are integers: a sample is inside when the edges right of it (crossing > x)
+  have a non-zero winding sum, the same rule the float point-in-polygon test used to have.
+*/
+void truetypeClass::fillGlyph(ttGlyphRaster_t &raster, uint8_t _scale) {
+    if (numPoints == 0) return;
+    if (numPoints > edgesSize) {
+        ttEdge_t *newEdges = (ttEdge_t *)realloc(edges, sizeof(ttEdge_t) * numPoints);
+        if (newEdges != nullptr) edges = newEdges;
+        uint16_t *newActive = (uint16_t *)realloc(activeEdges, sizeof(uint16_t) * numPoints);
+        if (newActive != nullptr) activeEdges = newActive;
+        if (newEdges == nullptr || newActive == nullptr) return;
+        edgesSize = numPoints;
+    }
+    const uint16_t span = raster.width * _scale;
+    if (span + 1 > rowSize) {
+        int16_t *newDeltas = (int16_t *)realloc(rowDeltas, sizeof(int16_t) * (span + 1));
+        if (newDeltas != nullptr) rowDeltas = newDeltas;
+        uint8_t *newSamples = (uint8_t *)realloc(rowSamples, span + 1);
+        if (newSamples != nullptr) rowSamples = newSamples;
+        if (newDeltas == nullptr || newSamples == nullptr) return;
+        rowSize = span + 1;
+    }
+
+    // edge table, horizontal edges never cross a row
+    uint16_t numEdges = 0;
+    uint16_t bpCounter = 0;
+    uint16_t epCounter = 0;
+    for (uint16_t i = 0; i < numPoints; i++) {
+        uint16_t p2Num;
+        if (i == endPoints[epCounter]) {
+            p2Num = beginPoints[bpCounter];
+            epCounter++;
+            bpCounter++;
+        } else {
+            p2Num = i + 1;
+        }
+        const int16_t x1 = points[i].x, y1 = points[i].y;
+        const int16_t x2 = points[p2Num].x, y2 = points[p2Num].y;
+        if (y1 == y2) continue;
+        ttEdge_t &edge = edges[numEdges++];
+        edge.dir = (y2 > y1) ? 1 : -1;
+        edge.x0 = (y2 > y1) ? x1 : x2;
+        edge.y0 = (y2 > y1) ? y1 : y2;
+        edge.y1 = (y2 > y1) ? y2 : y1;
+        edge.dx = (y2 > y1) ? x2 - x1 : x1 - x2;
+        edge.dy = edge.y1 - edge.y0;
+    }
+    std::sort(edges, edges + numEdges, [](const ttEdge_t &a, const ttEdge_t &b) { return a.y0 < b.y0; });
+
+    const uint16_t stride = (raster.width * raster.bpp + 7) / 8;
+    const int32_t xStart = raster.left * _scale;
+    const int32_t yStart = raster.top * _scale;
+    const uint16_t samples = _scale * _scale;
+    uint16_t nextEdge = 0;
+    uint16_t numActive = 0;
+
+    for (int32_t ys = yStart; ys < yStart + raster.height * _scale; ys++) {
+        const uint16_t row = (ys - yStart) / _scale;
+        if ((ys - yStart) % _scale == 0) memset(rowSamples, 0, raster.width);
+
+        while (nextEdge < numEdges && edges[nextEdge].y0 <= ys) {
+            ttEdge_t &edge = edges[nextEdge];
+            if (edge.y1 > ys) {
+                const int32_t num = edge.dx * (ys - edge.y0);
+                edge.q = floorDiv(num, edge.dy);
+                edge.r = num - edge.q * edge.dy;
+                activeEdges[numActive++] = nextEdge;
             }
+            nextEdge++;
         }
 
-        for (int16_t x = _x_min + round((float)glyph.xMin * (float)characterSize / (float)headTable.unitsPerEm);
-             x < _x_min + round((float)glyph.xMax * (float)characterSize / (float)headTable.unitsPerEm);
-             x++) {
-            int16_t windingNumber = 0;
-            point.x = (float)x;
+        int16_t total = 0;
+        memset(rowDeltas, 0, sizeof(int16_t) * (span + 1));
+        uint16_t kept = 0;
+        for (uint16_t i = 0; i < numActive; i++) {
+            ttEdge_t &edge = edges[activeEdges[i]];
+            if (edge.y1 <= ys) continue;
+            activeEdges[kept++] = activeEdges[i];
+
+            // samples left of the crossing get the winding of this edge
+            const int32_t crossing = edge.x0 + edge.q + (edge.r > 0);
+            total += edge.dir;
+            if (crossing - xStart < span) rowDeltas[std::max<int32_t>(crossing - xStart, 0)] += edge.dir;
+
+            const int32_t stepQ = floorDiv(edge.dx, edge.dy);
+            edge.q += stepQ;
+            edge.r += edge.dx - stepQ * edge.dy;
+            if (edge.r >= edge.dy) {
+                edge.q++;
+                edge.r -= edge.dy;
+            }
+        }
+        numActive = kept;
 
-            for (uint16_t i = 0; i < intersectPointsNum; i++) {
-                point1 = points[pointsToFill[i].p1];
-                point2 = points[pointsToFill[i].p2];
+        int16_t windingNumber = total;
+        for (uint16_t xs = 0; numActive && xs < span; xs++) {
+            windingNumber -= rowDeltas[xs];
+            if (windingNumber != 0) rowSamples[xs / _scale]++;
+        }
 
-                if (pointsToFill[i].up == 1) {
-                    if (isLeft(&point1, &point2, &point) > 0) {
-                        windingNumber++;
-                    }
-                } else {
-                    if (isLeft(&point1, &point2, &point) < 0) {
-                        windingNumber--;
-                    }
-                }
+        if ((ys - yStart) % _scale != _scale - 1) continue;
+        uint8_t *bits = raster.bits.get() + row * stride;
+        for (uint16_t x = 0; x < raster.width; x++) {
+            if (rowSamples[x] == 0) continue;
+            if (raster.bpp == 1) {
+                bits[x / 8] |= 0x80 >> (x % 8);
+            } else {
+                const uint8_t level = (rowSamples[x] * 3 + samples / 2) / samples;
+                bits[x / 4] |= level << (6 - 2 * (x % 4));
             }
+        }
+    }
+}
 
-            if (windingNumber != 0) {
-                addPixel(x, y, colorInside);
+/* outline and fill a glyph at the origin, into a bitmap of its bounding box */
+std::shared_ptr<ttGlyphRaster_t> truetypeClass::rasterizeGlyph(uint16_t _glyphId) {
+    auto raster = std::make_shared<ttGlyphRaster_t>();
+    raster->left = raster->top = 0;
+    raster->width = raster->height = 0;
+    raster->bpp = 1;
+
+    readGlyph(_glyphId);
+    if (glyph.numberOfContours >= 0) {
+        raster->left = round((float)glyph.xMin * (float)characterSize / (float)headTable.unitsPerEm);
+        raster->top = round((float)(ascender - glyph.yMax) * (float)characterSize / (float)headTable.unitsPerEm);
+        const int16_t right = round((float)glyph.xMax * (float)characterSize / (float)headTable.unitsPerEm);
+        const int16_t bottom = round((float)(ascender - glyph.yMin) * (float)characterSize / (float)headTable.unitsPerEm);
+        const uint8_t scale = (coverageLevels == 4) ? TTF_COVERAGE_SCALE : 1;
+        raster->bpp = (coverageLevels == 4) ? 2 : 1;
+        const size_t bytes = (size_t)(std::max(right - raster->left, 0) * raster->bpp + 7) / 8 * std::max(bottom - raster->top, 0);
+        if (bytes) {
+#ifdef BOARD_HAS_PSRAM
+            uint8_t *bits = (uint8_t *)ps_calloc(bytes, 1);
+#else
+            uint8_t *bits = (uint8_t *)calloc(bytes, 1);
+#endif
+            if (bits != nullptr) {
+                raster->bits = std::shared_ptr<uint8_t>(bits, free);
+                raster->width = right - raster->left;
+                raster->height = bottom - raster->top;
+                generateOutline(0, 0, characterSize * scale);
+                fillGlyph(*raster, scale);
             }
         }
-
-        if (pointsToFill != nullptr) free(pointsToFill);
-        pointsToFill = nullptr;
     }
+    freePointsAll();
+    freeGlyph();
+    return raster;
 }
 
-float truetypeClass::isLeft(ttCoordinate_t *_p0, ttCoordinate_t *_p1, ttCoordinate_t *_point) {
-    return ((_p1->x - _p0->x) * (_point->y - _p0->y) - (_point->x - _p0->x) * (_p1->y - _p0->y));
+/* draw a glyph from the cache, rasterising it on a miss. Rotation is applied per pixel so it isn't part of the key */
+void truetypeClass::drawGlyph(int16_t _x, int16_t _y, uint16_t _glyphId) {
+    const uint64_t key = glyphKey(fontKey, characterSize, _glyphId, coverageLevels);
+    std::shared_ptr<ttGlyphRaster_t> raster = findRaster(key);
+    if (raster == nullptr) {
+        raster = rasterizeGlyph(_glyphId);
+        storeRaster(key, raster);
+    }
+
+    const uint16_t stride = (raster->width * raster->bpp + 7) / 8;
+    for (uint16_t row = 0; row < raster->height; row++) {
+        const uint8_t *bits = raster->bits.get() + row * stride;
+        for (uint16_t col = 0; col < raster->width; col++) {
+            if (raster->bpp == 1) {
+                if (bits[col / 8] & (0x80 >> (col % 8))) {
+                    addPixel(_x + raster->left + col, _y + raster->top + row, colorInside);
+                }
+                continue;
+            }
+            const uint8_t level = (bits[col / 4] >> (6 - 2 * (col % 4))) & 3;
+            if (level == 3) {
+                addPixel(_x + raster->left + col, _y + raster->top + row, colorInside);
+            } else if (level) {
+                addCoverage(_x + raster->left + col, _y + raster->top + row, level);
+            }
+        }
+    }
 }
 
 void truetypeClass::textDraw(int16_t _x, int16_t _y, const wchar_t _character[]) {
@@ -913,10 +1171,10 @@ void truetypeClass::textDraw(int16_t _x, int16_t _y, const wchar_t _character[])
             continue;
         }
 
-        charCode = codeToGlyphId(_character[c]);
+        const ttGlyphInfo_t info = glyphInfo(_character[c]);
+        charCode = info.glyphId;
 
         //Serial.printf("code:%4d\n", charCode);
-        readGlyph(charCode);
 
         _x += characterSpace;
 #ifdef ENABLEKERNING
@@ -927,7 +1185,7 @@ void truetypeClass::textDraw(int16_t _x, int16_t _y, const wchar_t _character[])
 #endif
         prev_code = charCode;
 
-        ttHMetric_t hMetric = getHMetric(charCode);
+        ttHMetric_t hMetric = getHMetric(info);
 
         // Line breaks when reaching the edge of the display
         if (c > 0 && (hMetric.advanceWidth + _x) > end_x) {
@@ -948,12 +1206,7 @@ void truetypeClass::textDraw(int16_t _x, int16_t _y, const wchar_t _character[])
             continue;
         }
 
-        if (glyph.numberOfContours >= 0) {
-            generateOutline(_x, _y, characterSize);
-            fillGlyph(_x, _y, characterSize);
-        }
-        freePointsAll();
-        freeGlyph();
+        drawGlyph(_x, _y, charCode);
 
         _x += hMetric.advanceWidth;
         c++;
@@ -983,16 +1236,11 @@ void truetypeClass::textDraw(int16_t _x, int16_t _y, const String _string) {
     wcharacter = nullptr;
 }
 
-void truetypeClass::addPixel(int16_t _x, int16_t _y, uint16_t _colorCode) {
-    uint8_t *buf_ptr;
-
-    if (pfnDrawPixel) {  // user-supplied pixel function
-        (*pfnDrawPixel)(_x, _y, _colorCode);
-        return;
-    }
+/* boundary and rotation of a pixel, false if it isn't in the framebuffer */
+bool truetypeClass::mapPixel(int16_t &_x, int16_t &_y) {
     // limit to boundary co-ordinates the boundary is always in the same orientation as the string not the buffer
     if ((_x < start_x) || (_x >= end_x) || (_y >= end_y)) {
-        return;
+        return false;
     }
 
     // Rotate co-ordinates relative to the buffer
@@ -1016,7 +1264,17 @@ void truetypeClass::addPixel(int16_t _x, int16_t _y, uint16_t _colorCode) {
     }
 
     // out of range
-    if ((_x < 0) || ((uint16_t)_x >= displayWidth) || ((uint16_t)_y >= displayHeight) || (_y < 0)) {
+    return !((_x < 0) || ((uint16_t)_x >= displayWidth) || ((uint16_t)_y >= displayHeight) || (_y < 0));
+}
+
+void truetypeClass::addPixel(int16_t _x, int16_t _y, uint16_t _colorCode) {
+    uint8_t *buf_ptr;
+
+    if (pfnDrawPixel) {  // user-supplied pixel function
+        (*pfnDrawPixel)(_x, _y, _colorCode);
+        return;
+    }
+    if (!mapPixel(_x, _y)) {
         return;
     }
 
@@ -1053,33 +1311,60 @@ void truetypeClass::addPixel(int16_t _x, int16_t _y, uint16_t _colorCode) {
     return;
 }
 
+/* edge pixel of level 1 or 2 out of 3, blended between the framebuffer and colorInside where the framebuffer has colours */
+void truetypeClass::addCoverage(int16_t _x, int16_t _y, uint8_t _level) {
+    if (pfnDrawPixel || (framebufferBit != 16 && framebufferBit != 8)) {
+        if (_level >= 2) addPixel(_x, _y, colorInside);
+        return;
+    }
+    if (!mapPixel(_x, _y)) {
+        return;
+    }
+
+    if (framebufferBit == 16) {
+        uint16_t *p = (uint16_t *)&userFrameBuffer[(uint16_t)_x * 2 + (uint16_t)_y * displayWidthFrame];
+        const uint16_t bg = (*p >> 8) | (*p << 8);
+        const int16_t r = (bg >> 11) + (((colorInside >> 11) - (bg >> 11)) * _level) / 3;
+        const int16_t g = ((bg >> 5) & 0x3F) + ((((colorInside >> 5) & 0x3F) - ((bg >> 5) & 0x3F)) * _level) / 3;
+        const int16_t b = (bg & 0x1F) + (((colorInside & 0x1F) - (bg & 0x1F)) * _level) / 3;
+        const uint16_t mixed = r << 11 | g << 5 | b;
+        *p = (mixed >> 8) | (mixed << 8);
+    } else {
+        uint8_t *p = &userFrameBuffer[(uint16_t)_x + (uint16_t)_y * displayWidthFrame];
+        const uint8_t bg = *p;
+        const int16_t r = (bg >> 5) + ((((colorInside >> 5) & 0x07) - (bg >> 5)) * _level) / 3;
+        const int16_t g = ((bg >> 2) & 0x07) + ((((colorInside >> 2) & 0x07) - ((bg >> 2) & 0x07)) * _level) / 3;
+        const int16_t b = (bg & 0x03) + (((colorInside & 0x03) - (bg & 0x03)) * _level) / 3;
+        *p = r << 5 | g << 2 | b;
+    }
+}
+
+int16_t truetypeClass::getCharAdvance(uint16_t _code, uint16_t _prevCode) {
+    // space (half-width, full-width)
+    if ((_code == ' ') || (_code == L'　')) {
+        return characterSize / 4;
+    }
+    const ttGlyphInfo_t info = glyphInfo(_code);
+
+    int16_t output = characterSpace;
+#ifdef ENABLEKERNING
+    if (_prevCode != 0 && _prevCode != ' ' && _prevCode != L'　' && kerningOn) {
+        int16_t kern = getKerning(glyphInfo(_prevCode).glyphId, info.glyphId);  // space between charctor
+        output += (kern * (int16_t)characterSize) / headTable.unitsPerEm;
+    }
+#endif
+    ttHMetric_t hMetric = getHMetric(info);
+    return output + hMetric.advanceWidth;
+}
+
 uint16_t truetypeClass::getStringWidth(const wchar_t _character[]) {
     uint16_t prev_code = 0;
     uint16_t c = 0;
     uint16_t output = 0;
 
     while (_character[c] != '\0') {
-        // space (half-width, full-width)
-        if ((_character[c] == ' ') || (_character[c] == L'　')) {
-            prev_code = 0;
-            output += characterSize / 4;
-            c++;
-            continue;
-        }
-        uint16_t code = codeToGlyphId(_character[c]);
-        readGlyph(code, 1);
-
-        output += characterSpace;
-#ifdef ENABLEKERNING
-        if (prev_code != 0 && kerningOn) {
-            int16_t kern = getKerning(prev_code, code);  // space between charctor
-            output += (kern * (int16_t)characterSize) / headTable.unitsPerEm;
-        }
-#endif
-        prev_code = code;
-
-        ttHMetric_t hMetric = getHMetric(code);
-        output += hMetric.advanceWidth;
+        output += getCharAdvance(_character[c], prev_code);
+        prev_code = _character[c];
         c++;
     }
 
@@ -10,6 +10,8 @@
 #include <WiFi.h>
 
 #include <algorithm>
+#include <memory>
+#include <vector>
 
 #include "AsyncJson.h"
 #include "LittleFS.h"
@@ -17,8 +19,10 @@
 #include "commstructs.h"
 #include "language.h"
 #include "leds.h"
+#include "miniz-oepl.h"
 #include "newproto.h"
 #include "ota.h"
+#include "renderpool.h"
 #include "serialap.h"
 #include "settings.h"
 #include "storage.h"
@@ -55,18 +59,15 @@ void wsErr(const String &text) {
 }
 
 size_t dbSize() {
-    size_t size = tagDB.size() * sizeof(tagRecord);
-    for (auto &tag : tagDB) {
-        if (tag->data) {
-            size += tag->len;
-        }
-        size += tag->modeConfigJson.length();
+    size_t size = tagDB.size() * (sizeof(tagRecord) + sizeof(tagHotRecord));
+    for (const tagHotRecord &hot : tagHot) {
+        size += hot.coldBytes;
     }
     return size;
 }
 
 void wsSendSysteminfo() {
-    DynamicJsonDocument doc(300);
+    DynamicJsonDocument doc(400);
     JsonObject sys = doc.createNestedObject("sys");
     time_t now;
     time(&now);
@@ -96,6 +97,10 @@ void wsSendSysteminfo() {
     sys["wifistatus"] = WiFi.status();
     sys["wifissid"] = WiFi.SSID();
     sys["uptime"] = esp_timer_get_time() / 1000000;
+    sys["schedrenders"] = schedStats.renders;
+    sys["schedlag"] = schedStats.renders ? schedStats.lagTotal / schedStats.renders : 0;
+    sys["schedlagmax"] = schedStats.lagMax;
+    sys["renderqueue"] = renderQueueDepth();
 
     static uint8_t day = 0;
     struct tm timeinfo;
@@ -133,7 +138,7 @@ void wsSendSysteminfo() {
         ws.enable(false);
         vTaskDelay(5000 / portTICK_PERIOD_MS);
         refreshAllPending();
-        saveDB("/current/tagDB.json");
+        journalDB();
         ws.closeAll();
         delay(100);
         ESP.restart();
@@ -168,19 +173,31 @@ void wsSendSysteminfo() {
 }
 
 void wsSendTaginfo(const uint8_t *mac, uint8_t syncMode) {
+    tagRecord *taginfo = tagRecord::findByMAC(mac);
+    if (taginfo != nullptr) syncHotRecord(taginfo);
     if (syncMode != SYNC_DELETE) {
-        String json = "";
-        json = tagDBtoJson(mac);
-        xSemaphoreTake(wsMutex, portMAX_DELAY);
-        ws.textAll(json);
-        xSemaphoreGive(wsMutex);
+        const uint32_t hash = taginfo != nullptr ? hashRecord(taginfo) : 0;
+        if (taginfo != nullptr && hash == taginfo->wsHash) {
+            syncStats.wsSkipped++;
+        } else {
+            String json = "";
+            json = tagDBtoJson(mac);
+            xSemaphoreTake(wsMutex, portMAX_DELAY);
+            ws.textAll(json);
+            xSemaphoreGive(wsMutex);
+            if (taginfo != nullptr) {
+                time_t now;
+                time(&now);
+                taginfo->wsHash = hash;
+                taginfo->lastChanged = now;
+            }
+            syncStats.wsSent++;
+        }
     }
     if (syncMode > SYNC_NOSYNC) {
-        const tagRecord *taginfo = tagRecord::findByMAC(mac);
         if (taginfo != nullptr) {
             if (taginfo->contentMode != 12 || syncMode == SYNC_DELETE) {
-                UDPcomm udpsync;
-                struct TagInfo taginfoitem;
+                struct TagInfo taginfoitem = {};
                 memcpy(taginfoitem.mac, taginfo->mac, sizeof(taginfoitem.mac));
                 taginfoitem.syncMode = syncMode;
                 taginfoitem.contentMode = taginfo->contentMode;
@@ -199,7 +216,16 @@ void wsSendTaginfo(const uint8_t *mac, uint8_t syncMode) {
                     taginfoitem.capabilities = taginfo->capabilities;
                     taginfoitem.pendingIdle = taginfo->pendingIdle;
                 }
-                udpsync.netTaginfo(&taginfoitem);
+                // only multicast if the other APs haven't seen this exact info yet
+                const uint32_t hash = mz_crc32(MZ_CRC32_INIT, reinterpret_cast<const uint8_t *>(&taginfoitem), sizeof(taginfoitem));
+                if (syncMode != SYNC_DELETE && hash == taginfo->syncHash) {
+                    syncStats.syncSkipped++;
+                } else {
+                    UDPcomm udpsync;
+                    udpsync.netTaginfo(&taginfoitem);
+                    taginfo->syncHash = hash;
+                    syncStats.syncSent++;
+                }
             }
         }
     }
@@ -241,6 +267,116 @@ uint8_t wsClientCount() {
     return ws.count();
 }
 
+struct TagDBStream {
+    DynamicJsonDocument doc{2500};
+    // the tags to send, taken when the request comes in. A tag deleted since is skipped
+    std::vector<uint64_t> macs;
+    uint32_t pos = 0;
+    uint32_t count = 0;
+    std::vector<String> fields;
+    bool started = false;
+    bool finished = false;
+    // a record that didn't fit in the previous chunk
+    std::unique_ptr<char[]> pending;
+    size_t pendingLen = 0;
+    size_t pendingPos = 0;
+};
+
+// Streams all tags as {"tags":[...]} in chunks, serializing one record at a time straight into the tcp buffer.
+// Optional parameters: pos (first record), since (only records changed since epoch), fields (comma separated list of keys)
+void sendTagDBStream(AsyncWebServerRequest *request) {
+    std::shared_ptr<TagDBStream> state = std::make_shared<TagDBStream>();
+    const uint32_t pos = request->hasParam("pos") ? request->getParam("pos")->value().toInt() : 0;
+    const uint32_t since = request->hasParam("since") ? request->getParam("since")->value().toInt() : 0;
+    {
+        std::lock_guard<std::recursive_mutex> lock(tagDBMutex);
+        for (uint32_t c = pos; c < tagDB.size(); c++) {
+            const tagRecord *tag = tagDB[c];
+            if (tag->version == 0 && tag->lastChanged >= since) state->macs.push_back(mac2key(tag->mac));
+        }
+    }
+    if (request->hasParam("fields")) {
+        String list = request->getParam("fields")->value();
+        int start = 0;
+        while (start < list.length()) {
+            int end = list.indexOf(',', start);
+            if (end < 0) end = list.length();
+            String field = list.substring(start, end);
+            field.trim();
+            if (field.length()) state->fields.push_back(field);
+            start = end + 1;
+        }
+    }
+
+    AsyncWebServerResponse *response = request->beginChunkedResponse("application/json", [state](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+        size_t filled = 0;
+        auto put = [&](const char *text, size_t len) {
+            memcpy(buffer + filled, text, len);
+            filled += len;
+        };
+
+        if (!state->started) {
+            put("{\"tags\":[", 9);
+            state->started = true;
+        }
+
+        while (true) {
+            if (state->pending) {
+                const size_t n = std::min(maxLen - filled, state->pendingLen - state->pendingPos);
+                put(state->pending.get() + state->pendingPos, n);
+                state->pendingPos += n;
+                if (state->pendingPos < state->pendingLen) return filled;
+                state->pending.reset();
+            }
+            if (state->finished) return filled;
+
+            state->doc.clear();
+            JsonObject tag = state->doc.to<JsonObject>();
+            bool found = false;
+            {
+                std::lock_guard<std::recursive_mutex> lock(tagDBMutex);
+                while (!found && state->pos < state->macs.size()) {
+                    const auto it = tagIndex.find(state->macs[state->pos++]);
+                    if (it == tagIndex.end()) continue;
+                    fillNode(tag, it->second);
+                    found = true;
+                }
+            }
+            if (!found) {
+                if (maxLen - filled < 2) return filled;
+                put("]}", 2);
+                state->finished = true;
+                return filled;
+            }
+            if (!state->fields.empty()) {
+                std::vector<const char *> unwanted;
+                for (JsonPair kv : tag) {
+                    const char *key = kv.key().c_str();
+                    if (strcmp(key, "mac") == 0) continue;
+                    if (std::find(state->fields.begin(), state->fields.end(), key) == state->fields.end()) unwanted.push_back(key);
+                }
+                for (const char *key : unwanted) tag.remove(key);
+            }
+
+            const size_t separator = state->count++ > 0 ? 1 : 0;
+            const size_t len = measureJson(state->doc);
+            if (separator + len + 1 <= maxLen - filled) {
+                if (separator) put(",", 1);
+                filled += serializeJson(state->doc, reinterpret_cast<char *>(buffer + filled), maxLen - filled);
+            } else {
+                // doesn't fit in this chunk, keep the rest for the next ones
+                state->pending.reset(new char[separator + len + 1]);
+                if (separator) state->pending[0] = ',';
+                serializeJson(state->doc, state->pending.get() + separator, len + 1);
+                state->pendingLen = separator + len;
+                state->pendingPos = 0;
+            }
+            if (filled == maxLen) return filled;
+        }
+    });
+    request->send(response);
+}
+
 void init_web() {
     wsMutex = xSemaphoreCreateMutex();
     WiFi.mode(WIFI_STA);
@@ -259,7 +395,7 @@ void init_web() {
         delay(100);
         ws.enable(false);
         refreshAllPending();
-        saveDB("/current/tagDB.json");
+        journalDB();
         ws.closeAll();
         delay(100);
         ESP.restart();
@@ -276,8 +412,8 @@ void init_web() {
     server.on("/jsonupload", HTTP_POST, doJsonUpload);
 
     server.on("/get_db", HTTP_GET, [](AsyncWebServerRequest *request) {
-        String json = "";
         if (request->hasParam("mac")) {
+            String json = "";
             String dst = request->getParam("mac")->value();
             uint8_t mac[8];
             if (hex2mac(dst, mac)) {
@@ -285,14 +421,10 @@ void init_web() {
             } else {
                 json = "{\"error\": \"malformatted parameter\"}";
             }
+            request->send(200, "application/json", json);
         } else {
-            uint8_t startPos = 0;
-            if (request->hasParam("pos")) {
-                startPos = atoi(request->getParam("pos")->value().c_str());
-            }
-            json = tagDBtoJson(nullptr, startPos);
+            sendTagDBStream(request);
         }
-        request->send(200, "application/json", json);
     });
 
     server.on("/getdata", HTTP_GET, [](AsyncWebServerRequest *request) {
@@ -305,24 +437,25 @@ void init_web() {
                     if (request->hasParam("md5")) {
                         uint8_t md5[8];
                         if (hex2mac(request->getParam("md5")->value(), md5)) {
-                            PendingItem *queueItem = getQueueItem(mac, *reinterpret_cast<uint64_t *>(md5));
+                            PendingItemPtr queueItem = getQueueItem(mac, *reinterpret_cast<uint64_t *>(md5));
                             if (queueItem == nullptr) {
                                 Serial.println("getQueueItem: no queue item");
                                 request->send(404, "text/plain", "File not found");
                                 return;
                             }
-                            if (queueItem->data == nullptr) {
-                                fs::File file = contentFS->open(queueItem->filename);
-                                if (file) {
-                                    queueItem->data = getDataForFile(file);
-                                    Serial.println("Reading file " + String(queueItem->filename));
-                                    file.close();
-                                } else {
-                                    request->send(404, "text/plain", "File not found");
-                                    return;
-                                }
+                            const std::shared_ptr<uint8_t[]> data = loadQueueItemData(queueItem);
+                            if (data == nullptr) {
+                                request->send(404, "text/plain", "File not found");
+                                return;
                             }
-                            request->send_P(200, "application/octet-stream", queueItem->data, queueItem->len);
+                            // the response holds on to the buffer, so it survives a dequeue while sending
+                            const uint32_t size = queueItem->len;
+                            AsyncWebServerResponse *response = request->beginResponse("application/octet-stream", size, [data, size](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+                                const size_t len = std::min(maxLen, static_cast<size_t>(size - index));
+                                memcpy(buffer, data.get() + index, len);
+                                return len;
+                            });
+                            request->send(response);
                             return;
                         }
                     } else {
@@ -410,6 +543,7 @@ void init_web() {
                         }
                     }
                     if (strcmp(cmdValue, "clear") == 0) {
+                        std::lock_guard<std::recursive_mutex> lock(tagDBMutex);
                         clearPending(taginfo);
                         while (dequeueItem(mac)) {
                         };
@@ -760,13 +894,15 @@ void init_web() {
             contentFS->remove("/current/tagDB.json");
             contentFS->remove("/current/tagDB.json.bak");
             contentFS->remove("/current/tagDBrestored.json");
+            contentFS->remove("/current/tagDB.bin");
+            contentFS->remove("/current/tagDB.jnl");
             contentFS->remove("/current/apconfig.json");
             delay(100);
             esp_deep_sleep_start();
             ESP.restart();
         } else {
             refreshAllPending();
-            saveDB("/current/tagDB.json");
+            journalDB();
         }
 
         ws.closeAll();
@@ -868,7 +1004,7 @@ void doImageUpload(AsyncWebServerRequest *request, String filename, size_t index
                 memcpy(&uploadInfo->buffer[uploadInfo->bufferSize], data, len);
                 uploadInfo->bufferSize += len;
             } else {
-                xSemaphoreTake(fsMutex, portMAX_DELAY);
+                fsLock();
                 File file = contentFS->open("/temp/" + uploadfilename, "a");
                 if (file) {
                     file.write(uploadInfo->buffer, uploadInfo->bufferSize);
@@ -877,7 +1013,7 @@ void doImageUpload(AsyncWebServerRequest *request, String filename, size_t index
                 } else {
                     logLine("Failed to open file for appending: " + uploadfilename);
                 }
-                xSemaphoreGive(fsMutex);
+                fsUnlock();
 
                 memcpy(uploadInfo->buffer, data, len);
                 uploadInfo->bufferSize = len;
@@ -886,7 +1022,7 @@ void doImageUpload(AsyncWebServerRequest *request, String filename, size_t index
 
         if (final) {
             if (uploadInfo->bufferSize > 0) {
-                xSemaphoreTake(fsMutex, portMAX_DELAY);
+                fsLock();
                 File file = contentFS->open("/temp/" + uploadfilename, "a");
                 if (file) {
                     file.write(uploadInfo->buffer, uploadInfo->bufferSize);
@@ -894,7 +1030,7 @@ void doImageUpload(AsyncWebServerRequest *request, String filename, size_t index
                 } else {
                     logLine("Failed to open file for appending: " + uploadfilename);
                 }
-                xSemaphoreGive(fsMutex);
+                fsUnlock();
                 request->_tempObject = nullptr;
                 delete uploadInfo;
             }
@@ -963,16 +1099,16 @@ void doJsonUpload(AsyncWebServerRequest *request) {
         String dst = request->getParam("mac", true)->value();
         uint8_t mac[8];
         if (hex2mac(dst, mac)) {
-            xSemaphoreTake(fsMutex, portMAX_DELAY);
+            fsLock();
             File file = LittleFS.open("/current/" + dst + ".json", "w");
             if (!file) {
                 request->send(400, "text/plain", "Failed to create file");
-                xSemaphoreGive(fsMutex);
+                fsUnlock();
                 return;
             }
             file.print(request->getParam("json", true)->value());
             file.close();
-            xSemaphoreGive(fsMutex);
+            fsUnlock();
             tagRecord *taginfo = tagRecord::findByMAC(mac);
             if (taginfo != nullptr) {
                 uint32_t ttl = 0;
@@ -996,7 +1132,7 @@ void doJsonUpload(AsyncWebServerRequest *request) {
 void dotagDBUpload(AsyncWebServerRequest *request, String filename, size_t index, uint8_t *data, size_t len, bool final) {
     if (!index) {
         logLine("restore tagDB");
-        xSemaphoreTake(fsMutex, portMAX_DELAY);
+        fsLock();
         request->_tempFile = contentFS->open("/current/tagDBrestored.json", "w");
     }
     if (len) {
@@ -1004,9 +1140,10 @@ void dotagDBUpload(AsyncWebServerRequest *request, String filename, size_t index
     }
     if (final) {
         request->_tempFile.close();
-        xSemaphoreGive(fsMutex);
+        fsUnlock();
         destroyDB();
         loadDB("/current/tagDBrestored.json");
+        compactDB();
         request->send(200, "text/plain", "Ok, restored.");
     }
 }
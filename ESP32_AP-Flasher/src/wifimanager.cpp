@@ -349,7 +349,7 @@ bool onCommandCallback(improv::ImprovCommand cmd) {
 
             ws.enable(false);
             refreshAllPending();
-            saveDB("/current/tagDB.json");
+            journalDB();
             ws.closeAll();
             delay(100);
             if (wm.connectToWifi(String(cmd.ssid.c_str()), String(cmd.password.c_str()), true)) {
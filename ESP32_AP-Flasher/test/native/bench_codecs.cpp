@@ -0,0 +1,70 @@
+// Bytes and 4096 byte blocks on air per codec for typical screens, and what the adaptive choice of spr2buffer sends
+#include "hosttest.h"
+
+#include "commstructs.h"
+
+struct codecRun {
+    const char *name;
+    bool zlib;
+    bool g5;
+};
+
+// each codec on its own, spr2buffer still falls back to raw when it doesn't help. Adaptive tries both
+static const codecRun codecRuns[] = {{"raw", false, false}, {"zlib", true, false}, {"g5", false, true}, {"adaptive", true, true}};
+#define CODEC_RUNS (sizeof(codecRuns) / sizeof(codecRuns[0]))
+
+static uint8_t nextContentMode = 1;
+
+static size_t blocks(size_t bytes) {
+    return (bytes + BLOCK_DATA_SIZE - 1) / BLOCK_DATA_SIZE;
+}
+
+TEST_CASE(codec_corpus) {
+    const struct {
+        const char *name;
+        void (*draw)(TFT_eSprite &, uint32_t);
+    } screens[] = {{"text", drawTextScreen}, {"icons", drawIconScreen}, {"qr", drawQrScreen}, {"photo", drawPhotoScreen}};
+    size_t totalBlocks[CODEC_RUNS] = {0}, totalBytes[CODEC_RUNS] = {0};
+    printf("    %-4s %-6s", "type", "screen");
+    for (const codecRun &run : codecRuns) printf(" %15s", run.name);
+    printf("   %s\n", "adaptive picks");
+    for (const uint8_t type : {0x01, 0x33, 0x36}) {
+        const HwType hw = hostTagType(type);
+        for (const auto &screen : screens) {
+            for (uint32_t seed = 1; seed <= 3; seed++) {
+                // the encoders print as they go, the line is printed when it is complete
+                char line[160];
+                int length = snprintf(line, sizeof(line), "    %02X   %-6s", type, screen.name);
+                uint8_t picked = 0;
+                for (uint8_t i = 0; i < CODEC_RUNS; i++) {
+                    imgParam imageParams = hostImageParams(hw, screen.draw == drawPhotoScreen ? DITHER_FLOYD_STEINBERG : DITHER_ORDERED);
+                    imageParams.zlib = codecRuns[i].zlib;
+                    imageParams.zlibXor = codecRuns[i].zlib;
+                    imageParams.g5 = codecRuns[i].g5;
+                    // a content mode without history, so adaptive tries every codec
+                    imageParams.contentMode = nextContentMode++;
+                    TFT_eSprite spr(nullptr);
+                    hostSprite(spr, imageParams);
+                    screen.draw(spr, seed);
+                    String file = "/corpus.raw";
+                    spr2buffer(spr, file, imageParams);
+                    const size_t bytes = hostReadFile(file).size();
+                    totalBlocks[i] += blocks(bytes);
+                    totalBytes[i] += bytes;
+                    length += snprintf(line + length, sizeof(line) - length, " %8u (%2u bl)", (unsigned)bytes, (unsigned)blocks(bytes));
+                    picked = hostDataType(imageParams);
+                }
+                printf("%s   %s\n", line, picked == DATATYPE_IMG_G5 ? "g5" : picked == DATATYPE_IMG_ZLIB ? "zlib" : "raw");
+            }
+        }
+    }
+    printf("    %-11s", "total");
+    for (uint8_t i = 0; i < CODEC_RUNS; i++) printf(" %8u (%2u bl)", (unsigned)totalBytes[i], (unsigned)totalBlocks[i]);
+    printf("\n");
+    // adaptive never sends more blocks than the best single codec of an image, so neither in total
+    CHECK(totalBlocks[3] <= totalBlocks[1] && totalBlocks[3] <= totalBlocks[2]);
+}
+
+int main(int argc, char **argv) {
+    return hostRunTests(argc, argv);
+}
@@ -0,0 +1,36 @@
+// Megapixels per second of spr2color for each dither mode
+#include "hosttest.h"
+
+TEST_CASE(dither_throughput) {
+    const char *env = getenv("OEPL_BENCH_MS");
+    const uint32_t minMs = env ? atoi(env) : 200;
+    const struct {
+        uint8_t dither;
+        const char *name;
+    } modes[] = {{DITHER_NONE, "none"}, {DITHER_ORDERED, "ordered"}, {DITHER_BURKES, "burkes"},
+                 {DITHER_FLOYD_STEINBERG, "floyd-steinberg"}, {DITHER_ATKINSON, "atkinson"}, {DITHER_SIERRA_LITE, "sierra lite"}};
+    printf("    %-4s %-10s %-16s %10s %10s\n", "type", "size", "dither", "ms", "Mpx/s");
+    for (const uint8_t type : {0x01, 0x36, 0xC2}) {
+        const HwType hw = hostTagType(type);
+        const String size = String(hw.width) + "x" + String(hw.height);
+        for (const auto &mode : modes) {
+            imgParam imageParams = hostImageParams(hw, mode.dither);
+            TFT_eSprite spr(nullptr);
+            hostSprite(spr, imageParams);
+            drawPhotoScreen(spr);
+            const size_t planeSize = (size_t)hw.width * hw.height / 8;
+            std::vector<uint8_t> planes(planeSize * std::max<uint8_t>(2, hw.bpp));
+            uint8_t *red = hw.bpp <= 2 ? planes.data() + planeSize : nullptr;
+            const size_t bufferSize = hw.bpp <= 2 ? planeSize : planes.size();
+            const double ms = hostTimeMs([&] {
+                imgParam params = imageParams;
+                spr2color(spr, params, planes.data(), red, bufferSize);
+            }, minMs);
+            printf("    %02X   %-10s %-16s %10.3f %10.1f\n", type, size.c_str(), mode.name, ms, (double)hw.width * hw.height / ms / 1000);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    return hostRunTests(argc, argv);
+}
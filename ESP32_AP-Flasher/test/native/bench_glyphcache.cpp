@@ -0,0 +1,37 @@
+// A weather and prices screen drawn with a cold glyph cache and with a warm one
+#include <FS.h>
+
+#include "hostfont.h"
+#include "hosttest.h"
+
+TEST_CASE(weather_screen) {
+    const char *env = getenv("OEPL_BENCH_MS");
+    const uint32_t minMs = env ? atoi(env) : 200;
+    printf("    %-6s %-5s %10s %12s %12s %12s\n", "levels", "cache", "ms", "chars/s", "file reads", "bytes read");
+    for (const uint8_t levels : {2, 4}) {
+        truetypeClass ttf;
+        CHECK(hostOpenTtf(ttf));
+        uint64_t key = 0xC01D000000000000ULL;
+        for (const bool warm : {false, true}) {
+            TFT_eSprite spr(nullptr);
+            hostTextSprite(spr);
+            uint32_t chars = 0;
+            uint32_t runs = 0;
+            const fs::hostFileStats before = fs::fileStats;
+            // a cold run gets a font key of its own, a warm one the key the cold runs left behind
+            const double ms = hostTimeMs([&] {
+                ttf.setFontKey(warm ? key : ++key);
+                chars = drawWeatherScreen(spr, ttf, levels);
+                runs++;
+            }, minMs);
+            printf("    %-6u %-5s %10.3f %12.0f %12.1f %12.0f\n", levels, warm ? "warm" : "cold", ms, chars * 1000.0 / ms,
+                   (double)(fs::fileStats.reads - before.reads) / runs, (double)(fs::fileStats.bytesRead - before.bytesRead) / runs);
+            if (warm) CHECK_EQ(fs::fileStats.reads - before.reads, 0u);
+        }
+        ttf.end();
+    }
+}
+
+int main(int argc, char **argv) {
+    return hostRunTests(argc, argv);
+}
@@ -0,0 +1,51 @@
+// ms per frame of spr2color with the palette lut and with the search over the palette it replaces
+#include "hosttest.h"
+
+static const uint8_t unknownType = 0xFE;
+
+TEST_CASE(lut_speedup) {
+    const char *env = getenv("OEPL_BENCH_MS");
+    const uint32_t minMs = env ? atoi(env) : 200;
+    printf("    %-4s %-24s %-8s %-7s %10s %10s %8s\n", "type", "name", "dither", "screen", "search ms", "lut ms", "speedup");
+    for (const uint8_t type : {0x01, 0x26, 0x36, 0xC1, 0xC2}) {
+        const HwType hw = hostTagType(type);
+        const hostPanel *panel = nullptr;
+        const std::vector<hostPanel> panels = hostTagTypes();
+        for (const hostPanel &p : panels) {
+            if (p.hw.id == type) panel = &p;
+        }
+        for (const uint8_t dither : {DITHER_NONE, DITHER_ORDERED}) {
+            for (int screen = 0; screen < 2; screen++) {
+                imgParam imageParams = hostImageParams(hw, dither);
+                TFT_eSprite spr(nullptr);
+                hostSprite(spr, imageParams);
+                if (screen) {
+                    drawPhotoScreen(spr);
+                } else {
+                    drawTextScreen(spr);
+                }
+                const size_t planeSize = (size_t)hw.width * hw.height / 8;
+                std::vector<uint8_t> planes(planeSize * std::max<uint8_t>(2, hw.bpp));
+                uint8_t *red = hw.bpp <= 2 ? planes.data() + planeSize : nullptr;
+                const size_t size = hw.bpp <= 2 ? planeSize : planes.size();
+                imgParam searchParams = imageParams;
+                searchParams.hwdata.id = unknownType;
+                const double searchMs = hostTimeMs([&] {
+                    imgParam params = searchParams;
+                    spr2color(spr, params, planes.data(), red, size);
+                }, minMs);
+                // the lut is filled by the first frame, the ones after it are what a tag sees
+                const double lutMs = hostTimeMs([&] {
+                    imgParam params = imageParams;
+                    spr2color(spr, params, planes.data(), red, size);
+                }, minMs);
+                printf("    %02X   %-24.24s %-8s %-7s %10.3f %10.3f %7.1fx\n", type, panel ? panel->name.c_str() : "",
+                       dither == DITHER_NONE ? "none" : "ordered", screen ? "photo" : "text", searchMs, lutMs, searchMs / lutMs);
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    return hostRunTests(argc, argv);
+}
@@ -0,0 +1,51 @@
+// ms per frame of the pixel pipeline for each panel resolution in resources/tagtypes, and the quantize time of the
+// converter of before (refspr2color.cpp)
+#include "hosttest.h"
+#include "refspr2color.h"
+
+TEST_CASE(panel_frames) {
+    const char *env = getenv("OEPL_BENCH_MS");
+    const uint32_t minMs = env ? atoi(env) : 100;
+    std::vector<String> seen;
+    printf("    %-8s %-30s %10s %4s %12s %12s %12s %10s\n", "type", "name", "size", "bpp", "old quant ms", "quantize ms", "frame ms", "bytes");
+    for (const hostPanel &panel : hostTagTypes()) {
+        // one line per resolution and depth, most panels share one with others
+        const String key = String(panel.hw.width) + "x" + String(panel.hw.height) + "/" + String(panel.hw.bpp) + "/" + String(panel.hw.colortable.size());
+        if (std::find(seen.begin(), seen.end(), key) != seen.end()) continue;
+        seen.push_back(key);
+        hostSetHwType(panel.hw);
+
+        imgParam imageParams = hostImageParams(panel.hw);
+        TFT_eSprite spr(nullptr);
+        hostSprite(spr, imageParams);
+        drawTextScreen(spr);
+        std::vector<uint8_t> planes(panel.hw.bpp <= 4 ? (size_t)panel.hw.width * panel.hw.height / 8 * std::max<uint8_t>(2, panel.hw.bpp) : 0);
+        const size_t planeSize = panel.hw.bpp <= 2 ? planes.size() / 2 : planes.size();
+        double refMs = 0, quantizeMs = 0;
+        if (panel.hw.bpp <= 4) {
+            // the old converter went over the sprite once per plane
+            refMs = hostTimeMs([&] {
+                imgParam params = imageParams;
+                refSpr2color(spr, params, planes.data(), planeSize, false);
+                if (panel.hw.bpp <= 2) refSpr2color(spr, params, planes.data() + planeSize, planeSize, true);
+            }, minMs);
+            quantizeMs = hostTimeMs([&] {
+                imgParam params = imageParams;
+                spr2color(spr, params, planes.data(), panel.hw.bpp <= 2 ? planes.data() + planeSize : nullptr, planeSize);
+            }, minMs);
+        }
+        String file = "/frame.raw";
+        // spr2buffer() as drawNew() calls it: quantize, encode and write the file
+        const double frameMs = hostTimeMs([&] {
+            imgParam params = imageParams;
+            spr2buffer(spr, file, params);
+        }, minMs);
+        const String size = String(panel.hw.width) + "x" + String(panel.hw.height);
+        printf("    %-8s %-30.30s %10s %4u %12.3f %12.3f %12.3f %10u\n", panel.file.c_str(), panel.name.c_str(), size.c_str(), panel.hw.bpp, refMs,
+               quantizeMs, frameMs, (unsigned)hostReadFile(file).size());
+    }
+}
+
+int main(int argc, char **argv) {
+    return hostRunTests(argc, argv);
+}
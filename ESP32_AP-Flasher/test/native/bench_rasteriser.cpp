@@ -0,0 +1,38 @@
+// Glyphs rasterised per second by size and coverage levels, with the glyph cache missing every time
+#include "hostfont.h"
+#include "hosttest.h"
+
+TEST_CASE(glyphs_per_second) {
+    const char *env = getenv("OEPL_BENCH_MS");
+    const uint32_t minMs = env ? atoi(env) : 200;
+    const char *text = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+    const uint32_t glyphs = strlen(text);
+    printf("    %-6s %-6s %12s %12s\n", "size", "levels", "ms", "glyphs/s");
+    truetypeClass ttf;
+    CHECK(hostOpenTtf(ttf));
+    uint64_t key = 0xBE4C000000000000ULL;
+    for (const uint16_t size : {16, 40, 100}) {
+        // one line of all of them at every size
+        TFT_eSprite spr(nullptr);
+        spr.setColorDepth(16);
+        spr.createSprite(4000, 120);
+        for (const uint8_t levels : {2, 4}) {
+            ttf.setFramebuffer(spr.width(), spr.height(), 16, static_cast<uint8_t *>(spr.getPointer()));
+            ttf.setCharacterSize(size);
+            ttf.setTextColor(TFT_BLACK, TFT_BLACK);
+            ttf.setTextBoundary(0, spr.width(), spr.height());
+            ttf.setTextCoverage(levels);
+            // the font key of a run is new, so every glyph is read and rasterised
+            const double ms = hostTimeMs([&] {
+                ttf.setFontKey(++key);
+                ttf.textDraw(0, 0, text);
+            }, minMs);
+            printf("    %-6u %-6u %12.3f %12.0f\n", size, levels, ms, glyphs * 1000.0 / ms);
+        }
+    }
+    ttf.end();
+}
+
+int main(int argc, char **argv) {
+    return hostRunTests(argc, argv);
+}
@@ -0,0 +1,70 @@
+// Saving and loading the tagDB: the binary snapshot of compactDB() and the journal of journalDB() against the
+// json of saveDB() and loadDB(), time and bytes written
+#include <FS.h>
+
+#include "hosttagdb.h"
+#include "hosttest.h"
+#include "storage.h"
+#include "tag_db.h"
+
+#define SNAPSHOT_FILE "/current/tagDB.bin"
+#define JOURNAL_FILE "/current/tagDB.jnl"
+#define JSON_FILE "/current/tagDB.json"
+
+static size_t fileSize(const char *path) {
+    return hostReadFile(path).size();
+}
+
+TEST_CASE(save_and_load) {
+    const char *env = getenv("OEPL_BENCH_MS");
+    const uint32_t minMs = env ? atoi(env) : 200;
+    printf("    %-6s %-14s %10s %10s %10s %10s\n", "tags", "format", "save ms", "load ms", "bytes", "bytes/tag");
+    for (const size_t count : {100, 1000, 5000}) {
+        hostFillTags(count);
+
+        // saveDB() keeps the previous file as .bak and waits 100ms to do so, without it only the writing is timed
+        const double jsonSave = hostTimeMs([] {
+            contentFS->remove(JSON_FILE);
+            saveDB(JSON_FILE);
+        }, minMs);
+        const size_t jsonBytes = fileSize(JSON_FILE);
+        const double binSave = hostTimeMs([] { compactDB(); }, minMs);
+        const size_t binBytes = fileSize(SNAPSHOT_FILE);
+
+        // a load includes the destroyDB() before it
+        const double jsonLoad = hostTimeMs([] {
+            destroyDB();
+            CHECK(loadDB(JSON_FILE));
+        }, minMs);
+        CHECK_EQ(tagDB.size(), count);
+        const double binLoad = hostTimeMs([] {
+            destroyDB();
+            CHECK(loadDBbinary());
+        }, minMs);
+        CHECK_EQ(tagDB.size(), count);
+
+        // a check-in of one tag: the json path saves everything again, the journal appends one entry. The time
+        // includes the compactions the growing journal sets off
+        compactDB();
+        tagDB[count / 2]->batteryMv = 2000;
+        journalDB();
+        const size_t journalBytes = fileSize(JOURNAL_FILE) - 8;
+        uint16_t battery = 2000;
+        const double journalSave = hostTimeMs([&] {
+            tagDB[count / 2]->batteryMv = ++battery;
+            journalDB();
+        }, minMs);
+
+        printf("    %-6u %-14s %10.3f %10.3f %10u %10.1f\n", (unsigned)count, "json", jsonSave, jsonLoad, (unsigned)jsonBytes,
+               (double)jsonBytes / count);
+        printf("    %-6u %-14s %10.3f %10.3f %10u %10.1f\n", (unsigned)count, "binary", binSave, binLoad, (unsigned)binBytes,
+               (double)binBytes / count);
+        printf("    %-6u %-14s %10.3f %10s %10u\n", (unsigned)count, "journal, 1 tag", journalSave, "", (unsigned)journalBytes);
+        CHECK(binBytes < jsonBytes);
+    }
+    destroyDB();
+}
+
+int main(int argc, char **argv) {
+    return hostRunTests(argc, argv);
+}
@@ -0,0 +1,56 @@
+// Looking a tag up by mac: tagRecord::findByMAC() through tagIndex against the linear scan of tagDB it replaced
+#include <algorithm>
+#include <array>
+#include <random>
+
+#include "hosttagdb.h"
+#include "hosttest.h"
+#include "tag_db.h"
+
+// findByMAC() as it was before tagIndex
+static tagRecord *linearFind(const uint8_t mac[8]) {
+    for (tagRecord *tag : tagDB) {
+        if (memcmp(tag->mac, mac, 8) == 0 && tag->version == 0) {
+            return tag;
+        }
+    }
+    return nullptr;
+}
+
+TEST_CASE(find_by_mac) {
+    const char *env = getenv("OEPL_BENCH_MS");
+    const uint32_t minMs = env ? atoi(env) : 200;
+    printf("    %-6s %-8s %12s %12s %10s\n", "tags", "lookup", "ns/lookup", "linear ns", "speedup");
+    for (const size_t count : {100, 1000, 5000}) {
+        hostFillTags(count);
+
+        // every tag once in random order, and as many macs that aren't there
+        std::vector<std::array<uint8_t, 8>> hits(count);
+        for (size_t n = 0; n < count; n++) memcpy(hits[n].data(), tagDB[n]->mac, 8);
+        std::shuffle(hits.begin(), hits.end(), std::mt19937(1));
+        std::vector<std::array<uint8_t, 8>> misses = hits;
+        for (auto &mac : misses) mac[6] = 0xFF;
+
+        for (const auto *macs : {&hits, &misses}) {
+            bool same = true;
+            for (const auto &mac : *macs) same &= tagRecord::findByMAC(mac.data()) == linearFind(mac.data());
+            CHECK(same);
+
+            size_t found = 0;
+            const double indexMs = hostTimeMs([&] {
+                for (const auto &mac : *macs) found += tagRecord::findByMAC(mac.data()) != nullptr;
+            }, minMs);
+            const double linearMs = hostTimeMs([&] {
+                for (const auto &mac : *macs) found += linearFind(mac.data()) != nullptr;
+            }, minMs);
+            printf("    %-6u %-8s %12.1f %12.1f %9.0fx\n", (unsigned)count, macs == &hits ? "hit" : "miss",
+                   indexMs * 1e6 / count, linearMs * 1e6 / count, linearMs / indexMs);
+            CHECK(macs == &hits ? found > 0 : found == 0);
+        }
+    }
+    destroyDB();
+}
+
+int main(int argc, char **argv) {
+    return hostRunTests(argc, argv);
+}
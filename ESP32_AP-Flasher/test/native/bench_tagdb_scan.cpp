@@ -0,0 +1,83 @@
+// The periodic scans over all tags at 2,000 tags: getTagCount() and the dbSize() sum over the tagHot array against
+// the same loops over the tagRecord pointers, as they were before tagHot
+#include <algorithm>
+#include <random>
+
+#include "hosttagdb.h"
+#include "hosttest.h"
+#include "tag_db.h"
+
+#define TAGS 2000
+
+// getTagCount() as it was before tagHot
+static uint32_t recordTagCount(uint32_t &timeoutcount, uint32_t &lowbattcount) {
+    uint32_t tagcount = 0;
+    time_t now;
+    time(&now);
+    for (const tagRecord *taginfo : tagDB) {
+        if (!taginfo->isExternal) tagcount++;
+        const int32_t timeout = now - taginfo->lastseen;
+        if (taginfo->expectedNextCheckin < 3600) {
+            if (timeout > 600) timeoutcount++;
+        } else if (now - taginfo->expectedNextCheckin > 600) {
+            if (timeout > 600) timeoutcount++;
+        }
+        if (taginfo->batteryMv < 2400 && taginfo->batteryMv != 0 && taginfo->batteryMv != 1337) lowbattcount++;
+    }
+    return tagcount;
+}
+
+// the loop of dbSize() in web.cpp, before and after tagHot
+static size_t recordBytes() {
+    size_t size = 0;
+    for (const tagRecord *tag : tagDB) {
+        if (tag->data) size += tag->len;
+        size += tag->modeConfigJson.length();
+    }
+    return size;
+}
+
+static size_t hotBytes() {
+    size_t size = 0;
+    for (const tagHotRecord &hot : tagHot) size += hot.coldBytes;
+    return size;
+}
+
+TEST_CASE(scan_all_tags) {
+    const char *env = getenv("OEPL_BENCH_MS");
+    const uint32_t minMs = env ? atoi(env) : 200;
+    printf("    %-9s %-12s %10s %10s %10s\n", "heap", "scan", "tagHot us", "records us", "speedup");
+    // the records in the order of tagDB, and spread over the heap the way tags that came and went leave them
+    for (const bool shuffled : {false, true}) {
+        hostFillTags(0);
+        std::vector<tagRecord *> tags;
+        for (uint32_t n = 0; n < TAGS; n++) tags.push_back(hostMakeTag(n));
+        if (shuffled) std::shuffle(tags.begin(), tags.end(), std::mt19937(1));
+        for (tagRecord *tag : tags) insertRecord(tag);
+
+        uint32_t timeouts[2] = {0}, lowBatt[2] = {0};
+        CHECK_EQ(getTagCount(timeouts[0], lowBatt[0]), recordTagCount(timeouts[1], lowBatt[1]));
+        CHECK_EQ(timeouts[0], timeouts[1]);
+        CHECK_EQ(lowBatt[0], lowBatt[1]);
+        CHECK_EQ(hotBytes(), recordBytes());
+
+        uint32_t sink = 0;
+        const double hotCount = hostTimeMs([&] { sink += getTagCount(); }, minMs);
+        const double recordCount = hostTimeMs([&] {
+            uint32_t temp = 0;
+            sink += recordTagCount(temp, temp);
+        }, minMs);
+        const double hotSize = hostTimeMs([&] { sink += hotBytes(); }, minMs);
+        const double recordSize = hostTimeMs([&] { sink += recordBytes(); }, minMs);
+        const char *heap = shuffled ? "scattered" : "in order";
+        printf("    %-9s %-12s %10.2f %10.2f %9.1fx\n", heap, "getTagCount", hotCount * 1000, recordCount * 1000,
+               recordCount / hotCount);
+        printf("    %-9s %-12s %10.2f %10.2f %9.1fx\n", heap, "dbSize", hotSize * 1000, recordSize * 1000, recordSize / hotSize);
+        CHECK(sink > 0);
+    }
+    destroyDB();
+}
+
+int main(int argc, char **argv) {
+    return hostRunTests(argc, argv);
+}
@@ -0,0 +1,44 @@
+// 2 KB text boxes wrapped with layoutText and with the wrap loop of before, time and characters measured
+#include "hostfont.h"
+#include "hosttest.h"
+
+TEST_CASE(wrap_2k) {
+    const char *env = getenv("OEPL_BENCH_MS");
+    const uint32_t minMs = env ? atoi(env) : 200;
+    const String text = hostLongText(2048);
+    truetypeClass ttf;
+    CHECK(hostOpenTtf(ttf));
+    ttf.setCharacterSize(16);
+    // the metrics of the ttf font are looked up before, as a warm font cache has them
+    std::vector<textLine> lines;
+    layoutText(text, 300, 1000, hostTtfMeasure(ttf), lines, false);
+    const struct {
+        const char *name;
+        measureFunc measure;
+    } fonts[] = {{"vlw", hostVlwMetrics}, {"ttf", hostTtfMeasure(ttf)}};
+    printf("    %-4s %-6s %6s %22s %22s\n", "font", "box", "lines", "measured naive/layout", "ms naive/layout");
+    for (const auto &font : fonts) {
+        for (const int16_t boxwidth : {120, 300}) {
+            std::vector<textLine> expected;
+            uint32_t naiveMeasured = 0;
+            const double naiveMs = hostTimeMs([&] { hostNaiveLayout(text, boxwidth, 1000, font.measure, expected, naiveMeasured); }, minMs);
+            uint32_t layoutMeasured = 0;
+            const measureFunc counted = [&](uint16_t code, uint16_t prev) {
+                layoutMeasured++;
+                return font.measure(code, prev);
+            };
+            const double layoutMs = hostTimeMs([&] {
+                layoutMeasured = 0;
+                layoutText(text, boxwidth, 1000, counted, lines, false);
+            }, minMs);
+            printf("    %-4s %4dpx %6u %10u / %-10u %10.3f / %-10.3f\n", font.name, boxwidth, (unsigned)lines.size(), naiveMeasured, layoutMeasured,
+                   naiveMs, layoutMs);
+            CHECK_EQ(lines.size(), expected.size());
+        }
+    }
+    ttf.end();
+}
+
+int main(int argc, char **argv) {
+    return hostRunTests(argc, argv);
+}
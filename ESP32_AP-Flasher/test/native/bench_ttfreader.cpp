@@ -0,0 +1,46 @@
+// File io per rendered glyph of truetypeClass, with the glyph cache missing every time
+//
+// Built twice: bench_ttfreader with the block cache of the firmware, bench_ttfreader_256 with one block of 256 bytes.
+// The reader of before had one 256 byte buffer and refilled it on every seek, so it did at least what the second does
+#include <FS.h>
+
+#include "hostfont.h"
+#include "hosttest.h"
+
+TEST_CASE(io_per_glyph) {
+    const char *env = getenv("OEPL_BENCH_MS");
+    const uint32_t minMs = env ? atoi(env) : 200;
+    printf("    %u blocks of %u bytes\n", TTF_BLOCKS, TTF_BLOCK_SIZE);
+    printf("    %-8s %8s %8s %12s %12s %12s\n", "size", "glyphs", "ms", "reads/glyph", "seeks/glyph", "bytes/glyph");
+    truetypeClass ttf;
+    CHECK(hostOpenTtf(ttf));
+    uint64_t key = 0x10000000ULL;
+    for (const uint16_t size : {16, 40, 100}) {
+        // wide enough for the text on one line at every size
+        TFT_eSprite spr(nullptr);
+        spr.createSprite(2400, 120);
+        ttf.setFramebuffer(spr.width(), spr.height(), 16, static_cast<uint8_t *>(spr.getPointer()));
+        ttf.setCharacterSize(size);
+        ttf.setTextColor(TFT_BLACK, TFT_BLACK);
+        ttf.setTextBoundary(0, spr.width(), spr.height());
+        const char *text = "Mon 17 Oct 12:45 Partly cloudy 21.5 EUR 3.49";
+        uint32_t glyphs = 0;
+        for (const char *c = text; *c; c++) glyphs += *c != ' ';
+        uint32_t runs = 0;
+        const fs::hostFileStats before = fs::fileStats;
+        // a font key of its own per run, so each glyph is looked up and rasterised from the file
+        const double ms = hostTimeMs([&] {
+            ttf.setFontKey(++key);
+            ttf.textDraw(0, 0, text);
+            runs++;
+        }, minMs);
+        const double perGlyph = (double)runs * glyphs;
+        printf("    %-8u %8u %8.3f %12.2f %12.2f %12.0f\n", size, glyphs, ms, (fs::fileStats.reads - before.reads) / perGlyph,
+               (fs::fileStats.seeks - before.seeks) / perGlyph, (fs::fileStats.bytesRead - before.bytesRead) / perGlyph);
+    }
+    ttf.end();
+}
+
+int main(int argc, char **argv) {
+    return hostRunTests(argc, argv);
+}
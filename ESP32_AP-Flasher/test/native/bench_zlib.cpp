@@ -0,0 +1,86 @@
+// The zlib profiles of zlibEncode against one deflate run with flags 1500, the settings compressAndWrite used
+#include "hosttest.h"
+
+#include "commstructs.h"
+#include "miniz-oepl.h"
+
+// exported by makeimage.cpp, the compressAndWrite of before was made of these
+size_t prepareHeader(uint8_t headerbuf[], uint16_t bufw, uint16_t bufh, imgParam imageParams, size_t buffer_size);
+bool initializeCompressor(Miniz::tdefl_compressor *comp, int flags);
+size_t compressChunk(Miniz::tdefl_compressor *comp, const void *inbuf, size_t inbytes, void *zlibbuf, size_t outsize, Miniz::tdefl_flush flush);
+void rewriteHeader(uint8_t *zlibstream);
+
+static uint8_t nextContentMode = 1;
+
+// header and planes deflated in one go with flags 1500, behind the 4 byte length, as the tag gets it
+static size_t baselineDeflate(const imgParam &imageParams, const std::vector<uint8_t> &planes, size_t planeSize, std::vector<uint8_t> &out) {
+    uint8_t header[6];
+    const uint32_t totalbytes = prepareHeader(header, imageParams.width, imageParams.height, imageParams, planeSize);
+    std::unique_ptr<Miniz::tdefl_compressor> comp(new Miniz::tdefl_compressor);
+    out.resize(sizeof(uint32_t) + totalbytes * 1.3 + 64);
+    uint8_t *stream = out.data() + sizeof(uint32_t);
+    const size_t capacity = out.size() - sizeof(uint32_t);
+    if (!initializeCompressor(comp.get(), Miniz::TDEFL_WRITE_ZLIB_HEADER | 1500)) return 0;
+    const bool twoPlanes = planes.size() == 2 * planeSize;
+    size_t size = compressChunk(comp.get(), header, sizeof(header), stream, capacity, Miniz::TDEFL_NO_FLUSH);
+    size += compressChunk(comp.get(), planes.data(), planeSize, stream + size, capacity - size, twoPlanes ? Miniz::TDEFL_SYNC_FLUSH : Miniz::TDEFL_FINISH);
+    if (twoPlanes) size += compressChunk(comp.get(), planes.data() + planeSize, planeSize, stream + size, capacity - size, Miniz::TDEFL_FINISH);
+    rewriteHeader(stream);
+    memcpy(out.data(), &totalbytes, sizeof(uint32_t));
+    return sizeof(uint32_t) + size;
+}
+
+TEST_CASE(zlib_profiles) {
+    const char *env = getenv("OEPL_BENCH_MS");
+    const uint32_t minMs = env ? atoi(env) : 100;
+    const struct {
+        const char *name;
+        void (*draw)(TFT_eSprite &, uint32_t);
+    } screens[] = {{"text", drawTextScreen}, {"icons", drawIconScreen}, {"qr", drawQrScreen}, {"photo", drawPhotoScreen}};
+    size_t baselineTotal = 0, profilesTotal = 0;
+    printf("    %-4s %-6s %10s %10s %14s %14s\n", "type", "screen", "1500 bytes", "ms", "profile bytes", "ms");
+    for (const uint8_t type : {0x26, 0x33, 0x36}) {
+        const HwType hw = hostTagType(type);
+        for (const auto &screen : screens) {
+            imgParam imageParams = hostImageParams(hw, screen.draw == drawPhotoScreen ? DITHER_FLOYD_STEINBERG : DITHER_ORDERED);
+            imageParams.zlib = 1;
+            imageParams.zlibXor = 1;
+            imageParams.g5 = 0;
+            TFT_eSprite spr(nullptr);
+            hostSprite(spr, imageParams);
+            screen.draw(spr, 1);
+            imgParam planeParams = imageParams;
+            const std::vector<uint8_t> planes = hostPlanes(spr, planeParams);
+            const size_t planeSize = (size_t)hw.width * hw.height / 8;
+
+            std::vector<uint8_t> baseline;
+            size_t baselineSize = 0;
+            const double baselineMs = hostTimeMs([&] { baselineSize = baselineDeflate(planeParams, planes, planeSize, baseline); }, minMs);
+
+            // spr2buffer with zlib only, less the time of spr2color
+            String file = "/profile.raw";
+            const double frameMs = hostTimeMs([&] {
+                imgParam params = imageParams;
+                params.contentMode = nextContentMode++;
+                spr2buffer(spr, file, params);
+            }, minMs);
+            std::vector<uint8_t> scratch(planes.size() + planeSize);
+            const double quantizeMs = hostTimeMs([&] {
+                imgParam params = imageParams;
+                spr2color(spr, params, scratch.data(), scratch.data() + planeSize, planeSize);
+            }, minMs);
+            const size_t profileSize = hostReadFile(file).size();
+            baselineTotal += baselineSize;
+            profilesTotal += profileSize;
+            printf("    %02X   %-6s %10u %10.3f %14u %14.3f\n", type, screen.name, (unsigned)baselineSize, baselineMs, (unsigned)profileSize,
+                   std::max(0.0, frameMs - quantizeMs));
+            CHECK(profileSize <= baselineSize);
+        }
+    }
+    printf("    total %u bytes with 1500, %u bytes with the profiles (%.1f%%)\n", (unsigned)baselineTotal, (unsigned)profilesTotal,
+           100.0 * profilesTotal / baselineTotal);
+}
+
+int main(int argc, char **argv) {
+    return hostRunTests(argc, argv);
+}
@@ -0,0 +1,94 @@
+#include <Arduino.h>
+
+#include <zlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+EspClass ESP;
+HardwareSerial Serial;
+
+static const auto startTime = std::chrono::steady_clock::now();
+static std::atomic<uint64_t> advancedUs{0};
+
+static uint64_t elapsedUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count() + advancedUs;
+}
+
+uint32_t millis() {
+    return elapsedUs() / 1000;
+}
+
+uint32_t micros() {
+    return elapsedUs();
+}
+
+void delay(uint32_t ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void hostAdvanceMillis(uint32_t ms) {
+    advancedUs += (uint64_t)ms * 1000;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    delay(ticks * portTICK_PERIOD_MS);
+}
+
+uint32_t mz_crc32(uint32_t crc, const uint8_t *ptr, size_t len) {
+    return crc32(crc, ptr, len);
+}
+
+#if !defined(__GLIBC__) || !__GLIBC_PREREQ(2, 38)
+size_t strlcpy(char *dst, const char *src, size_t size) {
+    const size_t len = strlen(src);
+    if (size) {
+        const size_t n = std::min(len, size - 1);
+        memcpy(dst, src, n);
+        dst[n] = 0;
+    }
+    return len;
+}
+#endif
+
+void *ps_malloc(size_t size) {
+    return malloc(size);
+}
+
+void *ps_calloc(size_t n, size_t size) {
+    return calloc(n, size);
+}
+
+void *ps_realloc(void *ptr, size_t size) {
+    return realloc(ptr, size);
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps) {
+    return 100000;
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+    return caps & MALLOC_CAP_SPIRAM ? ESP.getFreePsram() : ESP.getFreeHeap();
+}
+
+bool getLocalTime(struct tm *info, uint32_t ms) {
+    const time_t now = time(nullptr);
+    localtime_r(&now, info);
+    return true;
+}
+
+static bool serialEnabled() {
+    static const bool enabled = getenv("OEPL_SERIAL") != nullptr;
+    return enabled;
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+    if (serialEnabled()) fputc(c, stdout);
+    return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size) {
+    if (serialEnabled()) fwrite(buffer, 1, size, stdout);
+    return size;
+}
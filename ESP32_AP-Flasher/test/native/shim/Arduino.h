@@ -0,0 +1,292 @@
+// Host stand-in for the parts of the Arduino core the image and font code use
+#pragma once
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+#define PROGMEM
+#define __packed __attribute__((packed))
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t *)(addr))
+#define memcpy_P memcpy
+#define F(s) (s)
+
+using std::max;
+using std::min;
+
+#define MALLOC_CAP_DEFAULT (1 << 0)
+#define MALLOC_CAP_8BIT (1 << 1)
+#define MALLOC_CAP_SPIRAM (1 << 2)
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+typedef void *SemaphoreHandle_t;
+typedef void *TaskHandle_t;
+typedef uint32_t TickType_t;
+
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+/// @brief ms since the start, plus what hostAdvanceMillis() added
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+/// @brief Make millis() and micros() jump ahead, for code that waits for time to pass
+void hostAdvanceMillis(uint32_t ms);
+void vTaskDelay(TickType_t ticks);
+
+/// @brief The crc32 of the miniz in the esp32 rom
+uint32_t mz_crc32(uint32_t crc, const uint8_t *ptr, size_t len);
+#if !defined(__GLIBC__) || !__GLIBC_PREREQ(2, 38)
+size_t strlcpy(char *dst, const char *src, size_t size);
+#endif
+
+void *ps_malloc(size_t size);
+void *ps_calloc(size_t n, size_t size);
+void *ps_realloc(void *ptr, size_t size);
+size_t heap_caps_get_largest_free_block(uint32_t caps);
+size_t heap_caps_get_free_size(uint32_t caps);
+inline uint32_t uxTaskGetStackHighWaterMark(TaskHandle_t) { return 0; }
+bool getLocalTime(struct tm *info, uint32_t ms = 5000);
+
+struct EspClass {
+    uint32_t getFreeHeap() { return 200000; }
+    uint32_t getMaxAllocHeap() { return 100000; }
+    uint32_t getPsramSize() { return 8 * 1024 * 1024; }
+    uint32_t getFreePsram() { return 4 * 1024 * 1024; }
+};
+extern EspClass ESP;
+
+class String {
+   public:
+    String() {}
+    String(const char *s) : s(s ? s : "") {}
+    String(const char *s, size_t len) : s(s, len) {}
+    String(const std::string &s) : s(s) {}
+    explicit String(char c) : s(1, c) {}
+    explicit String(unsigned char v, unsigned char base = 10) : s(number(v, base)) {}
+    explicit String(short v, unsigned char base = 10) : s(number(v, base)) {}
+    explicit String(unsigned short v, unsigned char base = 10) : s(number(v, base)) {}
+    explicit String(int v, unsigned char base = 10) : s(number(v, base)) {}
+    explicit String(unsigned int v, unsigned char base = 10) : s(number(v, base)) {}
+    explicit String(long v, unsigned char base = 10) : s(number(v, base)) {}
+    explicit String(unsigned long v, unsigned char base = 10) : s(number(v, base)) {}
+    explicit String(long long v, unsigned char base = 10) : s(number(v, base)) {}
+    explicit String(unsigned long long v, unsigned char base = 10) : s(number(v, base)) {}
+    explicit String(float v, unsigned char decimals = 2) : s(fixed(v, decimals)) {}
+    explicit String(double v, unsigned char decimals = 2) : s(fixed(v, decimals)) {}
+
+    const char *c_str() const { return s.c_str(); }
+    unsigned int length() const { return s.length(); }
+    bool isEmpty() const { return s.empty(); }
+    bool reserve(unsigned int size) {
+        s.reserve(size);
+        return true;
+    }
+    char charAt(unsigned int i) const { return i < s.length() ? s[i] : 0; }
+    char operator[](unsigned int i) const { return charAt(i); }
+    char &operator[](unsigned int i) { return s[i]; }
+
+    String &operator=(const char *other) {
+        s = other ? other : "";
+        return *this;
+    }
+    String &operator+=(const String &other) {
+        s += other.s;
+        return *this;
+    }
+    String &operator+=(const char *other) {
+        s += other;
+        return *this;
+    }
+    String &operator+=(char c) {
+        s += c;
+        return *this;
+    }
+    template <typename T>
+    String &operator+=(T v) {
+        s += String(v).s;
+        return *this;
+    }
+    bool concat(const String &other) {
+        s += other.s;
+        return true;
+    }
+
+    bool operator==(const String &other) const { return s == other.s; }
+    bool operator==(const char *other) const { return s == (other ? other : ""); }
+    bool operator!=(const String &other) const { return s != other.s; }
+    bool operator!=(const char *other) const { return !(*this == other); }
+    bool operator<(const String &other) const { return s < other.s; }
+    bool equals(const String &other) const { return s == other.s; }
+
+    int indexOf(char c, unsigned int from = 0) const { return find(s.find(c, from)); }
+    int indexOf(const String &str, unsigned int from = 0) const { return find(s.find(str.s, from)); }
+    int lastIndexOf(char c) const { return find(s.rfind(c)); }
+    int lastIndexOf(const String &str) const { return find(s.rfind(str.s)); }
+    bool startsWith(const String &prefix) const { return s.compare(0, prefix.s.length(), prefix.s) == 0; }
+    bool endsWith(const String &suffix) const {
+        return s.length() >= suffix.s.length() && s.compare(s.length() - suffix.s.length(), suffix.s.length(), suffix.s) == 0;
+    }
+    String substring(unsigned int from) const { return from < s.length() ? String(s.substr(from)) : String(); }
+    String substring(unsigned int from, unsigned int to) const {
+        if (from > to) std::swap(from, to);
+        if (from >= s.length()) return String();
+        return String(s.substr(from, to - from));
+    }
+    void replace(const String &find, const String &with) {
+        if (find.s.empty()) return;
+        for (size_t pos = 0; (pos = s.find(find.s, pos)) != std::string::npos; pos += with.s.length()) s.replace(pos, find.s.length(), with.s);
+    }
+    void remove(unsigned int index, unsigned int count = (unsigned int)-1) {
+        if (index < s.length()) s.erase(index, count);
+    }
+    void trim() {
+        const size_t first = s.find_first_not_of(" \t\r\n");
+        const size_t last = s.find_last_not_of(" \t\r\n");
+        s = first == std::string::npos ? "" : s.substr(first, last - first + 1);
+    }
+    void toLowerCase() {
+        for (char &c : s) c = tolower(c);
+    }
+    void toUpperCase() {
+        for (char &c : s) c = toupper(c);
+    }
+    long toInt() const { return atol(s.c_str()); }
+    float toFloat() const { return atof(s.c_str()); }
+    void getBytes(unsigned char *buf, unsigned int size, unsigned int index = 0) const {
+        if (size == 0) return;
+        const size_t n = index < s.length() ? std::min<size_t>(size - 1, s.length() - index) : 0;
+        memcpy(buf, s.data() + std::min<size_t>(index, s.length()), n);
+        buf[n] = 0;
+    }
+    void toCharArray(char *buf, unsigned int size, unsigned int index = 0) const { getBytes((unsigned char *)buf, size, index); }
+
+    friend String operator+(const String &a, const String &b) { return String(a.s + b.s); }
+    friend String operator+(const String &a, const char *b) { return String(a.s + b); }
+    friend String operator+(const char *a, const String &b) { return String(a + b.s); }
+    friend String operator+(const String &a, char b) { return String(a.s + b); }
+    template <typename T>
+    friend String operator+(const String &a, T b) { return String(a.s + String(b).s); }
+
+   private:
+    std::string s;
+
+    static int find(size_t pos) { return pos == std::string::npos ? -1 : (int)pos; }
+    template <typename T>
+    static std::string number(T v, unsigned char base) {
+        if (base == 10) return std::to_string(v);
+        std::string out;
+        unsigned long long u = (unsigned long long)v;
+        do {
+            out.insert(out.begin(), "0123456789abcdefghijklmnopqrstuvwxyz"[u % base]);
+            u /= base;
+        } while (u);
+        return out;
+    }
+    static std::string fixed(double v, unsigned char decimals) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%.*f", decimals, v);
+        return buf;
+    }
+};
+
+class Print {
+   public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size) {
+        size_t n = 0;
+        while (size--) n += write(*buffer++);
+        return n;
+    }
+    size_t print(const String &s) { return write((const uint8_t *)s.c_str(), s.length()); }
+    size_t print(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+    template <typename T>
+    size_t print(T v) { return print(String(v)); }
+    size_t println() { return print("\r\n"); }
+    template <typename T>
+    size_t println(T v) { return print(v) + println(); }
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3))) {
+        char buf[512];
+        va_list args;
+        va_start(args, format);
+        const int len = vsnprintf(buf, sizeof(buf), format, args);
+        va_end(args);
+        return write((const uint8_t *)buf, std::min<size_t>(len, sizeof(buf) - 1));
+    }
+};
+
+class Stream : public Print {
+   public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    virtual void flush() {}
+    /// @brief Read up to and including target, false when the stream ends first
+    bool find(const char *target) {
+        const size_t len = strlen(target);
+        size_t matched = 0;
+        if (len == 0) return true;
+        for (int c; (c = read()) >= 0;) {
+            if (c == target[matched]) {
+                if (++matched == len) return true;
+            } else {
+                matched = c == target[0] ? 1 : 0;
+            }
+        }
+        return false;
+    }
+    size_t readBytes(uint8_t *buffer, size_t length) {
+        size_t n = 0;
+        for (int c; n < length && (c = read()) >= 0; n++) buffer[n] = c;
+        return n;
+    }
+    size_t readBytes(char *buffer, size_t length) { return readBytes((uint8_t *)buffer, length); }
+};
+
+/// @brief Serial goes to stdout when OEPL_SERIAL is set in the environment, the pipeline logs a lot
+class HardwareSerial : public Stream {
+   public:
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+};
+extern HardwareSerial Serial;
+
+class IPAddress {
+   public:
+    IPAddress() : bytes{0} {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : bytes{a, b, c, d} {}
+    IPAddress(uint32_t address) { memcpy(bytes, &address, 4); }
+    operator uint32_t() const {
+        uint32_t address;
+        memcpy(&address, bytes, 4);
+        return address;
+    }
+    bool fromString(const String &address) {
+        unsigned a, b, c, d;
+        if (sscanf(address.c_str(), "%u.%u.%u.%u", &a, &b, &c, &d) != 4 || a > 255 || b > 255 || c > 255 || d > 255) return false;
+        *this = IPAddress(a, b, c, d);
+        return true;
+    }
+    uint8_t operator[](int i) const { return bytes[i]; }
+    uint8_t &operator[](int i) { return bytes[i]; }
+    bool operator==(const IPAddress &other) const { return memcmp(bytes, other.bytes, 4) == 0; }
+    String toString() const { return String(bytes[0]) + "." + String(bytes[1]) + "." + String(bytes[2]) + "." + String(bytes[3]); }
+
+   private:
+    uint8_t bytes[4];
+};
@@ -0,0 +1,289 @@
+#include "ArduinoJson.h"
+
+#include <math.h>
+
+static void writeString(const std::string &s, std::string &out) {
+    out += '"';
+    for (const char c : s) {
+        switch (c) {
+            case '"':
+                out += "\\\"";
+                break;
+            case '\\':
+                out += "\\\\";
+                break;
+            case '\b':
+                out += "\\b";
+                break;
+            case '\f':
+                out += "\\f";
+                break;
+            case '\n':
+                out += "\\n";
+                break;
+            case '\r':
+                out += "\\r";
+                break;
+            case '\t':
+                out += "\\t";
+                break;
+            default:
+                if ((uint8_t)c < 0x20) {
+                    char buf[8];
+                    snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out += buf;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    out += '"';
+}
+
+static void writeNumber(double v, std::string &out) {
+    char buf[32];
+    if (!std::isfinite(v)) {
+        out += "null";
+        return;
+    }
+    if (v == floor(v) && fabs(v) < 1e15) {
+        snprintf(buf, sizeof(buf), "%.0f", v == 0 ? 0.0 : v);
+    } else {
+        snprintf(buf, sizeof(buf), "%.9g", v);
+    }
+    out += buf;
+}
+
+// indent < 0 is compact, otherwise the depth of pretty output, two spaces a level and \r\n as ArduinoJson does
+static void writeNode(const JsonNode *node, std::string &out, int indent) {
+    const bool pretty = indent >= 0;
+    auto newline = [&](int depth) {
+        if (!pretty) return;
+        out += "\r\n";
+        out.append(2 * depth, ' ');
+    };
+    if (!node) {
+        out += "null";
+        return;
+    }
+    switch (node->kind) {
+        case JsonNode::NUL:
+            out += "null";
+            break;
+        case JsonNode::BOOLEAN:
+            out += node->number != 0 ? "true" : "false";
+            break;
+        case JsonNode::NUMBER:
+            writeNumber(node->number, out);
+            break;
+        case JsonNode::STRING:
+            writeString(node->str, out);
+            break;
+        case JsonNode::OBJECT:
+            out += '{';
+            for (size_t i = 0; i < node->members.size(); i++) {
+                if (i) out += ',';
+                newline(indent + 1);
+                writeString(node->members[i].first, out);
+                out += pretty ? ": " : ":";
+                writeNode(node->members[i].second.get(), out, pretty ? indent + 1 : -1);
+            }
+            if (!node->members.empty()) newline(indent);
+            out += '}';
+            break;
+        case JsonNode::ARRAY:
+            out += '[';
+            for (size_t i = 0; i < node->elements.size(); i++) {
+                if (i) out += ',';
+                newline(indent + 1);
+                writeNode(node->elements[i].get(), out, pretty ? indent + 1 : -1);
+            }
+            if (!node->elements.empty()) newline(indent);
+            out += ']';
+            break;
+    }
+}
+
+void hostJsonWrite(const JsonNode *node, std::string &out, int indent) {
+    writeNode(node, out, indent);
+}
+
+namespace {
+
+struct parser {
+    HostJsonReader &in;
+    DeserializationError::Code error = DeserializationError::Ok;
+
+    bool fail(DeserializationError::Code code) {
+        if (error == DeserializationError::Ok) error = code;
+        return false;
+    }
+    int skipSpace() {
+        int c = in.peek();
+        while (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+            in.read();
+            c = in.peek();
+        }
+        return c;
+    }
+    bool expect(const char *word) {
+        for (; *word; word++) {
+            const int c = in.read();
+            if (c < 0) return fail(DeserializationError::IncompleteInput);
+            if (c != *word) return fail(DeserializationError::InvalidInput);
+        }
+        return true;
+    }
+    static void putUtf8(uint32_t cp, std::string &out) {
+        if (cp < 0x80) {
+            out += (char)cp;
+        } else if (cp < 0x800) {
+            out += (char)(0xC0 | (cp >> 6));
+            out += (char)(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            out += (char)(0xE0 | (cp >> 12));
+            out += (char)(0x80 | ((cp >> 6) & 0x3F));
+            out += (char)(0x80 | (cp & 0x3F));
+        } else {
+            out += (char)(0xF0 | (cp >> 18));
+            out += (char)(0x80 | ((cp >> 12) & 0x3F));
+            out += (char)(0x80 | ((cp >> 6) & 0x3F));
+            out += (char)(0x80 | (cp & 0x3F));
+        }
+    }
+    bool hex4(uint32_t &value) {
+        value = 0;
+        for (int i = 0; i < 4; i++) {
+            const int c = in.read();
+            if (c < 0) return fail(DeserializationError::IncompleteInput);
+            if (!isxdigit(c)) return fail(DeserializationError::InvalidInput);
+            value = value * 16 + (isdigit(c) ? c - '0' : (tolower(c) - 'a' + 10));
+        }
+        return true;
+    }
+    bool string(std::string &out) {
+        const int quote = in.read();
+        for (;;) {
+            int c = in.read();
+            if (c < 0) return fail(DeserializationError::IncompleteInput);
+            if (c == quote) return true;
+            if (c != '\\') {
+                out += (char)c;
+                continue;
+            }
+            c = in.read();
+            uint32_t cp;
+            switch (c) {
+                case -1:
+                    return fail(DeserializationError::IncompleteInput);
+                case 'b':
+                    out += '\b';
+                    break;
+                case 'f':
+                    out += '\f';
+                    break;
+                case 'n':
+                    out += '\n';
+                    break;
+                case 'r':
+                    out += '\r';
+                    break;
+                case 't':
+                    out += '\t';
+                    break;
+                case 'u':
+                    if (!hex4(cp)) return false;
+                    if (cp >= 0xD800 && cp < 0xDC00) {
+                        uint32_t low;
+                        if (!expect("\\u") || !hex4(low)) return false;
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    putUtf8(cp, out);
+                    break;
+                default:
+                    out += (char)c;
+            }
+        }
+    }
+    bool value(JsonNode &node, int depth) {
+        if (depth > 10) return fail(DeserializationError::TooDeep);
+        const int c = skipSpace();
+        if (c < 0) return fail(depth == 0 ? DeserializationError::EmptyInput : DeserializationError::IncompleteInput);
+        if (c == '{') {
+            in.read();
+            node.reset(JsonNode::OBJECT);
+            if (skipSpace() == '}') {
+                in.read();
+                return true;
+            }
+            for (;;) {
+                const int q = skipSpace();
+                if (q < 0) return fail(DeserializationError::IncompleteInput);
+                if (q != '"' && q != '\'') return fail(DeserializationError::InvalidInput);
+                std::string key;
+                if (!string(key)) return false;
+                const int colon = skipSpace();
+                if (colon < 0) return fail(DeserializationError::IncompleteInput);
+                if (colon != ':') return fail(DeserializationError::InvalidInput);
+                in.read();
+                if (!value(*node.addMember(key.c_str()), depth + 1)) return false;
+                const int next = skipSpace();
+                in.read();
+                if (next == '}') return true;
+                if (next < 0) return fail(DeserializationError::IncompleteInput);
+                if (next != ',') return fail(DeserializationError::InvalidInput);
+            }
+        }
+        if (c == '[') {
+            in.read();
+            node.reset(JsonNode::ARRAY);
+            if (skipSpace() == ']') {
+                in.read();
+                return true;
+            }
+            for (;;) {
+                if (!value(*node.addElement(), depth + 1)) return false;
+                const int next = skipSpace();
+                in.read();
+                if (next == ']') return true;
+                if (next < 0) return fail(DeserializationError::IncompleteInput);
+                if (next != ',') return fail(DeserializationError::InvalidInput);
+            }
+        }
+        if (c == '"' || c == '\'') {
+            node.reset(JsonNode::STRING);
+            return string(node.str);
+        }
+        if (c == 't' || c == 'f') {
+            node.reset(JsonNode::BOOLEAN);
+            node.number = c == 't';
+            return expect(c == 't' ? "true" : "false");
+        }
+        if (c == 'n') {
+            node.reset(JsonNode::NUL);
+            return expect("null");
+        }
+        std::string text;
+        for (int d = in.peek(); d >= 0 && (isdigit(d) || strchr("+-.eE", d)); d = in.peek()) {
+            text += (char)in.read();
+        }
+        if (text.empty()) return fail(DeserializationError::InvalidInput);
+        char *end;
+        node.reset(JsonNode::NUMBER);
+        node.number = strtod(text.c_str(), &end);
+        if (*end) return fail(DeserializationError::InvalidInput);
+        return true;
+    }
+};
+
+}  // namespace
+
+DeserializationError hostJsonParse(JsonNode &root, HostJsonReader &reader) {
+    parser p{reader};
+    root.reset(JsonNode::NUL);
+    if (!p.value(root, 0)) {
+        root.reset(JsonNode::NUL);
+        return p.error;
+    }
+    return DeserializationError::Ok;
+}
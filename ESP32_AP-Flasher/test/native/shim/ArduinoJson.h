@@ -0,0 +1,516 @@
+// Host stand-in for ArduinoJson 6: a tree of values with the serializer and parser the firmware calls.
+// Documents have no capacity limit and filters are ignored, deserializeJson() keeps every member
+#pragma once
+
+#include <Arduino.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+struct JsonNode {
+    enum { NUL, BOOLEAN, NUMBER, STRING, OBJECT, ARRAY } kind = NUL;
+    double number = 0;
+    std::string str;
+    std::vector<std::pair<std::string, std::shared_ptr<JsonNode>>> members;
+    std::vector<std::shared_ptr<JsonNode>> elements;
+
+    std::shared_ptr<JsonNode> member(const char *key) const {
+        if (kind != OBJECT) return nullptr;
+        for (const auto &kv : members) {
+            if (kv.first == key) return kv.second;
+        }
+        return nullptr;
+    }
+    std::shared_ptr<JsonNode> addMember(const char *key) {
+        if (kind != OBJECT) reset(OBJECT);
+        std::shared_ptr<JsonNode> node = member(key);
+        if (!node) {
+            node = std::make_shared<JsonNode>();
+            members.emplace_back(key, node);
+        }
+        return node;
+    }
+    std::shared_ptr<JsonNode> addElement() {
+        if (kind != ARRAY) reset(ARRAY);
+        elements.push_back(std::make_shared<JsonNode>());
+        return elements.back();
+    }
+    void reset(decltype(kind) to) {
+        kind = to;
+        number = 0;
+        str.clear();
+        members.clear();
+        elements.clear();
+    }
+};
+
+class JsonVariant;
+class JsonObject;
+class JsonArray;
+class JsonDocument;
+
+void hostJsonWrite(const JsonNode *node, std::string &out, int indent);
+
+class JsonString {
+   public:
+    explicit JsonString(const char *s) : s(s) {}
+    const char *c_str() const { return s; }
+    operator String() const { return String(s); }
+
+   private:
+    const char *s;
+};
+
+/// @brief A value of a document. A variant of a missing member or element is null, assigning to it adds it
+class JsonVariant {
+   public:
+    typedef std::function<std::shared_ptr<JsonNode>()> Creator;
+
+    JsonVariant() {}
+    explicit JsonVariant(std::shared_ptr<JsonNode> node, Creator create = nullptr) : node(node), create(create) {}
+
+    template <typename T>
+    JsonVariant &operator=(const T &value) {
+        if (resolve()) assign(*node, value);
+        return *this;
+    }
+    JsonVariant &operator=(const char *value) {
+        if (resolve()) assign(*node, value);
+        return *this;
+    }
+    JsonVariant &operator=(char *value) { return *this = (const char *)value; }
+
+    bool isNull() const { return !node || node->kind == JsonNode::NUL; }
+    template <typename T>
+    bool is() const { return holds(T()); }
+    template <typename T>
+    T as() const { return get(node, (T *)nullptr); }
+    template <typename T>
+    operator T() const { return as<T>(); }
+
+    JsonVariant operator[](const char *key) const {
+        std::shared_ptr<JsonNode> member = node ? node->member(key) : nullptr;
+        JsonVariant parent = *this;
+        const std::string name = key;
+        return JsonVariant(member, [parent, name]() mutable {
+            return parent.resolve() ? parent.node->addMember(name.c_str()) : nullptr;
+        });
+    }
+    JsonVariant operator[](const String &key) const { return (*this)[key.c_str()]; }
+    JsonVariant operator[](int index) const {
+        if (!node || node->kind != JsonNode::ARRAY || index < 0 || (size_t)index >= node->elements.size()) return JsonVariant();
+        return JsonVariant(node->elements[index]);
+    }
+    bool containsKey(const char *key) const { return node && node->member(key); }
+    bool containsKey(const String &key) const { return containsKey(key.c_str()); }
+    size_t size() const {
+        if (!node) return 0;
+        return node->kind == JsonNode::OBJECT ? node->members.size() : node->kind == JsonNode::ARRAY ? node->elements.size() : 0;
+    }
+    template <typename T>
+    bool add(const T &value) {
+        if (!resolve()) return false;
+        JsonVariant(node->addElement()) = value;
+        return true;
+    }
+    std::shared_ptr<JsonNode> hostNode() const { return node; }
+
+   private:
+    std::shared_ptr<JsonNode> node;
+    Creator create;
+
+    bool resolve() {
+        if (!node && create) node = create();
+        return node != nullptr;
+    }
+
+    static void assign(JsonNode &n, bool value) {
+        n.reset(JsonNode::BOOLEAN);
+        n.number = value;
+    }
+    static void assign(JsonNode &n, const char *value) {
+        if (!value) return n.reset(JsonNode::NUL);
+        n.reset(JsonNode::STRING);
+        n.str = value;
+    }
+    static void assign(JsonNode &n, const String &value) { assign(n, value.c_str()); }
+    static void assign(JsonNode &n, const std::string &value) { assign(n, value.c_str()); }
+    static void assign(JsonNode &n, const JsonVariant &value) {
+        if (value.node) {
+            n = *value.node;
+        } else {
+            n.reset(JsonNode::NUL);
+        }
+    }
+    template <typename T>
+    static typename std::enable_if<std::is_arithmetic<T>::value>::type assign(JsonNode &n, const T &value) {
+        n.reset(JsonNode::NUMBER);
+        n.number = value;
+    }
+    template <size_t N>
+    static void assign(JsonNode &n, const char (&value)[N]) { assign(n, (const char *)value); }
+
+    template <typename T>
+    static typename std::enable_if<std::is_arithmetic<T>::value, T>::type get(const std::shared_ptr<JsonNode> &n, T *) {
+        if (!n || (n->kind != JsonNode::NUMBER && n->kind != JsonNode::BOOLEAN)) return T();
+        return (T)n->number;
+    }
+    static bool get(const std::shared_ptr<JsonNode> &n, bool *) {
+        return n && (n->kind == JsonNode::NUMBER || n->kind == JsonNode::BOOLEAN) && n->number != 0;
+    }
+    static const char *get(const std::shared_ptr<JsonNode> &n, const char **) {
+        return n && n->kind == JsonNode::STRING ? n->str.c_str() : nullptr;
+    }
+    static String get(const std::shared_ptr<JsonNode> &n, String *) {
+        if (n && n->kind == JsonNode::STRING) return String(n->str);
+        std::string out;
+        hostJsonWrite(n.get(), out, -1);
+        return String(out);
+    }
+    static JsonVariant get(const std::shared_ptr<JsonNode> &n, JsonVariant *) { return JsonVariant(n); }
+    static JsonObject get(const std::shared_ptr<JsonNode> &n, JsonObject *);
+    static JsonArray get(const std::shared_ptr<JsonNode> &n, JsonArray *);
+
+    template <typename T>
+    typename std::enable_if<std::is_arithmetic<T>::value, bool>::type holds(T) const {
+        return node && node->kind == (std::is_same<T, bool>::value ? JsonNode::BOOLEAN : JsonNode::NUMBER);
+    }
+    bool holds(const char *) const { return node && node->kind == JsonNode::STRING; }
+    bool holds(String) const { return node && node->kind == JsonNode::STRING; }
+    bool holds(JsonObject) const;
+    bool holds(JsonArray) const;
+};
+
+/// @brief x | fallback: the value of x, or fallback when x is missing or of another type
+template <typename T>
+T operator|(const JsonVariant &variant, const T &fallback) {
+    return variant.is<T>() ? variant.as<T>() : fallback;
+}
+inline const char *operator|(const JsonVariant &variant, const char *fallback) {
+    return variant.is<const char *>() ? variant.as<const char *>() : fallback;
+}
+
+class JsonPair {
+   public:
+    JsonPair(const std::string &key, std::shared_ptr<JsonNode> value) : k(key.c_str()), v(value) {}
+    JsonString key() const { return k; }
+    JsonVariant value() const { return v; }
+
+   private:
+    JsonString k;
+    JsonVariant v;
+};
+
+class JsonObject {
+   public:
+    JsonObject() {}
+    explicit JsonObject(std::shared_ptr<JsonNode> node) : node(node) {}
+
+    JsonVariant operator[](const char *key) const {
+        if (!node) return JsonVariant();
+        std::shared_ptr<JsonNode> target = node;
+        const std::string name = key;
+        return JsonVariant(node->member(key), [target, name]() { return target->addMember(name.c_str()); });
+    }
+    JsonVariant operator[](const String &key) const { return (*this)[key.c_str()]; }
+    JsonObject createNestedObject(const char *key) const {
+        if (!node) return JsonObject();
+        std::shared_ptr<JsonNode> member = node->addMember(key);
+        member->reset(JsonNode::OBJECT);
+        return JsonObject(member);
+    }
+    JsonObject createNestedObject(const String &key) const { return createNestedObject(key.c_str()); }
+    JsonArray createNestedArray(const char *key) const;
+    JsonArray createNestedArray(const String &key) const;
+    bool containsKey(const char *key) const { return node && node->member(key); }
+    bool containsKey(const String &key) const { return containsKey(key.c_str()); }
+    void remove(const char *key) {
+        if (!node) return;
+        for (auto it = node->members.begin(); it != node->members.end(); ++it) {
+            if (it->first == key) {
+                node->members.erase(it);
+                return;
+            }
+        }
+    }
+    size_t size() const { return node ? node->members.size() : 0; }
+    bool isNull() const { return !node; }
+    operator JsonVariant() const { return JsonVariant(node); }
+
+    class iterator {
+       public:
+        iterator(const JsonNode *node, size_t i) : node(node), i(i) {}
+        JsonPair operator*() const { return JsonPair(node->members[i].first, node->members[i].second); }
+        iterator &operator++() {
+            ++i;
+            return *this;
+        }
+        bool operator!=(const iterator &other) const { return i != other.i; }
+
+       private:
+        const JsonNode *node;
+        size_t i;
+    };
+    iterator begin() const { return iterator(node.get(), 0); }
+    iterator end() const { return iterator(node.get(), size()); }
+
+    std::shared_ptr<JsonNode> hostNode() const { return node; }
+
+   private:
+    std::shared_ptr<JsonNode> node;
+};
+
+class JsonArray {
+   public:
+    JsonArray() {}
+    explicit JsonArray(std::shared_ptr<JsonNode> node) : node(node) {}
+
+    JsonVariant operator[](int index) const { return JsonVariant(node)[index]; }
+    template <typename T>
+    bool add(const T &value) const {
+        if (!node) return false;
+        JsonVariant(node->addElement()) = value;
+        return true;
+    }
+    bool add(const char *value) const { return add<const char *>(value); }
+    JsonObject createNestedObject() const {
+        if (!node) return JsonObject();
+        std::shared_ptr<JsonNode> element = node->addElement();
+        element->reset(JsonNode::OBJECT);
+        return JsonObject(element);
+    }
+    JsonArray createNestedArray() const {
+        if (!node) return JsonArray();
+        std::shared_ptr<JsonNode> element = node->addElement();
+        element->reset(JsonNode::ARRAY);
+        return JsonArray(element);
+    }
+    size_t size() const { return node ? node->elements.size() : 0; }
+    bool isNull() const { return !node; }
+    operator JsonVariant() const { return JsonVariant(node); }
+
+    class iterator {
+       public:
+        iterator(const JsonNode *node, size_t i) : node(node), i(i) {}
+        JsonVariant operator*() const { return JsonVariant(node->elements[i]); }
+        iterator &operator++() {
+            ++i;
+            return *this;
+        }
+        bool operator!=(const iterator &other) const { return i != other.i; }
+
+       private:
+        const JsonNode *node;
+        size_t i;
+    };
+    iterator begin() const { return iterator(node.get(), 0); }
+    iterator end() const { return iterator(node.get(), size()); }
+
+    std::shared_ptr<JsonNode> hostNode() const { return node; }
+
+   private:
+    std::shared_ptr<JsonNode> node;
+};
+
+inline JsonObject JsonVariant::get(const std::shared_ptr<JsonNode> &n, JsonObject *) {
+    return n && n->kind == JsonNode::OBJECT ? JsonObject(n) : JsonObject();
+}
+inline JsonArray JsonVariant::get(const std::shared_ptr<JsonNode> &n, JsonArray *) {
+    return n && n->kind == JsonNode::ARRAY ? JsonArray(n) : JsonArray();
+}
+inline bool JsonVariant::holds(JsonObject) const { return node && node->kind == JsonNode::OBJECT; }
+inline bool JsonVariant::holds(JsonArray) const { return node && node->kind == JsonNode::ARRAY; }
+
+inline JsonArray JsonObject::createNestedArray(const char *key) const {
+    if (!node) return JsonArray();
+    std::shared_ptr<JsonNode> member = node->addMember(key);
+    member->reset(JsonNode::ARRAY);
+    return JsonArray(member);
+}
+inline JsonArray JsonObject::createNestedArray(const String &key) const { return createNestedArray(key.c_str()); }
+
+class JsonDocument {
+   public:
+    JsonDocument() : JsonDocument(0) {}
+    explicit JsonDocument(size_t capacity) : root(std::make_shared<JsonNode>()), bytes(capacity) {}
+    JsonDocument(const JsonDocument &other) : root(std::make_shared<JsonNode>(*other.root)), bytes(other.bytes) {}
+    JsonDocument &operator=(const JsonDocument &other) {
+        *root = *other.root;
+        return *this;
+    }
+
+    template <typename T>
+    T as() const { return JsonVariant(root).as<T>(); }
+    template <typename T>
+    T to() {
+        root->reset(std::is_same<T, JsonArray>::value ? JsonNode::ARRAY : std::is_same<T, JsonObject>::value ? JsonNode::OBJECT : JsonNode::NUL);
+        return JsonVariant(root).as<T>();
+    }
+    template <typename T>
+    bool is() const { return JsonVariant(root).is<T>(); }
+
+    JsonVariant operator[](const char *key) {
+        std::shared_ptr<JsonNode> target = root;
+        const std::string name = key;
+        return JsonVariant(root->member(key), [target, name]() { return target->addMember(name.c_str()); });
+    }
+    JsonVariant operator[](const String &key) { return (*this)[key.c_str()]; }
+    JsonVariant operator[](int index) { return JsonVariant(root)[index]; }
+    bool containsKey(const char *key) const { return root->member(key) != nullptr; }
+    bool containsKey(const String &key) const { return containsKey(key.c_str()); }
+
+    JsonObject createNestedObject() { return JsonArray(array()).createNestedObject(); }
+    JsonObject createNestedObject(const char *key) { return JsonObject(object()).createNestedObject(key); }
+    JsonObject createNestedObject(const String &key) { return createNestedObject(key.c_str()); }
+    JsonArray createNestedArray() { return JsonArray(array()).createNestedArray(); }
+    JsonArray createNestedArray(const char *key) { return JsonObject(object()).createNestedArray(key); }
+    JsonArray createNestedArray(const String &key) { return createNestedArray(key.c_str()); }
+    template <typename T>
+    bool add(const T &value) { return JsonArray(array()).add(value); }
+
+    void clear() { root->reset(JsonNode::NUL); }
+    bool isNull() const { return root->kind == JsonNode::NUL; }
+    size_t size() const { return JsonVariant(root).size(); }
+    size_t capacity() const { return bytes; }
+    /// @brief What ArduinoJson would use on the esp32: 16 bytes a value plus the copied strings
+    size_t memoryUsage() const { return usage(*root); }
+
+    std::shared_ptr<JsonNode> hostNode() const { return root; }
+
+   private:
+    std::shared_ptr<JsonNode> root;
+    size_t bytes;
+
+    std::shared_ptr<JsonNode> object() {
+        if (root->kind != JsonNode::OBJECT) root->reset(JsonNode::OBJECT);
+        return root;
+    }
+    std::shared_ptr<JsonNode> array() {
+        if (root->kind != JsonNode::ARRAY) root->reset(JsonNode::ARRAY);
+        return root;
+    }
+    static size_t usage(const JsonNode &node) {
+        size_t n = node.kind == JsonNode::STRING ? node.str.length() + 1 : 0;
+        for (const auto &kv : node.members) n += 16 + kv.first.length() + 1 + usage(*kv.second);
+        for (const auto &element : node.elements) n += 16 + usage(*element);
+        return n;
+    }
+};
+
+typedef JsonDocument DynamicJsonDocument;
+template <size_t N>
+class StaticJsonDocument : public JsonDocument {
+   public:
+    StaticJsonDocument() : JsonDocument(N) {}
+};
+
+class DeserializationError {
+   public:
+    enum Code { Ok, EmptyInput, IncompleteInput, InvalidInput, NoMemory, TooDeep };
+
+    DeserializationError(Code code = Ok) : error(code) {}
+    explicit operator bool() const { return error != Ok; }
+    bool operator==(Code other) const { return error == other; }
+    bool operator!=(Code other) const { return error != other; }
+    Code code() const { return error; }
+    const char *c_str() const {
+        static const char *names[] = {"Ok", "EmptyInput", "IncompleteInput", "InvalidInput", "NoMemory", "TooDeep"};
+        return names[error];
+    }
+
+   private:
+    Code error;
+};
+
+namespace DeserializationOption {
+struct Filter {
+    explicit Filter(JsonDocument &doc) {}
+};
+struct NestingLimit {
+    explicit NestingLimit(uint8_t limit) {}
+};
+}  // namespace DeserializationOption
+
+/// @brief Characters of a Stream, or of a string in memory, one at a time
+class HostJsonReader {
+   public:
+    explicit HostJsonReader(Stream &stream) : stream(&stream) {}
+    HostJsonReader(const char *s, size_t len) : s(s), end(s + len) {}
+
+    int peek() {
+        if (stream) return stream->peek();
+        return s < end && *s ? (uint8_t)*s : -1;
+    }
+    int read() {
+        if (stream) return stream->read();
+        return s < end && *s ? (uint8_t)*s++ : -1;
+    }
+
+   private:
+    Stream *stream = nullptr;
+    const char *s = nullptr;
+    const char *end = nullptr;
+};
+
+DeserializationError hostJsonParse(JsonNode &root, HostJsonReader &reader);
+
+inline DeserializationError deserializeJson(JsonDocument &doc, Stream &input) {
+    HostJsonReader reader(input);
+    return hostJsonParse(*doc.hostNode(), reader);
+}
+inline DeserializationError deserializeJson(JsonDocument &doc, const char *input, size_t len = (size_t)-1) {
+    HostJsonReader reader(input, len);
+    return hostJsonParse(*doc.hostNode(), reader);
+}
+inline DeserializationError deserializeJson(JsonDocument &doc, const String &input) { return deserializeJson(doc, input.c_str(), input.length()); }
+inline DeserializationError deserializeJson(JsonDocument &doc, const std::string &input) { return deserializeJson(doc, input.c_str(), input.length()); }
+inline DeserializationError deserializeJson(JsonDocument &doc, char *input) { return deserializeJson(doc, (const char *)input); }
+template <typename TInput>
+DeserializationError deserializeJson(JsonDocument &doc, TInput &&input, DeserializationOption::Filter) { return deserializeJson(doc, input); }
+template <typename TInput>
+DeserializationError deserializeJson(JsonDocument &doc, TInput &&input, DeserializationOption::NestingLimit) { return deserializeJson(doc, input); }
+
+template <typename TSource>
+std::string hostJsonText(const TSource &source, int indent) {
+    std::string out;
+    hostJsonWrite(source.hostNode().get(), out, indent);
+    return out;
+}
+
+template <typename TSource>
+size_t serializeJson(const TSource &source, Print &output) {
+    const std::string text = hostJsonText(source, -1);
+    return output.write((const uint8_t *)text.data(), text.length());
+}
+template <typename TSource>
+size_t serializeJson(const TSource &source, String &output) {
+    output = String(hostJsonText(source, -1));
+    return output.length();
+}
+template <typename TSource>
+size_t serializeJson(const TSource &source, char *output, size_t size) {
+    const std::string text = hostJsonText(source, -1);
+    if (size == 0) return 0;
+    const size_t n = std::min(size - 1, text.length());
+    memcpy(output, text.data(), n);
+    output[n] = 0;
+    return n;
+}
+template <typename TSource>
+size_t serializeJsonPretty(const TSource &source, Print &output) {
+    const std::string text = hostJsonText(source, 0);
+    return output.write((const uint8_t *)text.data(), text.length());
+}
+template <typename TSource>
+size_t serializeJsonPretty(const TSource &source, String &output) {
+    output = String(hostJsonText(source, 0));
+    return output.length();
+}
+template <typename TSource>
+size_t measureJson(const TSource &source) { return hostJsonText(source, -1).length(); }
+template <typename TSource>
+size_t measureJsonPretty(const TSource &source) { return hostJsonText(source, 0).length(); }
@@ -0,0 +1,2 @@
+// Host stand-in, web.h only needs the names
+#pragma once
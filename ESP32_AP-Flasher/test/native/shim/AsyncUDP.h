@@ -0,0 +1,5 @@
+// Host stand-in, udp.h only needs the names
+#pragma once
+
+class AsyncUDP {};
+class AsyncUDPPacket {};
@@ -0,0 +1,5 @@
+// Host stand-in, web.h only needs the names
+#pragma once
+
+class AsyncWebServerRequest;
+class AsyncWebSocket {};
@@ -0,0 +1,152 @@
+#include <FS.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+namespace fs {
+
+hostFileStats fileStats = {0};
+
+struct File::openFile {
+    FILE *fp = nullptr;
+    DIR *dir = nullptr;
+    String path;
+    String hostPath;
+    String name;
+    ~openFile() {
+        if (fp) fclose(fp);
+        if (dir) closedir(dir);
+    }
+};
+
+File::File(FILE *fp, const String &path, const String &hostPath) : handle(std::make_shared<openFile>()) {
+    handle->fp = fp;
+    handle->path = path;
+    handle->hostPath = hostPath;
+    handle->name = path.substring(path.lastIndexOf('/') + 1);
+}
+
+File::File(const String &path, const String &hostPath) : handle(std::make_shared<openFile>()) {
+    handle->dir = opendir(hostPath.c_str());
+    handle->path = path;
+    handle->hostPath = hostPath;
+    handle->name = path.substring(path.lastIndexOf('/') + 1);
+}
+
+bool File::isDirectory() const {
+    return handle && handle->dir;
+}
+
+File File::openNextFile(const char *mode) {
+    if (!handle || !handle->dir) return File();
+    while (struct dirent *entry = readdir(handle->dir)) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        const String path = (handle->path.endsWith("/") ? handle->path : handle->path + "/") + entry->d_name;
+        const String host = handle->hostPath + "/" + entry->d_name;
+        struct stat st;
+        if (stat(host.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) return File(path, host);
+        FILE *fp = fopen(host.c_str(), mode[0] == 'w' ? "w+b" : "rb");
+        if (fp) return File(fp, path, host);
+    }
+    return File();
+}
+
+size_t File::write(const uint8_t *buffer, size_t size) {
+    return handle && handle->fp ? fwrite(buffer, 1, size, handle->fp) : 0;
+}
+
+int File::available() {
+    return handle ? (int)(size() - position()) : 0;
+}
+
+int File::read() {
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+}
+
+int File::peek() {
+    if (!handle || !handle->fp) return -1;
+    const int c = fgetc(handle->fp);
+    if (c != EOF) ungetc(c, handle->fp);
+    return c == EOF ? -1 : c;
+}
+
+void File::flush() {
+    if (handle && handle->fp) fflush(handle->fp);
+}
+
+size_t File::read(uint8_t *buffer, size_t size) {
+    if (!handle || !handle->fp) return 0;
+    const size_t n = fread(buffer, 1, size, handle->fp);
+    fileStats.reads++;
+    fileStats.bytesRead += n;
+    return n;
+}
+
+bool File::seek(uint32_t pos, SeekMode mode) {
+    if (!handle || !handle->fp) return false;
+    fileStats.seeks++;
+    return fseek(handle->fp, pos, mode == SeekSet ? SEEK_SET : mode == SeekCur ? SEEK_CUR : SEEK_END) == 0;
+}
+
+size_t File::position() const {
+    return handle && handle->fp ? ftell(handle->fp) : 0;
+}
+
+size_t File::size() const {
+    if (!handle || !handle->fp) return 0;
+    fflush(handle->fp);
+    struct stat st;
+    return fstat(fileno(handle->fp), &st) == 0 ? st.st_size : 0;
+}
+
+void File::close() {
+    handle.reset();
+}
+
+time_t File::getLastWrite() {
+    if (!handle || !handle->fp) return 0;
+    fflush(handle->fp);
+    struct stat st;
+    return fstat(fileno(handle->fp), &st) == 0 ? st.st_mtime : 0;
+}
+
+const char *File::path() const {
+    return handle ? handle->path.c_str() : "";
+}
+
+const char *File::name() const {
+    return handle ? handle->name.c_str() : "";
+}
+
+File FS::open(const String &path, const char *mode, bool create) {
+    const String host = hostPath(path);
+    struct stat st;
+    if (mode[0] == 'r' && stat(host.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+        fileStats.opens++;
+        return File(path, host);
+    }
+    const char *hostMode = mode[0] == 'w' ? "w+b" : mode[0] == 'a' ? "a+b" : "rb";
+    FILE *fp = fopen(host.c_str(), hostMode);
+    if (fp == nullptr) return File();
+    fileStats.opens++;
+    return File(fp, path, host);
+}
+
+bool FS::exists(const String &path) {
+    struct stat st;
+    return stat(hostPath(path).c_str(), &st) == 0;
+}
+
+bool FS::remove(const String &path) {
+    return ::remove(hostPath(path).c_str()) == 0;
+}
+
+bool FS::rename(const String &from, const String &to) {
+    return ::rename(hostPath(from).c_str(), hostPath(to).c_str()) == 0;
+}
+
+bool FS::mkdir(const String &path) {
+    return ::mkdir(hostPath(path).c_str(), 0755) == 0;
+}
+
+}  // namespace fs
@@ -0,0 +1,77 @@
+// Host stand-in for the Arduino FS: paths live under a directory of the host
+#pragma once
+
+#include <Arduino.h>
+
+#include <memory>
+
+namespace fs {
+
+enum SeekMode { SeekSet = 0, SeekCur = 1, SeekEnd = 2 };
+
+/// @brief Calls into the host file system since the start, for tests that count file io
+struct hostFileStats {
+    uint32_t opens;
+    uint32_t reads;
+    uint32_t seeks;
+    uint64_t bytesRead;
+};
+extern hostFileStats fileStats;
+
+class File : public Stream {
+   public:
+    File() {}
+    File(FILE *fp, const String &path, const String &hostPath);
+    /// @brief A directory, openNextFile() walks its entries
+    File(const String &path, const String &hostPath);
+
+    operator bool() const { return handle != nullptr; }
+
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t *buffer, size_t size) override;
+    int available() override;
+    int read() override;
+    int peek() override;
+    void flush() override;
+    size_t read(uint8_t *buffer, size_t size);
+    bool seek(uint32_t pos, SeekMode mode = SeekSet);
+    size_t position() const;
+    size_t size() const;
+    void close();
+    time_t getLastWrite();
+    const char *path() const;
+    const char *name() const;
+    bool isDirectory() const;
+    File openNextFile(const char *mode = "r");
+
+   private:
+    struct openFile;
+    std::shared_ptr<openFile> handle;
+};
+
+class FS {
+   public:
+    /// @param root Directory of the host the paths are relative to
+    explicit FS(const String &root) : root(root) {}
+
+    File open(const String &path, const char *mode = "r", bool create = false);
+    bool exists(const String &path);
+    bool remove(const String &path);
+    bool rename(const String &from, const String &to);
+    bool mkdir(const String &path);
+
+    /// @brief Host path of a path of this file system
+    String hostPath(const String &path) const { return root + path; }
+
+   private:
+    String root;
+};
+
+}  // namespace fs
+
+using fs::File;
+using fs::FS;
+using fs::SeekMode;
+using fs::SeekSet;
+using fs::SeekCur;
+using fs::SeekEnd;
@@ -0,0 +1,17 @@
+#include <HTTPClient.h>
+
+std::function<hostHttpResponse(const hostHttpRequest &request)> hostHttpServer;
+
+int HTTPClient::GET() {
+    responseHeaders.clear();
+    body = String();
+    if (!hostHttpServer) {
+        stream.reset(body);
+        return HTTPC_ERROR_CONNECTION_REFUSED;
+    }
+    const hostHttpResponse response = hostHttpServer(hostHttpRequest{url, requestHeaders});
+    responseHeaders = response.headers;
+    body = response.body;
+    stream.reset(body);
+    return response.code;
+}
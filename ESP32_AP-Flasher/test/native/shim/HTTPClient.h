@@ -0,0 +1,86 @@
+// Host stand-in for the HTTPClient of the ESP32 core. There is no network, a test answers the requests with
+// hostHttpServer, without it every request fails to connect
+#pragma once
+
+#include <Arduino.h>
+
+#include <functional>
+#include <map>
+
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+#define HTTPC_ERROR_NOT_CONNECTED (-4)
+
+typedef enum {
+    HTTPC_DISABLE_FOLLOW_REDIRECTS,
+    HTTPC_STRICT_FOLLOW_REDIRECTS,
+    HTTPC_FORCE_FOLLOW_REDIRECTS
+} followRedirects_t;
+
+/// @brief The body of a response, read as a stream
+class WiFiClient : public Stream {
+   public:
+    size_t write(uint8_t c) override { return 0; }
+    int available() override { return data.length() - pos; }
+    int read() override { return pos < data.length() ? (uint8_t)data[pos++] : -1; }
+    int peek() override { return pos < data.length() ? (uint8_t)data[pos] : -1; }
+    void reset(const String &body) {
+        data = body;
+        pos = 0;
+    }
+
+   private:
+    String data;
+    unsigned int pos = 0;
+};
+
+/// @brief A GET as hostHttpServer sees it
+struct hostHttpRequest {
+    String url;
+    std::map<String, String> headers;
+};
+
+struct hostHttpResponse {
+    int code = 200;
+    std::map<String, String> headers;
+    String body;
+};
+
+/// @brief The server of the host build, it answers every GET on the thread that sends it
+extern std::function<hostHttpResponse(const hostHttpRequest &request)> hostHttpServer;
+
+class HTTPClient {
+   public:
+    bool begin(const String &url) {
+        this->url = url;
+        requestHeaders.clear();
+        return true;
+    }
+    void end() { responseHeaders.clear(); }
+    void setReuse(bool reuse) {}
+    void useHTTP10(bool http10 = true) { this->http10 = http10; }
+    void setTimeout(uint16_t timeout) { this->timeout = timeout; }
+    void setFollowRedirects(followRedirects_t follow) {}
+    void collectHeaders(const char *headerKeys[], const size_t headerKeysCount) {}
+    void addHeader(const String &name, const String &value) { requestHeaders[name] = value; }
+
+    int GET();
+
+    String header(const char *name) {
+        auto it = responseHeaders.find(name);
+        return it == responseHeaders.end() ? String() : it->second;
+    }
+    int getSize() { return body.length(); }
+    String getString() { return body; }
+    WiFiClient *getStreamPtr() { return &stream; }
+    WiFiClient &getStream() { return stream; }
+    int writeToStream(Stream *out) { return out->write((const uint8_t *)body.c_str(), body.length()); }
+
+   private:
+    String url;
+    bool http10 = false;
+    uint16_t timeout = 5000;
+    std::map<String, String> requestHeaders;
+    std::map<String, String> responseHeaders;
+    String body;
+    WiFiClient stream;
+};
@@ -0,0 +1,4 @@
+// Host stand-in, the headers that include it only need FS.h
+#pragma once
+
+#include <FS.h>
@@ -0,0 +1,32 @@
+// Host stand-in for the MD5Builder of the ESP32 core
+#pragma once
+
+#include <Arduino.h>
+
+class MD5Builder {
+   public:
+    void begin();
+    void add(const uint8_t *data, size_t len);
+    void add(const String &str) { add((const uint8_t *)str.c_str(), str.length()); }
+    /// @brief Add up to maxLen bytes of a stream
+    bool addStream(Stream &stream, size_t maxLen) {
+        uint8_t buf[512];
+        while (maxLen) {
+            const size_t n = stream.readBytes(buf, std::min(maxLen, sizeof(buf)));
+            if (n == 0) return false;
+            add(buf, n);
+            maxLen -= n;
+        }
+        return true;
+    }
+    void calculate();
+    void getBytes(uint8_t *output) const { memcpy(output, digest, 16); }
+    String toString() const;
+
+   private:
+    uint32_t state[4];
+    uint64_t count;
+    uint8_t block[64];
+    uint8_t digest[16];
+    void transform(const uint8_t *data);
+};
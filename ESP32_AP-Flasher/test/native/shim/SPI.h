@@ -0,0 +1,4 @@
+// Host stand-in, truetype.h includes it
+#pragma once
+
+#define _SPI_H_INCLUDED
@@ -0,0 +1,98 @@
+#include <TFT_eSPI.h>
+
+void *TFT_eSprite::createSprite(int16_t w, int16_t h, uint8_t frames) {
+    if (_img) return _img;
+    const size_t size = _bpp == 16 ? (size_t)w * h * 2 : _bpp == 8 ? (size_t)w * h : (size_t)(w + 7) / 8 * h;
+    _img = (uint8_t *)calloc(1, size);
+    if (_img) {
+        _width = w;
+        _height = h;
+    }
+    return _img;
+}
+
+void TFT_eSprite::deleteSprite() {
+    free(_img);
+    _img = nullptr;
+    _width = _height = 0;
+}
+
+// 16 bit pixels are stored with their bytes swapped, 8 bit ones as RGB332, 1 bit ones MSB first per row
+void TFT_eSprite::drawPixel(int32_t x, int32_t y, uint32_t color) {
+    if (_img == nullptr || x < 0 || y < 0 || x >= _width || y >= _height) return;
+    if (_bpp == 16) {
+        ((uint16_t *)_img)[x + y * _width] = (uint16_t)(color >> 8 | color << 8);
+    } else if (_bpp == 8) {
+        _img[x + y * _width] = (color & 0xE000) >> 8 | (color & 0x0700) >> 6 | (color & 0x0018) >> 3;
+    } else {
+        uint8_t &byte = _img[x / 8 + y * ((_width + 7) / 8)];
+        const uint8_t mask = 0x80 >> (x & 7);
+        byte = color ? byte | mask : byte & ~mask;
+    }
+}
+
+void TFT_eSprite::fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color) {
+    const int32_t x0 = std::max<int32_t>(x, 0), y0 = std::max<int32_t>(y, 0);
+    const int32_t x1 = std::min<int32_t>(x + w, _width), y1 = std::min<int32_t>(y + h, _height);
+    for (int32_t py = y0; py < y1; py++) {
+        for (int32_t px = x0; px < x1; px++) drawPixel(px, py, color);
+    }
+}
+
+void TFT_eSprite::drawRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color) {
+    drawFastHLine(x, y, w, color);
+    drawFastHLine(x, y + h - 1, w, color);
+    drawFastVLine(x, y, h, color);
+    drawFastVLine(x + w - 1, y, h, color);
+}
+
+void TFT_eSprite::drawLine(int32_t x0, int32_t y0, int32_t x1, int32_t y1, uint32_t color) {
+    const int32_t dx = abs(x1 - x0), dy = -abs(y1 - y0);
+    const int32_t sx = x0 < x1 ? 1 : -1, sy = y0 < y1 ? 1 : -1;
+    int32_t err = dx + dy;
+    while (true) {
+        drawPixel(x0, y0, color);
+        if (x0 == x1 && y0 == y1) break;
+        const int32_t e2 = 2 * err;
+        if (e2 >= dy) {
+            err += dy;
+            x0 += sx;
+        }
+        if (e2 <= dx) {
+            err += dx;
+            y0 += sy;
+        }
+    }
+}
+
+void TFT_eSprite::fillCircle(int32_t x, int32_t y, int32_t r, uint32_t color) {
+    for (int32_t dy = -r; dy <= r; dy++) {
+        const int32_t dx = (int32_t)sqrt((double)(r * r - dy * dy));
+        drawFastHLine(x - dx, y + dy, 2 * dx + 1, color);
+    }
+}
+
+uint16_t TFT_eSprite::readPixel(int32_t x, int32_t y) {
+    if (_img == nullptr || x < 0 || y < 0 || x >= _width || y >= _height) return 0xFFFF;
+    if (_bpp == 16) {
+        const uint16_t c = ((uint16_t *)_img)[x + y * _width];
+        return c >> 8 | c << 8;
+    }
+    if (_bpp == 8) {
+        const uint8_t c = _img[x + y * _width];
+        if (c == 0) return 0;
+        const uint8_t blue[] = {0, 11, 21, 31};
+        return (c & 0xE0) << 8 | (c & 0xC0) << 5 | (c & 0x1C) << 6 | (c & 0x1C) << 3 | blue[c & 0x03];
+    }
+    return _img[x / 8 + y * ((_width + 7) / 8)] & (0x80 >> (x & 7)) ? _bitmapFg : _bitmapBg;
+}
+
+// the data goes in as it is, like the library does without setSwapBytes()
+void TFT_eSprite::pushImage(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t *data) {
+    for (int32_t py = 0; py < h; py++) {
+        for (int32_t px = 0; px < w; px++) {
+            const uint16_t c = data[px + py * w];
+            drawPixel(x + px, y + py, _bpp == 16 ? (uint16_t)(c >> 8 | c << 8) : c);
+        }
+    }
+}
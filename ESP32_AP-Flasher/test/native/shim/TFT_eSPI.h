@@ -0,0 +1,70 @@
+// Host stand-in for TFT_eSPI: sprites in RAM with the pixel layout of the library, 1, 8 and 16 bit
+#pragma once
+
+#include <Arduino.h>
+
+#define TFT_BLACK 0x0000
+#define TFT_WHITE 0xFFFF
+#define TFT_RED 0xF800
+#define TFT_GREEN 0x07E0
+#define TFT_BLUE 0x001F
+#define TFT_YELLOW 0xFFE0
+#define TFT_ORANGE 0xFDA0
+#define TFT_DARKGREY 0x7BEF
+#define TFT_LIGHTGREY 0xD69A
+
+// text datums of TFT_eSPI
+#define TL_DATUM 0
+
+class TFT_eSPI {
+   public:
+    TFT_eSPI(int16_t w = 240, int16_t h = 320) : _width(w), _height(h) {}
+    virtual ~TFT_eSPI() {}
+
+    virtual int16_t width() { return _width; }
+    virtual int16_t height() { return _height; }
+    void setRotation(uint8_t r) {}
+    void setSwapBytes(bool swap) { _swapBytes = swap; }
+    bool getSwapBytes() { return _swapBytes; }
+
+    static uint16_t color565(uint8_t r, uint8_t g, uint8_t b) { return (r & 0xF8) << 8 | (g & 0xFC) << 3 | b >> 3; }
+
+   protected:
+    int16_t _width;
+    int16_t _height;
+    bool _swapBytes = false;
+};
+
+class TFT_eSprite : public TFT_eSPI {
+   public:
+    explicit TFT_eSprite(TFT_eSPI *tft) : TFT_eSPI(0, 0) {}
+    ~TFT_eSprite() { deleteSprite(); }
+
+    void setColorDepth(int8_t bpp) { _bpp = bpp == 1 || bpp == 8 ? bpp : 16; }
+    int8_t getColorDepth() { return _bpp; }
+    void *createSprite(int16_t w, int16_t h, uint8_t frames = 1);
+    void deleteSprite();
+    void *getPointer() { return _img; }
+    bool created() { return _img != nullptr; }
+    void setBitmapColor(uint16_t fg, uint16_t bg) {
+        _bitmapFg = fg;
+        _bitmapBg = bg;
+    }
+
+    void fillSprite(uint32_t color) { fillRect(0, 0, _width, _height, color); }
+    void drawPixel(int32_t x, int32_t y, uint32_t color);
+    void fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color);
+    void drawFastHLine(int32_t x, int32_t y, int32_t w, uint32_t color) { fillRect(x, y, w, 1, color); }
+    void drawFastVLine(int32_t x, int32_t y, int32_t h, uint32_t color) { fillRect(x, y, 1, h, color); }
+    void drawRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color);
+    void drawLine(int32_t x0, int32_t y0, int32_t x1, int32_t y1, uint32_t color);
+    void fillCircle(int32_t x, int32_t y, int32_t r, uint32_t color);
+    uint16_t readPixel(int32_t x, int32_t y);
+    void pushImage(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t *data);
+
+   private:
+    uint8_t *_img = nullptr;
+    int8_t _bpp = 16;
+    uint16_t _bitmapFg = TFT_WHITE;
+    uint16_t _bitmapBg = TFT_BLACK;
+};
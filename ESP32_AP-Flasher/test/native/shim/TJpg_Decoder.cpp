@@ -0,0 +1,54 @@
+#include <TJpg_Decoder.h>
+
+#include <vector>
+
+TJpg_Decoder TJpgDec;
+
+#define MCU_SIZE 16
+
+static int readNumber(fs::File &file) {
+    int c = file.read();
+    while (c == ' ' || c == '\n' || c == '\r' || c == '\t') c = file.read();
+    int value = 0;
+    for (; c >= '0' && c <= '9'; c = file.read()) value = value * 10 + c - '0';
+    return value;
+}
+
+// leaves the file at the first pixel
+static bool readHeader(fs::File &file, uint16_t &w, uint16_t &h) {
+    if (!file || file.read() != 'P' || file.read() != '6') return false;
+    w = readNumber(file);
+    h = readNumber(file);
+    return readNumber(file) == 255 && w && h;
+}
+
+JRESULT TJpg_Decoder::getFsJpgSize(uint16_t *w, uint16_t *h, const String &path, fs::FS &fs) {
+    fs::File file = fs.open(path, "r");
+    *w = *h = 0;
+    return readHeader(file, *w, *h) ? JDR_OK : JDR_FMT1;
+}
+
+JRESULT TJpg_Decoder::drawFsJpg(int32_t x, int32_t y, const String &path, fs::FS &fs) {
+    fs::File file = fs.open(path, "r");
+    uint16_t w, h;
+    if (!readHeader(file, w, h)) return JDR_FMT1;
+    // one band of MCUs at a time, like the decoder's work buffer
+    std::vector<uint8_t> rgb((size_t)w * 3 * MCU_SIZE);
+    std::vector<uint16_t> block(MCU_SIZE * MCU_SIZE);
+    for (uint16_t top = 0; top < h; top += MCU_SIZE) {
+        const uint16_t rows = std::min<uint16_t>(MCU_SIZE, h - top);
+        file.read(rgb.data(), (size_t)w * 3 * rows);
+        for (uint16_t left = 0; left < w; left += MCU_SIZE) {
+            const uint16_t cols = std::min<uint16_t>(MCU_SIZE, w - left);
+            for (uint16_t r = 0; r < rows; r++) {
+                for (uint16_t c = 0; c < cols; c++) {
+                    const uint8_t *p = &rgb[((size_t)r * w + left + c) * 3];
+                    const uint16_t color = (p[0] & 0xF8) << 8 | (p[1] & 0xFC) << 3 | p[2] >> 3;
+                    block[r * cols + c] = swapBytes ? (uint16_t)(color >> 8 | color << 8) : color;
+                }
+            }
+            if (callback && !callback(x + left, y + top, cols, rows, block.data())) return JDR_INTR;
+        }
+    }
+    return JDR_OK;
+}
@@ -0,0 +1,25 @@
+// Host stand-in for TJpg_Decoder. It reads binary PPM (P6) files instead of jpgs, so tests know every pixel,
+// and hands them to the callback in 16x16 blocks in the order TJpgDec delivers its MCUs
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+
+typedef bool (*SketchCallback)(int16_t x, int16_t y, uint16_t w, uint16_t h, uint16_t *data);
+
+enum JRESULT { JDR_OK = 0, JDR_INTR, JDR_INP, JDR_MEM1, JDR_MEM2, JDR_PAR, JDR_FMT1, JDR_FMT2, JDR_FMT3 };
+
+class TJpg_Decoder {
+   public:
+    void setJpgScale(uint8_t scale) {}
+    void setSwapBytes(bool swap) { swapBytes = swap; }
+    void setCallback(SketchCallback callback) { this->callback = callback; }
+    JRESULT getFsJpgSize(uint16_t *w, uint16_t *h, const String &path, fs::FS &fs);
+    JRESULT drawFsJpg(int32_t x, int32_t y, const String &path, fs::FS &fs);
+
+   private:
+    SketchCallback callback = nullptr;
+    bool swapBytes = false;
+};
+
+extern TJpg_Decoder TJpgDec;
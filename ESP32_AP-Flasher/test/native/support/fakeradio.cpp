@@ -0,0 +1,67 @@
+// Stand-ins for the modules newproto.cpp sends to: the AP on the serial port, the other APs over udp and the
+// websocket. Nothing is sent, sendBlock() hands the block to the test
+#include <Arduino.h>
+
+#include "commstructs.h"
+#include "hostradio.h"
+#include "serialap.h"
+#include "tagdata.h"
+#include "udp.h"
+#include "web.h"
+
+std::function<void(const uint8_t *data, uint16_t len)> hostOnBlock;
+
+struct espSetChannelPower curChannel = {0};
+struct APInfoS apInfo;
+UDPcomm udpsync;
+
+bool sendCancelPending(struct pendingData *pending) {
+    return true;
+}
+
+bool sendDataAvail(struct pendingData *pending) {
+    return true;
+}
+
+bool sendChannelPower(struct espSetChannelPower *scp) {
+    return true;
+}
+
+uint16_t sendBlock(const void *data, const uint16_t len) {
+    const uint8_t *block = (const uint8_t *)data;
+    if (hostOnBlock) hostOnBlock(block, len);
+    uint16_t checksum = 0;
+    for (uint16_t c = 0; c < len; c++) checksum += block[c];
+    return checksum;
+}
+
+void wsSendTaginfo(const uint8_t *mac, uint8_t syncMode) {
+}
+
+uint8_t wsClientCount() {
+    return 0;
+}
+
+void TagData::parse(const uint8_t src[8], const size_t id, const uint8_t *data, const uint8_t len) {
+}
+
+UDPcomm::UDPcomm() {
+}
+
+UDPcomm::~UDPcomm() {
+}
+
+void UDPcomm::getAPList() {
+}
+
+void UDPcomm::netProcessDataReq(struct espAvailDataReq *eadr) {
+}
+
+void UDPcomm::netProcessXferComplete(struct espXferComplete *xfc) {
+}
+
+void UDPcomm::netProcessXferTimeout(struct espXferComplete *xfc) {
+}
+
+void UDPcomm::netSendDataAvail(struct pendingData *pending) {
+}
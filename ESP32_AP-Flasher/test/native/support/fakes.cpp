@@ -0,0 +1,60 @@
+// Stand-ins for the firmware modules the host build links against: web, storage and contentmanager
+#include <Arduino.h>
+#include <FS.h>
+
+#include <mutex>
+#include <unordered_map>
+
+#include "contentmanager.h"
+#include "hosttest.h"
+#include "storage.h"
+#include "tag_db.h"
+#include "web.h"
+
+static fs::FS hostFS(".");
+fs::FS *contentFS = &hostFS;
+SemaphoreHandle_t fsMutex = nullptr;
+static std::recursive_mutex hostFsMutex;
+
+void wsLog(const String &text) {
+    Serial.println(text);
+}
+
+void wsErr(const String &text) {
+    Serial.println("error: " + text);
+}
+
+void logLine(const String &text) {
+    Serial.println(text);
+}
+
+void logLine(const char *buffer) {
+    Serial.println(buffer);
+}
+
+char *formatHttpDate(const time_t t) {
+    static thread_local char buf[40];
+    struct tm timeinfo;
+    gmtime_r(&t, &timeinfo);
+    strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &timeinfo);
+    return buf;
+}
+
+void fsLock() {
+    hostFsMutex.lock();
+}
+
+void fsUnlock() {
+    hostFsMutex.unlock();
+}
+
+void hostSetFsRoot(const String &root) {
+    hostFS = fs::FS(root);
+}
+
+// the cache of tag_db.cpp, tests fill it before they start any threads
+extern std::unordered_map<int, HwType> hwdata;
+
+void hostSetHwType(const HwType &type) {
+    hwdata[type.id] = type;
+}
@@ -0,0 +1,132 @@
+#include "hostfont.h"
+
+#include <FS.h>
+
+#include "storage.h"
+
+const String &hostTtfPath() {
+    static const String path = "/fonts/Signika-SB.ttf";
+    if (!contentFS->exists(path)) {
+        contentFS->mkdir("/fonts");
+        FILE *in = fopen(OEPL_DATA_DIR "/fonts/Signika-SB.ttf", "rb");
+        fs::File out = contentFS->open(path, "w");
+        uint8_t buf[4096];
+        size_t n;
+        while (in && (n = fread(buf, 1, sizeof(buf), in)) > 0) out.write(buf, n);
+        if (in) fclose(in);
+        out.close();
+    }
+    return path;
+}
+
+bool hostOpenTtf(truetypeClass &ttf) {
+    return ttf.setTtfFile(contentFS->open(hostTtfPath(), "r"));
+}
+
+void hostTextSprite(TFT_eSprite &spr) {
+    spr.setColorDepth(16);
+    spr.createSprite(400, 300);
+    spr.fillSprite(TFT_WHITE);
+}
+
+// one string at a size, as prepareTtf() and drawString() of contentmanager.cpp set it up
+static uint32_t drawText(TFT_eSprite &spr, truetypeClass &ttf, int16_t x, int16_t y, uint16_t size, uint8_t levels, const char *text) {
+    ttf.setFramebuffer(spr.width(), spr.height(), spr.getColorDepth(), static_cast<uint8_t *>(spr.getPointer()));
+    ttf.setCharacterSize(size);
+    ttf.setCharacterSpacing(0);
+    ttf.setTextCoverage(size >= 40 ? levels : 2);
+    ttf.setTextColor(TFT_BLACK, TFT_BLACK);
+    ttf.setTextBoundary(x, spr.width(), spr.height());
+    ttf.textDraw(x, y, text);
+    return strlen(text);
+}
+
+uint32_t drawWeatherScreen(TFT_eSprite &spr, truetypeClass &ttf, uint8_t levels) {
+    uint32_t chars = 0;
+    chars += drawText(spr, ttf, 8, 4, 20, levels, "Amsterdam");
+    chars += drawText(spr, ttf, 260, 4, 20, levels, "Mon 17 Oct");
+    chars += drawText(spr, ttf, 8, 32, 100, levels, "21.5");
+    chars += drawText(spr, ttf, 230, 40, 40, levels, "12:45");
+    chars += drawText(spr, ttf, 230, 90, 16, levels, "Partly cloudy");
+    chars += drawText(spr, ttf, 230, 110, 16, levels, "Wind 12 km/h NW");
+    chars += drawText(spr, ttf, 230, 130, 16, levels, "Rain 0.4 mm");
+    static const char *const prices[][2] = {{"Bananas / kg", "1.29"}, {"Whole milk 1L", "0.99"}, {"Coffee beans", "7.49"}, {"Eggs x10", "3.15"}};
+    for (uint8_t i = 0; i < 4; i++) {
+        chars += drawText(spr, ttf, 8, 160 + i * 32, 24, levels, prices[i][0]);
+        chars += drawText(spr, ttf, 300, 160 + i * 32, 24, levels, prices[i][1]);
+    }
+    return chars;
+}
+
+glyphMetrics hostVlwMetrics(uint16_t code, uint16_t prev) {
+    glyphMetrics glyph;
+    glyph.advance = code == ' ' ? 5 : 5 + (code * 7) % 9;
+    glyph.extent = glyph.advance - 1 + (code % 3 == 0);
+    glyph.lead = code % 5 == 0 ? 1 : 0;
+    return glyph;
+}
+
+measureFunc hostTtfMeasure(truetypeClass &ttf) {
+    return [&ttf](uint16_t code, uint16_t prev) -> glyphMetrics {
+        const int16_t advance = ttf.getCharAdvance(code, prev);
+        return {advance, advance, 0};
+    };
+}
+
+String hostLongText(size_t bytes, uint32_t seed) {
+    static const char *const words[] = {"the", "tag", "shows", "a", "calendar", "entry", "for", "tomorrow", "morning", "meeting", "room",
+                                        "north-east", "wing", "bring", "laptop", "and", "coffee", "updated", "weather", "forecast", "light",
+                                        "rain", "expected", "after", "lunch", "access-point", "firmware", "rollout", "schedule", "of"};
+    String text;
+    uint32_t state = seed;
+    while (text.length() < bytes) {
+        state = state * 1103515245 + 12345;
+        const uint32_t r = state >> 16;
+        text += words[r % (sizeof(words) / sizeof(words[0]))];
+        if (r % 13 == 0) text += ",";
+        text += (r % 41 == 0) ? "\n" : (r % 29 == 0) ? "  " : " ";
+    }
+    return text.substring(0, bytes);
+}
+
+// width of text[start, end) measured from its first character, as textWidth() does
+static int32_t naiveWidth(const String &text, uint16_t start, uint16_t end, const measureFunc &measure, uint32_t &measured) {
+    int32_t width = 0;
+    uint16_t prev = 0;
+    for (uint16_t pos = start; pos < end; pos++) {
+        const glyphMetrics m = measure((uint8_t)text[pos], prev);
+        measured++;
+        if (pos == start) width += m.lead;
+        width += pos + 1 < end ? m.advance : m.extent;
+        prev = (uint8_t)text[pos];
+    }
+    return width;
+}
+
+bool hostNaiveLayout(const String &text, int16_t boxwidth, uint16_t maxLines, const measureFunc &measure, std::vector<textLine> &lines, uint32_t &measured) {
+    lines.clear();
+    measured = 0;
+    const int length = text.length();
+    int startPos = 0;
+    while (startPos < length && lines.size() < maxLines) {
+        int endPos = startPos;
+        bool hasspace = false;
+        while (endPos < length && naiveWidth(text, startPos, endPos + 1, measure, measured) <= boxwidth && text.charAt(endPos) != '\n') {
+            if (text.charAt(endPos) == ' ' || text.charAt(endPos) == '-') hasspace = true;
+            endPos++;
+        }
+        while (endPos < length && endPos > startPos && hasspace == true && text.charAt(endPos - 1) != ' ' && text.charAt(endPos - 1) != '-' && text.charAt(endPos) != '\n') {
+            endPos--;
+        }
+        // the width of the line is for the comparison, the loop didn't measure it
+        uint32_t widthMeasured = 0;
+        lines.push_back({(uint16_t)startPos, (uint16_t)endPos, (int16_t)naiveWidth(text, startPos, endPos, measure, widthMeasured), false});
+
+        if (text.charAt(endPos) == '\n') endPos++;
+        startPos = endPos;
+        while (startPos < length && text.charAt(startPos) == ' ') {
+            startPos++;
+        }
+    }
+    return startPos >= length;
+}
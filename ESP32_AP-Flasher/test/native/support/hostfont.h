@@ -0,0 +1,39 @@
+// Fonts of data/ and typical ttf screens, for the font tests of the host build
+#pragma once
+
+#include <Arduino.h>
+#include <TFT_eSPI.h>
+
+#include "textlayout.h"
+#include "truetype.h"
+
+/// @brief Path of the ttf font of data/ in contentFS, it is copied there on the first call
+const String &hostTtfPath();
+
+/// @brief Parse the ttf font of hostTtfPath() straight from its file
+/// @return false if it doesn't open or parse
+bool hostOpenTtf(truetypeClass &ttf);
+
+/// @brief A 400x300 16 bit sprite filled white, the size of the screens below
+void hostTextSprite(TFT_eSprite &spr);
+
+/// @brief Weather and prices in several sizes, drawn the way drawString() draws ttf text
+/// @param levels Coverage levels of the text from size 40 up, as setTextCoverage()
+/// @return characters drawn, spaces included
+uint32_t drawWeatherScreen(TFT_eSprite &spr, truetypeClass &ttf, uint8_t levels = 2);
+
+/// @brief Metrics of a made-up vlw font, some characters lean left of the pen or end short of their advance
+glyphMetrics hostVlwMetrics(uint16_t code, uint16_t prev);
+
+/// @brief Metrics of a ttf font at its current size, the way drawTextBox() measures truetype text
+measureFunc hostTtfMeasure(truetypeClass &ttf);
+
+/// @brief ASCII words, hyphens, commas and now and then a newline or a double space, the same text for a seed
+String hostLongText(size_t bytes, uint32_t seed = 1);
+
+/// @brief The wrap loop of drawTextBox() before layoutText(), every width measured from the start of the line
+///
+/// Lines are as layoutText() gives them, without the ellipsis. It doesn't handle a character wider than the box
+/// @param measured Gets the number of measure calls
+/// @return true if all of the text fit
+bool hostNaiveLayout(const String &text, int16_t boxwidth, uint16_t maxLines, const measureFunc &measure, std::vector<textLine> &lines, uint32_t &measured);
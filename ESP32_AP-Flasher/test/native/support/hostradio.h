@@ -0,0 +1,9 @@
+// The radio side of the access point for the host build of newproto.cpp: serialap, udp and the websocket
+#pragma once
+
+#include <Arduino.h>
+
+#include <functional>
+
+/// @brief Called by sendBlock() with the block newproto.cpp hands to the radio, from the thread that sends it
+extern std::function<void(const uint8_t *data, uint16_t len)> hostOnBlock;
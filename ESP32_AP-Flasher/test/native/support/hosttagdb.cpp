@@ -0,0 +1,58 @@
+#include "hosttagdb.h"
+
+#include <FS.h>
+
+#include "storage.h"
+
+tagRecord *hostMakeTag(uint32_t n) {
+    static const uint8_t hwTypes[] = {0x00, 0x01, 0x05, 0x11, 0x2E, 0x33, 0x40};
+    const uint32_t now = time(nullptr);
+    tagRecord *tag = new tagRecord;
+    memcpy(tag->mac, &n, sizeof(n));
+    tag->mac[4] = 0x34;
+    tag->mac[5] = 0x12;
+    for (uint8_t i = 0; i < sizeof(tag->md5); i++) tag->md5[i] = n * 31 + i;
+    tag->alias = "tag " + String(n);
+    tag->lastseen = now - n % 600;
+    tag->nextupdate = now + n % 900;
+    tag->expectedNextCheckin = now + 3600 + n;
+    tag->contentMode = n % 30;
+    tag->modeConfigJson = "{\"location\":\"Room " + String(n) + "\",\"interval\":\"15\",\"units\":\"\\u00b0C\"}";
+    tag->LQI = 100 + n % 100;
+    tag->RSSI = -(int)(40 + n % 50);
+    tag->temperature = (int)(n % 40) - 10;
+    tag->batteryMv = 2400 + n % 700;
+    tag->hwType = hwTypes[n % sizeof(hwTypes)];
+    tag->wakeupReason = n % 4;
+    tag->capabilities = n & 0xFF;
+    tag->isExternal = n % 17 == 0;
+    tag->apIp = IPAddress(192, 168, 1, n % 200 + 2);
+    tag->rotate = n % 4;
+    tag->lut = n % 3;
+    tag->invert = n % 2;
+    tag->tagSoftwareVersion = 0x1A + n % 5;
+    tag->currentChannel = 11 + n % 16;
+    tag->updateCount = n * 3;
+    tag->updateLast = now - n * 7;
+    tag->lastChanged = now - n;
+    return tag;
+}
+
+void hostFillTags(size_t count) {
+    destroyDB();
+    contentFS->mkdir("/current");
+    contentFS->remove("/current/tagDB.bin");
+    contentFS->remove("/current/tagDB.jnl");
+    for (size_t n = 0; n < count; n++) insertRecord(hostMakeTag(n));
+}
+
+bool hostSameTag(const tagRecord &a, const tagRecord &b, bool lastChanged) {
+    return memcmp(a.mac, b.mac, sizeof(a.mac)) == 0 && memcmp(a.md5, b.md5, sizeof(a.md5)) == 0 && a.alias == b.alias &&
+           a.lastseen == b.lastseen && a.nextupdate == b.nextupdate && a.expectedNextCheckin == b.expectedNextCheckin &&
+           a.contentMode == b.contentMode && a.modeConfigJson == b.modeConfigJson && a.LQI == b.LQI && a.RSSI == b.RSSI &&
+           a.temperature == b.temperature && a.batteryMv == b.batteryMv && a.hwType == b.hwType &&
+           a.wakeupReason == b.wakeupReason && a.capabilities == b.capabilities && a.isExternal == b.isExternal &&
+           a.apIp == b.apIp && a.rotate == b.rotate && a.lut == b.lut && a.invert == b.invert &&
+           a.tagSoftwareVersion == b.tagSoftwareVersion && a.currentChannel == b.currentChannel &&
+           a.updateCount == b.updateCount && a.updateLast == b.updateLast && (!lastChanged || a.lastChanged == b.lastChanged);
+}
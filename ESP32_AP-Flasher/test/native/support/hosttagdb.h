@@ -0,0 +1,17 @@
+// Tag records of a typical access point, for the tagDB tests of the host build
+#pragma once
+
+#include <Arduino.h>
+
+#include "tag_db.h"
+
+/// @brief A tag with every persisted field set, the same for the same n
+/// @param n Number of the tag, it is in the low bytes of the mac
+tagRecord *hostMakeTag(uint32_t n);
+
+/// @brief destroyDB(), remove the files of the binary DB, and insert count tags of hostMakeTag()
+void hostFillTags(size_t count);
+
+/// @brief The fields saveDB() and compactDB() persist are the same
+/// @param lastChanged Compare lastChanged too, the json DB doesn't keep it
+bool hostSameTag(const tagRecord &a, const tagRecord &b, bool lastChanged = true);
@@ -0,0 +1,373 @@
+#include "hosttest.h"
+
+#include <FS.h>
+#include <MD5Builder.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+
+#include "commstructs.h"
+#include "g5/g5dec.inl"
+#include "storage.h"
+
+struct registeredCase {
+    const char *name;
+    void (*run)();
+};
+
+static std::vector<registeredCase> &testCases() {
+    static std::vector<registeredCase> cases;
+    return cases;
+}
+
+static const char *runningCase = nullptr;
+static uint32_t failedChecks = 0;
+
+hostTestCase::hostTestCase(const char *name, void (*run)()) {
+    testCases().push_back({name, run});
+}
+
+bool hostCheck(bool ok, const char *what, const char *file, int line) {
+    if (ok) return true;
+    failedChecks++;
+    printf("    FAILED %s:%d in %s: %s\n", file, line, runningCase, what);
+    return false;
+}
+
+static String scratchDir = "scratch";
+
+int hostRunTests(int argc, char **argv) {
+    // a directory per executable, ctest runs them side by side
+    const char *name = strrchr(argv[0], '/');
+    scratchDir = String("scratch_") + (name ? name + 1 : argv[0]);
+    ::mkdir(hostScratchDir().c_str(), 0755);
+    hostSetFsRoot(hostScratchDir());
+    uint32_t failedCases = 0;
+    for (const registeredCase &test : testCases()) {
+        bool selected = argc < 2;
+        for (int i = 1; i < argc; i++) selected |= strcmp(argv[i], test.name) == 0;
+        if (!selected) continue;
+        runningCase = test.name;
+        const uint32_t before = failedChecks;
+        printf("%s\n", test.name);
+        fflush(stdout);
+        test.run();
+        if (failedChecks != before) failedCases++;
+    }
+    printf("%u test cases failed, %u checks\n", failedCases, failedChecks);
+    return failedChecks ? 1 : 0;
+}
+
+const String &hostScratchDir() {
+    return scratchDir;
+}
+
+std::vector<uint8_t> hostReadFile(const String &path) {
+    std::vector<uint8_t> data;
+    fs::File file = contentFS->open(path, "r");
+    if (!file) return data;
+    data.resize(file.size());
+    data.resize(file.read(data.data(), data.size()));
+    return data;
+}
+
+String hostMd5(const uint8_t *data, size_t size) {
+    MD5Builder md5;
+    md5.begin();
+    md5.add(data, size);
+    md5.calculate();
+    return md5.toString();
+}
+
+// The few fields of a tag type json getHwType() reads, without a json parser
+static bool jsonValue(const std::string &json, const char *key, std::string &value) {
+    const size_t pos = json.find(std::string("\"") + key + "\"");
+    if (pos == std::string::npos) return false;
+    size_t start = json.find(':', pos) + 1;
+    while (json[start] == ' ' || json[start] == '\t') start++;
+    if (json[start] == '"') {
+        value.clear();
+        for (size_t i = start + 1; i < json.size() && json[i] != '"'; i++) {
+            if (json[i] == '\\' && i + 1 < json.size()) i++;
+            value += json[i];
+        }
+    } else {
+        value = json.substr(start, json.find_first_of(",}\n", start) - start);
+    }
+    return true;
+}
+
+static bool parseTagType(const std::string &json, uint8_t id, hostPanel &panel) {
+    std::string value;
+    HwType &hw = panel.hw;
+    hw = HwType{id, 0, 0, 0, 0, 0, 0};
+    if (jsonValue(json, "name", value)) panel.name = value.c_str();
+    if (!jsonValue(json, "width", value)) return false;
+    hw.width = atoi(value.c_str());
+    if (!jsonValue(json, "height", value)) return false;
+    hw.height = atoi(value.c_str());
+    if (jsonValue(json, "rotatebuffer", value)) hw.rotatebuffer = atoi(value.c_str());
+    if (jsonValue(json, "bpp", value)) hw.bpp = atoi(value.c_str());
+    if (jsonValue(json, "shortlut", value)) hw.shortlut = atoi(value.c_str());
+    if (jsonValue(json, "zlib_compression", value)) hw.zlib = strtol(value.c_str(), nullptr, 16);
+    if (jsonValue(json, "g5_compression", value)) hw.g5 = strtol(value.c_str(), nullptr, 16);
+    if (jsonValue(json, "zlib_rowxor", value)) hw.zlibXor = strtol(value.c_str(), nullptr, 16);
+    if (jsonValue(json, "delta_compression", value)) hw.delta = strtol(value.c_str(), nullptr, 16);
+    hw.highlightColor = jsonValue(json, "highlight_color", value) ? atoi(value.c_str()) : 2;
+
+    size_t pos = json.find("\"colortable\"");
+    if (pos == std::string::npos) return false;
+    const size_t end = json.find('}', pos);
+    while ((pos = json.find('[', pos)) < end) {
+        int r, g, b;
+        if (sscanf(json.c_str() + pos, "[ %d , %d , %d ]", &r, &g, &b) != 3) return false;
+        hw.colortable.push_back(Color(r, g, b));
+        pos++;
+    }
+    return hw.width && hw.height && !hw.colortable.empty();
+}
+
+std::vector<hostPanel> hostTagTypes() {
+    std::vector<hostPanel> panels;
+    DIR *dir = opendir(OEPL_TAGTYPES_DIR);
+    if (dir == nullptr) return panels;
+    std::vector<std::string> files;
+    while (dirent *entry = readdir(dir)) {
+        const std::string name = entry->d_name;
+        if (name.size() == 7 && name.substr(2) == ".json") files.push_back(name);
+    }
+    closedir(dir);
+    std::sort(files.begin(), files.end());
+    for (const std::string &name : files) {
+        std::ifstream in(std::string(OEPL_TAGTYPES_DIR) + "/" + name);
+        std::stringstream json;
+        json << in.rdbuf();
+        hostPanel panel;
+        panel.file = name.c_str();
+        if (parseTagType(json.str(), strtol(name.substr(0, 2).c_str(), nullptr, 16), panel)) panels.push_back(panel);
+    }
+    return panels;
+}
+
+HwType hostTagType(uint8_t id) {
+    for (const hostPanel &panel : hostTagTypes()) {
+        if (panel.hw.id != id) continue;
+        hostSetHwType(panel.hw);
+        return panel.hw;
+    }
+    return HwType{0, 0, 0, 0, 0, 0, 0};
+}
+
+imgParam hostImageParams(const HwType &hw, uint8_t dither) {
+    imgParam imageParams;
+    imageParams.hwdata = hw;
+    imageParams.width = hw.width;
+    imageParams.height = hw.height;
+    imageParams.bpp = hw.bpp;
+    imageParams.rotatebuffer = hw.rotatebuffer;
+    imageParams.shortlut = hw.shortlut;
+    imageParams.hasRed = false;
+    imageParams.dataType = DATATYPE_IMG_RAW_1BPP;
+    imageParams.dither = dither;
+    imageParams.invert = 0;
+    imageParams.symbols = 0;
+    imageParams.zlib = hw.zlib != 0;
+    imageParams.zlibXor = imageParams.zlib && hw.zlibXor != 0;
+    imageParams.g5 = hw.g5 != 0;
+    imageParams.lut = 0;
+    imageParams.preload = false;
+    return imageParams;
+}
+
+void hostSprite(TFT_eSprite &spr, const imgParam &imageParams) {
+    spr.deleteSprite();
+    spr.setColorDepth(16);
+    spr.createSprite(imageParams.width, imageParams.height);
+    spr.fillSprite(TFT_WHITE);
+}
+
+// the same numbers on every run
+static uint32_t nextRandom(uint32_t &state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+void drawTextScreen(TFT_eSprite &spr, uint32_t seed) {
+    // lines of "words": blocks of glyph-like strokes, a title bar and a price in red
+    const int w = spr.width(), h = spr.height();
+    uint32_t rnd = seed * 2654435761u | 1;
+    spr.fillRect(0, 0, w, h / 8, TFT_BLACK);
+    for (int x = 4; x < w / 2; x += 7) spr.fillRect(x, h / 32, 5, h / 16, TFT_WHITE);
+    const int lineHeight = std::max(10, h / 10);
+    for (int y = h / 8 + 4; y + lineHeight < h; y += lineHeight + 2) {
+        for (int x = 4; x < w - 10;) {
+            const int word = 3 + nextRandom(rnd) % 8;
+            for (int c = 0; c < word && x < w - 10; c++, x += lineHeight / 2 + 1) {
+                const uint32_t glyph = nextRandom(rnd);
+                spr.drawFastVLine(x, y + (glyph & 3), lineHeight - 4, TFT_BLACK);
+                spr.drawFastHLine(x, y + lineHeight / 2, lineHeight / 2 - 1, TFT_BLACK);
+                if (glyph & 8) spr.drawFastVLine(x + lineHeight / 2 - 2, y + 2, lineHeight - 4, TFT_BLACK);
+                if (glyph & 16) spr.drawFastHLine(x, y + 1, lineHeight / 2 - 1, TFT_BLACK);
+            }
+            x += lineHeight / 2;
+        }
+    }
+    spr.fillRect(w * 2 / 3, h * 2 / 3, w / 4, h / 4, TFT_RED);
+    spr.drawRect(w * 2 / 3 + 3, h * 2 / 3 + 3, w / 4 - 6, h / 4 - 6, TFT_WHITE);
+}
+
+void drawIconScreen(TFT_eSprite &spr, uint32_t seed) {
+    // weather: sun, clouds and rain drops over a temperature bar
+    const int w = spr.width(), h = spr.height();
+    uint32_t rnd = seed * 40503u | 1;
+    const int r = std::min(w, h) / 6;
+    for (int i = 0; i < 3; i++) {
+        const int cx = w * (1 + 2 * i) / 6, cy = h / 3;
+        spr.fillCircle(cx, cy, r, i == 1 ? TFT_RED : TFT_BLACK);
+        spr.fillCircle(cx + r / 2, cy + r / 3, r * 2 / 3, TFT_WHITE);
+        for (int d = 0; d < 6; d++) {
+            const int dx = cx - r + nextRandom(rnd) % (2 * r), dy = cy + r + nextRandom(rnd) % r;
+            spr.drawLine(dx, dy, dx - 2, dy + 5, TFT_BLACK);
+        }
+    }
+    spr.drawRect(w / 10, h * 3 / 4, w * 8 / 10, h / 10, TFT_BLACK);
+    spr.fillRect(w / 10, h * 3 / 4, w * (2 + nextRandom(rnd) % 6) / 10, h / 10, TFT_BLACK);
+}
+
+void drawQrScreen(TFT_eSprite &spr, uint32_t seed) {
+    // a 33x33 module code with its three finder patterns
+    const int w = spr.width(), h = spr.height();
+    uint32_t rnd = seed * 69069u | 1;
+    const int modules = 33, size = std::min(w, h) * 9 / 10, unit = std::max(1, size / modules);
+    const int left = (w - unit * modules) / 2, top = (h - unit * modules) / 2;
+    for (int y = 0; y < modules; y++) {
+        for (int x = 0; x < modules; x++) {
+            if (nextRandom(rnd) & 1) spr.fillRect(left + x * unit, top + y * unit, unit, unit, TFT_BLACK);
+        }
+    }
+    const int corners[3][2] = {{0, 0}, {modules - 7, 0}, {0, modules - 7}};
+    for (const auto &c : corners) {
+        spr.fillRect(left + c[0] * unit, top + c[1] * unit, 7 * unit, 7 * unit, TFT_BLACK);
+        spr.fillRect(left + (c[0] + 1) * unit, top + (c[1] + 1) * unit, 5 * unit, 5 * unit, TFT_WHITE);
+        spr.fillRect(left + (c[0] + 2) * unit, top + (c[1] + 2) * unit, 3 * unit, 3 * unit, TFT_BLACK);
+    }
+}
+
+void drawPhotoScreen(TFT_eSprite &spr, uint32_t seed) {
+    // smooth gradients with a bit of noise, like a scaled down photo
+    const int w = spr.width(), h = spr.height();
+    uint32_t rnd = seed * 1103515245u | 1;
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            const int noise = (int)(nextRandom(rnd) % 24) - 12;
+            const int r = std::clamp(128 + (int)(100 * sin(x * 0.031 + seed)) + noise, 0, 255);
+            const int g = std::clamp(128 + (int)(100 * cos(y * 0.027)) + noise, 0, 255);
+            const int b = std::clamp((x + y) * 255 / (w + h) + noise, 0, 255);
+            spr.drawPixel(x, y, TFT_eSPI::color565(r, g, b));
+        }
+    }
+}
+
+void drawPaletteScreen(TFT_eSprite &spr) {
+    const int w = spr.width(), h = spr.height();
+    uint32_t color = 0;
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++, color = (color + 40503) & 0xFFFF) spr.drawPixel(x, y, color);
+    }
+}
+
+bool hostInflate(const uint8_t *data, size_t size, std::vector<uint8_t> &out) {
+    if (size < sizeof(uint32_t)) return false;
+    uint32_t length;
+    memcpy(&length, data, sizeof(length));
+    out.resize(length);
+    uLongf n = length;
+    return uncompress(out.data(), &n, data + sizeof(uint32_t), size - sizeof(uint32_t)) == Z_OK && n == length;
+}
+
+// undoes xorRows() of makeimage.cpp
+static void unxorRows(uint8_t *plane, size_t planeSize, size_t rowBytes) {
+    for (size_t i = rowBytes; i < planeSize; i++) plane[i] ^= plane[i - rowBytes];
+}
+
+uint8_t hostDataType(const imgParam &imageParams) {
+    if (imageParams.bpp == 3) return DATATYPE_IMG_RAW_3BPP;
+    if (imageParams.bpp == 4) return DATATYPE_IMG_RAW_4BPP;
+    if (imageParams.delta) return DATATYPE_IMG_DELTA;
+    if (imageParams.zlib) return DATATYPE_IMG_ZLIB;
+    if (imageParams.g5) return DATATYPE_IMG_G5;
+    return imageParams.hasRed ? DATATYPE_IMG_RAW_2BPP : DATATYPE_IMG_RAW_1BPP;
+}
+
+bool hostDecodeImage(const std::vector<uint8_t> &file, const imgParam &imageParams, std::vector<uint8_t> &planes) {
+    const uint8_t dataType = hostDataType(imageParams);
+    const bool turned = imageParams.rotatebuffer % 2;
+    const size_t bufw = turned ? imageParams.height : imageParams.width;
+    const size_t bufh = turned ? imageParams.width : imageParams.height;
+    const size_t planeSize = bufw * bufh / 8;
+    if (dataType != DATATYPE_IMG_ZLIB && dataType != DATATYPE_IMG_G5 && dataType != DATATYPE_IMG_DELTA) {
+        planes = file;
+        return true;
+    }
+    if (dataType == DATATYPE_IMG_ZLIB) {
+        std::vector<uint8_t> data;
+        if (!hostInflate(file.data(), file.size(), data) || data.size() < 6 || data[0] != 6) return false;
+        const uint8_t colors = data[5];
+        planes.assign(data.begin() + 6, data.end());
+        if (planes.size() != ((colors & ~ZLIB_ROW_XOR) == 2 ? 2 : 1) * planeSize) return false;
+        if (colors & ZLIB_ROW_XOR) {
+            for (size_t offset = 0; offset < planes.size(); offset += planeSize) unxorRows(planes.data() + offset, planeSize, bufw / 8);
+        }
+        return true;
+    }
+    if (dataType == DATATYPE_IMG_G5) {
+        if (file.size() < 6 || file[0] != 6) return false;
+        const bool twoPlanes = file[5] == 2;
+        const int height = twoPlanes ? 2 * bufh : bufh;
+        std::vector<uint8_t> data(file.begin() + 6, file.end());
+        data.resize(data.size() + 8);
+        G5DECIMAGE decoder;
+        if (g5_decode_init(&decoder, bufw, height, data.data(), file.size() - 6) != G5_SUCCESS) return false;
+        // a byte of room behind the last line, the decoder writes up to the byte after it
+        planes.assign((twoPlanes ? 2 : 1) * planeSize + 1, 0);
+        for (int y = 0; y < height; y++) {
+            const int rc = g5_decode_line(&decoder, planes.data() + y * bufw / 8);
+            if (rc != G5_SUCCESS && rc != G5_DECODE_COMPLETE) return false;
+        }
+        planes.pop_back();
+        return true;
+    }
+    return false;
+}
+
+std::vector<uint8_t> hostPlanes(TFT_eSprite &spr, imgParam &imageParams) {
+    const size_t pixels = (size_t)spr.width() * spr.height();
+    if (imageParams.bpp == 3 || imageParams.bpp == 4) {
+        std::vector<uint8_t> planes(pixels / 8 * imageParams.bpp);
+        spr2color(spr, imageParams, planes.data(), nullptr, planes.size());
+        return planes;
+    }
+    const size_t planeSize = pixels / 8;
+    std::vector<uint8_t> planes(2 * planeSize);
+    spr2color(spr, imageParams, planes.data(), planes.data() + planeSize, planeSize);
+    if (!(imageParams.hasRed && imageParams.bpp > 1)) planes.resize(planeSize);
+    return planes;
+}
+
+double hostTimeMs(const std::function<void()> &fn, uint32_t minMs) {
+    const auto start = std::chrono::steady_clock::now();
+    uint32_t runs = 0;
+    double elapsed;
+    do {
+        fn();
+        runs++;
+        elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    } while (elapsed < minMs);
+    return elapsed / runs;
+}
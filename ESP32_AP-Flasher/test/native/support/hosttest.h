@@ -0,0 +1,100 @@
+// Test cases, checks and helpers of the host build
+#pragma once
+
+#include <Arduino.h>
+#include <TFT_eSPI.h>
+
+#include <functional>
+#include <vector>
+
+#include "makeimage.h"
+#include "tag_db.h"
+
+/// @brief Register a test case, it runs when the executable starts
+#define TEST_CASE(name)                                        \
+    static void name();                                        \
+    static hostTestCase name##_case(#name, name); \
+    static void name()
+
+/// @brief Fail the running test case when cond is false, and go on with it
+#define CHECK(cond) hostCheck((cond), #cond, __FILE__, __LINE__)
+/// @brief CHECK() that prints both values when they differ
+#define CHECK_EQ(a, b) hostCheckEq((a), (b), #a " == " #b, __FILE__, __LINE__)
+
+struct hostTestCase {
+    hostTestCase(const char *name, void (*run)());
+};
+
+bool hostCheck(bool ok, const char *what, const char *file, int line);
+
+template <typename A, typename B>
+bool hostCheckEq(const A &a, const B &b, const char *what, const char *file, int line) {
+    if (a == b) return true;
+    printf("    %s: %lld vs %lld\n", what, (long long)a, (long long)b);
+    return hostCheck(false, what, file, line);
+}
+
+/// @brief Run the registered test cases, or those named on the command line
+/// @return exit code, 0 if all checks passed
+int hostRunTests(int argc, char **argv);
+
+/// @brief Directory tests write their files to, it is the root of contentFS
+const String &hostScratchDir();
+/// @brief Point contentFS at a directory of the host
+void hostSetFsRoot(const String &root);
+/// @brief Make a hwType known to getHwType() and getPaletteLut()
+void hostSetHwType(const HwType &type);
+
+/// @brief Whole file of contentFS, empty if it doesn't exist
+std::vector<uint8_t> hostReadFile(const String &path);
+/// @brief Hex md5 of a buffer, for golden outputs
+String hostMd5(const uint8_t *data, size_t size);
+inline String hostMd5(const std::vector<uint8_t> &data) { return hostMd5(data.data(), data.size()); }
+
+/// @brief A tag type of resources/tagtypes
+struct hostPanel {
+    String file;
+    String name;
+    HwType hw;
+};
+
+/// @brief All tag types of resources/tagtypes, with a colour table and a size
+std::vector<hostPanel> hostTagTypes();
+/// @brief The tag type of resources/tagtypes with this id, it is made known to getHwType() too
+HwType hostTagType(uint8_t id);
+
+/// @brief Image parameters the way drawNew() sets them up for a tag with the latest firmware
+imgParam hostImageParams(const HwType &hw, uint8_t dither = DITHER_ORDERED);
+
+/// @brief A 16 bit sprite of the size of the panel, filled white
+void hostSprite(TFT_eSprite &spr, const imgParam &imageParams);
+
+// Typical screens, the same pixels every time
+void drawTextScreen(TFT_eSprite &spr, uint32_t seed = 1);
+void drawIconScreen(TFT_eSprite &spr, uint32_t seed = 1);
+void drawQrScreen(TFT_eSprite &spr, uint32_t seed = 1);
+void drawPhotoScreen(TFT_eSprite &spr, uint32_t seed = 1);
+/// @brief Pixels of the panel, for the tests that go through all of them
+void drawPaletteScreen(TFT_eSprite &spr);
+
+/// @brief Data type updateTagImage() sends an image spr2buffer() wrote with
+uint8_t hostDataType(const imgParam &imageParams);
+
+/// @brief Planes of an image spr2buffer() wrote, decoded as the tag would
+///
+/// Takes raw, zlib (with ZLIB_ROW_XOR) and G5 images, by hostDataType()
+/// @param planes Gets black and red back to back, or the packed pixels for 3/4 bpp
+/// @return false if the image doesn't decode
+bool hostDecodeImage(const std::vector<uint8_t> &file, const imgParam &imageParams, std::vector<uint8_t> &planes);
+
+/// @brief Inflate a zlib stream behind its 4 byte length, with the zlib of the host
+bool hostInflate(const uint8_t *data, size_t size, std::vector<uint8_t> &out);
+
+/// @brief Convert a sprite, exported by makeimage.cpp
+void spr2color(TFT_eSprite &spr, imgParam &imageParams, uint8_t *black, uint8_t *red, size_t buffer_size);
+
+/// @brief Planes spr2color() makes of a sprite: black and red back to back for 1 and 2 bpp
+std::vector<uint8_t> hostPlanes(TFT_eSprite &spr, imgParam &imageParams);
+
+/// @brief Run fn until it has taken at least minMs, return the average time per run in ms
+double hostTimeMs(const std::function<void()> &fn, uint32_t minMs = 200);
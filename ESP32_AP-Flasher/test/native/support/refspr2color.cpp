@@ -0,0 +1,247 @@
+// spr2color() of makeimage.cpp before the row at a time conversion, kept as it was apart from the name and the
+// value-initialised error rows, the old ones added to the uninitialised entries past bufw
+#include "refspr2color.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <tuple>
+
+namespace {
+
+
+struct Error {
+    int32_t r;
+    int32_t g;
+    int32_t b;
+};
+
+uint32_t colorDistance(const Color &c1, const Color &c2, const Error &e1) {
+    int32_t r_diff = c1.r + e1.r - c2.r;
+    int32_t g_diff = c1.g + e1.g - c2.g;
+    int32_t b_diff = c1.b + e1.b - c2.b;
+    if (abs(c1.r - c1.g) < 20 && abs(c1.b - c1.g) < 20) {
+        if (abs(c2.r - c2.g) > 20 || abs(c2.b - c2.g) > 20) return 4294967295;  // don't select color pixels on black and white
+    }
+    return 3 * r_diff * r_diff + 5.47 * g_diff * g_diff + 1.53 * b_diff * b_diff;
+}
+
+std::tuple<int, int, float, float> findClosestColors(const Color &pixel, const std::vector<Color> &palette) {
+    int closestIndex = -1, secondClosestIndex = -1;
+    float closestDist = std::numeric_limits<float>::max();
+    float secondClosestDist = std::numeric_limits<float>::max();
+    for (size_t i = 0; i < palette.size(); ++i) {
+        float dist = colorDistance(pixel, palette[i], (Error){0, 0, 0});
+        if (dist < closestDist) {
+            secondClosestIndex = closestIndex;
+            secondClosestDist = closestDist;
+            closestIndex = i;
+            closestDist = dist;
+        } else if (dist < secondClosestDist) {
+            secondClosestIndex = i;
+            secondClosestDist = dist;
+        }
+    }
+    if (closestIndex != -1 && secondClosestIndex != -1) {
+        auto rgbValue = [](const Color &color) {
+            return (color.r << 16) | (color.g << 8) | color.b;
+        };
+
+        if (rgbValue(palette[secondClosestIndex]) > rgbValue(palette[closestIndex])) {
+            std::swap(closestIndex, secondClosestIndex);
+            std::swap(closestDist, secondClosestDist);
+        }
+    }
+    return { closestIndex, secondClosestIndex, closestDist, secondClosestDist};
+}
+
+}  // namespace
+
+void refSpr2color(TFT_eSprite &spr, imgParam &imageParams, uint8_t *buffer, size_t buffer_size, bool is_red) {
+    uint8_t rotate = imageParams.rotate;
+    long bufw = spr.width(), bufh = spr.height();
+
+    if (imageParams.rotatebuffer % 2) {
+        // turn the image 90 or 270
+        rotate = (rotate + 3) % 4;
+        rotate = (rotate + (imageParams.rotatebuffer - 1)) % 4;
+        bufw = spr.height();
+        bufh = spr.width();
+    } else {
+        // rotate 180
+        rotate = (rotate + (imageParams.rotatebuffer)) % 4;
+    }
+
+    memset(buffer, 0, buffer_size);
+
+    std::vector<Color> palette = imageParams.hwdata.colortable;
+    if (imageParams.invert == 1) {
+        std::swap(palette[0], palette[1]);
+    }
+    Color color;
+    int num_colors = palette.size();
+    if (imageParams.bufferbpp == 1) num_colors = 2;
+    Error *error_bufferold = new Error[bufw + 4]();
+    Error *error_buffernew = new Error[bufw + 4]();
+
+    size_t bitOffset = 0;
+
+    memset(error_bufferold, 0, bufw * sizeof(Error));
+    for (uint16_t y = 0; y < bufh; y++) {
+        memset(error_buffernew, 0, bufw * sizeof(Error));
+        for (uint16_t x = 0; x < bufw; x++) {
+            switch (rotate) {
+                case 0:
+                    color = Color(spr.readPixel(x, y));
+                    break;
+                case 1:
+                    color = Color(spr.readPixel(y, bufw - 1 - x));
+                    break;
+                case 2:
+                    color = Color(spr.readPixel(bufw - 1 - x, bufh - 1 - y));
+                    break;
+                case 3:
+                    color = Color(spr.readPixel(bufh - 1 - y, x));
+                    break;
+            }
+
+            int best_color_index = 0;
+            if (imageParams.dither == 2) {
+                // special ordered dithering
+                auto [c1Index, c2Index, distC1, distC2] = findClosestColors(color, palette);
+                Color c1 = palette[c1Index];
+                Color c2 = palette[c2Index];
+                float weight = distC1 / (distC1 + distC2);
+                if (weight <= 0.03) {
+                    best_color_index = c1Index;
+                } else if (weight < 0.30) {
+                    best_color_index = ((y % 2 && ((y / 2 + x) % 2)) ? c2Index : c1Index);
+                } else if (weight < 0.70) {
+                    best_color_index = ((x + y) % 2 ? c2Index : c1Index);
+                } else if (weight < 0.97) {
+                    best_color_index = ((y % 2 && ((y / 2 + x) % 2)) % 2 ? c1Index : c2Index);
+                } else {
+                    best_color_index = c2Index;
+                }
+            }
+
+            if (imageParams.dither == 1 || imageParams.dither == 0) {
+                uint32_t best_color_distance = colorDistance(color, palette[0], error_bufferold[x]);
+
+                for (int i = 1; i < num_colors; i++) {
+                    if (best_color_distance == 0) break;
+                    uint32_t distance = colorDistance(color, palette[i], error_bufferold[x]);
+                    if (distance < best_color_distance) {
+                        best_color_distance = distance;
+                        best_color_index = i;
+                    }
+                }
+            }
+
+            if (imageParams.bpp == 3 || imageParams.bpp == 4) {
+                size_t byteIndex = bitOffset / 8;
+                uint8_t bitIndex = bitOffset % 8;
+
+                if (bitIndex + imageParams.bpp <= 8) {
+                    buffer[byteIndex] |= best_color_index << (8 - bitIndex - imageParams.bpp);
+                } else {
+                    uint8_t highPart = best_color_index >> (bitIndex + imageParams.bpp - 8);
+                    uint8_t lowPart = best_color_index & ((1 << (bitIndex + imageParams.bpp - 8)) - 1);
+                    buffer[byteIndex] |= highPart;
+                    buffer[byteIndex + 1] |= lowPart << (8 - (bitIndex + imageParams.bpp - 8));
+                }
+                bitOffset += imageParams.bpp;
+            } else {
+                uint8_t bitIndex = 7 - (x % 8);
+                uint32_t byteIndex = (y * bufw + x) / 8;
+
+                // this looks a bit ugly, but it's performing better than shorter notations
+                switch (best_color_index) {
+                    case 1:
+                        if (!is_red)
+                            buffer[byteIndex] |= (1 << bitIndex);
+                        break;
+                    case 2:
+                        imageParams.hasRed = true;
+                        if (is_red)
+                            buffer[byteIndex] |= (1 << bitIndex);
+                        break;
+                    case 3:
+                        imageParams.hasRed = true;
+                        buffer[byteIndex] |= (1 << bitIndex);
+                        break;
+                }
+            }
+
+            if (imageParams.dither == 1) {
+                // Burkes Dithering
+
+                Error error = {
+                    color.r + error_bufferold[x].r - palette[best_color_index].r,
+                    color.g + error_bufferold[x].g - palette[best_color_index].g,
+                    color.b + error_bufferold[x].b - palette[best_color_index].b};
+
+                float scaling_factor = 255.0f / std::max(std::abs(error.r), std::max(std::abs(error.g), std::abs(error.b)));
+                if (scaling_factor < 1.0f) {
+                    error.r *= scaling_factor;
+                    error.g *= scaling_factor;
+                    error.b *= scaling_factor;
+                }
+
+                error_buffernew[x].r += error.r / 4;
+                error_buffernew[x].g += error.g / 4;
+                error_buffernew[x].b += error.b / 4;
+
+                if (x > 0) {
+                    error_buffernew[x - 1].r += error.r / 8;
+                    error_buffernew[x - 1].g += error.g / 8;
+                    error_buffernew[x - 1].b += error.b / 8;
+                }
+
+                if (x > 1) {
+                    error_buffernew[x - 2].r += error.r / 16;
+                    error_buffernew[x - 2].g += error.g / 16;
+                    error_buffernew[x - 2].b += error.b / 16;
+                }
+
+                error_buffernew[x + 1].r += error.r / 8;
+                error_buffernew[x + 1].g += error.g / 8;
+                error_buffernew[x + 1].b += error.b / 8;
+
+                error_bufferold[x + 1].r += error.r / 4;
+                error_bufferold[x + 1].g += error.g / 4;
+                error_bufferold[x + 1].b += error.b / 4;
+
+                error_buffernew[x + 2].r += error.r / 16;
+                error_buffernew[x + 2].g += error.g / 16;
+                error_buffernew[x + 2].b += error.b / 16;
+
+                error_bufferold[x + 2].r += error.r / 8;
+                error_bufferold[x + 2].g += error.g / 8;
+                error_bufferold[x + 2].b += error.b / 8;
+            }
+        }
+        memcpy(error_bufferold, error_buffernew, bufw * sizeof(Error));
+    }
+
+    delete[] error_buffernew;
+    delete[] error_bufferold;
+
+    return;
+}
+
+
+std::vector<uint8_t> refPlanes(TFT_eSprite &spr, imgParam &imageParams) {
+    const size_t pixels = (size_t)spr.width() * spr.height();
+    if (imageParams.bpp == 3 || imageParams.bpp == 4) {
+        std::vector<uint8_t> planes(pixels / 8 * imageParams.bpp);
+        refSpr2color(spr, imageParams, planes.data(), planes.size(), false);
+        return planes;
+    }
+    const size_t planeSize = pixels / 8;
+    std::vector<uint8_t> planes(2 * planeSize);
+    refSpr2color(spr, imageParams, planes.data(), planeSize, false);
+    refSpr2color(spr, imageParams, planes.data() + planeSize, planeSize, true);
+    if (!(imageParams.hasRed && imageParams.bpp > 1)) planes.resize(planeSize);
+    return planes;
+}
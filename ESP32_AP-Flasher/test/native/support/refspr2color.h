@@ -0,0 +1,16 @@
+// The sprite conversion of makeimage.cpp as it was before it went a row at a time, for the tests and benchmarks that
+// compare the pixels and the time against it
+#pragma once
+
+#include <TFT_eSPI.h>
+
+#include <vector>
+
+#include "makeimage.h"
+
+/// @brief The old spr2color(): one plane per call, readPixel() per pixel, float Burkes error diffusion
+/// @param is_red Fill the red plane instead of the black one, 3/4 bpp ignore it
+void refSpr2color(TFT_eSprite &spr, imgParam &imageParams, uint8_t *buffer, size_t buffer_size, bool is_red);
+
+/// @brief Planes refSpr2color() makes of a sprite, laid out like hostPlanes()
+std::vector<uint8_t> refPlanes(TFT_eSprite &spr, imgParam &imageParams);
@@ -0,0 +1,118 @@
+// The render arena: output and scratch blocks from both ends, space handed back in reverse order, growing in place,
+// the heap when it is full, and whole frames encoded inside it
+#include "hosttest.h"
+
+#include "commstructs.h"
+#include "renderarena.h"
+
+static uint32_t arenaCounter(const char *name) {
+    DynamicJsonDocument doc(512);
+    JsonObject obj = doc.to<JsonObject>();
+    arenaStatsToJson(obj);
+    return obj[name].as<uint32_t>();
+}
+
+// the arena of the main thread, of the size renderArenaBytes() gives for an empty tagDB
+static uint8_t *base;
+static size_t size;
+
+static bool inArena(const void *ptr) {
+    return ptr >= base && ptr < base + size;
+}
+
+TEST_CASE(both_ends) {
+    arenaReset();
+    const uint32_t fallbacks = arenaCounter("fallbacks");
+    uint8_t *planes = (uint8_t *)arenaAlloc(1000, ARENA_OUTPUT);
+    uint8_t *scratch = (uint8_t *)arenaAlloc(500, ARENA_SCRATCH);
+    uint8_t *encoded = (uint8_t *)arenaAlloc(1001, ARENA_OUTPUT);
+    CHECK(planes == base);
+    CHECK(encoded == base + 1000);
+    CHECK(scratch == base + size - 504);
+
+    // a block below a live one stays taken until the one above it is freed
+    arenaFree(planes);
+    uint8_t *next = (uint8_t *)arenaAlloc(8, ARENA_OUTPUT);
+    CHECK(next == base + 2008);
+    arenaFree(next);
+    arenaFree(encoded);
+    next = (uint8_t *)arenaAlloc(8, ARENA_OUTPUT);
+    CHECK(next == base);
+    arenaFree(next);
+    arenaFree(scratch);
+    CHECK_EQ(arenaCounter("fallbacks"), fallbacks);
+}
+
+TEST_CASE(grow_and_fall_back) {
+    arenaReset();
+    const uint32_t fallbacks = arenaCounter("fallbacks");
+    // the last output block grows and shrinks in place, and keeps its bytes
+    uint8_t *planes = (uint8_t *)arenaAlloc(1000, ARENA_OUTPUT);
+    memset(planes, 0x5A, 1000);
+    CHECK(arenaRealloc(planes, 2001) == planes);
+    CHECK(arenaRealloc(planes, 100) == planes);
+
+    // one that isn't the last moves
+    uint8_t *scratch = (uint8_t *)arenaAlloc(64, ARENA_SCRATCH);
+    uint8_t *other = (uint8_t *)arenaAlloc(100, ARENA_OUTPUT);
+    uint8_t *moved = (uint8_t *)arenaRealloc(planes, 1000);
+    CHECK(moved != planes && inArena(moved));
+    CHECK(moved[0] == 0x5A && moved[99] == 0x5A);
+
+    // no room left, the heap takes it and it is counted
+    uint8_t *big = (uint8_t *)arenaAlloc(size - 1000, ARENA_OUTPUT);
+    CHECK(big != nullptr && !inArena(big));
+    CHECK_EQ(arenaCounter("fallbacks"), fallbacks + 1);
+    arenaFree(big);
+    arenaFree(moved);
+    arenaFree(other);
+    arenaFree(scratch);
+    arenaReset();
+    CHECK(arenaAlloc(8, ARENA_OUTPUT) == base);
+}
+
+// zlib and G5 of a 400x300 two-plane image, the size the arena is for: no heap fallback, the image decodes to the
+// planes, and the arena is empty after each frame
+TEST_CASE(frames_in_arena) {
+    const HwType hw = hostTagType(0x02);
+    const uint32_t fallbacks = arenaCounter("fallbacks");
+    for (const bool g5 : {false, true}) {
+        imgParam imageParams = hostImageParams(hw);
+        imageParams.zlib = !g5;
+        imageParams.zlibXor = !g5;
+        imageParams.g5 = g5;
+        imageParams.contentMode = g5 ? 1 : 2;
+        TFT_eSprite spr(nullptr);
+        hostSprite(spr, imageParams);
+        drawIconScreen(spr, 5);
+        imgParam planeParams = imageParams;
+        const std::vector<uint8_t> expected = hostPlanes(spr, planeParams);
+        CHECK(planeParams.hasRed);
+
+        arenaReset();
+        String file = "/arena.raw";
+        spr2buffer(spr, file, imageParams);
+        CHECK_EQ(hostDataType(imageParams), g5 ? DATATYPE_IMG_G5 : DATATYPE_IMG_ZLIB);
+        std::vector<uint8_t> planes;
+        CHECK(hostDecodeImage(hostReadFile(file), imageParams, planes) && planes == expected);
+        CHECK_EQ(arenaCounter("fallbacks"), fallbacks);
+        printf("    %s: high water %u of %u bytes\n", g5 ? "g5" : "zlib", arenaCounter("highwater"), (unsigned)size);
+        CHECK(arenaCounter("highwater") <= size);
+        // everything was handed back: both sides start at their end of the arena again without a reset
+        uint8_t *output = (uint8_t *)arenaAlloc(8, ARENA_OUTPUT);
+        uint8_t *scratch = (uint8_t *)arenaAlloc(8, ARENA_SCRATCH);
+        CHECK(output == base);
+        CHECK(scratch == base + size - 8);
+        arenaFree(scratch);
+        arenaFree(output);
+    }
+}
+
+int main(int argc, char **argv) {
+    size = renderArenaBytes();
+    if (!initRenderArena(size)) return 1;
+    // the first output block sits at the start of the arena
+    base = (uint8_t *)arenaAlloc(1, ARENA_OUTPUT);
+    arenaFree(base);
+    return hostRunTests(argc, argv);
+}
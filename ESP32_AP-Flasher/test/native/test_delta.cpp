@@ -0,0 +1,138 @@
+// DATATYPE_IMG_DELTA images against the image the tag has: decoded as the tag would, and their size on air
+#include "hosttest.h"
+
+#include <MD5Builder.h>
+
+#include "commstructs.h"
+#include "storage.h"
+
+static uint8_t nextContentMode = 1;
+
+// the data version a tag confirms for a file, the first 8 bytes of its md5 as in prepareDataAvail
+static uint64_t dataVersion(const std::vector<uint8_t> &file) {
+    MD5Builder md5;
+    md5.begin();
+    md5.add(file.data(), file.size());
+    md5.calculate();
+    uint8_t bytes[16];
+    md5.getBytes(bytes);
+    uint64_t dataVer;
+    memcpy(&dataVer, bytes, sizeof(dataVer));
+    return dataVer;
+}
+
+// applies a delta to the planes of its base: a 14 byte header with the base version, then regions of
+// {firstRow, rows, firstByte, bytes} followed by the xor of those bytes in each plane
+static bool applyDelta(const std::vector<uint8_t> &file, uint64_t baseVer, size_t rowBytes, std::vector<uint8_t> &planes) {
+    std::vector<uint8_t> data;
+    if (!hostInflate(file.data(), file.size(), data) || data.size() < 14 || data[0] != 14) return false;
+    if (!(data[5] & ZLIB_DELTA)) return false;
+    uint64_t version;
+    memcpy(&version, data.data() + 6, sizeof(version));
+    if (version != baseVer) return false;
+    const uint8_t planeCount = (data[5] & 0x0F) == 2 ? 2 : 1;
+    const size_t planeSize = planes.size() / planeCount;
+    size_t pos = 14;
+    while (pos < data.size()) {
+        uint16_t region[4];
+        if (pos + sizeof(region) > data.size()) return false;
+        memcpy(region, data.data() + pos, sizeof(region));
+        pos += sizeof(region);
+        const uint16_t firstRow = region[0], rows = region[1], firstByte = region[2], bytes = region[3];
+        if ((size_t)(firstRow + rows) * rowBytes > planeSize || firstByte + bytes > rowBytes) return false;
+        if (pos + (size_t)planeCount * rows * bytes > data.size()) return false;
+        for (uint8_t plane = 0; plane < planeCount; plane++) {
+            for (uint16_t y = firstRow; y < firstRow + rows; y++) {
+                uint8_t *row = planes.data() + plane * planeSize + y * rowBytes + firstByte;
+                for (uint16_t x = 0; x < bytes; x++) row[x] ^= data[pos++];
+            }
+        }
+    }
+    return true;
+}
+
+// a clock in the corner of the text screen, the kind of update the delta is for
+static void drawClock(TFT_eSprite &spr, uint8_t minute) {
+    spr.fillRect(8, 8, 96, 40, TFT_WHITE);
+    for (uint8_t digit = 0; digit < 4; digit++) {
+        const uint8_t value = (minute >> digit) & 3;
+        spr.fillRect(12 + digit * 22, 12 + value * 4, 16, 32 - value * 8, TFT_BLACK);
+    }
+}
+
+static std::vector<uint8_t> writeImage(TFT_eSprite &spr, imgParam &imageParams) {
+    String file = "/delta.raw";
+    contentFS->remove(file);
+    imageParams.contentMode = nextContentMode++;
+    spr2buffer(spr, file, imageParams);
+    return hostReadFile(file);
+}
+
+TEST_CASE(delta_round_trip) {
+    const struct {
+        const char *name;
+        void (*draw)(TFT_eSprite &, uint32_t);
+    } screens[] = {{"text", drawTextScreen}, {"photo", drawPhotoScreen}};
+    printf("    %-4s %-6s %-8s %12s %12s %10s\n", "type", "screen", "change", "full bytes", "delta bytes", "blocks");
+    // one plane, two planes, and a turned buffer
+    for (const uint8_t type : {0x26, 0x36, 0x01}) {
+        for (const auto &screen : screens) {
+            const HwType hw = hostTagType(type);
+            TFT_eSprite spr(nullptr);
+            imgParam baseParams = hostImageParams(hw);
+            baseParams.delta = 1;
+            hostSprite(spr, baseParams);
+            screen.draw(spr, 1);
+            drawClock(spr, 1);
+            imgParam basePlaneParams = baseParams;
+            const std::vector<uint8_t> basePlanes = hostPlanes(spr, basePlaneParams);
+            // the first image has no base, it is sent whole and kept as the base of the next one
+            const std::vector<uint8_t> baseFile = writeImage(spr, baseParams);
+            CHECK(hostDataType(baseParams) != DATATYPE_IMG_DELTA);
+            const uint64_t baseVer = dataVersion(baseFile);
+
+            for (const uint8_t minute : {2, 3}) {
+                drawClock(spr, minute);
+                imgParam imageParams = hostImageParams(hw);
+                imageParams.delta = 1;
+                imageParams.baseVer = baseVer;
+                imgParam planeParams = imageParams;
+                const std::vector<uint8_t> expected = hostPlanes(spr, planeParams);
+                const std::vector<uint8_t> file = writeImage(spr, imageParams);
+                CHECK_EQ(hostDataType(imageParams), DATATYPE_IMG_DELTA);
+                // a two plane base gets a two plane delta, the planes of both images are the same size
+                std::vector<uint8_t> planes = basePlanes;
+                if (planes.size() < expected.size()) planes.resize(expected.size(), 0);
+                const size_t rowBytes = (hw.rotatebuffer % 2 ? hw.height : hw.width) / 8;
+                if (!CHECK(applyDelta(file, baseVer, rowBytes, planes)) || !CHECK(planes == expected)) printf("    type %02X, minute %u\n", type, minute);
+
+                // what the tag gets without a delta
+                imgParam fullParams = hostImageParams(hw);
+                const size_t fullBytes = writeImage(spr, fullParams).size();
+                CHECK(file.size() < fullBytes);
+                printf("    %02X   %-6s minute %u %12u %12u %4u / %u\n", type, screen.name, minute, (unsigned)fullBytes, (unsigned)file.size(),
+                       (unsigned)((file.size() + BLOCK_DATA_SIZE - 1) / BLOCK_DATA_SIZE), (unsigned)((fullBytes + BLOCK_DATA_SIZE - 1) / BLOCK_DATA_SIZE));
+            }
+
+            // the planes of the base again: nothing is written and the tag is left alone
+            drawClock(spr, 1);
+            imgParam sameParams = hostImageParams(hw);
+            sameParams.delta = 1;
+            sameParams.baseVer = baseVer;
+            CHECK(writeImage(spr, sameParams).empty());
+            CHECK(sameParams.unchanged);
+
+            // a base the AP doesn't have is no delta
+            imgParam unknownParams = hostImageParams(hw);
+            unknownParams.delta = 1;
+            unknownParams.baseVer = baseVer ^ 1;
+            writeImage(spr, unknownParams);
+            CHECK(hostDataType(unknownParams) != DATATYPE_IMG_DELTA);
+            CHECK(!unknownParams.unchanged);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    return hostRunTests(argc, argv);
+}
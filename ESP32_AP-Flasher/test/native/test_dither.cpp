@@ -0,0 +1,64 @@
+// The error diffusion kernels of spr2color: golden outputs and the density they give a flat grey
+#include "hosttest.h"
+
+struct goldenDither {
+    uint8_t dither;
+    const char *planes;
+};
+
+// md5 of the planes of the photo screen on a 2.9" BWR tag, check a changed output on a tag before updating these
+static const goldenDither goldenDithers[] = {
+    {DITHER_BURKES, "332a92df49c074a5afd51c0f30e7518b"},
+    {DITHER_FLOYD_STEINBERG, "8a288e2cfd4b6e991c2c529f1f871479"},
+    {DITHER_ATKINSON, "4b4b5852a1a79d47757b6323b4e2c64f"},
+    {DITHER_SIERRA_LITE, "49afa8ade23eaad46e29b704b9188ba2"},
+};
+
+TEST_CASE(kernel_goldens) {
+    const HwType hw = hostTagType(0x01);
+    for (const goldenDither &golden : goldenDithers) {
+        imgParam imageParams = hostImageParams(hw, golden.dither);
+        TFT_eSprite spr(nullptr);
+        hostSprite(spr, imageParams);
+        drawPhotoScreen(spr);
+        const String planes = hostMd5(hostPlanes(spr, imageParams));
+        if (!CHECK(planes == golden.planes)) printf("    {%u, \"%s\"},\n", golden.dither, planes.c_str());
+    }
+}
+
+// a flat mid grey comes out as about half black pixels, and never as red
+TEST_CASE(grey_density) {
+    const HwType hw = hostTagType(0x01);
+    for (const goldenDither &golden : goldenDithers) {
+        imgParam imageParams = hostImageParams(hw, golden.dither);
+        TFT_eSprite spr(nullptr);
+        hostSprite(spr, imageParams);
+        spr.fillSprite(TFT_eSPI::color565(128, 128, 128));
+        const std::vector<uint8_t> planes = hostPlanes(spr, imageParams);
+        size_t black = 0;
+        for (uint8_t byte : planes) black += __builtin_popcount(byte);
+        const double density = (double)black / ((size_t)hw.width * hw.height);
+        if (!CHECK(density > 0.45 && density < 0.55)) printf("    dither %u: %.3f black\n", golden.dither, density);
+        CHECK(!imageParams.hasRed);
+    }
+}
+
+// error diffusion of a white or a black screen leaves it as it is
+TEST_CASE(flat_screens) {
+    const HwType hw = hostTagType(0x01);
+    for (const goldenDither &golden : goldenDithers) {
+        for (const uint16_t color : {TFT_WHITE, TFT_BLACK}) {
+            imgParam imageParams = hostImageParams(hw, golden.dither);
+            TFT_eSprite spr(nullptr);
+            hostSprite(spr, imageParams);
+            spr.fillSprite(color);
+            const std::vector<uint8_t> planes = hostPlanes(spr, imageParams);
+            const uint8_t expected = color == TFT_BLACK ? 0xFF : 0x00;
+            CHECK(std::all_of(planes.begin(), planes.end(), [&](uint8_t byte) { return byte == expected; }));
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    return hostRunTests(argc, argv);
+}
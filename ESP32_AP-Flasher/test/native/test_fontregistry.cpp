@@ -0,0 +1,93 @@
+// fontOpen() hits, rechecks against the file, reloads of changed fonts and evictions, from the registry counters
+#include <ArduinoJson.h>
+#include <FS.h>
+
+#include "fontregistry.h"
+#include "hostfont.h"
+#include "hosttest.h"
+#include "storage.h"
+
+static uint32_t registryStat(const char *name) {
+    JsonDocument doc;
+    JsonObject obj = doc.to<JsonObject>();
+    fontRegistryStatsToJson(obj);
+    return obj[name].as<uint32_t>();
+}
+
+// a copy of the ttf font under another name, padded to make it a different file
+static String copyFont(const String &name, size_t padding = 0) {
+    std::vector<uint8_t> font = hostReadFile(hostTtfPath());
+    font.resize(font.size() + padding, 0);
+    fs::File file = contentFS->open(name, "w");
+    file.write(font.data(), font.size());
+    file.close();
+    return name;
+}
+
+TEST_CASE(hits_and_rechecks) {
+    const String path = copyFont("/fonts/recheck.ttf");
+    {
+        fontLease lease = fontOpen(path);
+        CHECK(lease && lease.ttf() != nullptr);
+    }
+    const uint32_t loads = registryStat("loads");
+    const uint32_t hits = registryStat("hits");
+
+    // within the recheck time the file isn't even opened
+    uint32_t opens = fs::fileStats.opens;
+    for (uint8_t i = 0; i < 10; i++) {
+        fontLease lease = fontOpen(path);
+        CHECK(lease.ttf() != nullptr);
+    }
+    CHECK_EQ(fs::fileStats.opens - opens, 0u);
+    CHECK_EQ(registryStat("hits") - hits, 10u);
+
+    // after it the file is looked at, and kept as it is unchanged
+    hostAdvanceMillis(FONT_REGISTRY_RECHECK_MS + 1);
+    opens = fs::fileStats.opens;
+    {
+        fontLease lease = fontOpen(path);
+        CHECK(lease.ttf() != nullptr);
+    }
+    CHECK_EQ(fs::fileStats.opens - opens, 1u);
+    CHECK_EQ(registryStat("loads"), loads);
+
+    // a changed file is read again at the next check
+    copyFont(path, 64);
+    hostAdvanceMillis(FONT_REGISTRY_RECHECK_MS + 1);
+    const uint32_t reloads = registryStat("reloads");
+    {
+        fontLease lease = fontOpen(path);
+        CHECK(lease.ttf() != nullptr);
+    }
+    CHECK_EQ(registryStat("reloads") - reloads, 1u);
+    CHECK_EQ(registryStat("loads") - loads, 1u);
+
+    // a font that is gone gives an empty lease
+    contentFS->remove(path);
+    hostAdvanceMillis(FONT_REGISTRY_RECHECK_MS + 1);
+    CHECK(!fontOpen(path));
+}
+
+TEST_CASE(evicts_least_recently_used) {
+    const uint32_t evictions = registryStat("evictions");
+    // one font held the whole time, it stays while the others come and go
+    fontLease held = fontOpen(copyFont("/fonts/held.ttf"));
+    CHECK(held.ttf() != nullptr);
+    for (uint8_t i = 0; i < FONT_REGISTRY_FONTS + 4; i++) {
+        fontLease lease = fontOpen(copyFont("/fonts/lru" + String(i) + ".ttf", i + 1));
+        CHECK(lease.ttf() != nullptr);
+        CHECK(registryStat("fonts") <= FONT_REGISTRY_FONTS);
+        CHECK(registryStat("residentbytes") <= FONT_REGISTRY_BYTES);
+        hostAdvanceMillis(1);
+    }
+    CHECK(registryStat("evictions") > evictions);
+    const uint32_t hits = registryStat("hits");
+    fontLease again = fontOpen("/fonts/held.ttf");
+    CHECK_EQ(registryStat("hits") - hits, 1u);
+    CHECK(again.ttf() != nullptr && again.data() == held.data());
+}
+
+int main(int argc, char **argv) {
+    return hostRunTests(argc, argv);
+}
@@ -0,0 +1,99 @@
+// Text drawn from the glyph cache against text rasterised on the spot, and the file io a warm cache leaves
+#include <ArduinoJson.h>
+#include <FS.h>
+
+#include "hostfont.h"
+#include "hosttest.h"
+
+// a key nothing was cached under yet, so every glyph and character lookup misses
+static uint64_t coldKey() {
+    static uint64_t key = 0x600DF00D00000000ULL;
+    return key++;
+}
+
+static uint32_t cacheStat(const char *name) {
+    JsonDocument doc;
+    JsonObject obj = doc.to<JsonObject>();
+    glyphCacheStatsToJson(obj);
+    return obj[name].as<uint32_t>();
+}
+
+static std::vector<uint8_t> pixels(TFT_eSprite &spr) {
+    const uint8_t *img = static_cast<const uint8_t *>(spr.getPointer());
+    return std::vector<uint8_t>(img, img + spr.width() * spr.height() * 2);
+}
+
+TEST_CASE(warm_matches_cold) {
+    for (const uint8_t levels : {2, 4}) {
+        const uint64_t key = coldKey();
+        truetypeClass cold;
+        CHECK(hostOpenTtf(cold));
+        cold.setFontKey(key);
+        TFT_eSprite coldSpr(nullptr);
+        hostTextSprite(coldSpr);
+        const uint32_t misses = cacheStat("misses");
+        drawWeatherScreen(coldSpr, cold, levels);
+        CHECK(cacheStat("misses") > misses);
+        cold.end();
+
+        // a font parsed again, as a new lease of the registry gets it: nothing of the file is read to draw
+        truetypeClass warm;
+        CHECK(hostOpenTtf(warm));
+        warm.setFontKey(key);
+        TFT_eSprite warmSpr(nullptr);
+        hostTextSprite(warmSpr);
+        const fs::hostFileStats before = fs::fileStats;
+        const uint32_t hits = cacheStat("hits");
+        const uint32_t chars = drawWeatherScreen(warmSpr, warm, levels);
+        CHECK_EQ(fs::fileStats.reads - before.reads, 0u);
+        CHECK_EQ(fs::fileStats.seeks - before.seeks, 0u);
+        CHECK(cacheStat("hits") - hits > chars / 2);
+        warm.end();
+
+        if (!CHECK(pixels(warmSpr) == pixels(coldSpr))) printf("    levels %u\n", levels);
+    }
+}
+
+// rotation is applied as the cached glyph is drawn, a glyph cached upright draws the same turned
+TEST_CASE(rotated_from_cache) {
+    const uint64_t key = coldKey();
+    TFT_eSprite spr[2] = {TFT_eSprite(nullptr), TFT_eSprite(nullptr)};
+    for (uint8_t pass = 0; pass < 2; pass++) {
+        truetypeClass ttf;
+        CHECK(hostOpenTtf(ttf));
+        ttf.setFontKey(pass ? key : coldKey());
+        if (pass) {
+            TFT_eSprite warmup(nullptr);
+            hostTextSprite(warmup);
+            drawWeatherScreen(warmup, ttf);
+        }
+        hostTextSprite(spr[pass]);
+        ttf.setTextRotation(ROTATE_180);
+        drawWeatherScreen(spr[pass], ttf);
+        ttf.end();
+    }
+    CHECK(pixels(spr[0]) == pixels(spr[1]));
+}
+
+TEST_CASE(bounded) {
+    truetypeClass ttf;
+    CHECK(hostOpenTtf(ttf));
+    ttf.setFontKey(coldKey());
+    const uint32_t evictions = cacheStat("evictions");
+    // the screen in enough sizes to overflow the cache
+    for (uint16_t size = 12; size <= 120; size += 4) {
+        TFT_eSprite spr(nullptr);
+        hostTextSprite(spr);
+        ttf.setCharacterSize(size);
+        ttf.setFramebuffer(spr.width(), spr.height(), 16, static_cast<uint8_t *>(spr.getPointer()));
+        ttf.setTextBoundary(0, spr.width(), spr.height());
+        ttf.textDraw(0, 0, "0123456789 ABCDEFGHIJKLMNOPQRSTUVWXYZ abcdefghijklmnopqrstuvwxyz");
+        CHECK(cacheStat("bytes") <= TTF_GLYPH_CACHE_BYTES);
+    }
+    CHECK(cacheStat("evictions") > evictions);
+    ttf.end();
+}
+
+int main(int argc, char **argv) {
+    return hostRunTests(argc, argv);
+}
@@ -0,0 +1,199 @@
+// httpFetch() against the server of the HTTPClient stand-in: concurrent requests for a url sharing one response,
+// revalidation of a stale response, no-store, the FETCH_CACHE_BYTES limit and the FETCH_HOST_INTERVAL per host
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "hosttest.h"
+#include "httpfetch.h"
+
+// the cache lives as long as the executable, every test case fetches urls of its own
+static std::mutex serverMutex;
+static std::map<String, uint32_t> hits;
+static std::map<String, std::map<String, String>> lastHeaders;
+static std::vector<std::pair<String, uint32_t>> requestTimes;
+
+static void serve(std::function<hostHttpResponse(const hostHttpRequest &request)> handler) {
+    {
+        std::lock_guard<std::mutex> lock(serverMutex);
+        hits.clear();
+        lastHeaders.clear();
+        requestTimes.clear();
+    }
+    hostHttpServer = [handler](const hostHttpRequest &request) {
+        {
+            std::lock_guard<std::mutex> lock(serverMutex);
+            hits[request.url]++;
+            lastHeaders[request.url] = request.headers;
+            requestTimes.emplace_back(request.url, millis());
+        }
+        return handler(request);
+    };
+}
+
+static uint32_t hitsOf(const String &url) {
+    std::lock_guard<std::mutex> lock(serverMutex);
+    return hits[url];
+}
+
+static String requestHeader(const String &url, const char *name) {
+    std::lock_guard<std::mutex> lock(serverMutex);
+    const auto &headers = lastHeaders[url];
+    auto it = headers.find(name);
+    return it == headers.end() ? String() : it->second;
+}
+
+static uint32_t fetchCounter(const char *name) {
+    DynamicJsonDocument doc(512);
+    JsonObject obj = doc.to<JsonObject>();
+    fetchStatsToJson(obj);
+    return obj[name].as<uint32_t>();
+}
+
+static hostHttpResponse response(const String &body, const String &cacheControl = String(), const String &etag = String()) {
+    hostHttpResponse res;
+    res.body = body;
+    if (cacheControl.length()) res.headers["Cache-Control"] = cacheControl;
+    if (etag.length()) res.headers["ETag"] = etag;
+    return res;
+}
+
+TEST_CASE(no_server) {
+    hostHttpServer = nullptr;
+    String body;
+    CHECK(httpFetch("http://nowhere.test/", body, 1000) < 0);
+    CHECK(body.isEmpty());
+}
+
+TEST_CASE(coalesce_concurrent_requests) {
+    const String url = "http://coalesce.test/weather";
+    const uint32_t coalescedBefore = fetchCounter("coalesced");
+    const int waiters = 7;
+    // the response waits until the other requests have joined it
+    serve([&](const hostHttpRequest &request) {
+        const uint32_t start = millis();
+        while (fetchCounter("coalesced") - coalescedBefore < waiters && millis() - start < 2000) delay(1);
+        return response("{\"temp\":21}", "no-store");
+    });
+
+    std::vector<std::thread> threads;
+    std::atomic<int> good(0);
+    for (int t = 0; t <= waiters; t++) {
+        threads.emplace_back([&] {
+            String body;
+            if (httpFetch(url, body, 1000) == 200 && body == "{\"temp\":21}") good++;
+        });
+    }
+    for (std::thread &thread : threads) thread.join();
+    CHECK_EQ(hitsOf(url), 1u);
+    CHECK_EQ(good.load(), waiters + 1);
+    CHECK_EQ(fetchCounter("coalesced") - coalescedBefore, (uint32_t)waiters);
+}
+
+TEST_CASE(revalidate_stale_response) {
+    const String url = "http://revalidate.test/feed";
+    // no-cache: stored, but stale right away
+    serve([](const hostHttpRequest &request) {
+        auto it = request.headers.find("If-None-Match");
+        if (it != request.headers.end() && it->second == "\"v1\"") {
+            hostHttpResponse res;
+            res.code = 304;
+            return res;
+        }
+        return response("first body", "no-cache", "\"v1\"");
+    });
+    String body;
+    CHECK_EQ(httpFetch(url, body, 1000), 200);
+    CHECK(body == "first body");
+    CHECK(requestHeader(url, "If-None-Match").isEmpty());
+
+    const uint32_t notModifiedBefore = fetchCounter("notmodified");
+    body = String();
+    CHECK_EQ(httpFetch(url, body, 1000), 200);
+    CHECK(body == "first body");
+    CHECK(requestHeader(url, "If-None-Match") == "\"v1\"");
+    CHECK_EQ(hitsOf(url), 2u);
+    CHECK_EQ(fetchCounter("notmodified") - notModifiedBefore, 1u);
+}
+
+TEST_CASE(fresh_response_from_cache) {
+    const String url = "http://fresh.test/prices";
+    serve([](const hostHttpRequest &request) { return response("prices", "max-age=600"); });
+    String body;
+    CHECK_EQ(httpFetch(url, body, 1000), 200);
+    body = String();
+    CHECK_EQ(httpFetch(url, body, 1000), 200);
+    CHECK(body == "prices");
+    CHECK_EQ(hitsOf(url), 1u);
+}
+
+TEST_CASE(no_store_not_cached) {
+    const String url = "http://nostore.test/private";
+    serve([](const hostHttpRequest &request) { return response("secret", "no-store", "\"s\""); });
+    String body;
+    for (int c = 0; c < 3; c++) {
+        CHECK_EQ(httpFetch(url, body, 1000), 200);
+        CHECK(body == "secret");
+        CHECK(requestHeader(url, "If-None-Match").isEmpty());
+    }
+    CHECK_EQ(hitsOf(url), 3u);
+}
+
+TEST_CASE(cache_bytes_evict_least_recently_used) {
+    const String a = "http://evict.test/a", b = "http://evict.test/b", c = "http://evict.test/c", big = "http://evict.test/big";
+    // two of them fit, a third pushes the least recently used out
+    const uint32_t size = FETCH_CACHE_BYTES * 2 / 5;
+    serve([&](const hostHttpRequest &request) {
+        // the last letter of the url, then filler
+        std::string text(request.url == big ? FETCH_CACHE_BYTES / 2 + 1 : size, 'x');
+        text[0] = request.url.c_str()[request.url.length() - 1];
+        return response(String(text.c_str()), "max-age=600");
+    });
+    String body;
+    CHECK_EQ(httpFetch(a, body, 1000), 200);
+    CHECK_EQ(httpFetch(b, body, 1000), 200);
+    CHECK_EQ(httpFetch(a, body, 1000), 200);
+    CHECK_EQ(httpFetch(c, body, 1000), 200);
+    CHECK(fetchCounter("cachebytes") <= FETCH_CACHE_BYTES);
+
+    CHECK_EQ(httpFetch(a, body, 1000), 200);
+    CHECK_EQ(httpFetch(c, body, 1000), 200);
+    CHECK_EQ(body.length(), size);
+    CHECK(body[0] == 'c');
+    CHECK_EQ(hitsOf(a), 1u);
+    CHECK_EQ(hitsOf(c), 1u);
+    CHECK_EQ(httpFetch(b, body, 1000), 200);
+    CHECK_EQ(hitsOf(b), 2u);
+
+    // a body over half the cache isn't kept
+    CHECK_EQ(httpFetch(big, body, 1000), 200);
+    CHECK_EQ(httpFetch(big, body, 1000), 200);
+    CHECK_EQ(hitsOf(big), 2u);
+    CHECK(fetchCounter("cachebytes") <= FETCH_CACHE_BYTES);
+}
+
+TEST_CASE(host_rate_limit) {
+    serve([](const hostHttpRequest &request) { return response("ok", "no-store"); });
+    String body;
+    CHECK_EQ(httpFetch("http://slow.test/1", body, 1000), 200);
+    CHECK_EQ(httpFetch("http://slow.test/2", body, 1000), 200);
+    CHECK_EQ(httpFetch("http://other.test/1", body, 1000), 200);
+
+    std::lock_guard<std::mutex> lock(serverMutex);
+    CHECK_EQ(requestTimes.size(), 3u);
+    if (requestTimes.size() != 3) return;
+    // the second request to a host waits, another host doesn't
+    const uint32_t sameHost = requestTimes[1].second - requestTimes[0].second;
+    const uint32_t otherHost = requestTimes[2].second - requestTimes[1].second;
+    printf("    same host after %u ms, other host after %u ms\n", sameHost, otherHost);
+    CHECK(sameHost >= FETCH_HOST_INTERVAL);
+    CHECK(otherHost < FETCH_HOST_INTERVAL);
+}
+
+int main(int argc, char **argv) {
+    const int result = hostRunTests(argc, argv);
+    hostHttpServer = nullptr;
+    return result;
+}
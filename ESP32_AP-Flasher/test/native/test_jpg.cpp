@@ -0,0 +1,111 @@
+// jpg2buffer straight from the decoder against the full frame sprite path, and the heap each of them takes
+#include <malloc.h>
+
+#include <atomic>
+
+#include "hosttest.h"
+#include "storage.h"
+
+// every allocation of the process goes through these, to find the peak heap of a conversion
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+extern "C" void __libc_free(void *ptr);
+
+static std::atomic<size_t> heapInUse{0};
+static std::atomic<size_t> heapPeak{0};
+
+static void *counted(void *ptr) {
+    if (ptr) {
+        const size_t now = heapInUse += malloc_usable_size(ptr);
+        size_t peak = heapPeak;
+        while (now > peak && !heapPeak.compare_exchange_weak(peak, now)) {
+        }
+    }
+    return ptr;
+}
+
+extern "C" void *malloc(size_t size) { return counted(__libc_malloc(size)); }
+extern "C" void *calloc(size_t count, size_t size) { return counted(__libc_calloc(count, size)); }
+extern "C" void free(void *ptr) {
+    if (ptr) heapInUse -= malloc_usable_size(ptr);
+    __libc_free(ptr);
+}
+extern "C" void *realloc(void *ptr, size_t size) {
+    if (ptr) heapInUse -= malloc_usable_size(ptr);
+    return counted(__libc_realloc(ptr, size));
+}
+
+// heap a call takes on top of what was in use before it
+static size_t peakHeapOf(const std::function<void()> &fn) {
+    const size_t before = heapInUse;
+    heapPeak = before;
+    fn();
+    return heapPeak - before;
+}
+
+// a 1600x1200 BWR panel, there is no tag type this large
+static HwType largePanel() {
+    HwType hw = hostTagType(0x36);
+    hw.id = 0xF6;
+    hw.width = 1600;
+    hw.height = 1200;
+    hostSetHwType(hw);
+    return hw;
+}
+
+// a photo as the binary ppm the decoder stand-in reads
+static void writePhoto(const String &path, uint16_t w, uint16_t h) {
+    fs::File file = contentFS->open(path, "w");
+    const String header = "P6\n" + String(w) + " " + String(h) + "\n255\n";
+    file.write((const uint8_t *)header.c_str(), header.length());
+    std::vector<uint8_t> row((size_t)w * 3);
+    for (uint16_t y = 0; y < h; y++) {
+        for (uint16_t x = 0; x < w; x++) {
+            row[x * 3] = 128 + 100 * sin(x * 0.011);
+            row[x * 3 + 1] = 128 + 100 * cos(y * 0.013);
+            row[x * 3 + 2] = (x + y) * 255 / (w + h);
+        }
+        file.write(row.data(), row.size());
+    }
+    file.close();
+}
+
+static uint8_t nextContentMode = 1;
+
+TEST_CASE(stream_matches_sprite) {
+    const HwType hw = largePanel();
+    writePhoto("/photo.jpg", hw.width, hw.height);
+    for (const uint8_t dither : {DITHER_NONE, DITHER_ORDERED, DITHER_FLOYD_STEINBERG}) {
+        imgParam streamParams = hostImageParams(hw, dither);
+        streamParams.contentMode = nextContentMode++;
+        const size_t streamHeap = peakHeapOf([&] { jpg2buffer("/photo.jpg", "/stream.raw", streamParams); });
+
+        imgParam spriteParams = hostImageParams(hw, dither);
+        spriteParams.contentMode = nextContentMode++;
+        String spriteFile = "/sprite.raw";
+        const size_t spriteHeap = peakHeapOf([&] {
+            TFT_eSprite spr(nullptr);
+            spr.setColorDepth(16);
+            spr.createSprite(hw.width, hw.height);
+            spr.fillSprite(TFT_WHITE);
+            drawJpg(spr, "/photo.jpg");
+            spr2buffer(spr, spriteFile, spriteParams);
+            spr.deleteSprite();
+        });
+
+        std::vector<uint8_t> streamed, drawn;
+        CHECK(hostDecodeImage(hostReadFile("/stream.raw"), streamParams, streamed));
+        CHECK(hostDecodeImage(hostReadFile("/sprite.raw"), spriteParams, drawn));
+        CHECK(!streamed.empty() && streamed == drawn);
+        CHECK(streamParams.hasRed == spriteParams.hasRed);
+        CHECK(streamHeap < spriteHeap);
+        // both hold the planes and the encoder buffers, the sprite path adds the 16 bit frame
+        printf("    dither %u: peak heap %u KB streamed, %u KB through a sprite, planes %u KB\n", dither, (unsigned)(streamHeap / 1024),
+               (unsigned)(spriteHeap / 1024), (unsigned)(drawn.size() / 1024));
+    }
+}
+
+int main(int argc, char **argv) {
+    return hostRunTests(argc, argv);
+}
@@ -0,0 +1,52 @@
+// The palette lut of spr2color against the search over the palette it replaces
+#include "hosttest.h"
+
+// no tag type has this id, getPaletteLut() gives nullptr for it and spr2color searches the palette for every pixel
+static const uint8_t unknownType = 0xFE;
+
+static const uint8_t paletteTypes[] = {0x01, 0x26, 0x55, 0xC0, 0xC1, 0xC2};
+
+// every RGB565 value, for each depth of palette, dither and invert the lut is built for
+TEST_CASE(lut_matches_search) {
+    for (const uint8_t type : paletteTypes) {
+        const HwType hw = hostTagType(type);
+        for (const uint8_t dither : {DITHER_NONE, DITHER_ORDERED}) {
+            for (const uint8_t invert : {0, 1}) {
+                imgParam imageParams = hostImageParams(hw, dither);
+                imageParams.invert = invert;
+                TFT_eSprite spr(nullptr);
+                hostSprite(spr, imageParams);
+                drawPaletteScreen(spr);
+                imgParam searchParams = imageParams;
+                searchParams.hwdata.id = unknownType;
+                // the first pass fills the lut, the second one reads it
+                imgParam fillParams = imageParams;
+                const std::vector<uint8_t> filled = hostPlanes(spr, fillParams);
+                const std::vector<uint8_t> planes = hostPlanes(spr, imageParams);
+                const std::vector<uint8_t> searched = hostPlanes(spr, searchParams);
+                if (!CHECK(planes == searched) || !CHECK(filled == searched)) {
+                    printf("    type %02X, dither %u, invert %u\n", type, dither, invert);
+                }
+                CHECK(imageParams.hasRed == searchParams.hasRed);
+            }
+        }
+    }
+}
+
+// the 1 bit fallback sprite uses the first two colours only, with a lut of its own
+TEST_CASE(lut_two_colours) {
+    const HwType hw = hostTagType(0x01);
+    imgParam imageParams = hostImageParams(hw, DITHER_NONE);
+    imageParams.bufferbpp = 1;
+    TFT_eSprite spr(nullptr);
+    hostSprite(spr, imageParams);
+    drawPaletteScreen(spr);
+    imgParam searchParams = imageParams;
+    searchParams.hwdata.id = unknownType;
+    CHECK(hostPlanes(spr, imageParams) == hostPlanes(spr, searchParams));
+    CHECK(!imageParams.hasRed);
+}
+
+int main(int argc, char **argv) {
+    return hostRunTests(argc, argv);
+}
@@ -0,0 +1,245 @@
+// The pending queue of newproto.cpp from several threads at once, the way the content task, the serial task and
+// the web server of the firmware use it: payloads queued for tags in memory, in a file and mirrored to a second
+// tag, block requests and xfer completes of the tags, and the web server reading whole payloads. No payload may be
+// freed or swapped while it is sent, and the queue counts have to add up afterwards
+#include <FS.h>
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unordered_map>
+
+#include "hostradio.h"
+#include "hosttagdb.h"
+#include "hosttest.h"
+#include "newproto.h"
+#include "storage.h"
+#include "tag_db.h"
+
+extern std::unordered_map<uint64_t, std::deque<PendingItemPtr>> pendingQueue;
+extern size_t pendingQueueSize;
+extern std::unordered_map<const uint8_t *, std::weak_ptr<uint8_t[]>> pendingPayloads;
+extern std::mutex queueMutex;
+
+#define TAGS 8
+#define ROUNDS 5000
+
+static std::atomic<uint64_t> nextVer(1);
+static std::atomic<uint32_t> blocksSent(0);
+static std::atomic<uint32_t> badBlocks(0);
+static std::atomic<uint32_t> payloadsRead(0);
+static std::atomic<uint32_t> badPayloads(0);
+
+// the block a thread asks for with processBlockRequest(), sendBlock() runs on the same thread
+static thread_local uint64_t expectedVer;
+static thread_local uint32_t expectedOffset;
+
+static uint32_t payloadLen(uint64_t ver) {
+    return 100 + ver % (3 * BLOCK_DATA_SIZE);
+}
+
+static uint8_t payloadByte(uint64_t ver, uint32_t pos) {
+    return (uint8_t)(ver >> (pos % 8 * 8)) ^ (uint8_t)(pos / 8);
+}
+
+static uint8_t *makePayload(uint64_t ver) {
+    const uint32_t len = payloadLen(ver);
+    uint8_t *data = (uint8_t *)malloc(len);
+    for (uint32_t pos = 0; pos < len; pos++) data[pos] = payloadByte(ver, pos);
+    return data;
+}
+
+static bool samePayload(const uint8_t *data, uint32_t len, uint64_t ver, uint32_t offset) {
+    bool same = true;
+    for (uint32_t pos = 0; pos < len; pos++) same &= data[pos] == payloadByte(ver, offset + pos);
+    return same;
+}
+
+static const uint8_t *tagMac(uint32_t n) {
+    return tagDB[n % TAGS]->mac;
+}
+
+static pendingData pendingFor(const uint8_t *mac, uint64_t ver) {
+    pendingData pending = {0};
+    memcpy(pending.targetMac, mac, 8);
+    pending.availdatainfo.dataType = DATATYPE_IMG_RAW_1BPP;
+    pending.availdatainfo.dataVer = ver;
+    pending.availdatainfo.dataSize = payloadLen(ver);
+    pending.attemptsLeft = 10;
+    return pending;
+}
+
+// what prepareDataAvail() and checkMirror() do, a payload in memory, one in a file, or one for two tags
+static void enqueue(std::mt19937 &rng) {
+    const uint64_t ver = nextVer++;
+    const uint32_t n = rng();
+    switch (ver % 3) {
+        case 0: {
+            uint8_t *data = makePayload(ver);
+            std::lock_guard<std::recursive_mutex> lock(tagDBMutex);
+            tagRecord *taginfo = tagRecord::findByMAC(tagMac(n));
+            clearPending(taginfo);
+            taginfo->data = data;
+            taginfo->len = payloadLen(ver);
+            pendingData pending = pendingFor(taginfo->mac, ver);
+            queueDataAvail(&pending, true);
+            break;
+        }
+        case 1: {
+            const String filename = "/current/" + String((uint32_t)ver) + ".pending";
+            uint8_t *data = makePayload(ver);
+            fs::File file = contentFS->open(filename, "w");
+            file.write(data, payloadLen(ver));
+            file.close();
+            free(data);
+            std::lock_guard<std::recursive_mutex> lock(tagDBMutex);
+            tagRecord *taginfo = tagRecord::findByMAC(tagMac(n));
+            clearPending(taginfo);
+            taginfo->filename = filename;
+            taginfo->len = payloadLen(ver);
+            pendingData pending = pendingFor(taginfo->mac, ver);
+            queueDataAvail(&pending, true);
+            break;
+        }
+        case 2: {
+            uint8_t *data = makePayload(ver);
+            std::lock_guard<std::recursive_mutex> lock(tagDBMutex);
+            tagRecord *taginfo = tagRecord::findByMAC(tagMac(n));
+            tagRecord *mirror = tagRecord::findByMAC(tagMac(n + 1));
+            clearPending(taginfo);
+            clearPending(mirror);
+            taginfo->data = data;
+            taginfo->len = payloadLen(ver);
+            mirror->data = data;
+            mirror->len = payloadLen(ver);
+            pendingData pending = pendingFor(mirror->mac, ver);
+            queueDataAvail(&pending, true);
+            // the mirror can get its xfer complete before the buffer is in the other queue too
+            std::this_thread::yield();
+            pending = pendingFor(taginfo->mac, ver);
+            queueDataAvail(&pending, true);
+            break;
+        }
+    }
+}
+
+// the serial task: a block of whatever is first in line for a tag
+static void requestBlock(std::mt19937 &rng) {
+    const uint8_t *mac = tagMac(rng());
+    PendingItemPtr item = getQueueItem(mac);
+    if (item == nullptr) return;
+    const uint64_t ver = item->pendingdata.availdatainfo.dataVer;
+    const uint32_t blocks = (payloadLen(ver) + BLOCK_DATA_SIZE - 1) / BLOCK_DATA_SIZE;
+    item = nullptr;
+
+    espBlockRequest br = {0};
+    br.ver = ver;
+    br.blockId = rng() % blocks;
+    memcpy(br.src, mac, 8);
+    addCRC(&br, sizeof(br));
+    expectedVer = ver;
+    expectedOffset = br.blockId * BLOCK_DATA_SIZE;
+    processBlockRequest(&br);
+}
+
+static void completeXfer(std::mt19937 &rng) {
+    espXferComplete xfc = {0};
+    memcpy(xfc.src, tagMac(rng()), 8);
+    addCRC(&xfc, sizeof(xfc));
+    if (rng() % 8) {
+        processXferComplete(&xfc, true);
+    } else {
+        processXferTimeout(&xfc, true);
+    }
+}
+
+// the web server handing out the payload of a queued item, it keeps the handle while it sends
+static void readPayload(std::mt19937 &rng) {
+    PendingItemPtr item = getQueueItem(tagMac(rng()));
+    if (item == nullptr) return;
+    const std::shared_ptr<uint8_t[]> data = loadQueueItemData(item);
+    if (data == nullptr) return;
+    std::this_thread::yield();
+    payloadsRead++;
+    if (item->len != payloadLen(item->pendingdata.availdatainfo.dataVer) ||
+        !samePayload(data.get(), item->len, item->pendingdata.availdatainfo.dataVer, 0)) {
+        badPayloads++;
+    }
+}
+
+static bool queueConsistent() {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    size_t total = 0;
+    bool ok = true;
+    for (const auto &queue : pendingQueue) {
+        ok = CHECK(!queue.second.empty()) && ok;
+        total += queue.second.size();
+    }
+    return CHECK_EQ(total, pendingQueueSize) && ok;
+}
+
+TEST_CASE(concurrent_queue) {
+    hostFillTags(TAGS);
+    contentFS->mkdir("/current");
+    for (tagRecord *tag : tagDB) tag->contentMode = 0;
+    config.runStatus = RUNSTATUS_RUN;
+    config.preview = 0;
+    hostOnBlock = [](const uint8_t *data, uint16_t len) {
+        blocksSent++;
+        if (!samePayload(data, len, expectedVer, expectedOffset)) badBlocks++;
+    };
+
+    std::atomic<int> enqueuers(2);
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < 2; t++) {
+        threads.emplace_back([&, t] {
+            std::mt19937 rng(t);
+            for (int c = 0; c < ROUNDS; c++) enqueue(rng);
+            enqueuers--;
+        });
+    }
+    // block requests and xfer completes come from the serial task, the web server reads alongside
+    for (uint32_t t = 0; t < 2; t++) {
+        threads.emplace_back([&, t] {
+            std::mt19937 rng(10 + t);
+            while (enqueuers > 0) {
+                for (int c = 0; c < 8; c++) requestBlock(rng);
+                completeXfer(rng);
+            }
+        });
+        threads.emplace_back([&, t] {
+            std::mt19937 rng(20 + t);
+            while (enqueuers > 0) readPayload(rng);
+        });
+    }
+    for (std::thread &thread : threads) thread.join();
+
+    printf("    %u blocks sent, %u payloads read, %u items left in the queue\n", (unsigned)blocksSent,
+           (unsigned)payloadsRead, (unsigned)pendingQueueSize);
+    CHECK(blocksSent > 0);
+    CHECK(payloadsRead > 0);
+    CHECK_EQ(badBlocks.load(), 0u);
+    CHECK_EQ(badPayloads.load(), 0u);
+    CHECK(queueConsistent());
+    for (const tagRecord *tag : tagDB) CHECK_EQ(tag->pendingCount, countQueueItem(tag->mac));
+
+    // xfer completes empty the queue and free every payload
+    for (const tagRecord *tag : tagDB) {
+        espXferComplete xfc = {0};
+        memcpy(xfc.src, tag->mac, 8);
+        while (countQueueItem(tag->mac)) processXferComplete(&xfc, true);
+        CHECK(tag->data == nullptr);
+        CHECK_EQ(tag->pendingCount, 0);
+    }
+    CHECK(queueConsistent());
+    CHECK_EQ(pendingQueueSize, 0u);
+    for (const auto &payload : pendingPayloads) CHECK(payload.second.expired());
+    hostOnBlock = nullptr;
+    destroyDB();
+}
+
+int main(int argc, char **argv) {
+    return hostRunTests(argc, argv);
+}
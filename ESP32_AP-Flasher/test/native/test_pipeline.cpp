@@ -0,0 +1,161 @@
+// spr2color, the codecs and spr2buffer against decoders, golden outputs and the converter of before
+#include "hosttest.h"
+
+#include "commstructs.h"
+#include "refspr2color.h"
+
+struct goldenImage {
+    uint8_t hwType;
+    uint8_t rotate;
+    const char *planes;
+    const char *file;
+};
+
+// md5 of the planes and of the file spr2buffer writes, for the text screen. A change means the tags get other pixels or
+// other bytes, check the new output before updating these
+static const goldenImage goldenImages[] = {
+    {0x01, 0, "8d15919a8a46a661359dec83394a5b5d", "e3a291b2c2ef14bde562f17989b7b0e1"},
+    {0x06, 1, "7a8b96731b43f3c6e957a9b09cc8337b", "6153533a27c79d36d421bf48c64bd05b"},
+    {0x21, 0, "f00301b6c86954b26d0e5ebf55268708", "f00301b6c86954b26d0e5ebf55268708"},
+    {0x26, 2, "cbcb19f760349c986c481b172ace5c0f", "37d4df4794d6a611e0f381cb9aaa30e1"},
+    {0x36, 0, "3d58c7a7ccf1990487ee409e537aae48", "e894cc0dfb9c64d1fa44dc61bc03c0ec"},
+    {0x55, 3, "dc5227faf71628416ae722d7a91e0963", "b80f636b458694d5b317157bfa3711d4"},
+    {0xC1, 0, "70c99c330131be82a0581ade64c7a1d0", "70c99c330131be82a0581ade64c7a1d0"},
+    {0xC2, 0, "80ed3a2843cdf7fe13693ee19579bdb4", "80ed3a2843cdf7fe13693ee19579bdb4"},
+};
+
+// a content mode of its own per image, so the codec history of one doesn't change the codec of another
+static uint8_t nextContentMode = 1;
+
+static std::vector<uint8_t> writeImage(TFT_eSprite &spr, imgParam &imageParams) {
+    String file = "/image.raw";
+    imageParams.contentMode = nextContentMode++;
+    spr2buffer(spr, file, imageParams);
+    return hostReadFile(file);
+}
+
+TEST_CASE(golden_outputs) {
+    for (const goldenImage &golden : goldenImages) {
+        const HwType hw = hostTagType(golden.hwType);
+        CHECK(hw.width != 0);
+        imgParam imageParams = hostImageParams(hw);
+        imageParams.rotate = golden.rotate;
+        TFT_eSprite spr(nullptr);
+        hostSprite(spr, imageParams);
+        drawTextScreen(spr);
+        imgParam planeParams = imageParams;
+        const String planes = hostMd5(hostPlanes(spr, planeParams));
+        const String file = hostMd5(writeImage(spr, imageParams));
+        const bool samePlanes = CHECK(planes == golden.planes);
+        if (!CHECK(file == golden.file) || !samePlanes) {
+            printf("    {0x%02X, %u, \"%s\", \"%s\"},\n", golden.hwType, golden.rotate, planes.c_str(), file.c_str());
+        }
+    }
+}
+
+// every tag type and screen: what the tag decodes is what spr2color made
+TEST_CASE(codec_round_trip) {
+    void (*screens[])(TFT_eSprite &, uint32_t) = {drawTextScreen, drawIconScreen, drawQrScreen, drawPhotoScreen};
+    for (const hostPanel &panel : hostTagTypes()) {
+        if (panel.hw.bpp > 4) continue;
+        hostSetHwType(panel.hw);
+        for (auto screen : screens) {
+            imgParam imageParams = hostImageParams(panel.hw);
+            TFT_eSprite spr(nullptr);
+            hostSprite(spr, imageParams);
+            screen(spr, 7);
+            imgParam planeParams = imageParams;
+            const std::vector<uint8_t> expected = hostPlanes(spr, planeParams);
+            const std::vector<uint8_t> file = writeImage(spr, imageParams);
+            std::vector<uint8_t> planes;
+            if (!CHECK(hostDecodeImage(file, imageParams, planes)) || !CHECK(planes == expected)) {
+                printf("    %s %s, data type %02X\n", panel.file.c_str(), panel.name.c_str(), hostDataType(imageParams));
+            }
+            CHECK(imageParams.hasRed == planeParams.hasRed);
+        }
+    }
+}
+
+// 8 and 1 bit sprites, the low memory fallbacks, give the same planes for the colours they can hold
+TEST_CASE(sprite_depths) {
+    const HwType hw = hostTagType(0x01);
+    imgParam imageParams = hostImageParams(hw);
+    TFT_eSprite spr16(nullptr), spr8(nullptr), spr1(nullptr);
+    hostSprite(spr16, imageParams);
+    spr8.setColorDepth(8);
+    spr8.createSprite(imageParams.width, imageParams.height);
+    spr8.fillSprite(TFT_WHITE);
+    drawTextScreen(spr16);
+    drawTextScreen(spr8);
+    imgParam params8 = imageParams;
+    CHECK(hostPlanes(spr16, imageParams) == hostPlanes(spr8, params8));
+
+    imgParam bw = hostImageParams(hostTagType(0x26));
+    hostSprite(spr16, bw);
+    spr1.setColorDepth(1);
+    spr1.setBitmapColor(TFT_WHITE, TFT_BLACK);
+    spr1.createSprite(bw.width, bw.height);
+    spr1.fillSprite(TFT_WHITE);
+    for (TFT_eSprite *spr : {&spr16, &spr1}) {
+        spr->fillRect(10, 10, 200, 100, TFT_BLACK);
+        spr->fillCircle(320, 200, 90, TFT_BLACK);
+        spr->fillCircle(320, 200, 40, TFT_WHITE);
+    }
+    imgParam params1 = bw;
+    params1.bufferbpp = 1;
+    CHECK(hostPlanes(spr16, bw) == hostPlanes(spr1, params1));
+}
+
+// share of the pixels set in a plane of planes
+static double inkShare(const std::vector<uint8_t> &planes, size_t from, size_t size) {
+    size_t ink = 0;
+    for (size_t i = from; i < from + size && i < planes.size(); i++) ink += __builtin_popcount(planes[i]);
+    return (double)ink / (size * 8);
+}
+
+// every tag type, screen and rotation, in both orientations drawNew() draws in, against refSpr2color(). No dither and
+// ordered dither are the same bit for bit. Burkes went to integer error diffusion after the row at a time conversion,
+// which rounds differently, so it only has to keep the coverage of each plane within 1%
+TEST_CASE(baseline_converter) {
+    void (*screens[])(TFT_eSprite &, uint32_t) = {drawTextScreen, drawIconScreen, drawQrScreen, drawPhotoScreen};
+    double worstBurkes = 0;
+    for (const hostPanel &panel : hostTagTypes()) {
+        if (panel.hw.bpp > 4) continue;
+        hostSetHwType(panel.hw);
+        for (uint8_t rotate = 0; rotate < 4; rotate++) {
+            for (const uint8_t dither : {DITHER_NONE, DITHER_BURKES, DITHER_ORDERED}) {
+                imgParam imageParams = hostImageParams(panel.hw, dither);
+                imageParams.rotate = rotate;
+                if (rotate >= 2) {
+                    // the "rotate" option of a template
+                    std::swap(imageParams.width, imageParams.height);
+                    imageParams.rotatebuffer = 1 - (imageParams.rotatebuffer % 2);
+                }
+                TFT_eSprite spr(nullptr);
+                hostSprite(spr, imageParams);
+                screens[rotate](spr, 3);
+                imgParam refParams = imageParams;
+                const std::vector<uint8_t> planes = hostPlanes(spr, imageParams);
+                const std::vector<uint8_t> expected = refPlanes(spr, refParams);
+                bool same;
+                if (dither == DITHER_BURKES) {
+                    const size_t planeSize = (size_t)panel.hw.width * panel.hw.height / 8;
+                    same = CHECK_EQ(planes.size(), expected.size()) && CHECK(imageParams.hasRed == refParams.hasRed);
+                    for (size_t from = 0; same && from < planes.size(); from += planeSize) {
+                        const double drift = fabs(inkShare(planes, from, planeSize) - inkShare(expected, from, planeSize));
+                        worstBurkes = std::max(worstBurkes, drift);
+                        same = CHECK(drift < 0.01);
+                    }
+                } else {
+                    same = CHECK(planes == expected) && CHECK(imageParams.hasRed == refParams.hasRed);
+                }
+                if (!same) printf("    %s %s, rotate %u, dither %u\n", panel.file.c_str(), panel.name.c_str(), rotate, dither);
+            }
+        }
+    }
+    printf("    Burkes coverage within %.2f%% of the float version\n", worstBurkes * 100);
+}
+
+int main(int argc, char **argv) {
+    return hostRunTests(argc, argv);
+}
@@ -0,0 +1,114 @@
+// The integer rasteriser against the output of the float one it replaced, and its coverage levels
+#include "hostfont.h"
+#include "hosttest.h"
+
+static uint64_t nextKey = 0xFACE000000000000ULL;
+
+// the printable ascii glyphs one by one, a byte per pixel of a 200x200 frame, 1 where it is inked
+static String glyphMasks(uint16_t size, uint8_t rotation) {
+    std::vector<uint8_t> masks;
+    truetypeClass ttf;
+    CHECK(hostOpenTtf(ttf));
+    ttf.setFontKey(nextKey++);
+    for (char c = 33; c < 127; c++) {
+        TFT_eSprite spr(nullptr);
+        spr.setColorDepth(16);
+        spr.createSprite(200, 200);
+        spr.fillSprite(TFT_WHITE);
+        ttf.setFramebuffer(200, 200, 16, static_cast<uint8_t *>(spr.getPointer()));
+        ttf.setCharacterSize(size);
+        ttf.setTextColor(TFT_BLACK, TFT_BLACK);
+        ttf.setTextBoundary(0, 200, 200);
+        ttf.setTextRotation(rotation);
+        const char text[2] = {c, 0};
+        ttf.textDraw(20, 20, text);
+        const uint16_t *img = static_cast<const uint16_t *>(spr.getPointer());
+        for (uint32_t i = 0; i < 200 * 200; i++) masks.push_back(img[i] != TFT_WHITE);
+    }
+    ttf.end();
+    return hostMd5(masks);
+}
+
+// md5s of the masks the float scanline fill of before e367798 drew, the integer one draws every pixel the same
+TEST_CASE(matches_float_rasteriser) {
+    const struct {
+        uint16_t size;
+        uint8_t rotation;
+        const char *md5;
+    } goldens[] = {
+        {12, ROTATE_0, "8a925df3e3358d6622fc31725e4f34f8"},
+        {16, ROTATE_0, "7677bfe43c90909cb1de91bdfea9c52a"},
+        {20, ROTATE_0, "cda7dc4fd20fa272a9533337dfa1a23a"},
+        {24, ROTATE_0, "bd315ea74b87662fa39645ed90e21bb5"},
+        {32, ROTATE_0, "1ecfdf9ad19c32bb41a6d7ff6812dd0f"},
+        {40, ROTATE_0, "6ba878d2ce8dc41b1192d0632c05e81b"},
+        {60, ROTATE_0, "411476f2ab2d3ae2e0db178c97eff523"},
+        {100, ROTATE_0, "ad648a14f8be463f87b53168e7ca794b"},
+        {24, ROTATE_90, "603034e6b6fd080177106de878be067b"},
+        {100, ROTATE_90, "507001935eea88542cda11f3083ed52e"},
+        {24, ROTATE_180, "ff4917740daa74a19c714ee60659518b"},
+        {100, ROTATE_180, "52e1505b18360ea0c4a7e641de994d43"},
+        {24, ROTATE_270, "c0444d5c5b9b075dd7896eec2935d388"},
+        {100, ROTATE_270, "9028b91288e25af002594925b885795f"},
+    };
+    for (const auto &golden : goldens) {
+        const String md5 = glyphMasks(golden.size, golden.rotation);
+        if (!CHECK(md5 == golden.md5)) printf("    size %u, rotation %u: %s\n", golden.size, golden.rotation, md5.c_str());
+    }
+}
+
+// how much of a pixel is black, from the green of a 16 bit pixel on white
+static double darkness(uint16_t pixel) {
+    return 1.0 - ((pixel >> 5) & 0x3F) / 63.0;
+}
+
+TEST_CASE(coverage_levels) {
+    for (const uint16_t size : {40, 100}) {
+        double ink[2] = {0, 0};
+        uint32_t partial[2] = {0, 0};
+        for (uint8_t i = 0; i < 2; i++) {
+            truetypeClass ttf;
+            CHECK(hostOpenTtf(ttf));
+            ttf.setFontKey(nextKey++);
+            TFT_eSprite spr(nullptr);
+            spr.setColorDepth(16);
+            spr.createSprite(1600, 120);
+            spr.fillSprite(TFT_WHITE);
+            ttf.setFramebuffer(spr.width(), spr.height(), 16, static_cast<uint8_t *>(spr.getPointer()));
+            ttf.setCharacterSize(size);
+            ttf.setTextColor(TFT_BLACK, TFT_BLACK);
+            ttf.setTextBoundary(0, spr.width(), spr.height());
+            ttf.setTextCoverage(i ? 4 : 2);
+            ttf.textDraw(0, 0, size == 40 ? "Wind 12 km/h NW, rain 0.4 mm" : "21.5 @Qgj");
+            for (int32_t y = 0; y < spr.height(); y++) {
+                for (int32_t x = 0; x < spr.width(); x++) {
+                    const double d = darkness(spr.readPixel(x, y));
+                    ink[i] += d;
+                    partial[i] += d > 0.01 && d < 0.99;
+                }
+            }
+            ttf.end();
+        }
+        // two levels only ink or leave a pixel, four blend the edges and keep about the same amount of ink
+        CHECK_EQ(partial[0], 0u);
+        CHECK(partial[1] > 0);
+        if (!CHECK(fabs(ink[1] - ink[0]) < 0.05 * ink[0])) printf("    size %u: ink %.0f with 2 levels, %.0f with 4\n", size, ink[0], ink[1]);
+    }
+}
+
+// coverage levels drawn the way drawString() does, from size 40 up
+TEST_CASE(weather_screen_levels) {
+    truetypeClass ttf;
+    CHECK(hostOpenTtf(ttf));
+    ttf.setFontKey(nextKey++);
+    TFT_eSprite spr(nullptr);
+    hostTextSprite(spr);
+    drawWeatherScreen(spr, ttf, 4);
+    ttf.end();
+    const String md5 = hostMd5(static_cast<const uint8_t *>(spr.getPointer()), spr.width() * spr.height() * 2);
+    if (!CHECK(md5 == "1d61663b504b8d7a96092330400bc08d")) printf("    md5 %s\n", md5.c_str());
+}
+
+int main(int argc, char **argv) {
+    return hostRunTests(argc, argv);
+}
@@ -0,0 +1,172 @@
+// The binary tagDB: a snapshot of compactDB() and the journal of journalDB() read back by loadDBbinary(),
+// a torn or corrupt entry at the end of the journal, and the json DB of saveDB() and loadDB()
+#include <FS.h>
+
+#include <map>
+
+#include "hosttagdb.h"
+#include "hosttest.h"
+#include "storage.h"
+#include "tag_db.h"
+
+#define SNAPSHOT_FILE "/current/tagDB.bin"
+#define JOURNAL_FILE "/current/tagDB.jnl"
+#define JSON_FILE "/current/tagDB.json"
+
+typedef std::map<uint64_t, tagRecord> dbCopy;
+
+static dbCopy copyDB() {
+    dbCopy copy;
+    for (const tagRecord *tag : tagDB) {
+        tagRecord &entry = copy[mac2key(tag->mac)];
+        entry = *tag;
+        entry.data = nullptr;
+    }
+    return copy;
+}
+
+static bool sameDB(const dbCopy &expected, bool lastChanged = true) {
+    bool ok = CHECK_EQ(tagDB.size(), expected.size());
+    for (const auto &kv : expected) {
+        const tagRecord *tag = tagRecord::findByMAC(kv.second.mac);
+        ok = CHECK(tag != nullptr && hostSameTag(*tag, kv.second, lastChanged)) && ok;
+    }
+    return ok;
+}
+
+static bool reload() {
+    destroyDB();
+    return loadDBbinary();
+}
+
+static size_t fileSize(const char *path) {
+    return hostReadFile(path).size();
+}
+
+static void writeFile(const char *path, const std::vector<uint8_t> &data) {
+    fs::File file = contentFS->open(path, "w");
+    file.write(data.data(), data.size());
+    file.close();
+}
+
+TEST_CASE(snapshot_and_journal) {
+    hostFillTags(200);
+    compactDB();
+    CHECK(fileSize(SNAPSHOT_FILE) > 0);
+    CHECK(!contentFS->exists(JOURNAL_FILE));
+    dbCopy expected = copyDB();
+    CHECK(reload());
+    CHECK(sameDB(expected));
+
+    // a change, a new tag and a deleted one go to the journal only
+    const size_t snapshot = fileSize(SNAPSHOT_FILE);
+    tagRecord::findByMAC(expected.begin()->second.mac)->alias = "renamed";
+    tagDB[10]->batteryMv = 2100;
+    tagDB[11]->modeConfigJson = "{}";
+    uint8_t gone[8];
+    memcpy(gone, tagDB[20]->mac, sizeof(gone));
+    CHECK(deleteRecord(gone));
+    insertRecord(hostMakeTag(5000));
+    journalDB();
+    expected = copyDB();
+    const size_t journal = fileSize(JOURNAL_FILE);
+    CHECK(journal > 0 && journal < snapshot / 10);
+    CHECK_EQ(fileSize(SNAPSHOT_FILE), snapshot);
+
+    CHECK(reload());
+    CHECK(sameDB(expected));
+    CHECK(tagRecord::findByMAC(gone) == nullptr);
+
+    // nothing changed since the load, nothing is appended
+    journalDB();
+    CHECK_EQ(fileSize(JOURNAL_FILE), journal);
+
+    // compaction folds the journal into the snapshot
+    compactDB();
+    CHECK(!contentFS->exists(JOURNAL_FILE));
+    CHECK(reload());
+    CHECK(sameDB(expected));
+}
+
+// the journal with two appends, the last one holding only the change of tag 40
+static void journalTwoChanges(dbCopy &expected, std::vector<uint8_t> &journal, size_t &lastEntry) {
+    hostFillTags(50);
+    compactDB();
+    const dbCopy before = copyDB();
+    tagDB[5]->alias = "five";
+    journalDB();
+    lastEntry = fileSize(JOURNAL_FILE);
+    tagDB[40]->alias = "forty";
+    journalDB();
+    journal = hostReadFile(JOURNAL_FILE);
+    CHECK(journal.size() > lastEntry);
+
+    // the change of tag 5 survives, tag 40 is as in the snapshot
+    expected = copyDB();
+    expected[mac2key(tagDB[40]->mac)] = before.at(mac2key(tagDB[40]->mac));
+}
+
+TEST_CASE(torn_journal_tail) {
+    dbCopy expected;
+    std::vector<uint8_t> journal;
+    size_t lastEntry;
+    journalTwoChanges(expected, journal, lastEntry);
+
+    // power lost in the length, the payload and the crc of the last entry
+    for (const size_t keep : {lastEntry + 1, lastEntry + 3, lastEntry + 20, journal.size() - 1}) {
+        writeFile(JOURNAL_FILE, std::vector<uint8_t>(journal.begin(), journal.begin() + keep));
+        CHECK(reload());
+        if (!sameDB(expected)) printf("    torn after %u of %u bytes\n", (unsigned)keep, (unsigned)journal.size());
+    }
+
+    // the load compacts the torn journal away, so the next journalDB() doesn't append behind the torn entry
+    writeFile(JOURNAL_FILE, std::vector<uint8_t>(journal.begin(), journal.begin() + lastEntry + 3));
+    CHECK(reload());
+    CHECK(!contentFS->exists(JOURNAL_FILE));
+    tagDB[40]->alias = "forty";
+    journalDB();
+    expected = copyDB();
+    CHECK(reload());
+    CHECK(sameDB(expected));
+}
+
+TEST_CASE(bad_crc_tail) {
+    dbCopy expected;
+    std::vector<uint8_t> journal;
+    size_t lastEntry;
+    journalTwoChanges(expected, journal, lastEntry);
+
+    // a flipped bit in the crc and in the payload of the last entry
+    for (const size_t pos : {journal.size() - 1, lastEntry + 10}) {
+        std::vector<uint8_t> bad = journal;
+        bad[pos] ^= 0x10;
+        writeFile(JOURNAL_FILE, bad);
+        CHECK(reload());
+        if (!sameDB(expected)) printf("    bit flipped at %u of %u bytes\n", (unsigned)pos, (unsigned)journal.size());
+    }
+}
+
+TEST_CASE(bad_snapshot_header) {
+    hostFillTags(10);
+    compactDB();
+    std::vector<uint8_t> snapshot = hostReadFile(SNAPSHOT_FILE);
+    snapshot[0] ^= 0xFF;
+    writeFile(SNAPSHOT_FILE, snapshot);
+    // the caller falls back to the json DB
+    CHECK(!reload());
+}
+
+TEST_CASE(json_round_trip) {
+    hostFillTags(100);
+    contentFS->remove(JSON_FILE);
+    saveDB(JSON_FILE);
+    const dbCopy expected = copyDB();
+    destroyDB();
+    CHECK(loadDB(JSON_FILE));
+    CHECK(sameDB(expected, false));
+    destroyDB();
+}
+
+int main(int argc, char **argv) {
+    return hostRunTests(argc, argv);
+}
@@ -0,0 +1,102 @@
+// tagHot follows tagDB: a slot per record in the same order, through insertRecord(), deleteRecord(), destroyDB() and a
+// load, and syncHotRecord() and scrubHotRecords() bring changed records over
+#include "hosttagdb.h"
+#include "hosttest.h"
+#include "system.h"
+#include "tag_db.h"
+
+static bool sameHot(const tagHotRecord &hot, const tagRecord &tag) {
+    const uint8_t flags = (tag.RSSI ? TAGHOT_RSSI : 0) | (tag.isExternal ? TAGHOT_EXTERNAL : 0) | (tag.pendingIdle ? TAGHOT_IDLE : 0);
+    return memcmp(hot.mac, tag.mac, sizeof(hot.mac)) == 0 && hot.lastseen == tag.lastseen && hot.nextupdate == tag.nextupdate &&
+           hot.expectedNextCheckin == tag.expectedNextCheckin &&
+           hot.coldBytes == tag.modeConfigJson.length() + (tag.data ? tag.len : 0) && hot.batteryMv == tag.batteryMv &&
+           hot.pendingCount == tag.pendingCount && hot.contentMode == tag.contentMode && hot.wakeupReason == tag.wakeupReason &&
+           hot.flags == flags;
+}
+
+static bool hotConsistent() {
+    bool ok = CHECK_EQ(tagHot.size(), tagDB.size());
+    ok = CHECK_EQ(tagIndex.size(), tagDB.size()) && ok;
+    for (size_t slot = 0; slot < tagDB.size() && slot < tagHot.size(); slot++) {
+        const tagRecord *tag = tagDB[slot];
+        ok = CHECK_EQ(tag->hotSlot, slot) && ok;
+        ok = CHECK(sameHot(tagHot[slot], *tag)) && ok;
+        ok = CHECK(tagRecord::findByMAC(tag->mac) == tag) && ok;
+    }
+    return ok;
+}
+
+TEST_CASE(insert_and_delete) {
+    hostFillTags(50);
+    CHECK(hotConsistent());
+
+    // the first, one in the middle and the last, the slots behind move up
+    for (const size_t slot : {0, 25, 47}) {
+        uint8_t mac[8];
+        memcpy(mac, tagDB[slot]->mac, sizeof(mac));
+        CHECK(deleteRecord(mac));
+        CHECK(tagRecord::findByMAC(mac) == nullptr);
+    }
+    CHECK_EQ(tagDB.size(), 47u);
+    CHECK(hotConsistent());
+
+    for (uint32_t n = 100; n < 103; n++) insertRecord(hostMakeTag(n));
+    CHECK(hotConsistent());
+}
+
+TEST_CASE(sync_and_scrub) {
+    hostFillTags(20);
+    tagRecord *tag = tagDB[5];
+    tag->batteryMv = 2100;
+    tag->pendingCount = 3;
+    tag->isExternal = !tag->isExternal;
+    tag->modeConfigJson += " ";
+    CHECK(!sameHot(tagHot[5], *tag));
+    syncHotRecord(tag);
+    CHECK(hotConsistent());
+
+    // changes without syncHotRecord(), a scrub over all slots picks them up in two rounds
+    tagDB[7]->lastseen += 60;
+    tagDB[15]->wakeupReason = WAKEUP_REASON_BUTTON1;
+    tagDB[19]->pendingIdle = 60;
+    CHECK(!sameHot(tagHot[7], *tagDB[7]));
+    scrubHotRecords(10);
+    scrubHotRecords(10);
+    CHECK(hotConsistent());
+
+    // a record that isn't in tagDB leaves the slot of its hotSlot alone
+    tagRecord *stranger = hostMakeTag(500);
+    stranger->hotSlot = 3;
+    syncHotRecord(stranger);
+    CHECK(sameHot(tagHot[3], *tagDB[3]));
+    delete stranger;
+}
+
+TEST_CASE(destroy_and_load) {
+    hostFillTags(30);
+    compactDB();
+    destroyDB();
+    CHECK(tagHot.empty());
+    CHECK(tagIndex.empty());
+
+    CHECK(loadDBbinary());
+    CHECK_EQ(tagDB.size(), 30u);
+    CHECK(hotConsistent());
+
+    // a journal with a deleted tag and a changed one
+    uint8_t gone[8];
+    memcpy(gone, tagDB[10]->mac, sizeof(gone));
+    CHECK(deleteRecord(gone));
+    tagDB[20]->batteryMv = 2000;
+    journalDB();
+    destroyDB();
+    CHECK(loadDBbinary());
+    CHECK_EQ(tagDB.size(), 29u);
+    CHECK(hotConsistent());
+    destroyDB();
+    CHECK(tagHot.empty());
+}
+
+int main(int argc, char **argv) {
+    return hostRunTests(argc, argv);
+}
@@ -0,0 +1,110 @@
+// layoutText against the wrap loop drawTextBox had before it, and the ellipsis, UTF-8 and long word cases of its own
+#include "hostfont.h"
+#include "hosttest.h"
+
+static bool sameLines(const std::vector<textLine> &a, const std::vector<textLine> &b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].start != b[i].start || a[i].end != b[i].end || a[i].width != b[i].width) return false;
+    }
+    return true;
+}
+
+static void printLines(const char *what, const String &text, const std::vector<textLine> &lines) {
+    printf("    %s:\n", what);
+    for (const textLine &line : lines) printf("      %3d [%s]\n", line.width, text.substring(line.start, line.end).c_str());
+}
+
+// a measure function that counts its calls
+static measureFunc counting(const measureFunc &measure, uint32_t &calls) {
+    return [&measure, &calls](uint16_t code, uint16_t prev) {
+        calls++;
+        return measure(code, prev);
+    };
+}
+
+TEST_CASE(matches_naive_wrapper) {
+    truetypeClass ttf;
+    CHECK(hostOpenTtf(ttf));
+    ttf.setCharacterSize(20);
+    const measureFunc ttfMeasure = hostTtfMeasure(ttf);
+    const struct {
+        const char *name;
+        measureFunc measure;
+    } fonts[] = {{"vlw", hostVlwMetrics}, {"ttf", ttfMeasure}};
+    uint32_t cases = 0;
+    for (const auto &font : fonts) {
+        for (uint32_t seed = 1; seed <= 20; seed++) {
+            const String text = hostLongText(60 + seed * 37, seed);
+            for (const int16_t boxwidth : {90, 160, 300}) {
+                for (const uint16_t maxLines : {3, 200}) {
+                    std::vector<textLine> expected, lines;
+                    uint32_t measured = 0, calls = 0;
+                    const bool expectedFit = hostNaiveLayout(text, boxwidth, maxLines, font.measure, expected, measured);
+                    const bool fit = layoutText(text, boxwidth, maxLines, counting(font.measure, calls), lines, false);
+                    cases++;
+                    if (!CHECK(fit == expectedFit) || !CHECK(sameLines(lines, expected))) {
+                        printf("    %s, seed %u, box %d, %u lines\n", font.name, seed, boxwidth, maxLines);
+                        printLines("naive", text, expected);
+                        printLines("layoutText", text, lines);
+                        return;
+                    }
+                    // at most twice per character, the naive loop measures each line from its start again
+                    CHECK(calls <= 2 * text.length());
+                }
+            }
+        }
+    }
+    printf("    %u layouts the same\n", cases);
+    ttf.end();
+}
+
+TEST_CASE(ellipsis) {
+    const String text = hostLongText(600, 7);
+    for (const int16_t boxwidth : {60, 150, 300}) {
+        std::vector<textLine> lines;
+        CHECK(!layoutText(text, boxwidth, 3, hostVlwMetrics, lines, true));
+        if (!CHECK_EQ(lines.size(), 3u)) continue;
+        CHECK(!lines[0].ellipsis && !lines[1].ellipsis && lines[2].ellipsis);
+        // the last line and its dots are as wide as the naive loop measures them, and fit
+        std::vector<textLine> measuredLines;
+        uint32_t measured;
+        const String last = text.substring(lines[2].start, lines[2].end) + "...";
+        hostNaiveLayout(last, 10000, 1, hostVlwMetrics, measuredLines, measured);
+        CHECK_EQ(lines[2].width, measuredLines[0].width);
+        CHECK(lines[2].width <= boxwidth);
+        CHECK(last[last.length() - 4] != ' ');
+    }
+    // all of it fits, no dots
+    std::vector<textLine> lines;
+    CHECK(layoutText("short text", 300, 3, hostVlwMetrics, lines, true));
+    CHECK(lines.size() == 1 && !lines[0].ellipsis);
+}
+
+TEST_CASE(utf8_and_long_words) {
+    // lines break between characters, not inside one
+    const String text = "Grüße aus Köln, übermorgen 12°C und Regenschauer, Zürich 9°C, Malmö 4°C";
+    std::vector<textLine> lines;
+    CHECK(layoutText(text, 40, 100, hostVlwMetrics, lines, false));
+    for (const textLine &line : lines) {
+        CHECK((text[line.start] & 0xC0) != 0x80);
+        CHECK(line.end == text.length() || (text[line.end] & 0xC0) != 0x80);
+    }
+    CHECK(lines.back().end == text.length());
+
+    // a word wider than the box breaks anywhere, a character wider than it gets a line of its own
+    CHECK(layoutText("Donaudampfschifffahrtsgesellschaft", 50, 100, hostVlwMetrics, lines, false));
+    CHECK(lines.size() > 1);
+    for (const textLine &line : lines) CHECK(line.width <= 50 && line.end > line.start);
+    CHECK(layoutText("MWM", 3, 100, hostVlwMetrics, lines, false));
+    CHECK_EQ(lines.size(), 3u);
+
+    // newlines end a line, spaces after a break are skipped
+    const String broken = "one\n  two   three";
+    CHECK(layoutText(broken, 1000, 100, hostVlwMetrics, lines, false));
+    if (CHECK_EQ(lines.size(), 2u)) CHECK(broken.substring(lines[1].start, lines[1].end) == "two   three");
+}
+
+int main(int argc, char **argv) {
+    return hostRunTests(argc, argv);
+}
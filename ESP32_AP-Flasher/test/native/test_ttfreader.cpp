@@ -0,0 +1,70 @@
+// The block cache of truetypeClass against the bytes of the font file, and fonts in memory against fonts read from it
+#include <FS.h>
+
+#include "fontregistry.h"
+#include "hostfont.h"
+#include "hosttest.h"
+
+static uint64_t nextKey = 0x5EED000000000000ULL;
+
+static std::vector<uint8_t> pixels(TFT_eSprite &spr) {
+    const uint8_t *img = static_cast<const uint8_t *>(spr.getPointer());
+    return std::vector<uint8_t>(img, img + spr.width() * spr.height() * 2);
+}
+
+TEST_CASE(random_access) {
+    const std::vector<uint8_t> font = hostReadFile(hostTtfPath());
+    truetypeClass ttf;
+    CHECK(hostOpenTtf(ttf));
+    uint32_t state = 12345;
+    for (uint32_t i = 0; i < 20000; i++) {
+        state = state * 1103515245 + 12345;
+        // mostly short reads close to the last one, the way glyph lookups go, now and then a long one or one past the end
+        const uint32_t offset = (i % 7 == 0) ? state % (font.size() + 100) : (ttf.ttfPosition() + (state >> 8) % 600) % font.size();
+        const uint32_t length = (i % 11 == 0) ? 1 + (state >> 4) % (3 * TTF_BLOCK_SIZE) : 1 + (state >> 4) % 8;
+        uint8_t buf[3 * TTF_BLOCK_SIZE];
+        ttf.ttfSeek(offset);
+        const int got = ttf.ttfRead(buf, length);
+        const int expected = offset >= font.size() ? 0 : std::min<int>(length, font.size() - offset);
+        if (!CHECK_EQ(got, expected) || !CHECK(memcmp(buf, font.data() + offset, std::max(got, 0)) == 0)) {
+            printf("    read %u at %u\n", length, offset);
+            break;
+        }
+        CHECK_EQ(ttf.ttfPosition(), offset + got);
+    }
+    ttf.end();
+}
+
+TEST_CASE(file_matches_memory) {
+    std::vector<uint8_t> font = hostReadFile(hostTtfPath());
+    TFT_eSprite spr[2] = {TFT_eSprite(nullptr), TFT_eSprite(nullptr)};
+    for (uint8_t inMemory = 0; inMemory < 2; inMemory++) {
+        truetypeClass ttf;
+        CHECK(inMemory ? ttf.setTtfPointer(font.data(), font.size(), 0, false) : hostOpenTtf(ttf));
+        ttf.setFontKey(nextKey++);
+        hostTextSprite(spr[inMemory]);
+        drawWeatherScreen(spr[inMemory], ttf, 4);
+        ttf.end();
+    }
+    CHECK(pixels(spr[0]) == pixels(spr[1]));
+}
+
+// a font the registry made resident is read in place, rasterising doesn't touch the file
+TEST_CASE(resident_font_reads_nothing) {
+    fontLease lease = fontOpen(hostTtfPath());
+    CHECK(lease.data() != nullptr);
+    truetypeClass *ttf = lease.ttf();
+    if (!CHECK(ttf != nullptr)) return;
+    ttf->setFontKey(nextKey++);
+    TFT_eSprite spr(nullptr);
+    hostTextSprite(spr);
+    const fs::hostFileStats before = fs::fileStats;
+    drawWeatherScreen(spr, *ttf);
+    CHECK_EQ(fs::fileStats.opens - before.opens, 0u);
+    CHECK_EQ(fs::fileStats.reads - before.reads, 0u);
+    CHECK_EQ(fs::fileStats.seeks - before.seeks, 0u);
+}
+
+int main(int argc, char **argv) {
+    return hostRunTests(argc, argv);
+}
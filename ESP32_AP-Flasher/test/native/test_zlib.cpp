@@ -0,0 +1,55 @@
+// zlib images with ZLIB_ROW_XOR decode to the planes spr2color made
+#include "hosttest.h"
+
+#include "commstructs.h"
+
+static uint8_t nextContentMode = 1;
+
+// header byte 5 of the inflated stream, 0 if it doesn't inflate
+static uint8_t zlibColors(const std::vector<uint8_t> &file) {
+    std::vector<uint8_t> data;
+    if (!hostInflate(file.data(), file.size(), data) || data.size() < 6) return 0;
+    return data[5];
+}
+
+// no tag type has zlib_rowxor yet, so codec_round_trip of test_pipeline never gets a row xor image
+TEST_CASE(row_xor_round_trip) {
+    void (*screens[])(TFT_eSprite &, uint32_t) = {drawTextScreen, drawIconScreen, drawQrScreen, drawPhotoScreen};
+    uint32_t xored = 0;
+    // one plane, two planes, and a turned buffer
+    for (const uint8_t type : {0x26, 0x36, 0x01}) {
+        const HwType hw = hostTagType(type);
+        for (auto screen : screens) {
+            for (const bool zlibXor : {false, true}) {
+                imgParam imageParams = hostImageParams(hw);
+                imageParams.zlib = 1;
+                imageParams.zlibXor = zlibXor;
+                imageParams.g5 = 0;
+                imageParams.contentMode = nextContentMode++;
+                TFT_eSprite spr(nullptr);
+                hostSprite(spr, imageParams);
+                screen(spr, 3);
+                imgParam planeParams = imageParams;
+                const std::vector<uint8_t> expected = hostPlanes(spr, planeParams);
+                String fileName = "/xor.raw";
+                spr2buffer(spr, fileName, imageParams);
+                const std::vector<uint8_t> file = hostReadFile(fileName);
+                CHECK_EQ(hostDataType(imageParams), DATATYPE_IMG_ZLIB);
+                std::vector<uint8_t> planes;
+                if (!CHECK(hostDecodeImage(file, imageParams, planes)) || !CHECK(planes == expected)) {
+                    printf("    type %02X, zlibXor %u\n", type, zlibXor);
+                }
+                const bool flagged = zlibColors(file) & ZLIB_ROW_XOR;
+                // the flag only goes to tags that undo it
+                if (!zlibXor) CHECK(!flagged);
+                if (flagged) xored++;
+            }
+        }
+    }
+    // row xor wins on some of these screens, else the test above proves nothing
+    CHECK(xored > 0);
+}
+
+int main(int argc, char **argv) {
+    return hostRunTests(argc, argv);
+}
@@ -1204,10 +1204,13 @@ function processQueue() {
 
 function drawCanvas(buffer, canvas, hwtype, tagmac, doRotate) {
 	data = new Uint8ClampedArray(buffer);
-	if (data.length > 0 && tagTypes[hwtype].zlib > 0 && $('#tag' + tagmac).dataset.ver >= tagTypes[hwtype].zlib) {
-		data = processZlib(data);
+	// the AP sends whichever codec came out smallest, raw images have a fixed size
+	const rawSize = tagTypes[hwtype].width * tagTypes[hwtype].height / 8;
+	const isRaw = data.length == rawSize || data.length == rawSize * 2;
+	if (data.length > 0 && !isRaw && tagTypes[hwtype].zlib > 0 && $('#tag' + tagmac).dataset.ver >= tagTypes[hwtype].zlib && data[4] == 0x48) {
+		data = processZlib(data) || new Uint8ClampedArray(0);
 	}
-	if (data.length > 0 && tagTypes[hwtype].g5 > 0 && $('#tag' + tagmac).dataset.ver >= tagTypes[hwtype].g5) {
+	if (data.length > 0 && !isRaw && tagTypes[hwtype].g5 > 0 && $('#tag' + tagmac).dataset.ver >= tagTypes[hwtype].g5) {
 		const headerSize = data[0];
 		let bufw = (data[2] << 8) | data[1];
 		let bufh = (data[4] << 8) | data[3];
@@ -1302,7 +1305,18 @@ function processZlib(data) {
 		// to constrain window size for testing:
 		// const inflatedBuffer = pako.inflate(subBuffer, { windowBits: 12 });
 		const headerSize = inflatedBuffer[0];
-		return inflatedBuffer.subarray(headerSize);
+		// a delta only holds the changes against an image of the tag, nothing to draw on its own
+		if (inflatedBuffer[5] & 0x20) return new Uint8Array(0);
+		const pixels = inflatedBuffer.subarray(headerSize);
+		if (inflatedBuffer[5] & 0x10) {
+			// every row was xored with the row above it
+			const rowBytes = ((inflatedBuffer[2] << 8) | inflatedBuffer[1]) / 8;
+			const planeSize = rowBytes * ((inflatedBuffer[4] << 8) | inflatedBuffer[3]);
+			for (let i = rowBytes; i < pixels.length; i++) {
+				if (i % planeSize >= rowBytes) pixels[i] ^= pixels[i - rowBytes];
+			}
+		}
+		return pixels;
 	} catch (err) {
 		console.log('zlib: ' + err);
 	}
@@ -125,6 +125,9 @@
                                                     // image format: [uint8_t header length][uint16_t width][uint16_t height][uint8_t bpp (lower 4)][img data]
 
 #define DATATYPE_IMG_G5 0x31          // G5 compressed 1BPP
+#define DATATYPE_IMG_DELTA 0x32            // changes against the image the tag shows, zlib compressed like DATATYPE_IMG_ZLIB
+                                                    // header: [uint8_t header length][uint16_t width][uint16_t height][uint8_t bpp | 0x20][uint64_t dataVer of the base image]
+                                                    // then per changed region: [uint16_t first row][uint16_t rows][uint16_t first byte][uint16_t bytes][xor data, per plane]
 
 #define DATATYPE_UK_SEGMENTED 0x51         // Segmented data for the UK Segmented display type (contained in availableData Reply)
 #define DATATYPE_EU_SEGMENTED 0x52         // Segmented data for the EU/DE Segmented display type (contained in availableData Reply)